@@ -7,12 +7,19 @@
 
 #include "libs/animation.h"
 #include "libs/audio.h"
+#include "libs/audio_mix.h"
+#include "libs/audio_resample.h"
+#include "libs/audio_stretch.h"
 #include "libs/global_data.h"
 #include "libs/filesystem.h"
+#include "libs/frame_pacer.h"
 #include "libs/input.h"
+#include "libs/input_evdev.h"
 #include "libs/logging.h"
 #include "libs/camera_utils.h"
 #include "libs/network.h"
+#include "libs/profiler.h"
+#include "libs/replay.h"
 #include "libs/screen.h"
 #include "libs/script.h"
 #include "libs/song_parser.h"
@@ -38,6 +45,8 @@
 #include "scenes/title.h"
 #include "scenes/game_over.h"
 
+#include "objects/game/headless.h"
+#include "objects/global/audio_stats_overlay.h"
 #include "objects/global/fps_counter.h"
 
 #ifdef _WIN32
@@ -79,6 +88,22 @@ Screens check_args(int argc, char* argv[]) {
             auto_play = true;
         } else if (arg == "--practice") {
             practice = true;
+        } else if (arg == "--replay") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: --replay needs a replay file\n";
+                std::exit(1);
+            }
+            std::optional<Replay> replay = load_replay(argv[++i]);
+            if (!replay.has_value()) std::exit(1);
+            if (!std::filesystem::exists(replay->song_path)) {
+                std::cerr << "Error: Song file not found: " << replay->song_path.string() << "\n";
+                std::exit(1);
+            }
+            SessionData& session_data = global_data.session_data[(int)PlayerNum::P1];
+            session_data.selected_song       = replay->song_path;
+            session_data.selected_difficulty = replay->difficulty;
+            session_data.replay_path         = argv[i];
+            return Screens::GAME;
         } else if (arg == "--sandbox") {
             return Screens::SANDBOX;
         } else if (arg == "--skin-viewer") {
@@ -91,6 +116,11 @@ Screens check_args(int argc, char* argv[]) {
             std::cout << "  --practice  : Start in practice mode\n";
             std::cout << "  --skin-viewer : Open skin viewer\n";
             std::cout << "  --sandbox   : Open sandbox mode\n";
+            std::cout << "  --replay <file> : Play back a recorded replay; kat seeks, don changes speed\n";
+            std::cout << "  --bench-mix [voices] : Benchmark the audio mixing kernels and exit\n";
+            std::cout << "  --bench-resample [seconds] : Benchmark sound resampling per thread count and exit\n";
+            std::cout << "  --bench-stretch [seconds] : Benchmark pitch-preserving time-stretch and exit\n";
+            std::cout << "  --headless <song|dir> [difficulty] [--auto] [--inputs file] [--tick-ms ms] : Play charts or .ydr replays without a window and print the results\n";
             std::exit(0);
         } else if (song_path.empty()) {
             song_path = arg;
@@ -151,15 +181,70 @@ Screens check_args(int argc, char* argv[]) {
     return current_screen;
 }
 
+// Command line tools that run and exit without opening a window
+std::optional<int> run_tool_args(int argc, char* argv[]) {
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        if (arg == "--bench-mix") {
+            int voices = 64;
+            if (i + 1 < argc) {
+                try { voices = std::stoi(argv[i + 1]); } catch (const std::exception&) {}
+            }
+            return run_mix_benchmark(voices);
+        }
+        if (arg == "--bench-resample") {
+            int seconds = 180;
+            if (i + 1 < argc) {
+                try { seconds = std::stoi(argv[i + 1]); } catch (const std::exception&) {}
+            }
+            return run_resample_benchmark(seconds);
+        }
+        if (arg == "--bench-stretch") {
+            int seconds = 60;
+            if (i + 1 < argc) {
+                try { seconds = std::stoi(argv[i + 1]); } catch (const std::exception&) {}
+            }
+            return run_stretch_benchmark(seconds);
+        }
+        if (arg == "--headless") {
+            if (i + 1 >= argc) {
+                std::cerr << "Error: --headless needs a song file or directory\n";
+                return 1;
+            }
+            fs::path song_path = argv[++i];
+            HeadlessOptions options;
+            for (i++; i < argc; i++) {
+                std::string option = argv[i];
+                try {
+                    if (option == "--auto") {
+                        options.auto_play = true;
+                    } else if (option == "--tick-ms" && i + 1 < argc) {
+                        options.tick_ms = std::stod(argv[++i]);
+                    } else if (option == "--inputs" && i + 1 < argc) {
+                        options.inputs = argv[++i];
+                    } else if (!options.difficulty.has_value()) {
+                        options.difficulty = std::stoi(option);
+                    }
+                } catch (const std::exception&) {
+                    std::cerr << "Error: Invalid value: " << option << "\n";
+                    return 1;
+                }
+            }
+            return run_headless(song_path, options);
+        }
+    }
+    return std::nullopt;
+}
+
 struct LoopState {
     std::unordered_map<Screens, std::unique_ptr<Screen>> screens;
     Screens current_screen = Screens::LOADING;
     ray::Camera2D camera   = {};
     int screen_width       = 0;
     int screen_height      = 0;
-    std::chrono::steady_clock::duration target_duration = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / 60.0));
-    std::chrono::time_point<std::chrono::steady_clock> next_frame_time = std::chrono::steady_clock::now();
+    FramePacer frame_pacer;
     FPSCounter fps_counter;
+    AudioStatsOverlay audio_stats;
     ray::Color last_color = ray::BLACK;
     TextureResizeAnimation* touch_drum_resize = nullptr;
 };
@@ -169,13 +254,11 @@ double g_frame_ms = 0.0;
 
 static void run_frame() {
     LoopState& L = *g_loop;
+    PROFILE_SCOPE("frame");
 
     g_frame_ms = get_current_ms();
 
     ray::PollInputEvents();
-#ifdef __EMSCRIPTEN__
-    poll_keyboard_once();
-#endif
     poll_touch_once();
 
     auto frame_start = std::chrono::steady_clock::now();
@@ -186,6 +269,8 @@ static void run_frame() {
     } else if (check_key_pressed(global_data.config->keys.borderless_key)) {
         ray::ToggleBorderlessWindowed();
         spdlog::info("Toggled borderless windowed mode");
+    } else if (check_key_pressed(global_data.config->keys.profile_key)) {
+        profiler_dump(profiler_default_path());
     }
 
     L.camera = compute_camera2d(L.screen_width, L.screen_height);
@@ -203,9 +288,14 @@ static void run_frame() {
     Screen* screen = L.screens[L.current_screen].get();
 
     network.update(g_frame_ms);
-    std::optional<Screens> next_screen = screen->update();
+    std::optional<Screens> next_screen;
+    {
+        PROFILE_SCOPE("Screen::update");
+        next_screen = screen->update();
+    }
 
     if (screen->screen_init) {
+        PROFILE_SCOPE("Screen::draw");
         screen->_do_draw();
     }
 
@@ -232,6 +322,10 @@ static void run_frame() {
         L.fps_counter.update();
         L.fps_counter.draw();
     }
+    if (global_data.config->general.audio_stats) {
+        L.audio_stats.update(g_frame_ms, L.frame_pacer.enabled() ? L.frame_pacer.stats().summary() : "");
+        L.audio_stats.draw();
+    }
 
     draw_outer_border(L.screen_width, L.screen_height, L.last_color);
 
@@ -240,26 +334,20 @@ static void run_frame() {
     ray::EndDrawing();
 
     if (!next_screen.has_value()) {
+        PROFILE_SCOPE("SwapScreenBuffer");
         ray::SwapScreenBuffer();
     }
 
 #ifndef __EMSCRIPTEN__
-    if (L.target_duration.count() > 0) {
-        L.next_frame_time += L.target_duration;
-        auto now = std::chrono::steady_clock::now();
-        if (L.next_frame_time < now) {
-            L.next_frame_time = now;
-        }
-        auto spin_start = L.next_frame_time - std::chrono::microseconds(500);
-        if (spin_start > now) {
-            std::this_thread::sleep_until(spin_start);
-        }
-        while (std::chrono::steady_clock::now() < L.next_frame_time) { }
+    {
+        PROFILE_SCOPE("FramePacer::wait");
+        L.frame_pacer.wait();
     }
 #endif
 }
 
 int main(int argc, char* argv[]) {
+    PROFILE_THREAD("main");
     spdlog::info("Starting YataiDON");
     set_working_directory_to_executable();
     init_scores_manager();
@@ -273,6 +361,10 @@ int main(int argc, char* argv[]) {
     ray::SetTraceLogLevel(ray::LOG_ERROR);
     setup_logging(global_data.config->general.log_level);
 
+    if (auto exit_code = run_tool_args(argc, argv)) {
+        return *exit_code;
+    }
+
     fs::path root_skin_path = fs::path("Skins") / global_data.config->paths.skin;
 
     tex.init(root_skin_path / "Graphics");
@@ -287,7 +379,24 @@ int main(int argc, char* argv[]) {
     global_tex.load_screen_textures("global");
     script_manager.init(root_skin_path / "Scripts");
     font_manager.init(root_skin_path / "Graphics/font.ttf");
-    audio.init_audio_device(root_skin_path / "Sounds", global_data.config->audio, global_data.config->volume);
+    if (global_data.config->audio.buffer_size <= 0) {
+        // Takes a second or more per size, before the first screen can draw
+        auto show_progress = [](size_t index, size_t count, int size) {
+            std::string text = fmt::format("Calibrating audio: {} frames ({}/{})", size, index + 1, count);
+            ray::BeginDrawing();
+            ray::ClearBackground(ray::BLACK);
+            ray::DrawText(text.c_str(), 20, tex.screen_height - 40, 20, ray::WHITE);
+            ray::EndDrawing();
+        };
+        int buffer_size = audio.calibrate_buffer_size(root_skin_path / "Sounds", global_data.config->audio,
+                                                      global_data.config->volume, 1.0, show_progress);
+        if (buffer_size > 0) {
+            global_data.config->audio.buffer_size = buffer_size;
+            save_config(*global_data.config);
+        }
+    } else {
+        audio.init_audio_device(root_skin_path / "Sounds", global_data.config->audio, global_data.config->volume);
+    }
 
     scores_manager.player_1 = global_data.config->general.player_1_id;
     scores_manager.player_2 = global_data.config->general.player_2_id;
@@ -359,7 +468,9 @@ int main(int argc, char* argv[]) {
     L.screen_width       = tex.screen_width;
     L.screen_height      = tex.screen_height;
     L.current_screen     = initial_screen;
-    L.target_duration    = std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / target_fps));
+    if (target_fps > 0) {
+        L.frame_pacer.set_period(std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(1.0 / target_fps)));
+    }
     L.touch_drum_resize  = (TextureResizeAnimation*)global_tex.get_animation(66);
     L.touch_drum_resize->start();
 
@@ -405,11 +516,14 @@ int main(int argc, char* argv[]) {
 #endif
     ray::HideCursor();
 
-    L.next_frame_time = std::chrono::steady_clock::now();
+    L.frame_pacer.reset();
 #ifdef __EMSCRIPTEN__
     emscripten_set_main_loop(run_frame, 0, 1);
 #else
+#ifdef _WIN32
     input_thread = std::thread(input_polling_thread);
+#endif
+    start_evdev_input(global_data.config->general.evdev_input, global_data.config->general.evdev_keyboard);
 
 #ifdef PLATFORM_ANDROID
     while (!ray::WindowShouldClose()) {
@@ -423,7 +537,17 @@ int main(int argc, char* argv[]) {
     if (input_thread.joinable()) {
         input_thread.join();
     }
+    stop_evdev_input();
     shutdown_sdl_joysticks();
+    if (global_data.config->general.input_latency_stats) {
+        spdlog::info("{}", input_latency_summary());
+    }
+    if (global_data.config->general.audio_stats && L.frame_pacer.enabled()) {
+        spdlog::info("{}", L.frame_pacer.stats().summary());
+    }
+    if (global_data.config->general.profile_on_exit && profiler_available()) {
+        profiler_dump(profiler_default_path());
+    }
     delete g_loop;
     global_tex.unload_textures();
     tex.unload_textures();
@@ -1,5 +1,10 @@
 #include "audio.h"
+#include "audio_mix.h"
+#include "audio_resample.h"
+#include "profiler.h"
 #include "texture.h"
+#include <algorithm>
+#include <chrono>
 #ifdef __ANDROID__
 extern "C" {
 #include <libavformat/avformat.h>
@@ -88,6 +93,137 @@ static bool ffmpeg_decode_float(const char* path,
 }
 #endif // __ANDROID__
 
+// Folds volume and pan into per-channel gains, matching the per-sample
+// pan law the scalar loop uses for mono and stereo sources.
+static inline void pan_gains(unsigned int channels, float pan, float volume, float& gain_l, float& gain_r) {
+    if (channels == 1) {
+        gain_l = (1.0f - pan) * volume;
+        gain_r = pan * volume;
+    } else {
+        gain_l = (pan > 0.5f) ? (1.0f - pan) * 2.0f * volume : volume;
+        gain_r = (pan < 0.5f) ? pan * 2.0f * volume : volume;
+    }
+}
+
+// Frames copied out of a music ring per read inside the callback
+static constexpr unsigned int MUSIC_MIX_BLOCK_FRAMES = 1024;
+
+// Mixes a music stream at a pitch other than 1 with linear interpolation.
+// Ring frames are pulled into the stream's window (mix_buffer) as needed;
+// frames already passed are dropped from its front. Returns true when the
+// ring ran dry before the buffer was filled.
+static bool mix_music_pitched(music& mus, float* out, unsigned long frames, float pitch, float gain_l, float gain_r) {
+    const unsigned int channels = mus.decoder->get_channels();
+    const unsigned int capacity = (unsigned int)(mus.mix_buffer.size() / channels);
+    float* window = mus.mix_buffer.data();
+    double pos = mus.window_pos;
+
+    for (unsigned long i = 0; i < frames; i++) {
+        size_t index = (size_t)pos;
+        if (index + 1 >= mus.window_frames) {
+            // Shift the frames still needed to the front and top up
+            unsigned int drop = (unsigned int)std::min<size_t>(index, mus.window_frames);
+            std::memmove(window, window + (size_t)drop * channels,
+                         (size_t)(mus.window_frames - drop) * channels * sizeof(float));
+            mus.window_frames -= drop;
+            pos   -= drop;
+            index -= drop;
+            std::atomic_ref<unsigned long long>(mus.current_frame).fetch_add(drop, std::memory_order_relaxed);
+            mus.window_frames += (unsigned int)mus.decoder->read(window + (size_t)mus.window_frames * channels,
+                                                                 capacity - mus.window_frames);
+            if (index + 1 >= mus.window_frames) {
+                mus.window_pos = pos;
+                return true;
+            }
+        }
+
+        const float* a = window + index * channels;
+        const float* b = a + channels;
+        const float  t = (float)(pos - (double)index);
+        if (channels == 1) {
+            float sample = a[0] + (b[0] - a[0]) * t;
+            out[i * 2]     += sample * gain_l;
+            out[i * 2 + 1] += sample * gain_r;
+        } else {
+            out[i * 2]     += (a[0] + (b[0] - a[0]) * t) * gain_l;
+            out[i * 2 + 1] += (a[1] + (b[1] - a[1]) * t) * gain_r;
+        }
+        pos += pitch;
+    }
+    mus.window_pos = pos;
+    return false;
+}
+
+// Mixes a music stream through its time stretcher, topping the stretcher
+// up from the ring whenever it runs out of input. Afterwards current_frame
+// and window_pos hold the stretcher's source position for the clock.
+static bool mix_music_stretched(music& mus, float* out, unsigned long frames, float speed,
+                                float gain_l, float gain_r, const MixKernels& kernels) {
+    TimeStretch& stretch = *mus.stretch;
+    const unsigned int channels = stretch.get_channels();
+    const unsigned int block_frames = (unsigned int)(mus.mix_buffer.size() / channels);
+    bool starved = false;
+
+    unsigned long output_index = 0;
+    while (output_index < frames) {
+        unsigned int want = (unsigned int)std::min<unsigned long>(frames - output_index, block_frames);
+        unsigned int got  = stretch.read(mus.mix_buffer.data(), want, speed);
+        if (channels == 1) kernels.accumulate_mono(out + output_index * 2, mus.mix_buffer.data(), got, gain_l, gain_r);
+        else               kernels.accumulate_stereo(out + output_index * 2, mus.mix_buffer.data(), got, gain_l, gain_r);
+        output_index += got;
+        if (got == want) continue;
+
+        unsigned int space = 0;
+        float* dst = stretch.input_space(space);
+        size_t read = mus.decoder->read(dst, space);
+        stretch.commit_input((unsigned int)read);
+        if (read == 0) { starved = true; break; }
+    }
+
+    const double position = stretch.position();
+    std::atomic_ref<unsigned long long>(mus.current_frame).store((unsigned long long)position, std::memory_order_relaxed);
+    mus.window_pos = position - std::floor(position);
+    return starved;
+}
+
+// Plays out what the stretcher already took from the ring, unstretched, so
+// the stream can leave it without a gap or a seek. Returns the frames
+// written; fewer than asked once the stretcher is empty, with current_frame
+// then where the ring carries on.
+static unsigned long drain_music_stretch(music& mus, float* out, unsigned long frames,
+                                         float gain_l, float gain_r, const MixKernels& kernels) {
+    TimeStretch& stretch = *mus.stretch;
+    const unsigned int channels = stretch.get_channels();
+    const unsigned int block_frames = (unsigned int)(mus.mix_buffer.size() / channels);
+
+    unsigned long output_index = 0;
+    while (output_index < frames) {
+        unsigned int want = (unsigned int)std::min<unsigned long>(frames - output_index, block_frames);
+        unsigned int got  = stretch.drain(mus.mix_buffer.data(), want);
+        if (channels == 1) kernels.accumulate_mono(out + output_index * 2, mus.mix_buffer.data(), got, gain_l, gain_r);
+        else               kernels.accumulate_stereo(out + output_index * 2, mus.mix_buffer.data(), got, gain_l, gain_r);
+        output_index += got;
+        if (got < want) break;
+    }
+
+    const double position = stretch.drain_position();
+    std::atomic_ref<unsigned long long>(mus.current_frame).store((unsigned long long)position, std::memory_order_relaxed);
+    mus.window_pos = position - std::floor(position);
+    return output_index;
+}
+
+// Audio clock DLL gains: about 0.5 Hz bandwidth at typical buffer sizes.
+// Callback jitter is averaged out while device/CPU clock drift is tracked.
+static constexpr double CLOCK_DLL_B = 0.045;
+static constexpr double CLOCK_DLL_C = 0.001;
+// A callback further than this from the prediction means the stream
+// stalled or restarted, so the filter starts over.
+static constexpr double CLOCK_DLL_RESET_SECONDS = 0.1;
+
+static double steady_seconds() {
+    return std::chrono::duration<double>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
 static sf_count_t vf_get_filelen(void* user_data) {
     auto* vf = static_cast<VirtualFile*>(user_data);
     return static_cast<sf_count_t>(vf->data->size());
@@ -129,6 +265,10 @@ static sf_count_t vf_tell(void* user_data) {
 
 AudioEngine::AudioEngine()
 {
+    for (size_t i = 0; i < MAX_VOICES; i++) {
+        free_voice_list[i] = static_cast<uint32_t>(MAX_VOICES - 1 - i);
+    }
+    free_voice_count = MAX_VOICES;
 }
 
 AudioEngine::~AudioEngine() {
@@ -144,31 +284,63 @@ void AudioEngine::mix(float* out, unsigned int framesPerBuffer, AudioEngine* eng
 
     if (!engine) return;
 
+    // The first call registers this thread's profile buffer under a
+    // mutex; every later one is lock-free
+    PROFILE_THREAD("audio");
+    PROFILE_SCOPE("AudioEngine::mix");
+    const auto mix_start = std::chrono::steady_clock::now();
+    const uint64_t buffer_start = engine->stream_frames.load(std::memory_order_relaxed);
+    engine->update_clock(buffer_start, framesPerBuffer);
+
+    const MixKernels& kernels = mix_kernels();
     std::shared_lock<std::shared_mutex> guard(engine->rw_lock);
 
-    for (auto& [name, snd] : engine->sounds) {
-        std::atomic_ref<bool>         aref_playing(snd.is_playing);
-        std::atomic_ref<unsigned int> aref_frame(snd.current_frame);
+    engine->process_voice_commands(buffer_start, framesPerBuffer);
 
-        if (!aref_playing.load(std::memory_order_acquire)) continue;
+    // Only voices that are sounding cost anything here
+    for (size_t v = 0; v < engine->active_voice_count; ) {
+        const uint32_t voice_index = engine->active_voice_list[v];
+        AudioEngine::Voice& voice = engine->voice_pool[voice_index];
+        sound& snd = engine->sound_slots[voice.slot].snd;
 
         const float volume = std::atomic_ref<float>(snd.volume).load(std::memory_order_relaxed);
         const float pan    = std::atomic_ref<float>(snd.pan).load(std::memory_order_relaxed);
-        unsigned int frame = aref_frame.load(std::memory_order_relaxed);
+        unsigned int frame = voice.frame;
 
         const float pitch    = std::atomic_ref<float>(snd.pitch).load(std::memory_order_relaxed);
         const float* data_ptr = snd.data;
         const unsigned int channels = snd.channels;
 
-        unsigned long frames_to_process = framesPerBuffer;
-        unsigned long output_index = 0;
+        // Scheduled starts begin part way into the buffer
+        unsigned long frames_to_process = framesPerBuffer - voice.start_offset;
+        unsigned long output_index = voice.start_offset;
+        voice.start_offset = 0;
         bool still_playing = true;
         // Track the position as integer frame + fractional remainder. The
         // fraction must survive across mix() calls, otherwise non-integer
         // pitches degrade toward trunc(pitch) as the buffer size shrinks
         // (at buffer_size=1, pitch 0.9 never advances and 1.5 plays at 1.0).
-        double frame_f = (double)frame
-                       + std::atomic_ref<float>(snd.frame_frac).load(std::memory_order_relaxed);
+        double frame_f = (double)frame + voice.frame_frac;
+
+        if (pitch == 1.0f && frame_f == (double)frame && channels <= 2) {
+            // Unpitched voices read contiguous runs, so hand them to the
+            // vector kernels a run at a time.
+            float gain_l, gain_r;
+            pan_gains(channels, pan, volume, gain_l, gain_r);
+            while (frames_to_process > 0) {
+                if (frame >= snd.frame_count) {
+                    if (snd.loop && snd.frame_count > 0) { frame = 0; continue; }
+                    else { still_playing = false; break; }
+                }
+                unsigned long run = std::min<unsigned long>(frames_to_process, snd.frame_count - frame);
+                if (channels == 1) kernels.accumulate_mono(out + output_index * 2, data_ptr + frame, run, gain_l, gain_r);
+                else               kernels.accumulate_stereo(out + output_index * 2, data_ptr + (size_t)frame * 2, run, gain_l, gain_r);
+                frame             += run;
+                output_index      += run;
+                frames_to_process -= run;
+            }
+            frame_f = (double)frame;
+        }
 
         while (frames_to_process > 0 && still_playing) {
             unsigned long src_frame = (unsigned long)frame_f;
@@ -201,136 +373,113 @@ void AudioEngine::mix(float* out, unsigned int framesPerBuffer, AudioEngine* eng
         }
         frame = (unsigned int)frame_f;
 
-        std::atomic_ref<float>(snd.frame_frac).store((float)(frame_f - (double)frame), std::memory_order_relaxed);
-        aref_frame.store(frame, std::memory_order_relaxed);
-        if (!still_playing)
-            aref_playing.store(false, std::memory_order_release);
+        voice.frame_frac = (float)(frame_f - (double)frame);
+        voice.frame      = frame;
+        if (snd.newest_voice == voice_index) {
+            std::atomic_ref<unsigned int>(snd.position_frame).store(frame, std::memory_order_relaxed);
+            if (pitch > 0.0f) {
+                double origin = (double)(buffer_start + framesPerBuffer) - frame_f / pitch;
+                std::atomic_ref<double>(snd.clock_origin).store(origin, std::memory_order_relaxed);
+            }
+        }
+        if (!still_playing) {
+            engine->release_voice(v);  // swaps the last active voice into v
+            continue;
+        }
+        v++;
     }
 
     for (auto& [name, mus] : engine->music_streams) {
         std::atomic_ref<bool> aref_playing(mus.is_playing);
 
-        if (!aref_playing.load(std::memory_order_acquire)) continue;
+        if (!aref_playing.load(std::memory_order_acquire)) {
+            mus.decoder->discard_stale();
+            continue;
+        }
 
         std::atomic_ref<unsigned long long> aref_frame(mus.current_frame);
         const float volume = std::atomic_ref<float>(mus.volume).load(std::memory_order_relaxed);
         const float pan    = std::atomic_ref<float>(mus.pan).load(std::memory_order_relaxed);
+        const float pitch  = std::atomic_ref<float>(mus.pitch).load(std::memory_order_relaxed);
+
+        MusicDecoder& decoder = *mus.decoder;
+        const unsigned int channels = decoder.get_channels();
+        const unsigned long block_frames = mus.mix_buffer.size() / channels;
+        float gain_l, gain_r;
+        pan_gains(channels, pan, volume, gain_l, gain_r);
+
+        // The stretcher takes over from a clean ring position only, never
+        // mid-window
+        if (!mus.stretching && pitch != 1.0f && mus.preserve_pitch && mus.stretch && mus.window_frames == 0) {
+            mus.stretch->reset((double)mus.current_frame);
+            mus.stretching = true;
+        }
 
-        unsigned long frames_to_process = framesPerBuffer;
-        unsigned long output_index = 0;
-
-        while (frames_to_process > 0 && aref_playing.load(std::memory_order_relaxed)) {
-            if (mus.buffer_position >= mus.frames_in_buffer) {
-                if (mus.file_handle) {
-                    sf_count_t frames_read = sf_readf_float(mus.file_handle, mus.stream_buffer, mus.buffer_size);
-
-                    if (frames_read == 0) {
-                        if (mus.loop) {
-                            sf_seek(mus.file_handle, 0, SEEK_SET);
-                            frames_read = sf_readf_float(mus.file_handle, mus.stream_buffer, mus.buffer_size);
-                            if (mus.resampler) {
-                                src_reset(mus.resampler);
-                            }
-                        } else {
-                            aref_playing.store(false, std::memory_order_release);
-                            break;
-                        }
-                    }
-
-                    if (mus.resampler && frames_read > 0) {
-                        double ratio = engine->target_sample_rate / (double)mus.file_info.samplerate;
-
-                        SRC_DATA src_data;
-                        src_data.data_in = mus.stream_buffer;
-                        src_data.input_frames = frames_read;
-                        src_data.data_out = mus.resample_buffer;
-                        src_data.output_frames = (long)(frames_read * ratio) + 256;
-                        src_data.src_ratio = ratio;
-                        src_data.end_of_input = 0;
-
-                        int error = src_process(mus.resampler, &src_data);
-                        if (error) {
-                            spdlog::error("Resampling error for music stream {}: {}", name, src_strerror(error));
-                            aref_playing.store(false, std::memory_order_release);
-                            break;
-                        }
-
-                        mus.frames_in_buffer = src_data.output_frames_gen;
-                    } else {
-                        mus.frames_in_buffer = frames_read;
-                    }
-
-                    mus.buffer_position = 0;
-                } else if (mus.pcm_data) {
-                    unsigned long long frame_pos = aref_frame.load(std::memory_order_relaxed);
-                    sf_count_t frames_left = (mus.pcm_total_frames > (sf_count_t)frame_pos)
-                                             ? mus.pcm_total_frames - (sf_count_t)frame_pos : 0;
-                    sf_count_t to_fill = std::min((sf_count_t)mus.buffer_size, frames_left);
-
-                    if (to_fill == 0) {
-                        if (mus.loop) {
-                            aref_frame.store(0ULL, std::memory_order_relaxed);
-                            frame_pos = 0;
-                            to_fill = std::min((sf_count_t)mus.buffer_size, mus.pcm_total_frames);
-                        } else {
-                            aref_playing.store(false, std::memory_order_release);
-                            break;
-                        }
-                    }
+        // And hands back once the speed returns to 1 or preserve_pitch goes
+        // off. What it still holds (under 100 ms) plays at speed 1 first;
+        // the rest of the buffer then comes from the ring as usual.
+        float*        mix_out    = out;
+        unsigned long mix_frames = framesPerBuffer;
+        if (mus.stretching && (pitch == 1.0f || !mus.preserve_pitch)) {
+            const unsigned long drained = drain_music_stretch(mus, out, framesPerBuffer, gain_l, gain_r, kernels);
+            if (drained < framesPerBuffer) mus.stretching = false;
+            mix_out    += drained * 2;
+            mix_frames -= drained;
+        }
 
-                    unsigned int ch = (unsigned int)mus.file_info.channels;
-                    std::memcpy(mus.stream_buffer, mus.pcm_data + frame_pos * ch,
-                                (size_t)to_fill * ch * sizeof(float));
-                    mus.frames_in_buffer = (unsigned int)to_fill;
-                    mus.buffer_position  = 0;
-                } else {
-                    aref_playing.store(false, std::memory_order_release);
-                    break;
-                }
+        bool starved = false;
+        if (mix_frames == 0) {
+            // The whole buffer came out of the stretcher
+        } else if (mus.stretching) {
+            starved = mix_music_stretched(mus, mix_out, mix_frames, pitch, gain_l, gain_r, kernels);
+        } else if (pitch == 1.0f && mus.window_frames == 0) {
+            unsigned long frames_to_process = mix_frames;
+            unsigned long output_index = 0;
+
+            // Only copy out of the decoder's ring here; file reads and resampling
+            // happen on the decoder thread.
+            while (frames_to_process > 0) {
+                unsigned long want = std::min(frames_to_process, block_frames);
+                unsigned long frames_read = (unsigned long)decoder.read(mus.mix_buffer.data(), want);
+                if (channels == 1) kernels.accumulate_mono(mix_out + output_index * 2, mus.mix_buffer.data(), frames_read, gain_l, gain_r);
+                else               kernels.accumulate_stereo(mix_out + output_index * 2, mus.mix_buffer.data(), frames_read, gain_l, gain_r);
+
+                aref_frame.fetch_add(frames_read, std::memory_order_relaxed);
+                output_index      += frames_read;
+                frames_to_process -= frames_read;
+
+                if (frames_read < want) { starved = true; break; }
             }
+        } else {
+            starved = mix_music_pitched(mus, mix_out, mix_frames, pitch, gain_l, gain_r);
+        }
 
-            unsigned long frames_available = mus.frames_in_buffer - mus.buffer_position;
-            unsigned long frames_to_read = (frames_to_process < frames_available) ? frames_to_process : frames_available;
-
-            const unsigned int channels = mus.file_info.channels;
-            const float* source_buffer = mus.resampler ? mus.resample_buffer : mus.stream_buffer;
-
-            for (unsigned long i = 0; i < frames_to_read; i++) {
-                unsigned long src_index = (mus.buffer_position + i) * channels;
-                unsigned long dst_index = (output_index + i) * 2;
-
-                float left, right;
-
-                if (channels == 1) {
-                    float sample = source_buffer[src_index];
-                    left  = sample * (1.0f - pan);
-                    right = sample * pan;
-                } else {
-                    left  = source_buffer[src_index];
-                    right = source_buffer[src_index + 1];
-                    if (pan < 0.5f)      right *= (pan * 2.0f);
-                    else if (pan > 0.5f) left  *= ((1.0f - pan) * 2.0f);
-                }
-
-                out[dst_index]     += left * volume;
-                out[dst_index + 1] += right * volume;
+        if (starved) {
+            if (decoder.is_finished()) {
+                aref_playing.store(false, std::memory_order_release);
+            } else if (!decoder.seek_pending()) {
+                // Decoder fell behind: leave the rest of this buffer silent
+                engine->music_underruns.fetch_add(1, std::memory_order_relaxed);
             }
-
-            mus.buffer_position += frames_to_read;
-            aref_frame.fetch_add(frames_to_read, std::memory_order_relaxed);
-            output_index      += frames_to_read;
-            frames_to_process -= frames_to_read;
+        }
+        if (pitch > 0.0f) {
+            double position = (double)mus.current_frame + mus.window_pos;
+            double origin   = (double)(buffer_start + framesPerBuffer) - position / pitch;
+            std::atomic_ref<double>(mus.clock_origin).store(origin, std::memory_order_relaxed);
+            std::atomic_ref<bool>(mus.clock_valid).store(true, std::memory_order_release);
         }
     }
 
+    const unsigned int voices = static_cast<unsigned int>(engine->active_voice_count);
     guard.unlock();
+    engine->stream_frames.store(buffer_start + framesPerBuffer, std::memory_order_release);
 
     const float master_vol = engine->master_volume.load(std::memory_order_relaxed);
-    for (unsigned long i = 0; i < buffer_size; i++) {
-        float sample = out[i] * master_vol;
-        out[i] = (sample > 1.0f) ? 1.0f : ((sample < -1.0f) ? -1.0f : sample);
-    }
+    kernels.apply_master(out, buffer_size, master_vol);
 
+    const auto elapsed = std::chrono::steady_clock::now() - mix_start;
+    engine->stats.record((uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count(),
+                         (uint64_t)(framesPerBuffer * 1e9 / engine->target_sample_rate), voices);
 }
 
 void AudioEngine::sdl_audio_callback(void* userdata, SDL_AudioStream* stream, int additional_amount, int /*total_amount*/) {
@@ -346,6 +495,12 @@ void AudioEngine::sdl_audio_callback(void* userdata, SDL_AudioStream* stream, in
         engine->sdl_scratch_buffer.resize(needed_floats);
     }
 
+    // What we put now plays after whatever SDL still has queued plus one
+    // device buffer.
+    int queued_bytes = SDL_GetAudioStreamQueued(stream);
+    double queued_frames = (double)std::max(queued_bytes, 0) / bytes_per_frame + engine->sdl_device_frames;
+    engine->output_latency.store(queued_frames / engine->target_sample_rate, std::memory_order_relaxed);
+
     mix(engine->sdl_scratch_buffer.data(), frames, engine);
 
     SDL_PutAudioStreamData(stream, engine->sdl_scratch_buffer.data(),
@@ -355,8 +510,9 @@ void AudioEngine::sdl_audio_callback(void* userdata, SDL_AudioStream* stream, in
 #if !defined(__ANDROID__) && !defined(__EMSCRIPTEN__)
 int AudioEngine::rt_audio_callback(void* outputBuffer, void* /*inputBuffer*/,
                                     unsigned int framesPerBuffer, double /*streamTime*/,
-                                    unsigned int /*status*/, void* userData) {
+                                    unsigned int status, void* userData) {
     AudioEngine* engine = static_cast<AudioEngine*>(userData);
+    if (engine && (status & RTAUDIO_OUTPUT_UNDERFLOW)) engine->stats.record_xrun();
     mix(static_cast<float*>(outputBuffer), framesPerBuffer, engine);
     return 0;
 }
@@ -365,9 +521,14 @@ int AudioEngine::rt_audio_callback(void* outputBuffer, void* /*inputBuffer*/,
 #ifdef _WIN32
 int AudioEngine::pa_stream_callback(const void* /*inputBuffer*/, void* outputBuffer,
                                      unsigned long framesPerBuffer,
-                                     const PaStreamCallbackTimeInfo* /*timeInfo*/,
-                                     PaStreamCallbackFlags /*statusFlags*/, void* userData) {
+                                     const PaStreamCallbackTimeInfo* timeInfo,
+                                     PaStreamCallbackFlags statusFlags, void* userData) {
     AudioEngine* engine = static_cast<AudioEngine*>(userData);
+    if (engine && (statusFlags & paOutputUnderflow)) engine->stats.record_xrun();
+    // PortAudio tells us exactly when this buffer reaches the DAC
+    if (engine && timeInfo && timeInfo->outputBufferDacTime > timeInfo->currentTime) {
+        engine->output_latency.store(timeInfo->outputBufferDacTime - timeInfo->currentTime, std::memory_order_relaxed);
+    }
     mix(static_cast<float*>(outputBuffer), static_cast<unsigned int>(framesPerBuffer), engine);
     return paContinue;
 }
@@ -420,6 +581,14 @@ bool AudioEngine::init_rtaudio_device(RtAudio::Api api, const char* label) {
     }
 
     is_ready = true;
+    // The API may round the request to what the device supports
+    buffer_size = bufferFrames;
+
+    // getStreamLatency() is 0 on APIs that cannot report it; one buffer is
+    // the least the output can be behind the callback.
+    long latency_frames = rt_audio->getStreamLatency();
+    if (latency_frames <= 0) latency_frames = (long)bufferFrames;
+    output_latency.store((double)latency_frames / target_sample_rate, std::memory_order_relaxed);
 
     auto dev_info = rt_audio->getDeviceInfo(params.deviceId);
     spdlog::info("Audio Device initialized successfully");
@@ -429,6 +598,7 @@ bool AudioEngine::init_rtaudio_device(RtAudio::Api api, const char* label) {
     spdlog::info("    > Channels:      2");
     spdlog::info("    > Sample rate:   {} Hz", rt_audio->getStreamSampleRate());
     spdlog::info("    > Buffer size:   {} frames (actual)", bufferFrames);
+    spdlog::info("    > Latency:       {:.1f} ms", get_output_latency() * 1000.0);
     return true;
 }
 #endif
@@ -482,6 +652,10 @@ bool AudioEngine::init_portaudio_device(PaHostApiTypeId api, const char* label)
 
     is_ready = true;
 
+    if (const PaStreamInfo* stream_info = Pa_GetStreamInfo(pa_stream)) {
+        output_latency.store(stream_info->outputLatency, std::memory_order_relaxed);
+    }
+
     const PaDeviceInfo* dev_info = Pa_GetDeviceInfo(out_params.device);
     spdlog::info("Audio Device initialized successfully");
     spdlog::info("    > Backend:       PortAudio | {}", label);
@@ -490,6 +664,7 @@ bool AudioEngine::init_portaudio_device(PaHostApiTypeId api, const char* label)
     spdlog::info("    > Channels:      2");
     spdlog::info("    > Sample rate:   {} Hz", target_sample_rate);
     spdlog::info("    > Buffer size:   {} frames (requested)", buffer_size);
+    spdlog::info("    > Latency:       {:.1f} ms", get_output_latency() * 1000.0);
     return true;
 }
 #endif
@@ -533,6 +708,9 @@ bool AudioEngine::init_sdl3_device() {
     SDL_AudioSpec actual_spec{};
     int actual_frames = 0;
     SDL_GetAudioDeviceFormat(SDL_GetAudioStreamDevice(sdl_stream), &actual_spec, &actual_frames);
+    sdl_device_frames = actual_frames;
+    if (actual_frames > 0) buffer_size = static_cast<unsigned long>(actual_frames);
+    output_latency.store((double)actual_frames / target_sample_rate, std::memory_order_relaxed);
 
     spdlog::info("Audio Device initialized successfully");
     spdlog::info("    > Backend:       SDL3 | {}", SDL_GetCurrentAudioDriver());
@@ -543,6 +721,96 @@ bool AudioEngine::init_sdl3_device() {
     return true;
 }
 
+// Null and file backends. mix() runs on our own thread, so nothing here
+// needs a sound card: the null backend paces itself like a device would,
+// the file backend writes every buffer to a WAV at any speed.
+bool AudioEngine::init_null_device() {
+    offline_clock = false;
+    start_headless_thread(1.0);
+    is_ready = true;
+    // Each buffer "plays" while the next one is mixed
+    output_latency.store((double)buffer_size / target_sample_rate, std::memory_order_relaxed);
+
+    spdlog::info("Audio Device initialized successfully");
+    spdlog::info("    > Backend:       Null");
+    spdlog::info("    > Format:        Float32");
+    spdlog::info("    > Channels:      2");
+    spdlog::info("    > Sample rate:   {} Hz", target_sample_rate);
+    spdlog::info("    > Buffer size:   {} frames", buffer_size);
+    return true;
+}
+
+bool AudioEngine::init_file_device(const std::string& path, float speed) {
+    SF_INFO info{};
+    info.samplerate = static_cast<int>(target_sample_rate);
+    info.channels   = 2;
+    info.format     = SF_FORMAT_WAV | SF_FORMAT_FLOAT;
+    render_file = sf_open(path.c_str(), SFM_WRITE, &info);
+    if (!render_file) {
+        spdlog::error("Failed to open render file {}: {}", path, sf_strerror(NULL));
+        return false;
+    }
+    render_path     = path;
+    rendered_frames = 0;
+    // Nothing is waiting on a speaker, so chart time is simply the frames
+    // rendered so far, whatever the speed
+    offline_clock = true;
+    if (speed > 0.0f) start_headless_thread(speed);
+    is_ready = true;
+
+    spdlog::info("Audio Device initialized successfully");
+    spdlog::info("    > Backend:       File | {}", path);
+    spdlog::info("    > Format:        Float32 WAV");
+    spdlog::info("    > Channels:      2");
+    spdlog::info("    > Sample rate:   {} Hz", target_sample_rate);
+    spdlog::info("    > Buffer size:   {} frames", buffer_size);
+    if (speed > 0.0f) {
+        spdlog::info("    > Speed:         {:.2f}x real time", speed);
+    } else {
+        spdlog::info("    > Speed:         on demand (render_audio)");
+    }
+    return true;
+}
+
+void AudioEngine::start_headless_thread(double speed) {
+    headless_running.store(true, std::memory_order_release);
+    headless_thread = std::thread([this, speed] {
+        using clock = std::chrono::steady_clock;
+        const auto period = std::chrono::duration_cast<clock::duration>(
+            std::chrono::duration<double>((double)buffer_size / (target_sample_rate * speed)));
+        auto deadline = clock::now();
+        while (headless_running.load(std::memory_order_acquire)) {
+            render_block(static_cast<unsigned int>(buffer_size));
+            deadline += period;
+            auto now = clock::now();
+            // A stall (debugger, suspended VM) should not be made up for
+            // with a burst of buffers
+            if (now - deadline > period * 4) deadline = now;
+            std::this_thread::sleep_until(deadline);
+        }
+    });
+}
+
+void AudioEngine::render_block(unsigned int frames) {
+    headless_buffer.resize(static_cast<size_t>(frames) * 2);
+    mix(headless_buffer.data(), frames, this);
+    if (render_file) {
+        sf_writef_float(render_file, headless_buffer.data(), frames);
+        rendered_frames += frames;
+    }
+}
+
+unsigned int AudioEngine::render_audio(unsigned int frames) {
+    if (!render_file || headless_thread.joinable()) return 0;
+    const unsigned int block = static_cast<unsigned int>(std::max(buffer_size, 1ul));
+    for (unsigned int done = 0; done < frames;) {
+        unsigned int n = std::min(block, frames - done);
+        render_block(n);
+        done += n;
+    }
+    return frames;
+}
+
 bool AudioEngine::init_audio_device(const fs::path& sounds_path, const AudioConfig& audio_config, const VolumeConfig& volume_presets) {
     this->sounds_path = sounds_path;
     this->target_sample_rate = audio_config.sample_rate < 0 ? 44100.0f : audio_config.sample_rate;
@@ -550,6 +818,14 @@ bool AudioEngine::init_audio_device(const fs::path& sounds_path, const AudioConf
     this->volume_presets = volume_presets;
     this->is_ready = false;
     this->master_volume = 1.0f;
+    reset_clock();
+    stats.reset();
+    pcm_cache.configure(audio_config.pcm_cache_dir,
+                        (uint64_t)std::max(audio_config.pcm_cache_mb, 0) * 1024 * 1024,
+                        (unsigned int)this->target_sample_rate,
+                        [this](const fs::path& path, std::vector<float>& pcm, unsigned int& channels) {
+                            return decode_to_device_rate(path, pcm, channels);
+                        });
     try {
 #if !defined(__ANDROID__) && !defined(__EMSCRIPTEN__)
         switch (audio_config.device_type) {
@@ -571,6 +847,11 @@ bool AudioEngine::init_audio_device(const fs::path& sounds_path, const AudioConf
             default: break;
         }
 #endif
+        switch (audio_config.device_type) {
+            case 11: return init_null_device();
+            case 12: return init_file_device(audio_config.render_path, audio_config.render_speed);
+            default: break;
+        }
         return init_sdl3_device();
     } catch (const std::exception& e) {
         spdlog::error("Failed to initialize audio device: {}", e.what());
@@ -578,8 +859,98 @@ bool AudioEngine::init_audio_device(const fs::path& sounds_path, const AudioConf
     }
 }
 
+// Candidates for calibrate_buffer_size, smallest (lowest latency) first
+static constexpr int CALIBRATION_BUFFER_SIZES[] = {64, 128, 256, 512, 1024, 2048};
+// Looping voices mixed during calibration: a dense drumroll over the song
+static constexpr unsigned int CALIBRATION_VOICES = 48;
+// Device start-up often glitches once; it is not held against a size
+static constexpr double CALIBRATION_WARMUP_SECONDS = 0.25;
+// How often the stats are checked for a glitch during a size's window
+static constexpr std::chrono::milliseconds CALIBRATION_POLL{50};
+
+int AudioEngine::calibrate_buffer_size(const fs::path& sounds_path, const AudioConfig& audio_config,
+                                       const VolumeConfig& volume_presets, double window_seconds,
+                                       const std::function<void(size_t, size_t, int)>& progress) {
+    if (audio_config.device_type == 11 || audio_config.device_type == 12) {
+        spdlog::warn("Buffer size calibration needs a real device, keeping {} frames", audio_config.buffer_size);
+        AudioConfig fixed = audio_config;
+        fixed.buffer_size = std::max(audio_config.buffer_size, 512);
+        return init_audio_device(sounds_path, fixed, volume_presets) ? static_cast<int>(buffer_size) : 0;
+    }
+
+    AudioConfig trial = audio_config;
+    int chosen = 0;
+    // Sizes the backend granted that already glitched; a device that rounds
+    // several requests up to the same size is only measured once
+    std::vector<int> failed;
+    const size_t candidates = std::size(CALIBRATION_BUFFER_SIZES);
+    for (size_t i = 0; i < candidates; i++) {
+        const int size = CALIBRATION_BUFFER_SIZES[i];
+        if (progress) progress(i, candidates, size);
+        if (is_ready) close_audio_device();
+        trial.buffer_size = size;
+        if (!init_audio_device(sounds_path, trial, volume_presets)) continue;
+        const int granted = static_cast<int>(buffer_size);
+        chosen = granted;
+        if (std::find(failed.begin(), failed.end(), granted) != failed.end()) continue;
+
+        // Near-silent looping tone, so the mixer does real work without
+        // anyone hearing it
+        const unsigned int rate = static_cast<unsigned int>(target_sample_rate);
+        sound load{};
+        load.frame_count = rate / 2;
+        load.sample_rate = rate;
+        load.channels    = 2;
+        load.loop        = true;
+        load.volume      = 1.0f;
+        load.pan         = 0.5f;
+        load.pitch       = 1.0f;
+        load.data        = new float[load.frame_count * 2];
+        for (unsigned int i = 0; i < load.frame_count; i++) {
+            float sample = 1e-4f * std::sin(2.0f * 3.14159265f * 440.0f * (float)i / (float)rate);
+            load.data[i * 2]     = sample;
+            load.data[i * 2 + 1] = sample;
+        }
+        SoundId load_id = store_sound("__buffer_calibration", load);
+        set_sound_polyphony(load_id, CALIBRATION_VOICES);
+        for (unsigned int v = 0; v < CALIBRATION_VOICES; v++) play_sound(load_id);
+
+        std::this_thread::sleep_for(std::chrono::duration<double>(CALIBRATION_WARMUP_SECONDS));
+        AudioStatsSnapshot before = get_audio_stats();
+        AudioStatsSnapshot after = before;
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(window_seconds);
+        while (std::chrono::steady_clock::now() < deadline) {
+            std::this_thread::sleep_for(CALIBRATION_POLL);
+            after = get_audio_stats();
+            if (after.xruns != before.xruns || after.overruns != before.overruns) break;
+        }
+        unload_sound(load_id);
+
+        const uint64_t xruns    = after.xruns - before.xruns;
+        const uint64_t overruns = after.overruns - before.overruns;
+        spdlog::info("Buffer size {} frames (requested {}): {} callbacks, worst {:.0f} us of {:.0f} us, {} xruns, {} overruns",
+                     granted, size, after.callbacks - before.callbacks, after.worst_us, after.budget_us, xruns, overruns);
+        if (after.callbacks > before.callbacks && xruns == 0 && overruns == 0) {
+            spdlog::info("Calibrated audio buffer size: {} frames", granted);
+            return granted;
+        }
+        failed.push_back(granted);
+    }
+    if (chosen == 0) {
+        spdlog::error("Buffer size calibration could not open the audio device");
+        return 0;
+    }
+    spdlog::warn("No buffer size ran clean, keeping the largest that opened ({} frames)", chosen);
+    if (!is_ready) {
+        trial.buffer_size = chosen;
+        if (!init_audio_device(sounds_path, trial, volume_presets)) return 0;
+    }
+    return chosen;
+}
+
 void AudioEngine::close_audio_device() {
     try {
+        pcm_cache.shutdown();
         unload_all_sounds();
         unload_all_music();
 
@@ -607,6 +978,25 @@ void AudioEngine::close_audio_device() {
             Pa_Terminate();
         }
 #endif
+        headless_running.store(false, std::memory_order_release);
+        if (headless_thread.joinable()) headless_thread.join();
+
+        if (is_ready) {
+            std::string summary = get_audio_stats().summary();
+            size_t start = 0;
+            while (start < summary.size()) {
+                size_t end = summary.find('\n', start);
+                if (end == std::string::npos) end = summary.size();
+                spdlog::info("Audio stats | {}", summary.substr(start, end - start));
+                start = end + 1;
+            }
+        }
+        if (render_file) {
+            sf_close(render_file);
+            render_file = nullptr;
+            spdlog::info("Rendered {:.1f} s of audio to {}", rendered_frames / target_sample_rate, render_path);
+        }
+        offline_clock = false;
         is_ready = false;
 
         spdlog::info("Audio device closed");
@@ -619,6 +1009,12 @@ bool AudioEngine::is_audio_device_ready() const {
     return is_ready;
 }
 
+AudioStatsSnapshot AudioEngine::get_audio_stats() const {
+    AudioStatsSnapshot snapshot = stats.snapshot();
+    snapshot.music_underruns = get_music_underrun_count();
+    return snapshot;
+}
+
 void AudioEngine::set_master_volume(float volume) {
     master_volume.store(std::clamp(volume, 0.0f, 1.0f), std::memory_order_relaxed);
 }
@@ -641,7 +1037,7 @@ std::string AudioEngine::path_to_string(const fs::path& path) const {
     return path.string();
 }
 
-std::string AudioEngine::load_sound(const fs::path& file_path, const std::string& name) {
+SoundId AudioEngine::load_sound(const fs::path& file_path, const std::string& name) {
     try {
         SF_INFO file_info;
         std::memset(&file_info, 0, sizeof(SF_INFO));
@@ -665,47 +1061,37 @@ std::string AudioEngine::load_sound(const fs::path& file_path, const std::string
             if (!ffmpeg_decode_float(path_str2.c_str(), &ff_data, &ff_frames, &ff_rate, &ff_ch)) {
                 spdlog::error("Failed to open sound file: {} - {} (ffmpeg fallback also failed)",
                               file_path.string(), sf_strerror(NULL));
-                return "";
+                return {};
             }
             sound snd;
             snd.data        = ff_data;
             snd.frame_count = ff_frames;
             snd.sample_rate = ff_rate;
             snd.channels    = ff_ch;
-            snd.is_playing  = false;
-            snd.current_frame = 0;
             snd.loop   = false;
             snd.volume = 1.0f;
             snd.pan    = 0.5f;
             snd.pitch  = 1.0f;
-            snd.frame_frac = 0.0f;
             if ((double)ff_rate != target_sample_rate) {
-                double ratio = target_sample_rate / (double)ff_rate;
-                long out_frames = (long)(ff_frames * ratio) + 1;
+                unsigned int rate = (unsigned int)target_sample_rate;
+                long out_frames = resample_output_frames((long)ff_frames, ff_rate, rate);
                 float* rs = new float[out_frames * ff_ch];
-                SRC_DATA sd;
-                sd.data_in = ff_data; sd.input_frames = ff_frames;
-                sd.data_out = rs; sd.output_frames = out_frames;
-                sd.src_ratio = ratio; sd.end_of_input = 1;
-                int err = src_simple(&sd, SRC_SINC_FASTEST, (int)ff_ch);
-                if (err) { delete[] ff_data; delete[] rs; return ""; }
+                long written = resample_pcm(ff_data, (long)ff_frames, ff_ch, ff_rate, rate, rs, out_frames);
                 delete[] ff_data;
+                if (written < 0) { delete[] rs; return {}; }
                 snd.data = rs;
-                snd.frame_count = sd.output_frames_gen;
-                snd.sample_rate = (unsigned int)target_sample_rate;
+                snd.frame_count = written;
+                snd.sample_rate = rate;
             }
             snd.resampler = nullptr;
             snd.resample_buffer = nullptr;
-            {
-                std::unique_lock<std::shared_mutex> guard(rw_lock);
-                sounds[name] = snd;
-            }
+            SoundId id = store_sound(name, snd);
             spdlog::debug("Loaded sound (ffmpeg): {} ({} frames, {} Hz, {} ch)",
                           name, snd.frame_count, snd.sample_rate, snd.channels);
-            return name;
+            return id;
 #else
             spdlog::error("Failed to open sound file: {} - {}", file_path.string(), sf_strerror(NULL));
-            return "";
+            return {};
 #endif
         }
 
@@ -725,57 +1111,45 @@ std::string AudioEngine::load_sound(const fs::path& file_path, const std::string
         snd.frame_count = frames_read;
         snd.sample_rate = file_info.samplerate;
         snd.channels = channels;
-        snd.is_playing = false;
-        snd.current_frame = 0;
         snd.loop = false;
         snd.volume = 1.0f;
         snd.pan = 0.5f;
         snd.pitch = 1.0f;
-        snd.frame_frac = 0.0f;
 
         if (snd.sample_rate != target_sample_rate) {
-            double ratio = target_sample_rate / (double)snd.sample_rate;
-            long output_frames = (long)(frames_read * ratio) + 1;
+            // Long sounds are split across threads inside resample_pcm
+            unsigned int rate = (unsigned int)target_sample_rate;
+            long output_frames = resample_output_frames((long)frames_read, snd.sample_rate, rate);
             float* resampled_data = new float[output_frames * channels];
 
-            SRC_DATA src_data;
-            src_data.data_in = data;
-            src_data.input_frames = frames_read;
-            src_data.data_out = resampled_data;
-            src_data.output_frames = output_frames;
-            src_data.src_ratio = ratio;
-            src_data.end_of_input = 1;
-
-            int error = src_simple(&src_data, SRC_SINC_FASTEST, channels);
-            if (error) {
-                spdlog::error("Failed to resample sound: {} - {}", file_path.string(), src_strerror(error));
+            long written = resample_pcm(data, (long)frames_read, channels, snd.sample_rate, rate,
+                                        resampled_data, output_frames);
+            if (written < 0) {
+                spdlog::error("Failed to resample sound: {}", file_path.string());
                 delete[] data;
                 delete[] resampled_data;
-                return "";
+                return {};
             }
 
             delete[] data;
             snd.data = resampled_data;
-            snd.frame_count = src_data.output_frames_gen;
-            snd.sample_rate = target_sample_rate;
+            snd.frame_count = written;
+            snd.sample_rate = rate;
         }
 
         snd.resampler = nullptr;
         snd.resample_buffer = nullptr;
 
-        {
-            std::unique_lock<std::shared_mutex> guard(rw_lock);
-            sounds[name] = snd;
-        }
+        SoundId id = store_sound(name, snd);
 
         spdlog::debug("Loaded sound: {} ({} frames, {} Hz, {} channels)",
                      name, snd.frame_count, snd.sample_rate, snd.channels);
 
-        return name;
+        return id;
 
     } catch (const std::exception& e) {
         spdlog::error("Error loading sound {}: {}", file_path.string(), e.what());
-        return "";
+        return {};
     }
 }
 
@@ -830,153 +1204,669 @@ void AudioEngine::load_screen_sounds(const std::string& screen_name) {
     scan(sounds_path / "global");
 }
 
-void AudioEngine::unload_sound(const std::string& name) {
-    std::unique_lock<std::shared_mutex> guard(rw_lock);
-    auto it = sounds.find(name);
-    if (it != sounds.end()) {
-        sound& snd = it->second;
+static void free_sound_data(sound& snd) {
+    snd.envelope.clear();
+    if (snd.data) {
+        delete[] snd.data;
+        snd.data = nullptr;
+    }
 
-        std::atomic_ref<bool>(snd.is_playing).store(false, std::memory_order_relaxed);
+    if (snd.resampler) {
+        src_delete(snd.resampler);
+        snd.resampler = nullptr;
+    }
 
-        if (snd.data) {
-            delete[] snd.data;
-            snd.data = nullptr;
-        }
+    if (snd.resample_buffer) {
+        delete[] snd.resample_buffer;
+        snd.resample_buffer = nullptr;
+    }
+}
 
-        if (snd.resampler) {
-            src_delete(snd.resampler);
-            snd.resampler = nullptr;
+// RMS per ENVELOPE_BLOCK frames. QUIETEST stealing looks a voice's level up
+// here instead of measuring it in the callback.
+static std::vector<float> compute_envelope(const sound& snd) {
+    std::vector<float> envelope;
+    if (!snd.data || snd.frame_count == 0) return envelope;
+    envelope.reserve(snd.frame_count / sound::ENVELOPE_BLOCK + 1);
+    for (unsigned int start = 0; start < snd.frame_count; start += sound::ENVELOPE_BLOCK) {
+        unsigned int end = std::min(start + sound::ENVELOPE_BLOCK, snd.frame_count);
+        double sum = 0.0;
+        for (size_t i = (size_t)start * snd.channels; i < (size_t)end * snd.channels; i++) {
+            sum += (double)snd.data[i] * snd.data[i];
         }
+        envelope.push_back((float)std::sqrt(sum / ((double)(end - start) * snd.channels)));
+    }
+    return envelope;
+}
 
-        if (snd.resample_buffer) {
-            delete[] snd.resample_buffer;
-            snd.resample_buffer = nullptr;
-        }
+SoundId AudioEngine::store_sound(const std::string& name, sound snd) {
+    snd.envelope = compute_envelope(snd);
 
-        sounds.erase(it);
+    std::unique_lock<std::shared_mutex> guard(rw_lock);
+    uint32_t slot;
+    auto it = sound_ids.find(name);
+    if (it != sound_ids.end()) {
+        // Reloading a name keeps its slot, so handles held elsewhere stay
+        // valid. Queued commands still count against the old entry.
+        slot = it->second;
+        release_voices_of(slot);
+        sound& old = sound_slots[slot].snd;
+        snd.pending_starts = old.pending_starts;
+        snd.pending_stops  = old.pending_stops;
+        snd.max_voices     = old.max_voices;
+        snd.steal_policy   = old.steal_policy;
+        free_sound_data(old);
+    } else if (!free_sound_slots.empty()) {
+        slot = free_sound_slots.back();
+        free_sound_slots.pop_back();
     } else {
+        slot = static_cast<uint32_t>(sound_slots.size());
+        sound_slots.emplace_back();
+    }
+
+    SoundSlot& entry = sound_slots[slot];
+    entry.snd    = std::move(snd);
+    entry.name   = name;
+    entry.in_use = true;
+    sound_ids[name] = slot;
+    return SoundId{slot, entry.generation};
+}
+
+SoundId AudioEngine::get_sound_id(const std::string& name) const {
+    std::shared_lock<std::shared_mutex> guard(rw_lock);
+    auto it = sound_ids.find(name);
+    if (it == sound_ids.end()) return {};
+    return SoundId{it->second, sound_slots[it->second].generation};
+}
+
+void AudioEngine::unload_sound(SoundId id) {
+    std::unique_lock<std::shared_mutex> guard(rw_lock);
+    sound* snd = sound_at(id);
+    if (!snd) return;
+
+    release_voices_of(id.slot);
+    free_sound_data(*snd);
+
+    SoundSlot& entry = sound_slots[id.slot];
+    sound_ids.erase(entry.name);
+    entry.name.clear();
+    entry.in_use = false;
+    entry.generation++;  // stale handles (and queued commands) stop resolving
+    entry.snd = sound{};
+    free_sound_slots.push_back(id.slot);
+}
+
+void AudioEngine::unload_sound(const std::string& name) {
+    SoundId id = get_sound_id(name);
+    if (!id.is_valid()) {
         spdlog::warn("Sound {} not found", name);
+        return;
     }
+    unload_sound(id);
 }
 
 void AudioEngine::unload_all_sounds() {
-    std::vector<std::string> names;
+    std::vector<SoundId> ids;
     {
         std::shared_lock<std::shared_mutex> guard(rw_lock);
-        names.reserve(sounds.size());
-        for (const auto& [name, _] : sounds) names.push_back(name);
+        ids.reserve(sound_ids.size());
+        for (const auto& [name, slot] : sound_ids) ids.push_back(SoundId{slot, sound_slots[slot].generation});
     }
 
-    for (const auto& name : names) {
-        unload_sound(name);
+    for (SoundId id : ids) {
+        unload_sound(id);
     }
 
     spdlog::info("All sounds unloaded");
 }
 
-void AudioEngine::play_sound(const std::string& name, VolumePreset volume_preset) {
+float AudioEngine::preset_volume(VolumePreset volume_preset) const {
+    switch (volume_preset) {
+        case VolumePreset::SOUND:        return volume_presets.sound;
+        case VolumePreset::MUSIC:        return volume_presets.music;
+        case VolumePreset::VOICE:        return volume_presets.voice;
+        case VolumePreset::HITSOUND:     return volume_presets.hitsound;
+        case VolumePreset::ATTRACT_MODE: return volume_presets.attract_mode;
+        default:                         return 1.0f;
+    }
+}
+
+void AudioEngine::push_voice_command(const VoiceCommand& cmd) {
+    if (!voice_commands.push(cmd)) {
+        spdlog::warn("Voice command queue full, dropping command for sound slot {}", cmd.id.slot);
+    }
+}
+
+void AudioEngine::play_sound(SoundId id, VolumePreset volume_preset) {
     std::shared_lock<std::shared_mutex> guard(rw_lock);
-    auto it = sounds.find(name);
-    if (it != sounds.end()) {
-        sound& snd = it->second;
+    sound* snd = sound_at(id);
+    if (!snd) return;
 
-        if (volume_preset != VolumePreset::NONE) {
-            float volume = 1.0f;
-            if      (volume_preset == VolumePreset::SOUND)       volume = volume_presets.sound;
-            else if (volume_preset == VolumePreset::MUSIC)       volume = volume_presets.music;
-            else if (volume_preset == VolumePreset::VOICE)       volume = volume_presets.voice;
-            else if (volume_preset == VolumePreset::HITSOUND)    volume = volume_presets.hitsound;
-            else if (volume_preset == VolumePreset::ATTRACT_MODE) volume = volume_presets.attract_mode;
-            std::atomic_ref<float>(snd.volume).store(volume, std::memory_order_relaxed);
-        }
+    if (volume_preset != VolumePreset::NONE) {
+        std::atomic_ref<float>(snd->volume).store(preset_volume(volume_preset), std::memory_order_relaxed);
+    }
 
-        std::atomic_ref<unsigned int>(snd.current_frame).store(0, std::memory_order_relaxed);
-        std::atomic_ref<float>(snd.frame_frac).store(0.0f, std::memory_order_relaxed);
-        std::atomic_ref<bool>(snd.is_playing).store(true, std::memory_order_release);
-    } else {
+    // The mixer picks the voice; counting the play as pending keeps
+    // is_sound_playing() true until it does.
+    std::atomic_ref<unsigned int>(snd->pending_starts).fetch_add(1, std::memory_order_relaxed);
+    std::atomic_ref<unsigned int>(snd->position_frame).store(0, std::memory_order_relaxed);
+    if (!voice_commands.push(VoiceCommand{VoiceCommand::PLAY, id, 0})) {
+        std::atomic_ref<unsigned int>(snd->pending_starts).fetch_sub(1, std::memory_order_relaxed);
+        spdlog::warn("Voice command queue full, dropping play for sound slot {}", id.slot);
+    }
+}
+
+void AudioEngine::play_sound_at(SoundId id, double stream_time, VolumePreset volume_preset) {
+    std::shared_lock<std::shared_mutex> guard(rw_lock);
+    sound* snd = sound_at(id);
+    if (!snd) return;
+
+    if (volume_preset != VolumePreset::NONE) {
+        std::atomic_ref<float>(snd->volume).store(preset_volume(volume_preset), std::memory_order_relaxed);
+    }
+
+    VoiceCommand cmd{VoiceCommand::PLAY_AT, id, 0};
+    cmd.start_frame = (uint64_t)std::llround(std::max(stream_time, 0.0) * target_sample_rate);
+    // Pending until its start sample, as a play is until the next buffer
+    std::atomic_ref<unsigned int>(snd->pending_starts).fetch_add(1, std::memory_order_relaxed);
+    if (!voice_commands.push(cmd)) {
+        std::atomic_ref<unsigned int>(snd->pending_starts).fetch_sub(1, std::memory_order_relaxed);
+        spdlog::warn("Voice command queue full, dropping scheduled play for sound slot {}", id.slot);
+    }
+}
+
+void AudioEngine::cancel_scheduled_sound(SoundId id) {
+    std::shared_lock<std::shared_mutex> guard(rw_lock);
+    if (!sound_at(id)) return;
+    push_voice_command(VoiceCommand{VoiceCommand::CANCEL, id, 0});
+}
+
+void AudioEngine::play_sound(const std::string& name, VolumePreset volume_preset) {
+    SoundId id = get_sound_id(name);
+    if (!id.is_valid()) {
         //spdlog::warn("Sound {} not found", name);
+        return;
+    }
+    play_sound(id, volume_preset);
+}
+
+void AudioEngine::stop_sound(SoundId id) {
+    std::shared_lock<std::shared_mutex> guard(rw_lock);
+    if (sound* snd = sound_at(id)) {
+        std::atomic_ref<unsigned int>(snd->pending_stops).fetch_add(1, std::memory_order_relaxed);
+        std::atomic_ref<unsigned int>(snd->position_frame).store(0, std::memory_order_relaxed);
+        if (!voice_commands.push(VoiceCommand{VoiceCommand::STOP, id, 0})) {
+            std::atomic_ref<unsigned int>(snd->pending_stops).fetch_sub(1, std::memory_order_relaxed);
+            spdlog::warn("Voice command queue full, dropping stop for sound slot {}", id.slot);
+        }
     }
 }
 
 void AudioEngine::stop_sound(const std::string& name) {
+    SoundId id = get_sound_id(name);
+    if (!id.is_valid()) {
+        spdlog::warn("Sound {} not found", name);
+        return;
+    }
+    stop_sound(id);
+}
+
+bool AudioEngine::is_sound_playing(SoundId id) const {
     std::shared_lock<std::shared_mutex> guard(rw_lock);
-    auto it = sounds.find(name);
-    if (it != sounds.end()) {
-        std::atomic_ref<bool>(it->second.is_playing).store(false, std::memory_order_relaxed);
-        std::atomic_ref<unsigned int>(it->second.current_frame).store(0, std::memory_order_relaxed);
-        std::atomic_ref<float>(it->second.frame_frac).store(0.0f, std::memory_order_relaxed);
-    } else {
+    const sound* snd = sound_at(id);
+    if (!snd) return false;
+    auto load = [](const unsigned int& v) {
+        return std::atomic_ref<unsigned int>(const_cast<unsigned int&>(v)).load(std::memory_order_relaxed);
+    };
+    if (load(snd->pending_starts) > 0) return true;
+    return load(snd->active_voices) > 0 && load(snd->pending_stops) == 0;
+}
+
+bool AudioEngine::is_sound_playing(const std::string& name) const {
+    SoundId id = get_sound_id(name);
+    if (!id.is_valid()) {
         spdlog::warn("Sound {} not found", name);
+        return false;
     }
+    return is_sound_playing(id);
 }
 
-bool AudioEngine::is_sound_playing(const std::string& name) {
+void AudioEngine::set_sound_volume(SoundId id, float volume) {
     std::shared_lock<std::shared_mutex> guard(rw_lock);
-    auto it = sounds.find(name);
-    if (it != sounds.end()) {
-        return std::atomic_ref<bool>(it->second.is_playing).load(std::memory_order_relaxed);
+    if (sound* snd = sound_at(id)) {
+        std::atomic_ref<float>(snd->volume).store(std::clamp(volume, 0.0f, 1.0f), std::memory_order_relaxed);
     }
-    spdlog::warn("Sound {} not found", name);
-    return false;
 }
 
 void AudioEngine::set_sound_volume(const std::string& name, float volume) {
-    std::shared_lock<std::shared_mutex> guard(rw_lock);
-    auto it = sounds.find(name);
-    if (it != sounds.end()) {
-        std::atomic_ref<float>(it->second.volume).store(std::clamp(volume, 0.0f, 1.0f), std::memory_order_relaxed);
-    } else {
+    SoundId id = get_sound_id(name);
+    if (!id.is_valid()) {
         spdlog::warn("Sound {} not found", name);
+        return;
     }
+    set_sound_volume(id, volume);
 }
 
-void AudioEngine::set_sound_pan(const std::string& name, float pan) {
+void AudioEngine::set_sound_pan(SoundId id, float pan) {
     std::shared_lock<std::shared_mutex> guard(rw_lock);
-    auto it = sounds.find(name);
-    if (it != sounds.end()) {
-        std::atomic_ref<float>(it->second.pan).store(std::clamp(pan, 0.0f, 1.0f), std::memory_order_relaxed);
-    } else {
+    if (sound* snd = sound_at(id)) {
+        std::atomic_ref<float>(snd->pan).store(std::clamp(pan, 0.0f, 1.0f), std::memory_order_relaxed);
+    }
+}
+
+void AudioEngine::set_sound_pan(const std::string& name, float pan) {
+    SoundId id = get_sound_id(name);
+    if (!id.is_valid()) {
         spdlog::warn("Sound {} not found", name);
+        return;
     }
+    set_sound_pan(id, pan);
 }
 
-void AudioEngine::set_sound_pitch(const std::string& name, float pitch) {
+void AudioEngine::set_sound_pitch(SoundId id, float pitch) {
     std::shared_lock<std::shared_mutex> guard(rw_lock);
-    auto it = sounds.find(name);
-    if (it != sounds.end()) {
-        std::atomic_ref<float>(it->second.pitch).store(pitch, std::memory_order_relaxed);
-    } else {
+    if (sound* snd = sound_at(id)) {
+        std::atomic_ref<float>(snd->pitch).store(pitch, std::memory_order_relaxed);
+    }
+}
+
+void AudioEngine::set_sound_pitch(const std::string& name, float pitch) {
+    SoundId id = get_sound_id(name);
+    if (!id.is_valid()) {
         spdlog::warn("Sound {} not found", name);
+        return;
     }
+    set_sound_pitch(id, pitch);
+}
+
+float AudioEngine::get_sound_time_played(SoundId id) const {
+    std::shared_lock<std::shared_mutex> guard(rw_lock);
+    const sound* snd = sound_at(id);
+    if (!snd) return 0.0f;
+    unsigned int frame = std::atomic_ref<unsigned int>(const_cast<unsigned int&>(snd->position_frame))
+                             .load(std::memory_order_relaxed);
+    return static_cast<float>(frame) / static_cast<float>(target_sample_rate);
 }
 
 float AudioEngine::get_sound_time_played(const std::string& name) const {
+    SoundId id = get_sound_id(name);
+    if (!id.is_valid()) {
+        spdlog::warn("Sound {} not found", name);
+        return 0.0f;
+    }
+    return get_sound_time_played(id);
+}
+
+void AudioEngine::seek_sound(SoundId id, float position) {
     std::shared_lock<std::shared_mutex> guard(rw_lock);
-    auto it = sounds.find(name);
-    if (it != sounds.end()) {
-        unsigned int frame = std::atomic_ref<unsigned int>(const_cast<unsigned int&>(it->second.current_frame))
-                                 .load(std::memory_order_relaxed);
-        return static_cast<float>(frame) / static_cast<float>(target_sample_rate);
+    if (sound* snd = sound_at(id)) {
+        unsigned int frame = static_cast<unsigned int>(std::max(position, 0.0f) * static_cast<float>(target_sample_rate));
+        frame = std::min(frame, snd->frame_count);
+        std::atomic_ref<unsigned int>(snd->position_frame).store(frame, std::memory_order_relaxed);
+        push_voice_command(VoiceCommand{VoiceCommand::SEEK, id, frame});
     }
-    spdlog::warn("Sound {} not found", name);
-    return 0.0f;
 }
 
 void AudioEngine::seek_sound(const std::string& name, float position) {
+    SoundId id = get_sound_id(name);
+    if (!id.is_valid()) {
+        spdlog::warn("Sound {} not found", name);
+        return;
+    }
+    seek_sound(id, position);
+}
+
+void AudioEngine::reset_clock() {
+    clock_dll = ClockDll{};
+    clock_seq.store(0, std::memory_order_relaxed);
+    clock_frame_period.store(0.0, std::memory_order_relaxed);
+    output_latency.store(0.0, std::memory_order_relaxed);
+    last_audio_clock.store(0.0, std::memory_order_relaxed);
+}
+
+void AudioEngine::update_clock(uint64_t buffer_start, unsigned int frames) {
+    const double now     = steady_seconds();
+    const double nominal = 1.0 / target_sample_rate;
+    ClockDll& dll = clock_dll;
+
+    const double elapsed_frames = (double)(buffer_start - dll.frame);
+    const double predicted      = dll.time + elapsed_frames * dll.frame_period;
+    const double error          = now - predicted;
+    if (!dll.locked || elapsed_frames <= 0.0 || std::abs(error) > CLOCK_DLL_RESET_SECONDS) {
+        dll.locked       = true;
+        dll.time         = now;
+        dll.frame_period = nominal;
+    } else {
+        // Second-order loop: the phase term absorbs callback jitter, the
+        // rate term follows the device clock drifting from steady_clock.
+        dll.time          = predicted + CLOCK_DLL_B * error;
+        dll.frame_period += CLOCK_DLL_C * error / elapsed_frames;
+        dll.frame_period  = std::clamp(dll.frame_period, nominal * 0.99, nominal * 1.01);
+    }
+    dll.frame = buffer_start;
+
+    const uint32_t seq = clock_seq.load(std::memory_order_relaxed);
+    clock_seq.store(seq + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    clock_frame.store(buffer_start, std::memory_order_relaxed);
+    clock_time.store(dll.time, std::memory_order_relaxed);
+    clock_frame_period.store(dll.frame_period, std::memory_order_relaxed);
+    clock_buffer_frames.store(frames, std::memory_order_relaxed);
+    clock_seq.store(seq + 2, std::memory_order_release);
+}
+
+double AudioEngine::get_audio_clock() const {
+    if (offline_clock) return get_stream_time();
+
+    uint64_t     frame;
+    double       time, period;
+    unsigned int buffer_frames;
+    for (;;) {
+        const uint32_t seq = clock_seq.load(std::memory_order_acquire);
+        if (seq & 1) continue;  // callback is mid-publish
+        frame         = clock_frame.load(std::memory_order_relaxed);
+        time          = clock_time.load(std::memory_order_relaxed);
+        period        = clock_frame_period.load(std::memory_order_relaxed);
+        buffer_frames = clock_buffer_frames.load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (clock_seq.load(std::memory_order_relaxed) == seq) break;
+    }
+    if (period <= 0.0) return 0.0;  // no callback yet
+
+    // Don't run on past two buffers if the device stops calling back
+    double since = std::clamp((steady_seconds() - time) / period, 0.0, 2.0 * buffer_frames);
+    double clock = ((double)frame + since) / target_sample_rate - get_output_latency();
+
+    // Filtered stamps can still land a hair behind the last reading; never
+    // hand the chart a clock that runs backwards.
+    double last = last_audio_clock.load(std::memory_order_relaxed);
+    if (clock < last && last - clock < CLOCK_DLL_RESET_SECONDS) return last;
+    last_audio_clock.store(clock, std::memory_order_relaxed);
+    return clock;
+}
+
+std::optional<double> AudioEngine::get_sound_clock(SoundId id) const {
     std::shared_lock<std::shared_mutex> guard(rw_lock);
-    auto it = sounds.find(name);
-    if (it != sounds.end()) {
-        sound& snd = it->second;
-        unsigned int frame = static_cast<unsigned int>(std::max(position, 0.0f) * static_cast<float>(target_sample_rate));
-        std::atomic_ref<unsigned int>(snd.current_frame).store(std::min(frame, snd.frame_count), std::memory_order_relaxed);
-        std::atomic_ref<float>(snd.frame_frac).store(0.0f, std::memory_order_relaxed);
+    const sound* snd = sound_at(id);
+    if (!snd) return std::nullopt;
+    auto load = [](const unsigned int& v) {
+        return std::atomic_ref<unsigned int>(const_cast<unsigned int&>(v)).load(std::memory_order_relaxed);
+    };
+    // A queued play or stop has not reached the mixer, so the origin is stale
+    if (load(snd->pending_starts) > 0 || load(snd->pending_stops) > 0 || load(snd->active_voices) == 0) {
+        return std::nullopt;
+    }
+    double origin = std::atomic_ref<double>(const_cast<double&>(snd->clock_origin)).load(std::memory_order_relaxed);
+    float  pitch  = std::atomic_ref<float>(const_cast<float&>(snd->pitch)).load(std::memory_order_relaxed);
+    return (get_audio_clock() * target_sample_rate - origin) * pitch / target_sample_rate;
+}
+
+void AudioEngine::set_sound_polyphony(SoundId id, unsigned int max_voices, VoiceStealPolicy policy) {
+    std::shared_lock<std::shared_mutex> guard(rw_lock);
+    if (sound* snd = sound_at(id)) {
+        max_voices = std::clamp<unsigned int>(max_voices, 1, MAX_VOICES);
+        std::atomic_ref<unsigned int>(snd->max_voices).store(max_voices, std::memory_order_relaxed);
+        std::atomic_ref<VoiceStealPolicy>(snd->steal_policy).store(policy, std::memory_order_relaxed);
+    }
+}
+
+float AudioEngine::voice_level(const Voice& voice) const {
+    const sound& snd = sound_slots[voice.slot].snd;
+    float volume = std::atomic_ref<float>(const_cast<float&>(snd.volume)).load(std::memory_order_relaxed);
+    size_t block = voice.frame / sound::ENVELOPE_BLOCK;
+    float level = (block < snd.envelope.size()) ? snd.envelope[block] : 0.0f;
+    return volume * level;
+}
+
+void AudioEngine::release_voice(size_t active_index) {
+    uint32_t voice_index = active_voice_list[active_index];
+    Voice&   voice       = voice_pool[voice_index];
+    sound&   snd         = sound_slots[voice.slot].snd;
+
+    std::atomic_ref<unsigned int>(snd.active_voices).fetch_sub(1, std::memory_order_relaxed);
+    if (snd.newest_voice == voice_index) snd.newest_voice = UINT32_MAX;
+
+    active_voice_list[active_index] = active_voice_list[--active_voice_count];
+    free_voice_list[free_voice_count++] = voice_index;
+}
+
+void AudioEngine::release_voices_of(uint32_t slot) {
+    for (size_t v = 0; v < active_voice_count; ) {
+        if (voice_pool[active_voice_list[v]].slot == slot) release_voice(v);
+        else v++;
+    }
+}
+
+uint32_t AudioEngine::acquire_voice(sound& snd, SoundId id) {
+    const unsigned int max_voices = std::atomic_ref<unsigned int>(snd.max_voices).load(std::memory_order_relaxed);
+    const unsigned int active     = std::atomic_ref<unsigned int>(snd.active_voices).load(std::memory_order_relaxed);
+
+    // Steal from this sound once it is at its own limit, otherwise take a
+    // free voice, and only when the pool is empty steal from anyone.
+    bool own_only = active >= max_voices;
+    if (!own_only && free_voice_count > 0) {
+        uint32_t voice_index = free_voice_list[--free_voice_count];
+        active_voice_list[active_voice_count++] = voice_index;
+        std::atomic_ref<unsigned int>(snd.active_voices).fetch_add(1, std::memory_order_relaxed);
+        voice_pool[voice_index].slot       = id.slot;
+        voice_pool[voice_index].generation = id.generation;
+        return voice_index;
+    }
+
+    const VoiceStealPolicy policy = std::atomic_ref<VoiceStealPolicy>(snd.steal_policy).load(std::memory_order_relaxed);
+    size_t victim = SIZE_MAX;
+    for (size_t v = 0; v < active_voice_count; v++) {
+        const Voice& candidate = voice_pool[active_voice_list[v]];
+        if (own_only && candidate.slot != id.slot) continue;
+        if (victim == SIZE_MAX) { victim = v; continue; }
+        const Voice& best = voice_pool[active_voice_list[victim]];
+        // One still waiting on its start sample in this buffer would never
+        // be heard at all, so it is only taken when nothing else is left
+        bool better;
+        if ((candidate.start_offset > 0) != (best.start_offset > 0)) {
+            better = best.start_offset > 0;
+        } else {
+            better = (policy == VoiceStealPolicy::QUIETEST)
+                   ? voice_level(candidate) < voice_level(best)
+                   : candidate.serial < best.serial;
+        }
+        if (better) victim = v;
+    }
+    if (victim == SIZE_MAX) return UINT32_MAX;
+
+    // Hand the stolen voice over to this sound
+    uint32_t voice_index = active_voice_list[victim];
+    Voice&   voice       = voice_pool[voice_index];
+    sound&   previous    = sound_slots[voice.slot].snd;
+    if (&previous != &snd) {
+        std::atomic_ref<unsigned int>(previous.active_voices).fetch_sub(1, std::memory_order_relaxed);
+        std::atomic_ref<unsigned int>(snd.active_voices).fetch_add(1, std::memory_order_relaxed);
+    }
+    if (previous.newest_voice == voice_index) previous.newest_voice = UINT32_MAX;
+    voice.slot       = id.slot;
+    voice.generation = id.generation;
+    return voice_index;
+}
+
+void AudioEngine::start_voice(sound& snd, SoundId id, unsigned int start_offset) {
+    uint32_t voice_index = acquire_voice(snd, id);
+    if (voice_index == UINT32_MAX) return;
+    Voice& voice       = voice_pool[voice_index];
+    voice.frame        = 0;
+    voice.frame_frac   = 0.0f;
+    voice.serial       = voice_serial++;
+    voice.start_offset = start_offset;
+    snd.newest_voice   = voice_index;
+}
+
+void AudioEngine::drop_scheduled_plays(sound& snd, uint32_t slot) {
+    for (size_t i = 0; i < scheduled_count; ) {
+        if (scheduled_plays[i].id.slot == slot) {
+            std::atomic_ref<unsigned int>(snd.pending_starts).fetch_sub(1, std::memory_order_relaxed);
+            scheduled_plays[i] = scheduled_plays[--scheduled_count];
+        } else {
+            i++;
+        }
+    }
+}
+
+void AudioEngine::process_voice_commands(uint64_t buffer_start, unsigned int frames) {
+    const uint64_t buffer_end = buffer_start + frames;
+
+    VoiceCommand cmd;
+    while (voice_commands.pop(cmd)) {
+        sound* snd = sound_at(cmd.id);
+        if (!snd) continue;  // unloaded since the command was queued
+
+        switch (cmd.type) {
+        case VoiceCommand::PLAY:
+            std::atomic_ref<unsigned int>(snd->pending_starts).fetch_sub(1, std::memory_order_relaxed);
+            start_voice(*snd, cmd.id, 0);
+            break;
+        case VoiceCommand::PLAY_AT:
+            if (cmd.start_frame >= buffer_end && scheduled_count < MAX_SCHEDULED) {
+                scheduled_plays[scheduled_count++] = cmd;
+            } else {
+                // Due now (or the schedule is full): start as close as we can
+                unsigned int offset = cmd.start_frame > buffer_start
+                                    ? (unsigned int)std::min<uint64_t>(cmd.start_frame - buffer_start, frames - 1)
+                                    : 0;
+                std::atomic_ref<unsigned int>(snd->pending_starts).fetch_sub(1, std::memory_order_relaxed);
+                start_voice(*snd, cmd.id, offset);
+            }
+            break;
+        case VoiceCommand::STOP:
+            std::atomic_ref<unsigned int>(snd->pending_stops).fetch_sub(1, std::memory_order_relaxed);
+            release_voices_of(cmd.id.slot);
+            drop_scheduled_plays(*snd, cmd.id.slot);
+            break;
+        case VoiceCommand::CANCEL:
+            drop_scheduled_plays(*snd, cmd.id.slot);
+            break;
+        case VoiceCommand::SEEK:
+            if (snd->newest_voice != UINT32_MAX) {
+                Voice& voice     = voice_pool[snd->newest_voice];
+                voice.frame      = cmd.frame;
+                voice.frame_frac = 0.0f;
+            }
+            break;
+        }
+    }
+
+    // Start scheduled plays that fall inside this buffer
+    for (size_t i = 0; i < scheduled_count; ) {
+        const VoiceCommand& pending = scheduled_plays[i];
+        if (pending.start_frame >= buffer_end) { i++; continue; }
+        if (sound* snd = sound_at(pending.id)) {
+            unsigned int offset = pending.start_frame > buffer_start
+                                ? (unsigned int)(pending.start_frame - buffer_start) : 0;
+            std::atomic_ref<unsigned int>(snd->pending_starts).fetch_sub(1, std::memory_order_relaxed);
+            start_voice(*snd, pending.id, offset);
+        }
+        scheduled_plays[i] = scheduled_plays[--scheduled_count];
+    }
+}
+
+bool AudioEngine::store_pcm_music(const std::string& name, const fs::path& file_path,
+                                  std::shared_ptr<const float[]> data, sf_count_t frames, unsigned int channels) {
+    music mus{};
+    mus.file_info.channels   = (int)channels;
+    mus.file_info.samplerate = (int)target_sample_rate;
+    mus.file_info.frames     = frames;
+    mus.file_path = file_path.string();
+    mus.is_playing = false;
+    mus.current_frame = 0;
+    mus.volume = 1.0f;
+    mus.pan = 0.5f;
+    mus.pitch = 1.0f;
+    mus.decoder = std::make_unique<MusicDecoder>(std::move(data), frames, channels, target_sample_rate);
+    mus.mix_buffer.resize(MUSIC_MIX_BLOCK_FRAMES * channels);
+    if (!mus.decoder->start(name)) return false;
+
+    MusicNode replaced;
+    std::unique_lock<std::shared_mutex> guard(rw_lock);
+    replaced = replace_music_stream(name, std::move(mus));
+    return true;
+}
+
+AudioEngine::MusicNode AudioEngine::replace_music_stream(const std::string& name, music&& mus) {
+    MusicNode replaced;
+    if (auto it = music_streams.find(name); it != music_streams.end()) replaced = music_streams.extract(it);
+    music_streams.emplace(name, std::move(mus));
+    return replaced;
+}
+
+bool AudioEngine::decode_to_device_rate(const fs::path& file_path, std::vector<float>& pcm, unsigned int& channels) const {
+    SF_INFO file_info;
+    std::memset(&file_info, 0, sizeof(SF_INFO));
+    SNDFILE* file = nullptr;
+#ifdef _WIN32
+    file = sf_wchar_open(file_path.wstring().c_str(), SFM_READ, &file_info);
+#endif
+    if (!file) {
+        std::string path_str = path_to_string(file_path);
+        file = sf_open(path_str.c_str(), SFM_READ, &file_info);
+    }
+
+    std::vector<float> source;
+    unsigned int source_rate;
+    if (file) {
+        channels    = (unsigned int)file_info.channels;
+        source_rate = (unsigned int)file_info.samplerate;
+        source.resize((size_t)file_info.frames * channels);
+        sf_count_t got = sf_readf_float(file, source.data(), file_info.frames);
+        sf_close(file);
+        source.resize((size_t)std::max<sf_count_t>(got, 0) * channels);
     } else {
-        spdlog::warn("Sound {} not found", name);
+#ifdef __ANDROID__
+        float* ff_data = nullptr;
+        sf_count_t ff_frames = 0;
+        std::string path_str = path_to_string(file_path);
+        if (!ffmpeg_decode_float(path_str.c_str(), &ff_data, &ff_frames, &source_rate, &channels)) return false;
+        source.assign(ff_data, ff_data + ff_frames * channels);
+        delete[] ff_data;
+#else
+        return false;
+#endif
     }
+    if (channels == 0) return false;
+
+    if ((double)source_rate == target_sample_rate) {
+        pcm = std::move(source);
+        return true;
+    }
+    // Same converter as the streaming path, so cached and uncached playback
+    // sound identical. One thread: cache fills run in the background while
+    // the song plays, and must not take cores from the game.
+    const long source_frames = (long)(source.size() / channels);
+    const unsigned int rate = (unsigned int)target_sample_rate;
+    const long capacity = resample_output_frames(source_frames, source_rate, rate);
+    pcm.resize((size_t)capacity * channels);
+    long written = resample_pcm(source.data(), source_frames, channels, source_rate, rate, pcm.data(), capacity, 1);
+    if (written < 0) {
+        spdlog::error("Failed to resample {} for the PCM cache", file_path.string());
+        return false;
+    }
+    pcm.resize((size_t)written * channels);
+    return true;
 }
 
 std::string AudioEngine::load_music_stream(const fs::path& file_path, const std::string& name) {
     try {
+        // Songs and previews that were played before start straight from
+        // the mapped cache entry, with no decoding or resampling at all
+        std::string cache_key;
+        if (pcm_cache.is_enabled()) {
+            cache_key = pcm_cache.key_for(file_path);
+            if (std::optional<CachedPcm> cached = pcm_cache.lookup(cache_key)) {
+                if (store_pcm_music(name, file_path, cached->data, (sf_count_t)cached->frames, cached->channels)) {
+                    spdlog::debug("Loaded music stream from PCM cache: {} ({} frames, {} ch)",
+                                  name, cached->frames, cached->channels);
+                    return name;
+                }
+            }
+        }
+
         SF_INFO file_info;
         std::memset(&file_info, 0, sizeof(SF_INFO));
 
@@ -1003,44 +1893,19 @@ std::string AudioEngine::load_music_stream(const fs::path& file_path, const std:
             }
 
             if ((double)ff_rate != target_sample_rate) {
-                double ratio = target_sample_rate / (double)ff_rate;
-                long out_frames = (long)(ff_frames * ratio) + 1;
+                unsigned int rate = (unsigned int)target_sample_rate;
+                long out_frames = resample_output_frames((long)ff_frames, ff_rate, rate);
                 float* rs = new float[out_frames * ff_ch];
-                SRC_DATA sd{};
-                sd.data_in = ff_data; sd.input_frames = ff_frames;
-                sd.data_out = rs; sd.output_frames = out_frames;
-                sd.src_ratio = ratio; sd.end_of_input = 1;
-                int err = src_simple(&sd, SRC_SINC_FASTEST, (int)ff_ch);
-                if (err) { delete[] ff_data; delete[] rs; return ""; }
+                long written = resample_pcm(ff_data, (long)ff_frames, ff_ch, ff_rate, rate, rs, out_frames);
                 delete[] ff_data;
+                if (written < 0) { delete[] rs; return ""; }
                 ff_data = rs;
-                ff_frames = sd.output_frames_gen;
-                ff_rate = (unsigned int)target_sample_rate;
+                ff_frames = written;
+                ff_rate = rate;
             }
 
-            music mus{};
-            mus.file_handle = nullptr;
-            mus.file_info.channels = (int)ff_ch;
-            mus.file_info.samplerate = (int)ff_rate;
-            mus.file_path = file_path.string();
-            mus.pcm_data = ff_data;
-            mus.pcm_total_frames = ff_frames;
-            mus.buffer_size = 4096;
-            mus.stream_buffer = new float[mus.buffer_size * ff_ch];
-            mus.buffer_position = 0;
-            mus.frames_in_buffer = 0;
-            mus.is_playing = false;
-            mus.current_frame = 0;
-            mus.loop = false;
-            mus.volume = 1.0f;
-            mus.pan = 0.5f;
-            mus.pitch = 1.0f;
-            mus.resampler = nullptr;
-            mus.resample_buffer = nullptr;
-            {
-                std::unique_lock<std::shared_mutex> guard(rw_lock);
-                music_streams[name] = mus;
-            }
+            if (!store_pcm_music(name, file_path, std::shared_ptr<const float[]>(ff_data), ff_frames, ff_ch)) return "";
+            pcm_cache.fill_async(file_path);
             spdlog::debug("Loaded music stream (ffmpeg): {} ({} frames, {} Hz, {} ch)",
                           name, ff_frames, ff_rate, ff_ch);
             return name;
@@ -1051,47 +1916,27 @@ std::string AudioEngine::load_music_stream(const fs::path& file_path, const std:
         }
 
         music mus;
-        mus.file_handle = file;
         mus.file_info = file_info;
         mus.file_path = file_path.string();
 
-        mus.buffer_size = 4096; //arbitrary buffer size?
-        mus.stream_buffer = new float[mus.buffer_size * file_info.channels];
-        mus.buffer_position = 0;
-        mus.frames_in_buffer = 0;
-
         mus.is_playing = false;
         mus.current_frame = 0;
-        mus.loop = false;
         mus.volume = 1.0f;
         mus.pan = 0.5f;
         mus.pitch = 1.0f;
 
-        if (file_info.samplerate != target_sample_rate) {
-            int error;
-            mus.resampler = src_new(SRC_SINC_FASTEST, file_info.channels, &error);
-            if (!mus.resampler) {
-                spdlog::error("Failed to create resampler for music stream {}: {}", name, src_strerror(error));
-                sf_close(file);
-                delete[] mus.stream_buffer;
-                return "";
-            }
-
-            double ratio = target_sample_rate / (double)file_info.samplerate;
-            unsigned int resample_buffer_size = (unsigned int)(mus.buffer_size * ratio) + 256;
-            mus.resample_buffer = new float[resample_buffer_size * file_info.channels];
-
-            spdlog::info("Music stream {} will be resampled from {} Hz to {} Hz",
-                        name, file_info.samplerate, target_sample_rate);
-        } else {
-            mus.resampler = nullptr;
-            mus.resample_buffer = nullptr;
+        mus.decoder = std::make_unique<MusicDecoder>(file, file_info, target_sample_rate);
+        mus.mix_buffer.resize(MUSIC_MIX_BLOCK_FRAMES * file_info.channels);
+        if (!mus.decoder->start(name)) {
+            return "";
         }
 
         {
+            MusicNode replaced;
             std::unique_lock<std::shared_mutex> guard(rw_lock);
-            music_streams[name] = mus;
+            replaced = replace_music_stream(name, std::move(mus));
         }
+        pcm_cache.fill_async(file_path);
 
         spdlog::debug("Loaded music stream: {} ({} frames, {} Hz, {} channels)",
                      name, file_info.frames, file_info.samplerate, file_info.channels);
@@ -1116,32 +1961,18 @@ std::string AudioEngine::load_music_stream_memory(
             return "";
         }
 
-        // Build the struct and move it into the map BEFORE opening the sndfile
-        // handle, so that vio_cursor lives at its final stable address when
-        // sf_open_virtual stores a pointer to it.
+        // Opened and primed with no lock held, like load_music_stream; the
+        // cursor is on the heap, so moving the entry into the map later
+        // doesn't move what the SNDFILE points at
         music mus{};
         mus.memory_buffer    = std::make_shared<std::vector<uint8_t>>(std::move(encoded));
-        mus.file_handle      = nullptr;
+        mus.vio_cursor       = std::make_unique<VirtualFile>(VirtualFile{ mus.memory_buffer.get(), 0 });
         mus.file_path        = "<memory:" + name + ">";
-        mus.buffer_size      = 4096;
-        mus.buffer_position  = 0;
-        mus.frames_in_buffer = 0;
         mus.is_playing       = false;
         mus.current_frame    = 0;
-        mus.loop             = false;
         mus.volume           = 1.0f;
         mus.pan              = 0.5f;
         mus.pitch            = 1.0f;
-        mus.resampler        = nullptr;
-        mus.resample_buffer  = nullptr;
-        mus.stream_buffer    = nullptr;
-
-        std::unique_lock<std::shared_mutex> guard(rw_lock);
-        music_streams[name] = std::move(mus);
-        music& stored = music_streams[name];  // reference into the map – stable address
-
-        // vio_cursor now lives inside the map entry and will never move again.
-        stored.vio_cursor = VirtualFile{ stored.memory_buffer.get(), 0 };
 
         SF_VIRTUAL_IO vio{};
         vio.get_filelen = vf_get_filelen;
@@ -1153,33 +1984,24 @@ std::string AudioEngine::load_music_stream_memory(
         SF_INFO file_info{};
         std::memset(&file_info, 0, sizeof(SF_INFO));
 
-        stored.file_handle = sf_open_virtual(&vio, SFM_READ, &file_info, &stored.vio_cursor);
-        if (!stored.file_handle) {
+        SNDFILE* file_handle = sf_open_virtual(&vio, SFM_READ, &file_info, mus.vio_cursor.get());
+        if (!file_handle) {
             spdlog::error("load_music_stream_memory: sf_open_virtual failed for '{}': {}",
                           name, sf_strerror(nullptr));
-            music_streams.erase(name);
             return "";
         }
 
-        stored.file_info     = file_info;
-        stored.stream_buffer = new float[stored.buffer_size * file_info.channels];
-
-        if (file_info.samplerate != target_sample_rate) {
-            int error;
-            stored.resampler = src_new(SRC_SINC_FASTEST, file_info.channels, &error);
-            if (!stored.resampler) {
-                spdlog::error("Failed to create resampler for memory stream '{}': {}",
-                              name, src_strerror(error));
-                sf_close(stored.file_handle);
-                delete[] stored.stream_buffer;
-                music_streams.erase(name);
-                return "";
-            }
-            double       ratio            = target_sample_rate / (double)file_info.samplerate;
-            unsigned int resample_buf_size = (unsigned int)(stored.buffer_size * ratio) + 256;
-            stored.resample_buffer = new float[resample_buf_size * file_info.channels];
-            spdlog::info("Memory music stream '{}' will be resampled from {} Hz to {} Hz",
-                         name, file_info.samplerate, target_sample_rate);
+        mus.file_info = file_info;
+        mus.decoder   = std::make_unique<MusicDecoder>(file_handle, file_info, target_sample_rate);
+        mus.mix_buffer.resize(MUSIC_MIX_BLOCK_FRAMES * file_info.channels);
+        if (!mus.decoder->start(name)) {
+            return "";
+        }
+
+        {
+            MusicNode replaced;  // destroyed after guard releases the lock
+            std::unique_lock<std::shared_mutex> guard(rw_lock);
+            replaced = replace_music_stream(name, std::move(mus));
         }
 
         spdlog::debug("Loaded memory music stream: '{}' ({} frames, {} Hz, {} channels)",
@@ -1194,22 +2016,21 @@ std::string AudioEngine::load_music_stream_memory(
 #endif // __EMSCRIPTEN__
 
 void AudioEngine::play_music_stream(const std::string& name, VolumePreset volume_preset) {
-    std::shared_lock<std::shared_mutex> guard(rw_lock);
+    std::unique_lock<std::shared_mutex> guard(rw_lock);
     auto it = music_streams.find(name);
     if (it != music_streams.end()) {
         music& mus = it->second;
 
         if (volume_preset != VolumePreset::NONE) {
-            float volume = 1.0f;
-            if      (volume_preset == VolumePreset::SOUND)       volume = volume_presets.sound;
-            else if (volume_preset == VolumePreset::MUSIC)       volume = volume_presets.music;
-            else if (volume_preset == VolumePreset::VOICE)       volume = volume_presets.voice;
-            else if (volume_preset == VolumePreset::HITSOUND)    volume = volume_presets.hitsound;
-            else if (volume_preset == VolumePreset::ATTRACT_MODE) volume = volume_presets.attract_mode;
-            std::atomic_ref<float>(mus.volume).store(volume, std::memory_order_relaxed);
+            std::atomic_ref<float>(mus.volume).store(preset_volume(volume_preset), std::memory_order_relaxed);
         }
 
-        std::atomic_ref<unsigned long long>(mus.current_frame).store(0, std::memory_order_relaxed);
+        // Only rewind the decoder when the stream actually moved; the ring is
+        // already primed after load/stop.
+        if (mus.current_frame != 0 || mus.window_frames != 0 || mus.stretching) {
+            rewind_music(mus, 0);
+        }
+        mus.clock_valid = false;
         std::atomic_ref<bool>(mus.is_playing).store(true, std::memory_order_release);
     } else {
         spdlog::warn("Sound {} not found", name);
@@ -1220,9 +2041,7 @@ float AudioEngine::get_music_time_length(const std::string& name) const {
     std::shared_lock<std::shared_mutex> guard(rw_lock);
     auto it = music_streams.find(name);
     if (it != music_streams.end()) {
-        if (it->second.pcm_data)
-            return static_cast<float>(it->second.pcm_total_frames) / static_cast<float>(target_sample_rate);
-        return static_cast<float>(it->second.file_info.frames) / static_cast<float>(target_sample_rate);
+        return static_cast<float>(it->second.decoder->get_total_frames()) / static_cast<float>(target_sample_rate);
     }
     spdlog::warn("Music stream {} not found", name);
     return 0.0f;
@@ -1272,57 +2091,33 @@ void AudioEngine::stop_music_stream(const std::string& name) {
     auto it = music_streams.find(name);
     if (it != music_streams.end()) {
         music& mus = it->second;
-        mus.is_playing      = false;
-        mus.current_frame   = 0;
-        mus.buffer_position  = 0;
-        mus.frames_in_buffer = 0;
-
-        if (mus.file_handle) {
-            sf_seek(mus.file_handle, 0, SEEK_SET);
-        }
+        mus.is_playing = false;
+        rewind_music(mus, 0);
     } else {
         spdlog::warn("Music stream {} not found", name);
     }
 }
 
 void AudioEngine::unload_music_stream(const std::string& name) {
-    std::unique_lock<std::shared_mutex> guard(rw_lock);
-    auto it = music_streams.find(name);
-    if (it != music_streams.end()) {
-        music& mus = it->second;
-
-        mus.is_playing = false;
-
-        if (mus.file_handle) {
-            sf_close(mus.file_handle);
-            mus.file_handle = nullptr;
-        }
-
-        if (mus.pcm_data) {
-            delete[] mus.pcm_data;
-            mus.pcm_data = nullptr;
-        }
-
-        if (mus.stream_buffer) {
-            delete[] mus.stream_buffer;
-            mus.stream_buffer = nullptr;
-        }
-
-        if (mus.resampler) {
-            src_delete(mus.resampler);
-            mus.resampler = nullptr;
-        }
-
-        if (mus.resample_buffer) {
-            delete[] mus.resample_buffer;
-            mus.resample_buffer = nullptr;
+    // Taken out of the map under the lock but destroyed after it: that
+    // joins the decoder thread and closes the file, which the callback
+    // mustn't wait on.
+    decltype(music_streams)::node_type node;
+    {
+        std::unique_lock<std::shared_mutex> guard(rw_lock);
+        auto it = music_streams.find(name);
+        if (it == music_streams.end()) {
+            spdlog::warn("Music stream {} not found", name);
+            return;
         }
-
-        music_streams.erase(it);
-        spdlog::debug("Unloaded music stream: {}", name);
-    } else {
-        spdlog::warn("Music stream {} not found", name);
+        node = music_streams.extract(it);
     }
+    uint64_t underruns = node.mapped().decoder->underruns.load(std::memory_order_relaxed);
+    if (underruns > 0) {
+        spdlog::warn("Music stream {} underran {} times", name, underruns);
+    }
+    node = {};
+    spdlog::debug("Unloaded music stream: {}", name);
 }
 
 void AudioEngine::unload_all_music() {
@@ -1346,29 +2141,90 @@ void AudioEngine::seek_music_stream(const std::string& name, float position) {
     if (it != music_streams.end()) {
         music& mus = it->second;
 
-        if (mus.file_handle) {
-            sf_count_t frame_position = static_cast<sf_count_t>(position * mus.file_info.samplerate);
-
-            if (frame_position < 0) frame_position = 0;
-            if (frame_position >= mus.file_info.frames) frame_position = mus.file_info.frames - 1;
-
-            sf_seek(mus.file_handle, frame_position, SEEK_SET);
-
-            mus.buffer_position  = 0;
-            mus.frames_in_buffer = 0;
-            mus.current_frame    = frame_position;
-        } else if (mus.pcm_data) {
-            unsigned long long frame_pos = static_cast<unsigned long long>(
-                std::max(position, 0.0f) * static_cast<float>(target_sample_rate));
-            if (frame_pos > static_cast<unsigned long long>(mus.pcm_total_frames))
-                frame_pos = static_cast<unsigned long long>(mus.pcm_total_frames);
-            std::atomic_ref<unsigned long long>(mus.current_frame).store(frame_pos, std::memory_order_relaxed);
-            mus.buffer_position  = 0;
-            mus.frames_in_buffer = 0;
+        unsigned long long frame_pos = static_cast<unsigned long long>(
+            std::max(position, 0.0f) * static_cast<float>(target_sample_rate));
+        unsigned long long total = mus.decoder->get_total_frames();
+        if (frame_pos > total) frame_pos = total;
+
+        rewind_music(mus, frame_pos);
+    } else {
+        spdlog::warn("Music stream {} not found", name);
+    }
+}
+
+void AudioEngine::rewind_music(music& mus, unsigned long long frame) {
+    // Only posts the seek; the decoder thread refills the ring from the
+    // exact frame and the callback plays silence until it has, so
+    // playback resumes sample-accurately without the lock waiting on I/O
+    mus.decoder->seek(frame);
+    mus.current_frame = frame;
+    mus.window_frames = 0;
+    mus.window_pos    = 0.0;
+    mus.clock_valid   = false;
+    mus.stretching    = false;
+}
+
+void AudioEngine::pause_music_stream(const std::string& name) {
+    std::unique_lock<std::shared_mutex> guard(rw_lock);
+    auto it = music_streams.find(name);
+    if (it != music_streams.end()) {
+        it->second.is_playing  = false;
+        it->second.clock_valid = false;
+    } else {
+        spdlog::warn("Music stream {} not found", name);
+    }
+}
+
+void AudioEngine::resume_music_stream(const std::string& name, VolumePreset volume_preset) {
+    std::unique_lock<std::shared_mutex> guard(rw_lock);
+    auto it = music_streams.find(name);
+    if (it != music_streams.end()) {
+        if (volume_preset != VolumePreset::NONE) {
+            it->second.volume = preset_volume(volume_preset);
         }
+        it->second.clock_valid = false;
+        std::atomic_ref<bool>(it->second.is_playing).store(true, std::memory_order_release);
+    } else {
+        spdlog::warn("Music stream {} not found", name);
+    }
+}
+
+void AudioEngine::set_music_pitch(const std::string& name, float pitch) {
+    std::shared_lock<std::shared_mutex> guard(rw_lock);
+    auto it = music_streams.find(name);
+    if (it != music_streams.end()) {
+        std::atomic_ref<float>(it->second.pitch).store(std::clamp(pitch, 0.25f, 4.0f), std::memory_order_relaxed);
     } else {
         spdlog::warn("Music stream {} not found", name);
     }
 }
 
+void AudioEngine::set_music_preserve_pitch(const std::string& name, bool preserve) {
+    std::unique_lock<std::shared_mutex> guard(rw_lock);
+    auto it = music_streams.find(name);
+    if (it == music_streams.end()) {
+        spdlog::warn("Music stream {} not found", name);
+        return;
+    }
+    music& mus = it->second;
+    if (preserve && !mus.stretch) {
+        mus.stretch = std::make_unique<TimeStretch>(mus.decoder->get_channels(), (unsigned int)target_sample_rate);
+    }
+    mus.preserve_pitch = preserve;
+}
+
+std::optional<double> AudioEngine::get_music_clock(const std::string& name) const {
+    std::shared_lock<std::shared_mutex> guard(rw_lock);
+    auto it = music_streams.find(name);
+    if (it == music_streams.end()) return std::nullopt;
+    music& mus = const_cast<music&>(it->second);
+    if (!std::atomic_ref<bool>(mus.is_playing).load(std::memory_order_acquire) ||
+        !std::atomic_ref<bool>(mus.clock_valid).load(std::memory_order_acquire)) {
+        return std::nullopt;
+    }
+    double origin = std::atomic_ref<double>(mus.clock_origin).load(std::memory_order_relaxed);
+    float  pitch  = std::atomic_ref<float>(mus.pitch).load(std::memory_order_relaxed);
+    return (get_audio_clock() * target_sample_rate - origin) * pitch / target_sample_rate;
+}
+
 AudioEngine audio;
@@ -2,6 +2,11 @@
 
 #include "config.h"
 #include "av.h"
+#include "audio_stream.h"
+#include "audio_stats.h"
+#include "audio_stretch.h"
+#include "lockfree_queue.h"
+#include "pcm_cache.h"
 #include <SDL3/SDL_audio.h>
 #include <SDL3/SDL_hints.h>
 #include <SDL3/SDL_init.h>
@@ -14,8 +19,12 @@
 #include <sndfile.h>
 #include <samplerate.h>
 #include <memory>
+#include <optional>
+#include <array>
 #include <atomic>
+#include <functional>
 #include <shared_mutex>
+#include <thread>
 #include <vector>
 
 #ifdef __ANDROID__
@@ -36,6 +45,9 @@ namespace std {
         T fetch_add(T val, memory_order order = memory_order_seq_cst) noexcept {
             return __atomic_fetch_add(&ref, val, static_cast<int>(order));
         }
+        T fetch_sub(T val, memory_order order = memory_order_seq_cst) noexcept {
+            return __atomic_fetch_sub(&ref, val, static_cast<int>(order));
+        }
     };
 }
 #endif
@@ -56,15 +68,20 @@ struct VirtualFile {
     sf_count_t                  pos  = 0;
 };
 
+// Which voice a sound gives up when it needs one and has none spare
+enum class VoiceStealPolicy {
+    OLDEST,     // the voice that started first
+    QUIETEST,   // the voice with the lowest current level (volume x envelope)
+};
+
+// Sample data plus shared playback settings. Playback cursors live in the
+// engine's voice pool, so one sound can be heard several times at once.
 struct sound {
     float* data;                    // Audio sample data (interleaved stereo or mono)
     unsigned int frame_count;       // Total number of frames in the sound
     unsigned int sample_rate;       // Original sample rate of the audio
     unsigned int channels;          // Number of channels (1 = mono, 2 = stereo)
 
-    bool is_playing;                // Whether the sound is currently playing
-    unsigned int current_frame;     // Current playback position in frames
-    float frame_frac;               // Fractional part of playback position (for pitch != 1.0)
     bool loop;                      // Whether to loop the sound
 
     float volume;                   // Volume multiplier (0.0 to 1.0+)
@@ -73,34 +90,72 @@ struct sound {
 
     SRC_STATE* resampler;           // libsamplerate state (if needed)
     float* resample_buffer;         // Buffer for resampled audio
+
+    unsigned int max_voices = 1;    // Voices this sound may hold at once (1 = restart on play)
+    VoiceStealPolicy steal_policy = VoiceStealPolicy::OLDEST;
+    std::vector<float> envelope;    // RMS per ENVELOPE_BLOCK frames, for QUIETEST stealing
+
+    unsigned int pending_starts = 0;  // Plays queued but not yet started by the mixer
+    unsigned int pending_stops = 0;   // Stops queued but not yet applied by the mixer
+    unsigned int active_voices = 0;   // Voices currently mixing this sound (mixer writes)
+    unsigned int position_frame = 0;  // Playback position of the newest voice
+
+    uint32_t newest_voice = UINT32_MAX;  // Mixer-owned: voice pool index of the last play
+    double   clock_origin = 0.0;         // Stream frame the newest voice's frame 0 lines up with
+
+    static constexpr unsigned int ENVELOPE_BLOCK = 512;
+};
+
+// Handle returned by load_sound. It indexes the sound table directly, so the
+// hot path (hitsounds) never hashes a name. Reloading the same name keeps the
+// handle valid; unloading the sound makes it stale and calls become no-ops.
+struct SoundId {
+    static constexpr uint32_t INVALID_SLOT = UINT32_MAX;
+
+    uint32_t slot       = INVALID_SLOT;
+    uint32_t generation = 0;
+
+    bool is_valid() const { return slot != INVALID_SLOT; }
+    bool operator==(const SoundId&) const = default;
 };
 
 struct music {
-    SNDFILE* file_handle;           // libsndfile file handle for streaming
     SF_INFO file_info;              // Audio file information
 
-    float* stream_buffer;           // Buffer for reading from file
-    unsigned int buffer_size;       // Size of stream buffer in frames
-    unsigned int buffer_position;   // Current position in stream buffer
-    unsigned int frames_in_buffer;  // Number of valid frames currently in buffer
-
     bool is_playing;                // Whether the music is currently playing
-    unsigned long long current_frame; // Current playback position in frames
-    bool loop;                      // Whether to loop the music
+    unsigned long long current_frame; // Current playback position in frames (device rate)
 
     float volume;                   // Volume multiplier (0.0 to 1.0+)
     float pan;                      // Stereo pan (0.0 = left, 0.5 = center, 1.0 = right)
     float pitch;                    // Pitch/speed multiplier (1.0 = normal)
 
-    SRC_STATE* resampler;           // libsamplerate state (if needed)
-    float* resample_buffer;         // Buffer for resampled audio
-
-    std::string file_path;          // Path to the audio file
+    // A memory stream's encoded file and the read cursor its SNDFILE points
+    // at. Heap-allocated so the address survives moving the entry into the
+    // map, and declared before decoder so both outlive its thread.
     std::shared_ptr<std::vector<uint8_t>> memory_buffer;
-    VirtualFile                           vio_cursor;
+    std::unique_ptr<VirtualFile>          vio_cursor;
+
+    std::unique_ptr<MusicDecoder> decoder;  // Decode thread + ring the callback reads from
+    std::vector<float> mix_buffer;          // Callback-side scratch for one ring read
 
-    float*     pcm_data        = nullptr; // Android FFmpeg fallback: fully decoded PCM
-    sf_count_t pcm_total_frames = 0;
+    // Pitched playback keeps a short window of ring frames in mix_buffer to
+    // interpolate between. current_frame is the source frame of the
+    // window's first entry, window_pos the read position inside it.
+    unsigned int window_frames = 0;
+    double       window_pos = 0.0;
+    double       clock_origin = 0.0;   // Stream frame that source frame 0 lines up with
+    bool         clock_valid = false;  // Set by the mixer once clock_origin is current
+
+    // With preserve_pitch, speeds other than 1 go through the time
+    // stretcher instead of the interpolating window. Once the mixer has
+    // routed the stream through it (stretching), it stays there until the
+    // speed is back to 1, preserve_pitch goes off or the stream rewinds.
+    // Leaving plays out the frames it already took from the ring first.
+    std::unique_ptr<TimeStretch> stretch;
+    bool         preserve_pitch = false;
+    bool         stretching = false;
+
+    std::string file_path;          // Path to the audio file
 };
 
 class AudioEngine {
@@ -111,6 +166,16 @@ public:
     ~AudioEngine();
 
     bool  init_audio_device(const fs::path& sounds_path, const AudioConfig& audio_config, const VolumeConfig& volume_presets);
+    // Opens the device at each candidate buffer size in turn, smallest
+    // first, mixes a synthetic load for window_seconds and keeps the first
+    // size with no underruns or overruns; a size is dropped at its first
+    // glitch. The device is left open at that size, and the size the
+    // backend actually granted is returned (0 if the device never opened).
+    // progress is called before each size is tried with its 0-based index,
+    // the number of candidates and the size requested.
+    int   calibrate_buffer_size(const fs::path& sounds_path, const AudioConfig& audio_config,
+                                const VolumeConfig& volume_presets, double window_seconds = 1.0,
+                                const std::function<void(size_t, size_t, int)>& progress = {});
     void  close_audio_device();
     bool  is_audio_device_ready() const;
     void  set_master_volume(float volume);
@@ -118,12 +183,50 @@ public:
 
     void load_screen_sounds(const std::string& screen_name);
 
-    std::string load_sound(const fs::path& file_path, const std::string& name);
-    void unload_sound(const std::string& name);
+    SoundId load_sound(const fs::path& file_path, const std::string& name);
+    SoundId get_sound_id(const std::string& name) const;
+    void unload_sound(SoundId id);
     void unload_all_sounds();
+    void play_sound(SoundId id, VolumePreset volume_preset = VolumePreset::NONE);
+    void stop_sound(SoundId id);
+    bool is_sound_playing(SoundId id) const;
+    void  set_sound_volume(SoundId id, float volume);
+    void  set_sound_pan(SoundId id,   float pan);
+    void  set_sound_pitch(SoundId id, float pitch);
+    float get_sound_time_played(SoundId id) const;
+    void  seek_sound(SoundId id, float position);
+    // Lets a sound overlap itself (e.g. hitsounds in drumrolls). Voices come
+    // from a fixed pool, so playing never allocates.
+    void  set_sound_polyphony(SoundId id, unsigned int max_voices,
+                              VoiceStealPolicy policy = VoiceStealPolicy::OLDEST);
+
+    // Stream time counts the frames the mixer has produced since the device
+    // opened. play_sound_at starts the sound on the exact sample of that
+    // time; times already passed start at the top of the next buffer.
+    uint64_t get_stream_frame() const { return stream_frames.load(std::memory_order_acquire); }
+    double   get_stream_time() const { return (double)get_stream_frame() / target_sample_rate; }
+    void     play_sound_at(SoundId id, double stream_time, VolumePreset volume_preset = VolumePreset::NONE);
+    // Drops the sound's play_sound_at calls that haven't started yet, and
+    // leaves the voices already sounding alone (pause, seek)
+    void     cancel_scheduled_sound(SoundId id);
+
+    // Stream time that is leaving the speakers right now. Each callback
+    // stamps its first frame with steady_clock (smoothed by a DLL), this
+    // interpolates from the last stamp and subtracts the output latency the
+    // backend reports, so it moves smoothly between callbacks.
+    double get_audio_clock() const;
+    double get_output_latency() const { return output_latency.load(std::memory_order_relaxed); }
+    // Position (seconds) inside the sound that is audible right now, from
+    // the audio clock and the newest voice. Empty until the mixer has
+    // started a voice for it.
+    std::optional<double> get_sound_clock(SoundId id) const;
+
+    // Name-based wrappers for scripts and skins; each resolves the name with
+    // get_sound_id and forwards to the handle version.
+    void unload_sound(const std::string& name);
     void play_sound(const std::string& name, VolumePreset volume_preset = VolumePreset::NONE);
     void stop_sound(const std::string& name);
-    bool is_sound_playing(const std::string& name);
+    bool is_sound_playing(const std::string& name) const;
     void  set_sound_volume(const std::string& name, float volume);
     void  set_sound_pan(const std::string& name,   float pan);
     void  set_sound_pitch(const std::string& name, float pitch);
@@ -134,6 +237,10 @@ public:
 #ifndef __EMSCRIPTEN__
     std::string load_music_stream_memory(const av::AVAudioStream& audio_stream, const std::string& name);
 #endif
+    // play/stop rewind and seek repositions. None of them wait for the
+    // decoder: the stream plays silence until its ring is refilled from
+    // the new position (a few ms), and get_music_clock holds at that
+    // position meanwhile, so a chart synced to it just waits.
     void  play_music_stream(const std::string& name, VolumePreset volume_preset = VolumePreset::NONE);
     float get_music_time_length(const std::string& name) const;
     float get_music_time_played(const std::string& name) const;
@@ -144,6 +251,26 @@ public:
     void  unload_music_stream(const std::string& name);
     void  unload_all_music();
     void  seek_music_stream(const std::string& name, float position);
+    // Pause/resume keep the position, unlike stop/play which rewind
+    void  pause_music_stream(const std::string& name);
+    void  resume_music_stream(const std::string& name, VolumePreset volume_preset = VolumePreset::NONE);
+    // Playback speed (and pitch) of a stream, applied in the mixer so it
+    // takes effect on the next buffer
+    void  set_music_pitch(const std::string& name, float pitch);
+    // Keep the stream's pitch when its speed changes (practice mode)
+    void  set_music_preserve_pitch(const std::string& name, bool preserve);
+    // Like get_sound_clock: the audible position in the stream, or empty
+    // while it is not playing
+    std::optional<double> get_music_clock(const std::string& name) const;
+    // Total times the callback found a stream's ring short of data
+    uint64_t get_music_underrun_count() const { return music_underruns.load(std::memory_order_relaxed); }
+    // Mixer timing, xruns and voice counts since the device opened
+    AudioStatsSnapshot get_audio_stats() const;
+
+    // File backend (device_type 12) with render_speed 0: nothing is mixed
+    // until the caller pulls it, so tests and offline renders go as fast as
+    // the mixer can. Returns the frames written, 0 on any other backend.
+    unsigned int render_audio(unsigned int frames);
 
 private:
     double target_sample_rate;
@@ -152,6 +279,8 @@ private:
     bool is_ready;
     mutable std::shared_mutex rw_lock;
     std::atomic<float> master_volume;
+    std::atomic<uint64_t> music_underruns{0};
+    AudioStats            stats;
 
     SDL_AudioStream*   sdl_stream = nullptr;
     bool               sdl_audio_subsystem_initialized = false;
@@ -164,10 +293,98 @@ private:
     PaStream* pa_stream = nullptr;  // WDM-KS/MME
 #endif
 
-    std::unordered_map<std::string, sound> sounds;
+    // Null (11) and file (12) backends: a thread stands in for the device
+    std::thread        headless_thread;
+    std::atomic<bool>  headless_running{false};
+    std::vector<float> headless_buffer;
+    SNDFILE*           render_file = nullptr;
+    std::string        render_path;
+    uint64_t           rendered_frames = 0;
+    bool               offline_clock = false;  // file backend: the clock follows rendered frames
+
+    struct SoundSlot {
+        sound       snd{};
+        std::string name;
+        uint32_t    generation = 0;
+        bool        in_use = false;
+    };
+    std::vector<SoundSlot>                    sound_slots;
+    std::vector<uint32_t>                     free_sound_slots;
+    std::unordered_map<std::string, uint32_t> sound_ids;
+
+    // Voice pool. Everything below is owned by the mixer (or touched with
+    // rw_lock held exclusively); other threads talk to it via voice_commands.
+    static constexpr size_t MAX_VOICES = 64;
+    struct Voice {
+        uint32_t     slot = 0;
+        uint32_t     generation = 0;
+        unsigned int frame = 0;
+        float        frame_frac = 0.0f;
+        uint64_t     serial = 0;    // start order, for OLDEST stealing
+        unsigned int start_offset = 0;  // silent frames before it starts in the next buffer
+    };
+    struct VoiceCommand {
+        enum Type : uint8_t { PLAY, PLAY_AT, STOP, CANCEL, SEEK } type;
+        SoundId      id;
+        unsigned int frame;
+        uint64_t     start_frame = 0;  // PLAY_AT: stream frame to start on
+    };
+    std::array<Voice, MAX_VOICES>    voice_pool;
+    std::array<uint32_t, MAX_VOICES> active_voice_list;
+    size_t                           active_voice_count = 0;
+    std::array<uint32_t, MAX_VOICES> free_voice_list;
+    size_t                           free_voice_count = 0;
+    uint64_t                         voice_serial = 0;
+    MpscQueue<VoiceCommand, 256>     voice_commands;
+    static constexpr size_t MAX_SCHEDULED = 128;
+    std::array<VoiceCommand, MAX_SCHEDULED> scheduled_plays;  // PLAY_AT beyond the current buffer
+    size_t                           scheduled_count = 0;
+    std::atomic<uint64_t>            stream_frames{0};
+
+    // Audio clock. The callback owns the dll_* filter state and publishes
+    // the result through a seqlock so readers never block it.
+    struct ClockDll {
+        bool     locked = false;
+        uint64_t frame = 0;          // first frame of the last buffer
+        double   time = 0.0;         // filtered steady_clock seconds of that frame
+        double   frame_period = 0.0; // filtered seconds per frame
+    };
+    ClockDll                 clock_dll;
+    std::atomic<uint32_t>    clock_seq{0};
+    std::atomic<uint64_t>    clock_frame{0};
+    std::atomic<double>      clock_time{0.0};
+    std::atomic<double>      clock_frame_period{0.0};
+    std::atomic<unsigned int> clock_buffer_frames{0};
+    std::atomic<double>      output_latency{0.0};  // seconds from callback to speaker
+    mutable std::atomic<double> last_audio_clock{0.0};
+    int                      sdl_device_frames = 0;
     std::unordered_map<std::string, music> music_streams;
+    using MusicNode = std::unordered_map<std::string, music>::node_type;
+    PcmCache                         pcm_cache;
 
     std::string path_to_string(const fs::path& path) const;
+    bool        store_pcm_music(const std::string& name, const fs::path& file_path,
+                                std::shared_ptr<const float[]> data, sf_count_t frames, unsigned int channels);
+    bool        decode_to_device_rate(const fs::path& file_path, std::vector<float>& pcm, unsigned int& channels) const;
+
+    SoundId      store_sound(const std::string& name, sound snd);
+    float        preset_volume(VolumePreset volume_preset) const;
+    void         push_voice_command(const VoiceCommand& cmd);
+    void         process_voice_commands(uint64_t buffer_start, unsigned int frames);
+    void         start_voice(sound& snd, SoundId id, unsigned int start_offset);
+    uint32_t     acquire_voice(sound& snd, SoundId id);
+    void         release_voice(size_t active_index);
+    void         release_voices_of(uint32_t slot);
+    void         drop_scheduled_plays(sound& snd, uint32_t slot);
+    void         update_clock(uint64_t buffer_start, unsigned int frames);
+    void         rewind_music(music& mus, unsigned long long frame);  // rw_lock held exclusively
+    // Moves mus into the map. A stream it replaces is handed back, to be
+    // destroyed (joining its decoder) once rw_lock is released.
+    MusicNode    replace_music_stream(const std::string& name, music&& mus);  // rw_lock held exclusively
+    void         reset_clock();
+    float        voice_level(const Voice& voice) const;
+    sound*       sound_at(SoundId id);        // rw_lock must be held
+    const sound* sound_at(SoundId id) const;
 
 #if !defined(__ANDROID__) && !defined(__EMSCRIPTEN__)
     bool init_rtaudio_device(RtAudio::Api api, const char* label);
@@ -176,6 +393,10 @@ private:
     bool init_portaudio_device(PaHostApiTypeId api, const char* label);
 #endif
     bool init_sdl3_device();
+    bool init_null_device();
+    bool init_file_device(const std::string& path, float speed);
+    void start_headless_thread(double speed);
+    void render_block(unsigned int frames);
 
     static void mix(float* out, unsigned int framesPerBuffer, AudioEngine* engine);
     static void sdl_audio_callback(void* userdata, SDL_AudioStream* stream, int additional_amount, int total_amount);
@@ -0,0 +1,306 @@
+#include "audio_mix.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+#if defined(__SSE2__) || defined(_M_X64)
+#define MIX_X86 1
+#include <emmintrin.h>
+#if defined(__GNUC__)
+#define MIX_AVX2 1
+#include <immintrin.h>
+#endif
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#define MIX_NEON 1
+#include <arm_neon.h>
+#endif
+
+// ---------------------------------------------------------------------------
+// Scalar reference
+// ---------------------------------------------------------------------------
+
+static void scalar_accumulate_stereo(float* out, const float* src, size_t frames, float gain_l, float gain_r) {
+    for (size_t i = 0; i < frames; i++) {
+        out[i * 2]     += src[i * 2]     * gain_l;
+        out[i * 2 + 1] += src[i * 2 + 1] * gain_r;
+    }
+}
+
+static void scalar_accumulate_mono(float* out, const float* src, size_t frames, float gain_l, float gain_r) {
+    for (size_t i = 0; i < frames; i++) {
+        out[i * 2]     += src[i] * gain_l;
+        out[i * 2 + 1] += src[i] * gain_r;
+    }
+}
+
+static void scalar_apply_master(float* out, size_t samples, float master) {
+    for (size_t i = 0; i < samples; i++) {
+        float sample = out[i] * master;
+        out[i] = (sample > 1.0f) ? 1.0f : ((sample < -1.0f) ? -1.0f : sample);
+    }
+}
+
+static const MixKernels SCALAR_KERNELS = {
+    "scalar", scalar_accumulate_stereo, scalar_accumulate_mono, scalar_apply_master
+};
+
+// ---------------------------------------------------------------------------
+// SSE2 (baseline on x86-64)
+// ---------------------------------------------------------------------------
+
+#ifdef MIX_X86
+static void sse2_accumulate_stereo(float* out, const float* src, size_t frames, float gain_l, float gain_r) {
+    const __m128 gains = _mm_setr_ps(gain_l, gain_r, gain_l, gain_r);
+    size_t i = 0;
+    for (; i + 2 <= frames; i += 2) {
+        __m128 s = _mm_loadu_ps(src + i * 2);
+        __m128 o = _mm_loadu_ps(out + i * 2);
+        _mm_storeu_ps(out + i * 2, _mm_add_ps(o, _mm_mul_ps(s, gains)));
+    }
+    scalar_accumulate_stereo(out + i * 2, src + i * 2, frames - i, gain_l, gain_r);
+}
+
+static void sse2_accumulate_mono(float* out, const float* src, size_t frames, float gain_l, float gain_r) {
+    const __m128 gains = _mm_setr_ps(gain_l, gain_r, gain_l, gain_r);
+    size_t i = 0;
+    for (; i + 4 <= frames; i += 4) {
+        __m128 s  = _mm_loadu_ps(src + i);
+        __m128 lo = _mm_unpacklo_ps(s, s);  // s0 s0 s1 s1
+        __m128 hi = _mm_unpackhi_ps(s, s);  // s2 s2 s3 s3
+        __m128 o0 = _mm_loadu_ps(out + i * 2);
+        __m128 o1 = _mm_loadu_ps(out + i * 2 + 4);
+        _mm_storeu_ps(out + i * 2,     _mm_add_ps(o0, _mm_mul_ps(lo, gains)));
+        _mm_storeu_ps(out + i * 2 + 4, _mm_add_ps(o1, _mm_mul_ps(hi, gains)));
+    }
+    scalar_accumulate_mono(out + i * 2, src + i, frames - i, gain_l, gain_r);
+}
+
+static void sse2_apply_master(float* out, size_t samples, float master) {
+    const __m128 m   = _mm_set1_ps(master);
+    const __m128 one = _mm_set1_ps(1.0f);
+    const __m128 neg = _mm_set1_ps(-1.0f);
+    size_t i = 0;
+    for (; i + 4 <= samples; i += 4) {
+        __m128 s = _mm_mul_ps(_mm_loadu_ps(out + i), m);
+        _mm_storeu_ps(out + i, _mm_min_ps(_mm_max_ps(s, neg), one));
+    }
+    scalar_apply_master(out + i, samples - i, master);
+}
+
+static const MixKernels SSE2_KERNELS = {
+    "sse2", sse2_accumulate_stereo, sse2_accumulate_mono, sse2_apply_master
+};
+#endif
+
+// ---------------------------------------------------------------------------
+// AVX2, only installed when the CPU reports it
+// ---------------------------------------------------------------------------
+
+#ifdef MIX_AVX2
+__attribute__((target("avx2")))
+static void avx2_accumulate_stereo(float* out, const float* src, size_t frames, float gain_l, float gain_r) {
+    const __m256 gains = _mm256_setr_ps(gain_l, gain_r, gain_l, gain_r, gain_l, gain_r, gain_l, gain_r);
+    size_t i = 0;
+    for (; i + 4 <= frames; i += 4) {
+        __m256 s = _mm256_loadu_ps(src + i * 2);
+        __m256 o = _mm256_loadu_ps(out + i * 2);
+        _mm256_storeu_ps(out + i * 2, _mm256_add_ps(o, _mm256_mul_ps(s, gains)));
+    }
+    scalar_accumulate_stereo(out + i * 2, src + i * 2, frames - i, gain_l, gain_r);
+}
+
+__attribute__((target("avx2")))
+static void avx2_accumulate_mono(float* out, const float* src, size_t frames, float gain_l, float gain_r) {
+    const __m256 gains = _mm256_setr_ps(gain_l, gain_r, gain_l, gain_r, gain_l, gain_r, gain_l, gain_r);
+    size_t i = 0;
+    for (; i + 8 <= frames; i += 8) {
+        // Unpack works per 128-bit lane, so fix the lane order with a permute
+        // to get s0 s0 s1 s1 s2 s2 s3 s3 / s4 s4 ... s7 s7.
+        __m256 s  = _mm256_loadu_ps(src + i);
+        __m256 lo = _mm256_unpacklo_ps(s, s);  // s0 s0 s1 s1 | s4 s4 s5 s5
+        __m256 hi = _mm256_unpackhi_ps(s, s);  // s2 s2 s3 s3 | s6 s6 s7 s7
+        __m256 a  = _mm256_permute2f128_ps(lo, hi, 0x20);
+        __m256 b  = _mm256_permute2f128_ps(lo, hi, 0x31);
+        __m256 o0 = _mm256_loadu_ps(out + i * 2);
+        __m256 o1 = _mm256_loadu_ps(out + i * 2 + 8);
+        _mm256_storeu_ps(out + i * 2,     _mm256_add_ps(o0, _mm256_mul_ps(a, gains)));
+        _mm256_storeu_ps(out + i * 2 + 8, _mm256_add_ps(o1, _mm256_mul_ps(b, gains)));
+    }
+    scalar_accumulate_mono(out + i * 2, src + i, frames - i, gain_l, gain_r);
+}
+
+__attribute__((target("avx2")))
+static void avx2_apply_master(float* out, size_t samples, float master) {
+    const __m256 m   = _mm256_set1_ps(master);
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 neg = _mm256_set1_ps(-1.0f);
+    size_t i = 0;
+    for (; i + 8 <= samples; i += 8) {
+        __m256 s = _mm256_mul_ps(_mm256_loadu_ps(out + i), m);
+        _mm256_storeu_ps(out + i, _mm256_min_ps(_mm256_max_ps(s, neg), one));
+    }
+    scalar_apply_master(out + i, samples - i, master);
+}
+
+static const MixKernels AVX2_KERNELS = {
+    "avx2", avx2_accumulate_stereo, avx2_accumulate_mono, avx2_apply_master
+};
+
+static bool cpu_has_avx2() {
+    __builtin_cpu_init();
+    return __builtin_cpu_supports("avx2");
+}
+#endif
+
+// ---------------------------------------------------------------------------
+// NEON (ARM / Android)
+// ---------------------------------------------------------------------------
+
+#ifdef MIX_NEON
+static void neon_accumulate_stereo(float* out, const float* src, size_t frames, float gain_l, float gain_r) {
+    const float gain_arr[4] = { gain_l, gain_r, gain_l, gain_r };
+    const float32x4_t gains = vld1q_f32(gain_arr);
+    size_t i = 0;
+    for (; i + 2 <= frames; i += 2) {
+        float32x4_t s = vld1q_f32(src + i * 2);
+        float32x4_t o = vld1q_f32(out + i * 2);
+        vst1q_f32(out + i * 2, vmlaq_f32(o, s, gains));
+    }
+    scalar_accumulate_stereo(out + i * 2, src + i * 2, frames - i, gain_l, gain_r);
+}
+
+static void neon_accumulate_mono(float* out, const float* src, size_t frames, float gain_l, float gain_r) {
+    const float32x4_t gl = vdupq_n_f32(gain_l);
+    const float32x4_t gr = vdupq_n_f32(gain_r);
+    size_t i = 0;
+    for (; i + 4 <= frames; i += 4) {
+        // De-interleaving load/store does the L/R split for free
+        float32x4_t   s = vld1q_f32(src + i);
+        float32x4x2_t o = vld2q_f32(out + i * 2);
+        o.val[0] = vmlaq_f32(o.val[0], s, gl);
+        o.val[1] = vmlaq_f32(o.val[1], s, gr);
+        vst2q_f32(out + i * 2, o);
+    }
+    scalar_accumulate_mono(out + i * 2, src + i, frames - i, gain_l, gain_r);
+}
+
+static void neon_apply_master(float* out, size_t samples, float master) {
+    const float32x4_t one = vdupq_n_f32(1.0f);
+    const float32x4_t neg = vdupq_n_f32(-1.0f);
+    size_t i = 0;
+    for (; i + 4 <= samples; i += 4) {
+        float32x4_t s = vmulq_n_f32(vld1q_f32(out + i), master);
+        vst1q_f32(out + i, vminq_f32(vmaxq_f32(s, neg), one));
+    }
+    scalar_apply_master(out + i, samples - i, master);
+}
+
+static const MixKernels NEON_KERNELS = {
+    "neon", neon_accumulate_stereo, neon_accumulate_mono, neon_apply_master
+};
+#endif
+
+// ---------------------------------------------------------------------------
+// Dispatch
+// ---------------------------------------------------------------------------
+
+std::vector<const MixKernels*> available_mix_kernels() {
+    std::vector<const MixKernels*> kernels = { &SCALAR_KERNELS };
+#ifdef MIX_X86
+    kernels.push_back(&SSE2_KERNELS);
+#endif
+#ifdef MIX_AVX2
+    if (cpu_has_avx2()) kernels.push_back(&AVX2_KERNELS);
+#endif
+#ifdef MIX_NEON
+    kernels.push_back(&NEON_KERNELS);
+#endif
+    return kernels;
+}
+
+const MixKernels& scalar_mix_kernels() {
+    return SCALAR_KERNELS;
+}
+
+const MixKernels& mix_kernels() {
+    static const MixKernels* selected = [] {
+        const MixKernels* best = available_mix_kernels().back();
+        spdlog::info("Audio mix kernels: {}", best->name);
+        return best;
+    }();
+    return *selected;
+}
+
+// ---------------------------------------------------------------------------
+// Benchmark
+// ---------------------------------------------------------------------------
+
+int run_mix_benchmark(int voices) {
+    constexpr size_t FRAMES     = 256;   // a typical callback
+    constexpr int    ITERATIONS = 2000;
+    voices = std::max(voices, 1);
+
+    // Half stereo, half mono voices with distinct data and gains
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> dist(-1.0f, 1.0f);
+    std::vector<std::vector<float>> sources(voices);
+    std::vector<float> gains_l(voices), gains_r(voices);
+    for (int v = 0; v < voices; v++) {
+        sources[v].resize(FRAMES * ((v % 2 == 0) ? 2 : 1));
+        for (float& s : sources[v]) s = dist(rng);
+        gains_l[v] = 0.5f + 0.5f * std::abs(dist(rng));
+        gains_r[v] = 0.5f + 0.5f * std::abs(dist(rng));
+    }
+
+    auto mix_once = [&](const MixKernels& k, std::vector<float>& out) {
+        std::fill(out.begin(), out.end(), 0.0f);
+        for (int v = 0; v < voices; v++) {
+            if (v % 2 == 0) k.accumulate_stereo(out.data(), sources[v].data(), FRAMES, gains_l[v], gains_r[v]);
+            else            k.accumulate_mono(out.data(), sources[v].data(), FRAMES, gains_l[v], gains_r[v]);
+        }
+        k.apply_master(out.data(), out.size(), 0.25f);
+    };
+
+    std::vector<float> reference(FRAMES * 2);
+    mix_once(SCALAR_KERNELS, reference);
+
+    std::cout << "Mixing " << voices << " voices x " << FRAMES << " frames, "
+              << ITERATIONS << " iterations\n";
+
+    double scalar_rate = 0.0;
+    int status = 0;
+    for (const MixKernels* k : available_mix_kernels()) {
+        std::vector<float> out(FRAMES * 2);
+
+        mix_once(*k, out);
+        float max_error = 0.0f;
+        for (size_t i = 0; i < out.size(); i++) {
+            max_error = std::max(max_error, std::abs(out[i] - reference[i]));
+        }
+
+        auto start = std::chrono::steady_clock::now();
+        for (int it = 0; it < ITERATIONS; it++) {
+            mix_once(*k, out);
+        }
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        double rate = (double)voices * ITERATIONS / ms;
+        if (k == &SCALAR_KERNELS) scalar_rate = rate;
+
+        std::cout << std::left << std::setw(8) << k->name
+                  << std::right << std::fixed << std::setprecision(1)
+                  << std::setw(12) << rate << " voices/ms"
+                  << std::setw(8) << std::setprecision(2) << rate / scalar_rate << "x"
+                  << "   max error " << std::scientific << std::setprecision(2) << max_error
+                  << std::defaultfloat << "\n";
+
+        if (max_error > 1e-5f) {
+            std::cerr << "Error: " << k->name << " kernels disagree with the scalar reference\n";
+            status = 1;
+        }
+    }
+    return status;
+}
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+
+// Inner loops of AudioEngine::mix. Output is always interleaved stereo; the
+// gains already fold in voice volume and pan.
+struct MixKernels {
+    const char* name;
+
+    // out[2i] += src[2i] * gain_l, out[2i+1] += src[2i+1] * gain_r
+    void (*accumulate_stereo)(float* out, const float* src, size_t frames, float gain_l, float gain_r);
+    // out[2i] += src[i] * gain_l,  out[2i+1] += src[i] * gain_r
+    void (*accumulate_mono)(float* out, const float* src, size_t frames, float gain_l, float gain_r);
+    // out[i] = clamp(out[i] * master, -1, 1)
+    void (*apply_master)(float* out, size_t samples, float master);
+};
+
+// Best kernels for the running CPU, picked once on first use.
+const MixKernels& mix_kernels();
+
+// Plain C++ reference the vector paths are checked against.
+const MixKernels& scalar_mix_kernels();
+
+// Every kernel set this build can run on this CPU, scalar first.
+std::vector<const MixKernels*> available_mix_kernels();
+
+// --bench-mix: mixes synthetic voices with each kernel set and prints
+// voices per millisecond. Returns a process exit code.
+int run_mix_benchmark(int voices);
@@ -0,0 +1,188 @@
+#include "audio_resample.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <numeric>
+#include <random>
+#include <thread>
+#include <vector>
+
+// Input frames a chunk reads past each of its edges, so the filter sees
+// the same history a single pass would. Far longer than the SRC_SINC_*
+// filters reach at any ratio we use.
+static constexpr long RESAMPLE_ROLL_FRAMES = 4096;
+// Chunks shorter than this (~3s at 44.1kHz) are not worth a thread
+static constexpr long RESAMPLE_MIN_CHUNK_FRAMES = 1 << 17;
+
+long resample_output_frames(long input_frames, unsigned int source_rate, unsigned int target_rate) {
+    return (long)((double)input_frames * target_rate / source_rate) + 1;
+}
+
+static unsigned int default_resample_threads() {
+    return std::clamp(std::thread::hardware_concurrency(), 1u, 8u);
+}
+
+long resample_pcm(const float* input, long input_frames, unsigned int channels,
+                  unsigned int source_rate, unsigned int target_rate,
+                  float* output, long output_capacity,
+                  unsigned int threads, int converter) {
+    if (input_frames <= 0) return 0;
+    if (channels == 0 || source_rate == 0 || target_rate == 0) return -1;
+
+    const double ratio = (double)target_rate / (double)source_rate;
+    // Every in_step input frames land exactly on an output frame (out_step
+    // of them later), so chunks cut there need no fractional realignment.
+    const unsigned int rate_gcd = std::gcd(source_rate, target_rate);
+    const long in_step  = (long)(source_rate / rate_gcd);
+    const long out_step = (long)(target_rate / rate_gcd);
+    auto align_up = [in_step](long frames) { return (frames + in_step - 1) / in_step * in_step; };
+
+    if (threads == 0) threads = default_resample_threads();
+    long chunk_frames = align_up((input_frames + threads - 1) / threads);
+    long roll         = align_up(RESAMPLE_ROLL_FRAMES);
+    if (threads <= 1 || chunk_frames < RESAMPLE_MIN_CHUNK_FRAMES || chunk_frames + roll >= input_frames) {
+        chunk_frames = input_frames;
+        roll         = 0;
+    }
+    const size_t chunk_count = (size_t)((input_frames + chunk_frames - 1) / chunk_frames);
+
+    std::atomic<bool> failed{false};
+    long total_written = 0;
+
+    auto run_chunk = [&](size_t k) {
+        const long start = (long)k * chunk_frames;
+        const long end   = std::min(input_frames, start + chunk_frames);
+        const long from  = std::max(0L, start - roll);
+        const long to    = std::min(input_frames, end + roll);
+        const bool last  = end == input_frames;
+
+        int error = 0;
+        SRC_STATE* state = src_new(converter, (int)channels, &error);
+        if (!state) {
+            spdlog::error("Failed to create resampler: {}", src_strerror(error));
+            failed.store(true);
+            return;
+        }
+
+        std::vector<float> scratch((size_t)resample_output_frames(to - from, source_rate, target_rate) * channels);
+        SRC_DATA data{};
+        data.data_in       = input + (size_t)from * channels;
+        data.input_frames  = to - from;
+        data.data_out      = scratch.data();
+        data.output_frames = (long)(scratch.size() / channels);
+        data.src_ratio     = ratio;
+        data.end_of_input  = 1;
+
+        // One call normally does it all; loop in case the converter stops
+        // early with input left
+        long generated = 0;
+        while (true) {
+            error = src_process(state, &data);
+            if (error) break;
+            generated          += data.output_frames_gen;
+            data.data_in       += (size_t)data.input_frames_used * channels;
+            data.input_frames  -= data.input_frames_used;
+            data.data_out      += (size_t)data.output_frames_gen * channels;
+            data.output_frames -= data.output_frames_gen;
+            if (data.output_frames_gen == 0 || data.output_frames == 0) break;
+        }
+        src_delete(state);
+        if (error) {
+            spdlog::error("Resampling error: {}", src_strerror(error));
+            failed.store(true);
+            return;
+        }
+
+        // Drop the pre-roll's output and keep only this chunk's span
+        const long skip      = (start - from) / in_step * out_step;
+        const long out_start = start / in_step * out_step;
+        long take = last ? output_capacity - out_start : (end - start) / in_step * out_step;
+        take = std::clamp(std::min(take, generated - skip), 0L, std::max(0L, output_capacity - out_start));
+        std::memcpy(output + (size_t)out_start * channels, scratch.data() + (size_t)skip * channels,
+                    (size_t)take * channels * sizeof(float));
+        if (last) total_written = out_start + take;
+    };
+
+    if (chunk_count == 1) {
+        run_chunk(0);
+    } else {
+        std::atomic<size_t> next{0};
+        auto worker = [&] {
+            for (size_t k; (k = next.fetch_add(1)) < chunk_count;) run_chunk(k);
+        };
+        std::vector<std::thread> pool;
+        for (size_t t = 1; t < std::min<size_t>(threads, chunk_count); t++) pool.emplace_back(worker);
+        worker();
+        for (auto& t : pool) t.join();
+    }
+    return failed.load() ? -1 : total_written;
+}
+
+int run_resample_benchmark(int seconds) {
+    constexpr unsigned int SOURCE_RATE = 48000;
+    constexpr unsigned int TARGET_RATE = 44100;
+    constexpr unsigned int CHANNELS    = 2;
+    seconds = std::max(seconds, 1);
+
+    const long frames = (long)seconds * SOURCE_RATE;
+    std::vector<float> input((size_t)frames * CHANNELS);
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> noise(-0.1f, 0.1f);
+    for (long i = 0; i < frames; i++) {
+        float tone = 0.5f * std::sin(2.0f * 3.14159265f * 440.0f * (float)i / SOURCE_RATE);
+        input[(size_t)i * 2]     = tone + noise(rng);
+        input[(size_t)i * 2 + 1] = tone + noise(rng);
+    }
+
+    const long capacity = resample_output_frames(frames, SOURCE_RATE, TARGET_RATE);
+    std::vector<float> reference((size_t)capacity * CHANNELS);
+    std::vector<float> out((size_t)capacity * CHANNELS);
+
+    std::cout << "Resampling " << seconds << "s of stereo " << SOURCE_RATE << " Hz to "
+              << TARGET_RATE << " Hz (" << std::thread::hardware_concurrency() << " hardware threads)\n";
+
+    std::vector<unsigned int> thread_counts = {1, 2, 4, 8, std::thread::hardware_concurrency()};
+    std::sort(thread_counts.begin(), thread_counts.end());
+    thread_counts.erase(std::unique(thread_counts.begin(), thread_counts.end()), thread_counts.end());
+    thread_counts.erase(std::remove(thread_counts.begin(), thread_counts.end(), 0u), thread_counts.end());
+
+    long reference_frames = 0;
+    double single_ms = 0.0;
+    int status = 0;
+    for (unsigned int threads : thread_counts) {
+        std::vector<float>& dst = (threads == 1) ? reference : out;
+        auto start = std::chrono::steady_clock::now();
+        long written = resample_pcm(input.data(), frames, CHANNELS, SOURCE_RATE, TARGET_RATE,
+                                    dst.data(), capacity, threads);
+        double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+        if (written < 0) return 1;
+        if (threads == 1) {
+            reference_frames = written;
+            single_ms = ms;
+        }
+
+        float max_error = 0.0f;
+        for (size_t i = 0; i < (size_t)std::min(written, reference_frames) * CHANNELS; i++) {
+            max_error = std::max(max_error, std::abs(dst[i] - reference[i]));
+        }
+
+        std::cout << std::setw(3) << threads << " threads"
+                  << std::fixed << std::setprecision(1)
+                  << std::setw(10) << ms << " ms"
+                  << std::setw(8) << std::setprecision(2) << single_ms / ms << "x"
+                  << "   frames " << written
+                  << "   max error " << std::scientific << std::setprecision(2) << max_error
+                  << std::defaultfloat << "\n";
+
+        if (written != reference_frames || max_error > 1e-4f) {
+            std::cerr << "Error: " << threads << "-thread output differs from the single pass\n";
+            status = 1;
+        }
+    }
+    return status;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <samplerate.h>
+
+// Upper bound on the frames resample_pcm can produce, for sizing output
+long resample_output_frames(long input_frames, unsigned int source_rate, unsigned int target_rate);
+
+// Resamples a whole interleaved float buffer with libsamplerate. Long
+// inputs are cut into chunks that are resampled on worker threads and laid
+// back end to end. Chunk edges sit on frames where input and output line
+// up exactly, and each chunk runs over a pre/post-roll of its neighbours'
+// samples, so the result matches a single pass.
+//
+// threads = 0 picks from the hardware. Returns the frames written to
+// output, or -1 on error (already logged).
+long resample_pcm(const float* input, long input_frames, unsigned int channels,
+                  unsigned int source_rate, unsigned int target_rate,
+                  float* output, long output_capacity,
+                  unsigned int threads = 0, int converter = SRC_SINC_FASTEST);
+
+// --bench-resample: resamples synthetic 48kHz stereo to 44.1kHz at each
+// thread count and prints the time. Returns a process exit code.
+int run_resample_benchmark(int seconds);
@@ -0,0 +1,65 @@
+#include "audio_stats.h"
+#include <spdlog/spdlog.h>
+
+double latency_percentile(const LatencyBuckets& histogram, uint64_t counted, double fraction, double worst_us) {
+    const uint64_t target = (uint64_t)(fraction * counted);
+    uint64_t seen = 0;
+    for (size_t i = 0; i < LATENCY_BUCKETS; i++) {
+        seen += histogram[i];
+        if (seen > target) return (i + 1 < LATENCY_BUCKETS) ? (double)(2ull << i) : worst_us;
+    }
+    return worst_us;
+}
+
+void AudioStats::reset() {
+    for (auto& bucket : histogram) bucket.store(0, std::memory_order_relaxed);
+    callbacks.store(0, std::memory_order_relaxed);
+    total_ns.store(0, std::memory_order_relaxed);
+    total_budget_ns.store(0, std::memory_order_relaxed);
+    last_budget_ns.store(0, std::memory_order_relaxed);
+    worst_ns.store(0, std::memory_order_relaxed);
+    worst_share.store(0, std::memory_order_relaxed);
+    overruns.store(0, std::memory_order_relaxed);
+    xruns.store(0, std::memory_order_relaxed);
+    active_voices.store(0, std::memory_order_relaxed);
+    peak_voices.store(0, std::memory_order_relaxed);
+}
+
+AudioStatsSnapshot AudioStats::snapshot() const {
+    AudioStatsSnapshot s;
+    uint64_t counted = 0;
+    for (size_t i = 0; i < AUDIO_STATS_BUCKETS; i++) {
+        s.histogram[i] = histogram[i].load(std::memory_order_relaxed);
+        counted += s.histogram[i];
+    }
+    s.callbacks     = callbacks.load(std::memory_order_relaxed);
+    s.worst_us      = worst_ns.load(std::memory_order_relaxed) / 1000.0;
+    s.budget_us     = last_budget_ns.load(std::memory_order_relaxed) / 1000.0;
+    s.worst_percent = worst_share.load(std::memory_order_relaxed) / 100.0;
+    s.overruns      = overruns.load(std::memory_order_relaxed);
+    s.xruns         = xruns.load(std::memory_order_relaxed);
+    s.active_voices = active_voices.load(std::memory_order_relaxed);
+    s.peak_voices   = peak_voices.load(std::memory_order_relaxed);
+    if (s.callbacks == 0) return s;
+
+    const uint64_t total  = total_ns.load(std::memory_order_relaxed);
+    const uint64_t budget = total_budget_ns.load(std::memory_order_relaxed);
+    s.mean_us      = total / 1000.0 / s.callbacks;
+    s.load_percent = budget > 0 ? 100.0 * total / budget : 0.0;
+
+    s.p50_us = latency_percentile(s.histogram, counted, 0.50, s.worst_us);
+    s.p99_us = latency_percentile(s.histogram, counted, 0.99, s.worst_us);
+    return s;
+}
+
+std::string AudioStatsSnapshot::summary() const {
+    return fmt::format(
+        "Mix: {} callbacks, mean {:.0f} us, p50 <{:.0f} us, p99 <{:.0f} us, worst {:.0f} us\n"
+        "Load: {:.1f}% of {:.0f} us budget (worst {:.1f}%), {} overruns\n"
+        "Xruns: {} device, {} music ring\n"
+        "Voices: {} active, {} peak",
+        callbacks, mean_us, p50_us, p99_us, worst_us,
+        load_percent, budget_us, worst_percent, overruns,
+        xruns, music_underruns,
+        active_voices, peak_voices);
+}
@@ -0,0 +1,121 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+
+// Histogram buckets are powers of two in microseconds: bucket 0 is under
+// 2us, bucket i covers [2^i, 2^(i+1)) and the last one is open-ended.
+// The mixer, frame pacer, input latency and replay timings all share them.
+static constexpr size_t LATENCY_BUCKETS = 20;
+static constexpr size_t AUDIO_STATS_BUCKETS = LATENCY_BUCKETS;
+using LatencyBuckets = std::array<uint64_t, LATENCY_BUCKETS>;
+
+inline size_t latency_bucket(uint64_t us) {
+    size_t bucket = 0;
+    while (bucket + 1 < LATENCY_BUCKETS && (us >> (bucket + 1)) != 0) bucket++;
+    return bucket;
+}
+
+// Upper edge (us) of the bucket holding that fraction of the counted
+// samples; worst_us stands in for the open-ended last bucket
+double latency_percentile(const LatencyBuckets& histogram, uint64_t counted, double fraction, double worst_us);
+
+// A latency histogram with its count, mean and worst, for one thread
+struct LatencyHistogram {
+    LatencyBuckets buckets{};
+    uint64_t       count = 0;
+    double         total_us = 0.0;
+    double         worst_us = 0.0;
+
+    void record(double us) {
+        us = std::max(us, 0.0);
+        buckets[latency_bucket((uint64_t)us)]++;
+        count++;
+        total_us += us;
+        worst_us = std::max(worst_us, us);
+    }
+    double mean_us() const { return count ? total_us / count : 0.0; }
+    double percentile_us(double fraction) const {
+        return count ? latency_percentile(buckets, count, fraction, worst_us) : 0.0;
+    }
+    void reset() { *this = LatencyHistogram{}; }
+};
+
+struct AudioStatsSnapshot {
+    uint64_t callbacks = 0;
+    double   mean_us = 0.0;
+    double   p50_us = 0.0;        // upper edge of the bucket holding the percentile
+    double   p99_us = 0.0;
+    double   worst_us = 0.0;
+    double   budget_us = 0.0;     // length of the last buffer in real time
+    double   load_percent = 0.0;  // mean callback time as a share of its buffer
+    double   worst_percent = 0.0;
+    uint64_t overruns = 0;        // callbacks that took longer than their buffer
+    uint64_t xruns = 0;           // underflows reported by the backend
+    uint64_t music_underruns = 0;
+    unsigned int active_voices = 0;
+    unsigned int peak_voices = 0;
+    LatencyBuckets histogram{};
+
+    // One line per figure, for the log and the debug overlay
+    std::string summary() const;
+};
+
+// Per-callback timing for the mixer. The audio thread is the only writer,
+// so record() is plain relaxed loads and stores; any thread may snapshot.
+// A snapshot taken mid-callback can be one callback out of step between
+// fields, which is fine for monitoring.
+class AudioStats {
+public:
+    void record(uint64_t duration_ns, uint64_t budget_ns, unsigned int voices) {
+        bump(histogram[latency_bucket(duration_ns / 1000)]);
+        bump(callbacks);
+        total_ns.store(total_ns.load(std::memory_order_relaxed) + duration_ns, std::memory_order_relaxed);
+        total_budget_ns.store(total_budget_ns.load(std::memory_order_relaxed) + budget_ns, std::memory_order_relaxed);
+        last_budget_ns.store(budget_ns, std::memory_order_relaxed);
+        if (duration_ns > worst_ns.load(std::memory_order_relaxed)) {
+            worst_ns.store(duration_ns, std::memory_order_relaxed);
+        }
+        if (budget_ns > 0) {
+            // Parts per ten thousand, so the worst share stays an integer
+            uint64_t share = duration_ns * 10000 / budget_ns;
+            if (share > worst_share.load(std::memory_order_relaxed)) {
+                worst_share.store(share, std::memory_order_relaxed);
+            }
+            if (duration_ns > budget_ns) bump(overruns);
+        }
+        active_voices.store(voices, std::memory_order_relaxed);
+        if (voices > peak_voices.load(std::memory_order_relaxed)) {
+            peak_voices.store(voices, std::memory_order_relaxed);
+        }
+    }
+
+    // Backends call this from their callback when the device reports an
+    // underflow
+    void record_xrun() { bump(xruns); }
+
+    // Only while no callback is running (device closed)
+    void reset();
+
+    AudioStatsSnapshot snapshot() const;
+
+private:
+    static void bump(std::atomic<uint64_t>& counter) {
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    std::array<std::atomic<uint64_t>, AUDIO_STATS_BUCKETS> histogram{};
+    std::atomic<uint64_t>     callbacks{0};
+    std::atomic<uint64_t>     total_ns{0};
+    std::atomic<uint64_t>     total_budget_ns{0};
+    std::atomic<uint64_t>     last_budget_ns{0};
+    std::atomic<uint64_t>     worst_ns{0};
+    std::atomic<uint64_t>     worst_share{0};
+    std::atomic<uint64_t>     overruns{0};
+    std::atomic<uint64_t>     xruns{0};
+    std::atomic<unsigned int> active_voices{0};
+    std::atomic<unsigned int> peak_voices{0};
+};
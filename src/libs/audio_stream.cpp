@@ -0,0 +1,253 @@
+#include "audio_stream.h"
+#include "profiler.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <cstring>
+
+void PcmRing::init(size_t capacity_frames, unsigned int channels) {
+    size_t cap = 1;
+    while (cap < capacity_frames) cap <<= 1;
+    this->capacity = cap;
+    this->mask     = cap - 1;
+    this->channels = channels;
+    buffer.assign(cap * channels, 0.0f);
+    head.store(0, std::memory_order_relaxed);
+    tail.store(0, std::memory_order_relaxed);
+}
+
+size_t PcmRing::write(const float* src, size_t frames) {
+    const size_t h = head.load(std::memory_order_relaxed);
+    const size_t t = tail.load(std::memory_order_acquire);
+    frames = std::min(frames, capacity - (h - t));
+    if (frames == 0) return 0;
+
+    const size_t start = h & mask;
+    const size_t first = std::min(frames, capacity - start);
+    std::memcpy(buffer.data() + start * channels, src, first * channels * sizeof(float));
+    if (frames > first) {
+        std::memcpy(buffer.data(), src + first * channels, (frames - first) * channels * sizeof(float));
+    }
+    head.store(h + frames, std::memory_order_release);
+    return frames;
+}
+
+size_t PcmRing::read(float* dst, size_t frames) {
+    const size_t t = tail.load(std::memory_order_relaxed);
+    const size_t h = head.load(std::memory_order_acquire);
+    frames = std::min(frames, h - t);
+    if (frames == 0) return 0;
+
+    const size_t start = t & mask;
+    const size_t first = std::min(frames, capacity - start);
+    std::memcpy(dst, buffer.data() + start * channels, first * channels * sizeof(float));
+    if (frames > first) {
+        std::memcpy(dst + first * channels, buffer.data(), (frames - first) * channels * sizeof(float));
+    }
+    tail.store(t + frames, std::memory_order_release);
+    return frames;
+}
+
+size_t PcmRing::read_available() const {
+    return head.load(std::memory_order_acquire) - tail.load(std::memory_order_relaxed);
+}
+
+size_t PcmRing::write_available() const {
+    return capacity - (head.load(std::memory_order_relaxed) - tail.load(std::memory_order_acquire));
+}
+
+void PcmRing::discard_before(size_t position) {
+    const size_t t = tail.load(std::memory_order_relaxed);
+    // Unsigned distance, so this holds across wraparound of the counters
+    if (position - t <= capacity) tail.store(position, std::memory_order_release);
+}
+
+MusicDecoder::MusicDecoder(SNDFILE* file, const SF_INFO& info, double target_sample_rate)
+    : file_handle(file)
+    , channels(static_cast<unsigned int>(info.channels))
+    , source_sample_rate(static_cast<unsigned int>(info.samplerate))
+    , target_sample_rate(target_sample_rate)
+    , ratio(target_sample_rate / (double)info.samplerate)
+    , total_frames(static_cast<unsigned long long>((double)info.frames * (target_sample_rate / (double)info.samplerate)))
+{
+}
+
+MusicDecoder::MusicDecoder(std::shared_ptr<const float[]> pcm_data, sf_count_t pcm_frames, unsigned int channels, double target_sample_rate)
+    : pcm_data(std::move(pcm_data))
+    , pcm_total_frames(pcm_frames)
+    , channels(channels)
+    , source_sample_rate(static_cast<unsigned int>(target_sample_rate))
+    , target_sample_rate(target_sample_rate)
+    , ratio(1.0)
+    , total_frames(static_cast<unsigned long long>(pcm_frames))
+{
+}
+
+MusicDecoder::~MusicDecoder() {
+    stop_requested.store(true);
+    decode_cv.notify_all();
+    if (decode_thread.joinable()) {
+        decode_thread.join();
+    }
+    if (file_handle) sf_close(file_handle);
+    if (resampler)   src_delete(resampler);
+}
+
+bool MusicDecoder::start(const std::string& name) {
+    if (source_sample_rate != (unsigned int)target_sample_rate) {
+        int error;
+        resampler = src_new(SRC_SINC_FASTEST, (int)channels, &error);
+        if (!resampler) {
+            spdlog::error("Failed to create resampler for music stream {}: {}", name, src_strerror(error));
+            return false;
+        }
+        spdlog::info("Music stream {} will be resampled from {} Hz to {} Hz",
+                     name, source_sample_rate, target_sample_rate);
+    }
+
+    chunk_output_frames = (size_t)(CHUNK_FRAMES * ratio) + 256;
+    input_buffer.resize(CHUNK_FRAMES * channels);
+    output_buffer.resize(chunk_output_frames * channels);
+    ring.init(std::max(RING_FRAMES, chunk_output_frames * 2), channels);
+
+    {
+        std::lock_guard<std::mutex> lock(decode_mutex);
+        decode_chunk();
+        decode_chunk();
+    }
+    decode_thread = std::thread(&MusicDecoder::decode_loop, this);
+    return true;
+}
+
+size_t MusicDecoder::read(float* dst, size_t frames) {
+    // Silence while the decoder thread carries out a seek; what the ring
+    // holds is from before it
+    if (seek_pending()) return 0;
+    discard_stale();
+    size_t got = ring.read(dst, frames);
+    if (got < frames && !end_of_source.load(std::memory_order_acquire)) {
+        underruns.fetch_add(1, std::memory_order_relaxed);
+    }
+    return got;
+}
+
+void MusicDecoder::discard_stale() {
+    const uint32_t applied = seek_applied.load(std::memory_order_acquire);
+    if (applied == read_generation) return;
+    ring.discard_before(seek_ring_start.load(std::memory_order_acquire));
+    read_generation = applied;
+}
+
+void MusicDecoder::seek(unsigned long long device_frame) {
+    seek_frame.store(device_frame, std::memory_order_relaxed);
+    seek_requested.fetch_add(1, std::memory_order_release);
+    decode_cv.notify_one();
+}
+
+void MusicDecoder::apply_seek() {
+    const uint32_t requested = seek_requested.load(std::memory_order_acquire);
+    const unsigned long long device_frame = seek_frame.load(std::memory_order_relaxed);
+    rewind_source(static_cast<sf_count_t>((double)device_frame / ratio));
+    end_of_source.store(false, std::memory_order_release);
+    seek_ring_start.store(ring.write_position(), std::memory_order_release);
+    seek_applied.store(requested, std::memory_order_release);
+}
+
+bool MusicDecoder::is_finished() const {
+    return !seek_pending() && end_of_source.load(std::memory_order_acquire) && ring.read_available() == 0;
+}
+
+void MusicDecoder::decode_loop() {
+    // The callback never signals us (that would not be real-time safe), so
+    // the thread wakes on a short timer and tops the ring up when there is
+    // room for a whole chunk.
+    constexpr auto REFILL_INTERVAL = std::chrono::milliseconds(10);
+    PROFILE_THREAD("music decode");
+    std::unique_lock<std::mutex> lock(decode_mutex);
+    while (!stop_requested.load(std::memory_order_relaxed)) {
+        if (seek_pending()) apply_seek();
+        if (!end_of_source.load(std::memory_order_relaxed) &&
+            ring.write_available() >= chunk_output_frames) {
+            {
+                PROFILE_SCOPE("MusicDecoder::decode_chunk");
+                decode_chunk();
+            }
+            continue;
+        }
+        decode_cv.wait_for(lock, REFILL_INTERVAL, [this] {
+            return seek_pending() || stop_requested.load(std::memory_order_relaxed);
+        });
+    }
+}
+
+size_t MusicDecoder::read_source(float* dst, size_t frames) {
+    if (file_handle) {
+        sf_count_t got = sf_readf_float(file_handle, dst, (sf_count_t)frames);
+        return got > 0 ? (size_t)got : 0;
+    }
+    if (pcm_data) {
+        sf_count_t left = std::max<sf_count_t>(pcm_total_frames - pcm_position, 0);
+        size_t n = std::min((size_t)left, frames);
+        std::memcpy(dst, pcm_data.get() + pcm_position * channels, n * channels * sizeof(float));
+        pcm_position += (sf_count_t)n;
+        return n;
+    }
+    return 0;
+}
+
+void MusicDecoder::rewind_source(sf_count_t source_frame) {
+    if (file_handle) {
+        sf_seek(file_handle, source_frame, SEEK_SET);
+    } else if (pcm_data) {
+        pcm_position = std::clamp<sf_count_t>(source_frame, 0, pcm_total_frames);
+    }
+    if (resampler) src_reset(resampler);
+}
+
+void MusicDecoder::write_resampled(const float* input, long frames, bool end_of_input) {
+    // libsamplerate may leave input unconsumed when the output block fills,
+    // so keep feeding until the whole chunk has gone through.
+    for (;;) {
+        SRC_DATA src_data;
+        src_data.data_in       = input;
+        src_data.input_frames  = frames;
+        src_data.data_out      = output_buffer.data();
+        src_data.output_frames = (long)chunk_output_frames;
+        src_data.src_ratio     = ratio;
+        src_data.end_of_input  = end_of_input ? 1 : 0;
+
+        int error = src_process(resampler, &src_data);
+        if (error) {
+            spdlog::error("Resampling error in music decoder: {}", src_strerror(error));
+            return;
+        }
+        ring.write(output_buffer.data(), (size_t)src_data.output_frames_gen);
+
+        input  += src_data.input_frames_used * channels;
+        frames -= src_data.input_frames_used;
+        if (src_data.output_frames_gen == 0 && (frames == 0 || src_data.input_frames_used == 0)) break;
+        if (frames == 0 && !end_of_input) break;
+    }
+}
+
+bool MusicDecoder::decode_chunk() {
+    if (end_of_source.load(std::memory_order_relaxed)) return false;
+    if (ring.write_available() < chunk_output_frames) return false;
+
+    size_t frames_read = read_source(input_buffer.data(), CHUNK_FRAMES);
+    if (frames_read == 0) {
+        if (looping.load(std::memory_order_relaxed)) {
+            rewind_source(0);
+            return true;
+        }
+        if (resampler) write_resampled(input_buffer.data(), 0, true);  // flush the filter tail
+        end_of_source.store(true, std::memory_order_release);
+        return false;
+    }
+
+    if (resampler) {
+        write_resampled(input_buffer.data(), (long)frames_read, false);
+    } else {
+        ring.write(input_buffer.data(), frames_read);
+    }
+    return true;
+}
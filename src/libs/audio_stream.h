@@ -0,0 +1,138 @@
+#pragma once
+
+#include <sndfile.h>
+#include <samplerate.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Single-producer/single-consumer ring of interleaved float frames.
+// The decoder thread is the only writer and the audio callback the only
+// reader, so neither side ever takes a lock.
+class PcmRing {
+public:
+    // Capacity is rounded up to a power of two so indices wrap with a mask.
+    void init(size_t capacity_frames, unsigned int channels);
+
+    size_t write(const float* src, size_t frames);  // producer only
+    size_t read(float* dst, size_t frames);         // consumer only
+
+    size_t read_available() const;
+    size_t write_available() const;
+
+    // Producer only: the position the next write() lands at
+    size_t write_position() const { return head.load(std::memory_order_relaxed); }
+    // Consumer only: drops everything before a write_position(), if it
+    // hasn't been read yet
+    void discard_before(size_t position);
+
+    size_t capacity_frames() const { return capacity; }
+
+private:
+    std::vector<float> buffer;
+    size_t capacity = 0;
+    size_t mask = 0;
+    unsigned int channels = 0;
+    alignas(64) std::atomic<size_t> head{0};  // frames written, producer-owned
+    alignas(64) std::atomic<size_t> tail{0};  // frames read, consumer-owned
+};
+
+// Decodes and resamples one music stream on its own thread, keeping a ring
+// of device-rate PCM well ahead of playback. The audio callback only calls
+// read(); all file I/O and libsamplerate work happens here instead.
+class MusicDecoder {
+public:
+    // Streams from an open libsndfile handle (takes ownership of it).
+    MusicDecoder(SNDFILE* file, const SF_INFO& info, double target_sample_rate);
+    // Streams from fully decoded device-rate PCM (the Android FFmpeg
+    // fallback, or a mapped PcmCache entry).
+    MusicDecoder(std::shared_ptr<const float[]> pcm_data, sf_count_t pcm_frames, unsigned int channels, double target_sample_rate);
+    ~MusicDecoder();
+
+    MusicDecoder(const MusicDecoder&) = delete;
+    MusicDecoder& operator=(const MusicDecoder&) = delete;
+
+    // Creates the resampler, decodes the first chunks synchronously so
+    // playback can begin immediately, then starts the decoder thread.
+    bool start(const std::string& name);
+
+    // Audio callback side. Returns the frames copied; fewer than asked for
+    // means the decoder fell behind (an underrun) or the stream has ended.
+    size_t read(float* dst, size_t frames);
+
+    // Audio callback side. Frees the ring space held by frames from before
+    // the last seek; read() does this itself, a paused stream needs it so
+    // the decoder can refill.
+    void discard_stale();
+
+    // Repositions the stream to a device-rate frame. Only posts the
+    // request: the decoder thread rewinds and refills, and read() returns
+    // nothing until the ring holds data from the new position. Never
+    // blocks, so it is safe under the engine's lock.
+    void seek(unsigned long long device_frame);
+
+    // A seek was posted that the ring doesn't hold data for yet
+    bool seek_pending() const {
+        return seek_requested.load(std::memory_order_acquire) != seek_applied.load(std::memory_order_acquire);
+    }
+
+    void set_loop(bool loop) { looping.store(loop, std::memory_order_relaxed); }
+
+    // True once the source is exhausted and every buffered frame was read.
+    bool is_finished() const;
+
+    unsigned int       get_channels() const { return channels; }
+    unsigned long long get_total_frames() const { return total_frames; }  // device rate
+
+    std::atomic<uint64_t> underruns{0};
+
+private:
+    static constexpr size_t CHUNK_FRAMES = 4096;    // source frames per decode step
+    static constexpr size_t RING_FRAMES  = 32768;   // ~740ms at 44.1kHz
+
+    SNDFILE*     file_handle = nullptr;
+    std::shared_ptr<const float[]> pcm_data;
+    sf_count_t   pcm_total_frames = 0;
+    sf_count_t   pcm_position = 0;
+    unsigned int channels;
+    unsigned int source_sample_rate;
+    double       target_sample_rate;
+    double       ratio;
+    unsigned long long total_frames;
+
+    SRC_STATE*         resampler = nullptr;
+    std::vector<float> input_buffer;
+    std::vector<float> output_buffer;
+    size_t             chunk_output_frames;  // worst case ring space one chunk needs
+
+    PcmRing ring;
+
+    std::thread             decode_thread;
+    std::mutex              decode_mutex;   // held while touching the source/resampler
+    std::condition_variable decode_cv;
+    std::atomic<bool>       stop_requested{false};
+    std::atomic<bool>       looping{false};
+    std::atomic<bool>       end_of_source{false};
+
+    // Seeks are numbered. The engine bumps seek_requested; the decoder
+    // thread rewinds, notes where in the ring the new data starts and
+    // publishes seek_applied; read() then drops what came before.
+    std::atomic<unsigned long long> seek_frame{0};
+    std::atomic<uint32_t>           seek_requested{0};
+    std::atomic<uint32_t>           seek_applied{0};
+    std::atomic<size_t>             seek_ring_start{0};
+    uint32_t                        read_generation = 0;  // callback-owned
+
+    void   apply_seek();     // decode_mutex must be held
+    void   decode_loop();
+    bool   decode_chunk();   // decode_mutex must be held
+    size_t read_source(float* dst, size_t frames);
+    void   rewind_source(sf_count_t source_frame);
+    void   write_resampled(const float* input, long frames, bool end_of_input);
+};
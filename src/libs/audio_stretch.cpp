@@ -0,0 +1,262 @@
+#include "audio_stretch.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iomanip>
+#include <iostream>
+#include <random>
+
+// Sequence, crossfade and seek lengths. Long enough sequences keep low
+// notes intact; the seek window covers a period of anything above ~70Hz.
+static constexpr unsigned int STRETCH_SEQUENCE_MS = 40;
+static constexpr unsigned int STRETCH_OVERLAP_MS  = 8;
+static constexpr unsigned int STRETCH_SEEK_MS     = 15;
+
+TimeStretch::TimeStretch(unsigned int channels, unsigned int sample_rate)
+    : channels(std::max(channels, 1u)),
+      sequence(sample_rate * STRETCH_SEQUENCE_MS / 1000),
+      overlap(sample_rate * STRETCH_OVERLAP_MS / 1000),
+      seek(sample_rate * STRETCH_SEEK_MS / 1000) {
+    // One sequence plus its whole seek window, with room to spare so the
+    // caller tops up in decent-sized reads
+    input.resize((size_t)(2 * sequence + seek + 2) * this->channels);
+    tail.resize((size_t)overlap * this->channels);
+    tail_mono.resize(overlap);
+    input_mono.resize(seek + overlap);
+    output.resize((size_t)(sequence - overlap) * this->channels);
+}
+
+void TimeStretch::reset(double source_frame) {
+    input_frames     = 0;
+    input_start      = std::floor(source_frame);
+    nominal          = source_frame;
+    has_tail         = false;
+    out_frames       = 0;
+    out_read         = 0;
+    segment_position = source_frame;
+    segment_speed    = 1.0;
+    resume_frame     = input_start;
+}
+
+float* TimeStretch::input_space(unsigned int& frames) {
+    frames = (unsigned int)(input.size() / channels) - input_frames;
+    return input.data() + (size_t)input_frames * channels;
+}
+
+void TimeStretch::commit_input(unsigned int frames) {
+    input_frames = std::min(input_frames + frames, (unsigned int)(input.size() / channels));
+}
+
+unsigned int TimeStretch::read(float* out, unsigned int frames, float speed) {
+    speed = std::clamp(speed, 1.0f / MAX_SPEED, MAX_SPEED);
+    unsigned int done = 0;
+    while (done < frames) {
+        if (out_read == out_frames && !next_sequence(speed)) break;
+        unsigned int n = std::min(frames - done, out_frames - out_read);
+        std::memcpy(out + (size_t)done * channels, output.data() + (size_t)out_read * channels,
+                    (size_t)n * channels * sizeof(float));
+        out_read += n;
+        done     += n;
+    }
+    return done;
+}
+
+unsigned int TimeStretch::drain(float* out, unsigned int frames) {
+    unsigned int done = std::min(frames, out_frames - out_read);
+    std::memcpy(out, output.data() + (size_t)out_read * channels, (size_t)done * channels * sizeof(float));
+    out_read += done;
+    if (done == frames) return done;
+
+    // The sequence's own continuation, not nominal: it joins without a seam
+    const unsigned int from = (unsigned int)std::max(resume_frame - input_start, 0.0);
+    if (from >= input_frames) return done;
+    const unsigned int n = std::min(frames - done, input_frames - from);
+    std::memcpy(out + (size_t)done * channels, input.data() + (size_t)from * channels,
+                (size_t)n * channels * sizeof(float));
+    resume_frame += n;
+    return done + n;
+}
+
+bool TimeStretch::next_sequence(float speed) {
+    // The first sequence after a reset starts exactly on nominal; later
+    // ones may start anywhere in the seek window centred on it
+    const double window_start = has_tail ? std::floor(nominal) - (double)(seek / 2) : std::floor(nominal);
+    if (window_start > input_start) {
+        unsigned int drop = (unsigned int)std::min(window_start - input_start, (double)input_frames);
+        std::memmove(input.data(), input.data() + (size_t)drop * channels,
+                     (size_t)(input_frames - drop) * channels * sizeof(float));
+        input_frames -= drop;
+        input_start  += drop;
+        // Skipping ahead of what has arrived (speeds well above 1)
+        if (window_start > input_start) return false;
+    }
+
+    unsigned int count = has_tail ? seek : 1;
+    if (window_start < input_start) count -= (unsigned int)std::min(input_start - window_start, (double)(count - 1));
+    if (input_frames < count - 1 + sequence) return false;
+
+    const unsigned int offset = has_tail ? best_offset(count) : 0;
+    const float* seq = input.data() + (size_t)offset * channels;
+    const unsigned int body = sequence - overlap;
+
+    if (has_tail) {
+        const float step = 1.0f / (float)overlap;
+        for (unsigned int i = 0; i < overlap; i++) {
+            const float t = (float)i * step;
+            for (unsigned int c = 0; c < channels; c++) {
+                const size_t k = (size_t)i * channels + c;
+                output[k] = tail[k] + (seq[k] - tail[k]) * t;
+            }
+        }
+        std::memcpy(output.data() + (size_t)overlap * channels, seq + (size_t)overlap * channels,
+                    (size_t)(body - overlap) * channels * sizeof(float));
+    } else {
+        std::memcpy(output.data(), seq, (size_t)body * channels * sizeof(float));
+    }
+
+    std::memcpy(tail.data(), seq + (size_t)body * channels, (size_t)overlap * channels * sizeof(float));
+    for (unsigned int i = 0; i < overlap; i++) {
+        float sum = 0.0f;
+        for (unsigned int c = 0; c < channels; c++) sum += tail[(size_t)i * channels + c];
+        tail_mono[i] = sum;
+    }
+    has_tail = true;
+
+    segment_position = nominal;
+    segment_speed    = speed;
+    resume_frame     = input_start + offset + body;
+    out_frames       = body;
+    out_read         = 0;
+    nominal         += (double)body * speed;
+    return true;
+}
+
+// Offset in [0, count) where the input best continues the previous
+// sequence's tail, by normalised cross-correlation on a mono downmix
+unsigned int TimeStretch::best_offset(unsigned int count) {
+    const unsigned int span = count - 1 + overlap;
+    for (unsigned int i = 0; i < span; i++) {
+        float sum = 0.0f;
+        for (unsigned int c = 0; c < channels; c++) sum += input[(size_t)i * channels + c];
+        input_mono[i] = sum;
+    }
+
+    double energy = 0.0;
+    for (unsigned int i = 0; i < overlap; i++) energy += (double)input_mono[i] * input_mono[i];
+
+    unsigned int best = 0;
+    double best_score = -1e30;
+    for (unsigned int o = 0; o < count; o++) {
+        const float* x = input_mono.data() + o;
+        // Four partial sums so the compiler can keep this in vector registers
+        float a0 = 0.0f, a1 = 0.0f, a2 = 0.0f, a3 = 0.0f;
+        unsigned int i = 0;
+        for (; i + 4 <= overlap; i += 4) {
+            a0 += tail_mono[i]     * x[i];
+            a1 += tail_mono[i + 1] * x[i + 1];
+            a2 += tail_mono[i + 2] * x[i + 2];
+            a3 += tail_mono[i + 3] * x[i + 3];
+        }
+        for (; i < overlap; i++) a0 += tail_mono[i] * x[i];
+
+        const double score = (double)(a0 + a1 + a2 + a3) / std::sqrt(std::max(energy, 1e-9));
+        if (score > best_score) {
+            best_score = score;
+            best       = o;
+        }
+        if (o + 1 < count) {
+            energy += (double)x[overlap] * x[overlap] - (double)x[0] * x[0];
+        }
+    }
+    return best;
+}
+
+int run_stretch_benchmark(int seconds) {
+    constexpr unsigned int SAMPLE_RATE = 44100;
+    constexpr unsigned int CHANNELS    = 2;
+    constexpr unsigned int CALLBACK_FRAMES = 512;
+    constexpr float        TONE_HZ     = 440.0f;
+    constexpr double       BUDGET_PERCENT = 5.0;
+    seconds = std::max(seconds, 1);
+
+    // A tremolo'd tone over low noise: the tone's zero crossings give the
+    // pitch that should survive stretching, the noise keeps the seek honest
+    const size_t frames = (size_t)seconds * SAMPLE_RATE;
+    std::vector<float> source(frames * CHANNELS);
+    std::mt19937 rng(1234);
+    std::uniform_real_distribution<float> noise(-0.01f, 0.01f);
+    for (size_t i = 0; i < frames; i++) {
+        const float t = (float)i / SAMPLE_RATE;
+        const float tone = 0.5f * std::sin(2.0f * 3.14159265f * TONE_HZ * t)
+                         * (0.7f + 0.3f * std::sin(2.0f * 3.14159265f * 3.0f * t));
+        source[i * 2]     = tone + noise(rng);
+        source[i * 2 + 1] = tone + noise(rng);
+    }
+
+    std::cout << "Stretching " << seconds << "s of stereo " << SAMPLE_RATE << " Hz in "
+              << CALLBACK_FRAMES << "-frame callbacks (budget " << BUDGET_PERCENT << "% of one core)\n";
+
+    TimeStretch stretch(CHANNELS, SAMPLE_RATE);
+    std::vector<float> block((size_t)CALLBACK_FRAMES * CHANNELS);
+    std::vector<float> left;
+    int status = 0;
+
+    for (float speed : {0.5f, 0.75f, 0.9f, 1.0f, 1.25f}) {
+        stretch.reset(0.0);
+        left.clear();
+        left.reserve((size_t)(frames / speed) + CALLBACK_FRAMES);
+        size_t fed = 0;
+        double busy_ns = 0.0;
+
+        while (true) {
+            auto start = std::chrono::steady_clock::now();
+            unsigned int produced = 0;
+            bool exhausted = false;
+            while (produced < CALLBACK_FRAMES) {
+                unsigned int n = stretch.read(block.data() + (size_t)produced * CHANNELS, CALLBACK_FRAMES - produced, speed);
+                produced += n;
+                if (n > 0) continue;
+                unsigned int space = 0;
+                float* dst = stretch.input_space(space);
+                unsigned int take = (unsigned int)std::min<size_t>(space, frames - fed);
+                if (take == 0) { exhausted = true; break; }
+                std::memcpy(dst, source.data() + fed * CHANNELS, (size_t)take * CHANNELS * sizeof(float));
+                stretch.commit_input(take);
+                fed += take;
+            }
+            busy_ns += std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+            for (unsigned int i = 0; i < produced; i++) left.push_back(block[(size_t)i * CHANNELS]);
+            if (exhausted) break;
+        }
+
+        const double output_seconds = (double)left.size() / SAMPLE_RATE;
+        const double core_percent   = output_seconds > 0.0 ? busy_ns / 1e7 / output_seconds : 0.0;
+        const double expected       = (double)seconds / speed;
+
+        size_t crossings = 0;
+        for (size_t i = 1; i < left.size(); i++) {
+            if ((left[i - 1] < 0.0f) != (left[i] < 0.0f)) crossings++;
+        }
+        const double pitch_hz = output_seconds > 0.0 ? crossings / 2.0 / output_seconds : 0.0;
+
+        std::cout << std::fixed << std::setprecision(2)
+                  << "  speed " << std::setw(4) << speed
+                  << std::setprecision(1)
+                  << std::setw(9) << output_seconds << " s out (expected " << expected << ")"
+                  << std::setprecision(3)
+                  << std::setw(9) << core_percent << "% core"
+                  << std::setprecision(1)
+                  << "   pitch " << pitch_hz << " Hz\n";
+
+        if (core_percent > BUDGET_PERCENT) {
+            std::cerr << "Error: speed " << speed << " needs " << core_percent << "% of a core\n";
+            status = 1;
+        }
+        if (std::abs(output_seconds - expected) > 0.02 * expected || std::abs(pitch_hz - TONE_HZ) > 0.02 * TONE_HZ) {
+            std::cerr << "Error: speed " << speed << " output is off in length or pitch\n";
+            status = 1;
+        }
+    }
+    return status;
+}
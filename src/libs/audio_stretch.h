@@ -0,0 +1,77 @@
+#pragma once
+
+#include <vector>
+
+// Changes playback speed without changing pitch (WSOLA). The input is cut
+// into overlapping sequences; each new sequence is taken from wherever,
+// within a short seek window around its nominal position, it lines up best
+// with the tail of the previous one, and the two are crossfaded. Output
+// runs at the input's rate and channel count.
+//
+// All buffers are sized in the constructor, so reset/read/commit_input
+// never allocate and are safe on the audio thread.
+class TimeStretch {
+public:
+    static constexpr float MAX_SPEED = 4.0f;
+
+    TimeStretch(unsigned int channels, unsigned int sample_rate);
+
+    TimeStretch(const TimeStretch&) = delete;
+    TimeStretch& operator=(const TimeStretch&) = delete;
+
+    // Drops everything buffered; the next input frame is source_frame
+    void reset(double source_frame);
+
+    // Where the caller writes the next input frames; frames is set to how
+    // many fit. commit_input then hands over the ones actually written.
+    float* input_space(unsigned int& frames);
+    void   commit_input(unsigned int frames);
+
+    // Writes up to frames interleaved frames at speed (clamped to
+    // [1/MAX_SPEED, MAX_SPEED]). Returns fewer when more input is needed.
+    unsigned int read(float* out, unsigned int frames, float speed);
+
+    // Source frame the next output frame corresponds to
+    double position() const { return segment_position + out_read * segment_speed; }
+
+    // For handing playback back to a plain reader without a gap: writes up
+    // to frames of what is still held, unstretched. That is the rest of
+    // the current sequence, then the buffered input that continues it.
+    // Returns fewer once empty; drain_position() is then the source frame
+    // the reader carries on from.
+    unsigned int drain(float* out, unsigned int frames);
+    double drain_position() const { return out_read < out_frames ? position() : resume_frame; }
+
+    unsigned int get_channels() const { return channels; }
+
+private:
+    unsigned int channels;
+    unsigned int sequence;   // frames per analysis sequence
+    unsigned int overlap;    // crossfade length
+    unsigned int seek;       // search window, centred on the nominal position
+
+    std::vector<float> input;       // interleaved, input[0] is source frame input_start
+    unsigned int       input_frames = 0;
+    double             input_start = 0.0;
+    double             nominal = 0.0;   // where the next sequence should start
+    bool               has_tail = false;
+
+    std::vector<float> tail;        // last overlap frames of the previous sequence
+    std::vector<float> tail_mono;
+    std::vector<float> input_mono;  // downmix of the seek window, for matching
+
+    std::vector<float> output;      // one sequence of finished frames
+    unsigned int       out_frames = 0;
+    unsigned int       out_read = 0;
+    double             segment_position = 0.0;
+    double             segment_speed = 1.0;
+    double             resume_frame = 0.0;  // source frame straight after the current sequence
+
+    bool         next_sequence(float speed);
+    unsigned int best_offset(unsigned int count);
+};
+
+// --bench-stretch: stretches synthetic 44.1kHz stereo at several speeds
+// and prints the share of one core each needs in real time. Returns a
+// process exit code (non-zero past the 5% budget).
+int run_stretch_benchmark(int seconds);
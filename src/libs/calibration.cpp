@@ -0,0 +1,100 @@
+#include "calibration.h"
+#include <algorithm>
+#include <cmath>
+#include <deque>
+
+static constexpr double Z_95 = 1.959964;
+static constexpr double TRIM_FRACTION = 0.2;
+
+static constexpr size_t RELIABLE_MIN_SAMPLES  = 40;
+static constexpr double RELIABLE_MAX_CI_MS    = 8.0;   // full width of the median's interval
+static constexpr double RELIABLE_MAX_SPREAD_MS = 4.0;  // median vs trimmed mean
+
+// Plays pooled by recent_offset_estimate, and the fewest hits a play
+// needs to count at all
+static constexpr size_t RECENT_PLAYS = 8;
+static constexpr size_t RECENT_MIN_PLAY_SAMPLES = 20;
+
+static std::deque<std::vector<double>> recent_plays;
+
+int OffsetEstimate::suggested_offset() const {
+    return (int)std::lround(median_ms);
+}
+
+bool OffsetEstimate::reliable() const {
+    return samples >= RELIABLE_MIN_SAMPLES &&
+           median_high_ms - median_low_ms <= RELIABLE_MAX_CI_MS &&
+           std::abs(median_ms - trimmed_mean_ms) <= RELIABLE_MAX_SPREAD_MS;
+}
+
+// Student's t 97.5% quantile, by the Cornish-Fisher expansion around z;
+// within 1% of the table from 5 degrees of freedom up
+static double t_quantile_95(double df) {
+    if (df < 1.0) df = 1.0;
+    const double z3 = Z_95 * Z_95 * Z_95;
+    const double z5 = z3 * Z_95 * Z_95;
+    return Z_95 + (z3 + Z_95) / (4.0 * df) + (5.0 * z5 + 16.0 * z3 + 3.0 * Z_95) / (96.0 * df * df);
+}
+
+OffsetEstimate estimate_offset(std::vector<double> samples) {
+    OffsetEstimate est;
+    const size_t n = samples.size();
+    est.samples = n;
+    if (n == 0) return est;
+    std::sort(samples.begin(), samples.end());
+
+    est.median_ms = (n % 2 == 0) ? (samples[n / 2 - 1] + samples[n / 2]) / 2.0 : samples[n / 2];
+
+    // The median's interval runs between the order statistics a binomial
+    // (n, 1/2) count puts 1.96 standard deviations either side of n/2
+    const double half_width = Z_95 * std::sqrt((double)n) / 2.0;
+    const long lo = std::max(0L, (long)std::floor(n / 2.0 - half_width));
+    const long hi = std::min((long)n - 1, (long)std::ceil(n / 2.0 + half_width) - 1);
+    est.median_low_ms  = samples[(size_t)lo];
+    est.median_high_ms = samples[(size_t)std::max(hi, lo)];
+
+    // Trimmed mean, with its standard error from the winsorized variance
+    const size_t g = (size_t)std::floor(TRIM_FRACTION * n);
+    const size_t kept = n - 2 * g;
+    double sum = 0.0;
+    for (size_t i = g; i < n - g; i++) sum += samples[i];
+    est.trimmed_mean_ms = sum / kept;
+
+    if (kept < 2) {
+        est.trimmed_low_ms = est.trimmed_high_ms = est.trimmed_mean_ms;
+        return est;
+    }
+    const double low_w  = samples[g];
+    const double high_w = samples[n - g - 1];
+    double winsor_sum = 0.0;
+    for (double x : samples) winsor_sum += std::clamp(x, low_w, high_w);
+    const double winsor_mean = winsor_sum / n;
+    double winsor_ss = 0.0;
+    for (double x : samples) {
+        const double d = std::clamp(x, low_w, high_w) - winsor_mean;
+        winsor_ss += d * d;
+    }
+    const double winsor_sd = std::sqrt(winsor_ss / (n - 1));
+    const double se = winsor_sd / ((1.0 - 2.0 * TRIM_FRACTION) * std::sqrt((double)n));
+    const double t  = t_quantile_95((double)(kept - 1));
+    est.trimmed_low_ms  = est.trimmed_mean_ms - t * se;
+    est.trimmed_high_ms = est.trimmed_mean_ms + t * se;
+    return est;
+}
+
+void record_play_offsets(const std::vector<double>& samples) {
+    if (samples.size() < RECENT_MIN_PLAY_SAMPLES) return;
+    recent_plays.push_back(samples);
+    while (recent_plays.size() > RECENT_PLAYS) recent_plays.pop_front();
+}
+
+std::optional<OffsetEstimate> recent_offset_estimate() {
+    if (recent_plays.empty()) return std::nullopt;
+    std::vector<double> pooled;
+    for (const auto& play : recent_plays) pooled.insert(pooled.end(), play.begin(), play.end());
+    return estimate_offset(std::move(pooled));
+}
+
+void clear_recent_offsets() {
+    recent_plays.clear();
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstddef>
+#include <optional>
+#include <vector>
+
+// Robust estimate of general.audio_offset from a sample of the offsets
+// individual hits would have needed (see record_play_offsets). Both
+// estimators ignore the stray early/late hits that drag a plain mean.
+struct OffsetEstimate {
+    size_t samples = 0;
+    double median_ms = 0.0;
+    double median_low_ms = 0.0;     // 95% confidence interval, distribution-free
+    double median_high_ms = 0.0;
+    double trimmed_mean_ms = 0.0;   // mean of the middle 60%
+    double trimmed_low_ms = 0.0;    // 95% confidence interval (Tukey-McLaughlin)
+    double trimmed_high_ms = 0.0;
+
+    int suggested_offset() const;
+
+    // Enough hits, a tight interval, and the two estimators agree
+    bool reliable() const;
+};
+
+// Empty samples give an estimate with samples == 0
+OffsetEstimate estimate_offset(std::vector<double> samples);
+
+// Offsets from recent plays, kept for the session and pooled across the
+// last few songs. Game thread only.
+void record_play_offsets(const std::vector<double>& samples);
+std::optional<OffsetEstimate> recent_offset_estimate();
+void clear_recent_offsets();
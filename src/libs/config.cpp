@@ -198,6 +198,14 @@ Config get_config() {
     Config config{};
 
     config.general.fps_counter = config_file["general"]["fps_counter"].value_or(false);
+    config.general.audio_stats = config_file["general"]["audio_stats"].value_or(false);
+    config.general.input_thread_hitsounds = config_file["general"]["input_thread_hitsounds"].value_or(false);
+    config.general.input_latency_stats = config_file["general"]["input_latency_stats"].value_or(false);
+    config.general.evdev_input = config_file["general"]["evdev_input"].value_or(true);
+    config.general.evdev_keyboard = config_file["general"]["evdev_keyboard"].value_or(false);
+    config.general.sim_tick_hz = config_file["general"]["sim_tick_hz"].value_or(0);
+    config.general.profile_on_exit = config_file["general"]["profile_on_exit"].value_or(false);
+    config.general.save_replays = config_file["general"]["save_replays"].value_or(false);
     config.general.audio_offset = config_file["general"]["audio_offset"].value_or(0);
     config.general.visual_offset = config_file["general"]["visual_offset"].value_or(0);
     config.general.language = config_file["general"]["language"].value_or("en");
@@ -235,6 +243,7 @@ Config get_config() {
     config.keys.pause_key = getKeyCode(config_file["keys"]["pause_key"].value_or("p"));
     config.keys.back_key = getKeyCode(config_file["keys"]["back_key"].value_or("escape"));
     config.keys.restart_key = getKeyCode(config_file["keys"]["restart_key"].value_or("r"));
+    config.keys.profile_key = getKeyCode(config_file["keys"]["profile_key"].value_or("f9"));
 
     // Parse keys_1p
     if (auto left_kat = config_file["keys_1p"]["left_kat"].as_array()) {
@@ -293,6 +302,10 @@ Config get_config() {
     config.audio.device_type = config_file["audio"]["device_type"].value_or(0);
     config.audio.sample_rate = config_file["audio"]["sample_rate"].value_or(44100);
     config.audio.buffer_size = config_file["audio"]["buffer_size"].value_or(512);
+    config.audio.pcm_cache_mb = config_file["audio"]["pcm_cache_mb"].value_or(0);
+    config.audio.pcm_cache_dir = config_file["audio"]["pcm_cache_dir"].value_or("cache/pcm");
+    config.audio.render_path = config_file["audio"]["render_path"].value_or("render.wav");
+    config.audio.render_speed = config_file["audio"]["render_speed"].value_or(1.0);
 
     // Parse volume
     config.volume.sound = config_file["volume"]["sound"].value_or(1.0);
@@ -320,6 +333,14 @@ void save_config(const Config& config) {
     // General
     config_table.insert("general", toml::table{
         {"fps_counter", config.general.fps_counter},
+        {"audio_stats", config.general.audio_stats},
+        {"input_thread_hitsounds", config.general.input_thread_hitsounds},
+        {"input_latency_stats", config.general.input_latency_stats},
+        {"evdev_input", config.general.evdev_input},
+        {"evdev_keyboard", config.general.evdev_keyboard},
+        {"sim_tick_hz", config.general.sim_tick_hz},
+        {"profile_on_exit", config.general.profile_on_exit},
+        {"save_replays", config.general.save_replays},
         {"audio_offset", config.general.audio_offset},
         {"visual_offset", config.general.visual_offset},
         {"language", config.general.language},
@@ -361,7 +382,8 @@ void save_config(const Config& config) {
         {"borderless_key", getKeyString(config.keys.borderless_key)},
         {"pause_key", getKeyString(config.keys.pause_key)},
         {"back_key", getKeyString(config.keys.back_key)},
-        {"restart_key", getKeyString(config.keys.restart_key)}
+        {"restart_key", getKeyString(config.keys.restart_key)},
+        {"profile_key", getKeyString(config.keys.profile_key)}
     });
 
     // Keys 1P
@@ -422,7 +444,11 @@ void save_config(const Config& config) {
     config_table.insert("audio", toml::table{
         {"device_type", config.audio.device_type},
         {"sample_rate", config.audio.sample_rate},
-        {"buffer_size", config.audio.buffer_size}
+        {"buffer_size", config.audio.buffer_size},
+        {"pcm_cache_mb", config.audio.pcm_cache_mb},
+        {"pcm_cache_dir", config.audio.pcm_cache_dir},
+        {"render_path", config.audio.render_path},
+        {"render_speed", config.audio.render_speed}
     });
 
     // Volume
@@ -8,6 +8,7 @@ namespace fs = std::filesystem;
 
 struct GeneralConfig {
     bool fps_counter;
+    bool audio_stats;             // mixer timing/xrun overlay under the FPS counter
     int audio_offset;
     int visual_offset;
     std::string language;
@@ -24,6 +25,13 @@ struct GeneralConfig {
     int player_1_id;
     int player_2_id;
     bool touch_input;
+    bool input_thread_hitsounds;  // play drum hitsounds from the input thread
+    bool input_latency_stats;     // log event-to-judge input latency per song
+    bool evdev_input;             // Linux: read HID joysticks from /dev/input directly
+    bool evdev_keyboard;          // Linux: read keyboards from /dev/input directly too
+    int sim_tick_hz;              // judge on a fixed-rate thread at this rate (0 = per frame)
+    bool profile_on_exit;         // write a profiler trace at shutdown (profiler builds only)
+    bool save_replays;            // write each finished play's input to Replays/
 };
 
 struct NetworkConfig {
@@ -44,6 +52,7 @@ struct KeysConfig {
     int pause_key;
     int back_key;
     int restart_key;
+    int profile_key;              // write a profiler trace (profiler builds only)
 };
 
 struct Keys1PConfig {
@@ -70,7 +79,11 @@ struct GamepadConfig {
 struct AudioConfig {
     int device_type;
     int sample_rate;
-    int buffer_size;
+    int buffer_size;              // frames per callback, 0 = calibrate on next start
+    int pcm_cache_mb;             // on-disk device-rate PCM cache budget, 0 = off
+    std::string pcm_cache_dir;
+    std::string render_path;      // file backend (device_type 12) output WAV
+    float render_speed;           // file backend: multiple of real time, 0 = only when pulled
 };
 
 struct VolumeConfig {
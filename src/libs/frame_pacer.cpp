@@ -0,0 +1,101 @@
+#include "frame_pacer.h"
+#include <algorithm>
+#include <cmath>
+#include <thread>
+#include <spdlog/spdlog.h>
+
+#if defined(__linux__) && !defined(__EMSCRIPTEN__)
+#include <sys/prctl.h>
+#endif
+
+// Weight of each new sleep in the overshoot estimate
+static constexpr double OVERSHOOT_ALPHA = 1.0 / 16.0;
+// Wake this many mean deviations before the learned overshoot
+static constexpr double MARGIN_DEVIATIONS = 4.0;
+static constexpr double MIN_MARGIN_US = 20.0;
+
+void FramePacer::set_period(clock::duration new_period) {
+    period = new_period;
+#if defined(__linux__) && !defined(__EMSCRIPTEN__)
+    // The default 50us timer slack is most of the overshoot on Linux
+    if (enabled()) prctl(PR_SET_TIMERSLACK, 1UL, 0UL, 0UL, 0UL);
+#endif
+    reset();
+}
+
+void FramePacer::reset() {
+    next_frame = clock::now();
+}
+
+FramePacer::clock::duration FramePacer::margin() const {
+    double margin_us = overshoot_mean_us + MARGIN_DEVIATIONS * overshoot_dev_us;
+    // Past half a frame there's no sleeping left worth doing (coarse
+    // timers); the yield loop then covers the rest
+    const double half_period_us = std::chrono::duration<double, std::micro>(period).count() / 2.0;
+    margin_us = std::clamp(margin_us, MIN_MARGIN_US, std::max(half_period_us, MIN_MARGIN_US));
+    return std::chrono::duration_cast<clock::duration>(std::chrono::duration<double, std::micro>(margin_us));
+}
+
+void FramePacer::learn_overshoot(double overshoot_us) {
+    overshoot_us = std::max(overshoot_us, 0.0);
+    const double deviation = std::abs(overshoot_us - overshoot_mean_us);
+    overshoot_mean_us += (overshoot_us - overshoot_mean_us) * OVERSHOOT_ALPHA;
+    overshoot_dev_us  += (deviation - overshoot_dev_us) * OVERSHOOT_ALPHA;
+}
+
+void FramePacer::wait() {
+    if (!enabled()) return;
+    next_frame += period;
+    auto now = clock::now();
+    if (next_frame <= now) {
+        // The frame itself overran; start the schedule again from here
+        // rather than rushing the next few
+        next_frame = now;
+        missed++;
+        return;
+    }
+
+    const clock::time_point wake_at = next_frame - margin();
+    if (wake_at > now) {
+        std::this_thread::sleep_until(wake_at);
+        now = clock::now();
+        learn_overshoot(std::chrono::duration<double, std::micro>(now - wake_at).count());
+    }
+
+    // Inside the margin, short sleeps aimed one deviation short of the
+    // usual overshoot, then yield the last stretch to other threads
+    const clock::duration close = std::chrono::duration_cast<clock::duration>(
+        std::chrono::duration<double, std::micro>(overshoot_mean_us + overshoot_dev_us));
+    while (now < next_frame) {
+        if (next_frame - now > close) std::this_thread::sleep_for(next_frame - now - close);
+        else std::this_thread::yield();
+        now = clock::now();
+    }
+    errors.record(std::chrono::duration<double, std::micro>(now - next_frame).count());
+}
+
+FramePacerStats FramePacer::stats() const {
+    FramePacerStats s;
+    s.frames       = errors.count;
+    s.missed       = missed;
+    s.histogram    = errors.buckets;
+    s.worst_us     = errors.worst_us;
+    s.mean_us      = errors.mean_us();
+    s.p50_us       = errors.percentile_us(0.50);
+    s.p99_us       = errors.percentile_us(0.99);
+    s.margin_us    = std::chrono::duration<double, std::micro>(margin()).count();
+    s.overshoot_us = overshoot_mean_us;
+    return s;
+}
+
+void FramePacer::reset_stats() {
+    errors.reset();
+    missed = 0;
+}
+
+std::string FramePacerStats::summary() const {
+    return fmt::format("Frame pacing: {} frames, {} late\n"
+                       "Start error mean {:.0f}us  p50 <{:.0f}us  p99 <{:.0f}us  worst {:.0f}us\n"
+                       "Wake margin {:.0f}us (sleep overshoot {:.0f}us)",
+                       frames, missed, mean_us, p50_us, p99_us, worst_us, margin_us, overshoot_us);
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "audio_stats.h"
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+struct FramePacerStats {
+    uint64_t frames = 0;          // frames that waited for their slot
+    uint64_t missed = 0;          // frames that were already late, no wait
+    double   mean_us = 0.0;       // how far past its slot a frame started
+    double   p50_us = 0.0;        // upper edge of the bucket holding the percentile
+    double   p99_us = 0.0;
+    double   worst_us = 0.0;
+    double   margin_us = 0.0;     // current early-wake margin
+    double   overshoot_us = 0.0;  // learned mean sleep overshoot
+    LatencyBuckets histogram{};
+
+    // One line per figure, for the log and the debug overlay
+    std::string summary() const;
+};
+
+// Frame limiter for target_fps. Sleeps most of the way to each frame's
+// slot, waking early by a margin learned from how late this machine's
+// sleeps actually return, then closes in with short sleeps and yields.
+// Nothing spins, so the core is free for the audio and input threads.
+// Main thread only.
+class FramePacer {
+public:
+    using clock = std::chrono::steady_clock;
+
+    // A period of zero or less turns pacing off
+    void set_period(clock::duration period);
+    bool enabled() const { return period.count() > 0; }
+
+    // Starts the schedule at now
+    void reset();
+
+    // Blocks until the next frame's slot
+    void wait();
+
+    FramePacerStats stats() const;
+    void reset_stats();
+
+private:
+    clock::duration   period{0};
+    clock::time_point next_frame = clock::now();
+
+    // Sleep overshoot, as an exponential moving mean and mean deviation
+    double overshoot_mean_us = 500.0;
+    double overshoot_dev_us  = 250.0;
+
+    LatencyHistogram errors;  // how late each waited frame started
+    uint64_t         missed = 0;
+
+    clock::duration margin() const;
+    void learn_overshoot(double overshoot_us);
+};
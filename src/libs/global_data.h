@@ -108,6 +108,8 @@ struct SessionData {
     std::string song_subtitle = "default_subtitle";
     bool song_subtitle_full_display = false;
     int genre_index = 0;
+    // Replay file to play back instead of reading the drums (--replay)
+    fs::path replay_path;
     ResultData result_data;
     DanResultData dan_result_data;
 };
@@ -1,6 +1,14 @@
 #include "input.h"
+#include "animation.h"
+#include "audio_stats.h"
+#include "input_evdev.h"
+#include "lockfree_queue.h"
+#include "profiler.h"
 #include "texture.h"
+#include <algorithm>
 #include <array>
+#include <chrono>
+#include <mutex>
 #include <unordered_set>
 
 #ifdef _WIN32
@@ -16,9 +24,9 @@
 std::atomic<bool> input_thread_running{true};
 std::thread input_thread;
 
+// Plain SDL joysticks (no gamepad mapping), opened here since raylib only
+// opens gamepads. Touched only from the event watch, on the main thread.
 static std::unordered_map<SDL_JoystickID, SDL_Joystick*> sdl_joysticks;
-// keyed by joy_id * 256 + button_index
-static std::unordered_map<int64_t, bool>  sdl_prev_button;
 // keyed by joy_id * 256 + axis_index
 static std::unordered_map<int64_t, float> sdl_prev_axis;
 
@@ -46,6 +54,7 @@ static void refresh_sdl_joysticks() {
 
     for (int i = 0; i < count; i++) {
         if (SDL_IsGamepad(ids[i])) continue; // already handled by raylib
+        if (evdev_owns_device(SDL_GetJoystickPathForID(ids[i]))) continue;
         if (!sdl_joysticks.count(ids[i])) {
             SDL_Joystick* joy = SDL_OpenJoystick(ids[i]);
             if (joy) {
@@ -59,117 +68,408 @@ static void refresh_sdl_joysticks() {
     SDL_free(ids);
 }
 
-std::mutex input_mutex;
-std::unordered_multiset<int> pressed_keys;
-std::unordered_multiset<int> released_keys;
-
 static const int TOUCH_L_KAT = 40001;
 static const int TOUCH_R_KAT = 40002;
 static const int TOUCH_L_DON = 40003;
 static const int TOUCH_R_DON = 40004;
 
+// Producers (polling thread, event watch) -> game thread
+static MpscQueue<InputEvent, 256> input_queue;
+
+// Game-thread side: events drained from the queue and not yet consumed,
+// oldest first. When a buffer is full the oldest entry goes, as a screen
+// that ignores a key would otherwise keep its presses forever.
+static constexpr size_t PENDING_EVENTS = 128;
+static std::array<InputEvent, PENDING_EVENTS> pending_presses;
+static size_t                                 pending_press_count = 0;
+static std::array<int, PENDING_EVENTS>        pending_releases;
+static size_t                                 pending_release_count = 0;
+
 static std::unordered_map<SDL_FingerID, int> touch_id_to_vkey;
 
 std::atomic<bool> touch_drum_pressed{false};
 
+#ifdef _WIN32
 static std::array<bool, 349> previous_key_states{};
-static std::array<bool, 18>  previous_gamepad_states{};
+#endif
 
-// Gamepad/joystick buttons and axes are folded into the key space at these
-// offsets (config stores the bare button number).
-static constexpr int GAMEPAD_VKEY_BASE = 10000;
-static constexpr int AXIS_VKEY_BASE    = 20000;
 static std::atomic<int> last_gamepad_vkey{0};
 
-bool is_input_key_pressed(const std::vector<int>& keys, const std::vector<int>& gamepad_buttons) {
+// SDL event timestamps count from SDL_Init; move them onto get_current_ms
+static double sdl_event_ms(Uint64 timestamp_ns) {
+    const Uint64 now_ns = SDL_GetTicksNS();
+    const double age_ms = timestamp_ns < now_ns ? (double)(now_ns - timestamp_ns) / 1e6 : 0.0;
+    return get_current_ms() - age_ms;
+}
 
-    for (int key : keys) {
-        if (check_key_pressed(key)) return true;
+#ifndef _WIN32
+// raylib's key code for an SDL scancode, matching what raylib's SDL
+// platform reports through IsKeyDown (0 for keys it has no code for)
+static int sdl_scancode_to_key(SDL_Scancode sc) {
+    if (sc >= SDL_SCANCODE_A && sc <= SDL_SCANCODE_Z) return ray::KEY_A + (sc - SDL_SCANCODE_A);
+    if (sc >= SDL_SCANCODE_1 && sc <= SDL_SCANCODE_9) return ray::KEY_ONE + (sc - SDL_SCANCODE_1);
+    if (sc >= SDL_SCANCODE_F1 && sc <= SDL_SCANCODE_F12) return ray::KEY_F1 + (sc - SDL_SCANCODE_F1);
+    if (sc >= SDL_SCANCODE_KP_1 && sc <= SDL_SCANCODE_KP_9) return ray::KEY_KP_1 + (sc - SDL_SCANCODE_KP_1);
+    switch (sc) {
+        case SDL_SCANCODE_0:            return ray::KEY_ZERO;
+        case SDL_SCANCODE_RETURN:       return ray::KEY_ENTER;
+        case SDL_SCANCODE_ESCAPE:       return ray::KEY_ESCAPE;
+        case SDL_SCANCODE_BACKSPACE:    return ray::KEY_BACKSPACE;
+        case SDL_SCANCODE_TAB:          return ray::KEY_TAB;
+        case SDL_SCANCODE_SPACE:        return ray::KEY_SPACE;
+        case SDL_SCANCODE_MINUS:        return ray::KEY_MINUS;
+        case SDL_SCANCODE_EQUALS:       return ray::KEY_EQUAL;
+        case SDL_SCANCODE_LEFTBRACKET:  return ray::KEY_LEFT_BRACKET;
+        case SDL_SCANCODE_RIGHTBRACKET: return ray::KEY_RIGHT_BRACKET;
+        case SDL_SCANCODE_BACKSLASH:    return ray::KEY_BACKSLASH;
+        case SDL_SCANCODE_SEMICOLON:    return ray::KEY_SEMICOLON;
+        case SDL_SCANCODE_APOSTROPHE:   return ray::KEY_APOSTROPHE;
+        case SDL_SCANCODE_GRAVE:        return ray::KEY_GRAVE;
+        case SDL_SCANCODE_COMMA:        return ray::KEY_COMMA;
+        case SDL_SCANCODE_PERIOD:       return ray::KEY_PERIOD;
+        case SDL_SCANCODE_SLASH:        return ray::KEY_SLASH;
+        case SDL_SCANCODE_CAPSLOCK:     return ray::KEY_CAPS_LOCK;
+        case SDL_SCANCODE_PRINTSCREEN:  return ray::KEY_PRINT_SCREEN;
+        case SDL_SCANCODE_SCROLLLOCK:   return ray::KEY_SCROLL_LOCK;
+        case SDL_SCANCODE_PAUSE:        return ray::KEY_PAUSE;
+        case SDL_SCANCODE_INSERT:       return ray::KEY_INSERT;
+        case SDL_SCANCODE_HOME:         return ray::KEY_HOME;
+        case SDL_SCANCODE_PAGEUP:       return ray::KEY_PAGE_UP;
+        case SDL_SCANCODE_DELETE:       return ray::KEY_DELETE;
+        case SDL_SCANCODE_END:          return ray::KEY_END;
+        case SDL_SCANCODE_PAGEDOWN:     return ray::KEY_PAGE_DOWN;
+        case SDL_SCANCODE_RIGHT:        return ray::KEY_RIGHT;
+        case SDL_SCANCODE_LEFT:         return ray::KEY_LEFT;
+        case SDL_SCANCODE_DOWN:         return ray::KEY_DOWN;
+        case SDL_SCANCODE_UP:           return ray::KEY_UP;
+        case SDL_SCANCODE_NUMLOCKCLEAR: return ray::KEY_NUM_LOCK;
+        case SDL_SCANCODE_KP_DIVIDE:    return ray::KEY_KP_DIVIDE;
+        case SDL_SCANCODE_KP_MULTIPLY:  return ray::KEY_KP_MULTIPLY;
+        case SDL_SCANCODE_KP_MINUS:     return ray::KEY_KP_SUBTRACT;
+        case SDL_SCANCODE_KP_PLUS:      return ray::KEY_KP_ADD;
+        case SDL_SCANCODE_KP_ENTER:     return ray::KEY_KP_ENTER;
+        case SDL_SCANCODE_KP_0:         return ray::KEY_KP_0;
+        case SDL_SCANCODE_KP_PERIOD:    return ray::KEY_KP_DECIMAL;
+        case SDL_SCANCODE_KP_EQUALS:    return ray::KEY_KP_EQUAL;
+        case SDL_SCANCODE_APPLICATION:  return ray::KEY_KB_MENU;
+        case SDL_SCANCODE_LCTRL:        return ray::KEY_LEFT_CONTROL;
+        case SDL_SCANCODE_LSHIFT:       return ray::KEY_LEFT_SHIFT;
+        case SDL_SCANCODE_LALT:         return ray::KEY_LEFT_ALT;
+        case SDL_SCANCODE_LGUI:         return ray::KEY_LEFT_SUPER;
+        case SDL_SCANCODE_RCTRL:        return ray::KEY_RIGHT_CONTROL;
+        case SDL_SCANCODE_RSHIFT:       return ray::KEY_RIGHT_SHIFT;
+        case SDL_SCANCODE_RALT:         return ray::KEY_RIGHT_ALT;
+        case SDL_SCANCODE_RGUI:         return ray::KEY_RIGHT_SUPER;
+        default:                        return 0;
     }
+}
+#endif
 
-    // Check gamepad buttons (offset by 10000)
-    if (gamepad_buttons.empty()) return false;
+// raylib's GamepadButton for an SDL gamepad button, which is the number
+// the config stores
+static int sdl_gamepad_button_to_raylib(Uint8 button) {
+    switch (button) {
+        case SDL_GAMEPAD_BUTTON_SOUTH:          return ray::GAMEPAD_BUTTON_RIGHT_FACE_DOWN;
+        case SDL_GAMEPAD_BUTTON_EAST:           return ray::GAMEPAD_BUTTON_RIGHT_FACE_RIGHT;
+        case SDL_GAMEPAD_BUTTON_WEST:           return ray::GAMEPAD_BUTTON_RIGHT_FACE_LEFT;
+        case SDL_GAMEPAD_BUTTON_NORTH:          return ray::GAMEPAD_BUTTON_RIGHT_FACE_UP;
+        case SDL_GAMEPAD_BUTTON_BACK:           return ray::GAMEPAD_BUTTON_MIDDLE_LEFT;
+        case SDL_GAMEPAD_BUTTON_GUIDE:          return ray::GAMEPAD_BUTTON_MIDDLE;
+        case SDL_GAMEPAD_BUTTON_START:          return ray::GAMEPAD_BUTTON_MIDDLE_RIGHT;
+        case SDL_GAMEPAD_BUTTON_LEFT_STICK:     return ray::GAMEPAD_BUTTON_LEFT_THUMB;
+        case SDL_GAMEPAD_BUTTON_RIGHT_STICK:    return ray::GAMEPAD_BUTTON_RIGHT_THUMB;
+        case SDL_GAMEPAD_BUTTON_LEFT_SHOULDER:  return ray::GAMEPAD_BUTTON_LEFT_TRIGGER_1;
+        case SDL_GAMEPAD_BUTTON_RIGHT_SHOULDER: return ray::GAMEPAD_BUTTON_RIGHT_TRIGGER_1;
+        case SDL_GAMEPAD_BUTTON_DPAD_UP:        return ray::GAMEPAD_BUTTON_LEFT_FACE_UP;
+        case SDL_GAMEPAD_BUTTON_DPAD_DOWN:      return ray::GAMEPAD_BUTTON_LEFT_FACE_DOWN;
+        case SDL_GAMEPAD_BUTTON_DPAD_LEFT:      return ray::GAMEPAD_BUTTON_LEFT_FACE_LEFT;
+        case SDL_GAMEPAD_BUTTON_DPAD_RIGHT:     return ray::GAMEPAD_BUTTON_LEFT_FACE_RIGHT;
+        default:                                return 0;
+    }
+}
 
-    for (int button : gamepad_buttons) {
-        if (check_key_pressed(10000 + button)) return true;
+static void push_press(int key, double time_ms) {
+    InputEvent event;
+    event.key     = key;
+    event.time_ms = time_ms;
+    input_queue.push(event);
+}
+
+static void push_release(int key) {
+    InputEvent event;
+    event.key     = key;
+    event.pressed = false;
+    input_queue.push(event);
+}
+
+// Key -> drum actions, flattened over the parts of the key space that are
+// ever bound: keyboard, controller buttons, controller axes, touch zones.
+// Only the game thread reads or writes it.
+static constexpr int BINDING_KEYS    = 349;
+static constexpr int BINDING_BUTTONS = 10000;   // 10000..19999
+static constexpr int BINDING_AXES    = 64;      // 20000..20063
+static constexpr int BINDING_SLOTS   = BINDING_KEYS + BINDING_BUTTONS + BINDING_AXES + 4;
+struct DrumBinding {
+    uint8_t actions_1p = 0;
+    uint8_t actions_2p = 0;
+};
+static std::array<DrumBinding, BINDING_SLOTS> drum_bindings{};
+static bool drum_bindings_built = false;
+
+// The same actions for the thread that plays input hitsounds, 1P in the
+// low nibble and 2P in the high one
+static std::array<std::atomic<uint8_t>, BINDING_SLOTS> hitsound_bindings{};
+
+static int binding_slot(int vkey) {
+    if (vkey >= 0 && vkey < BINDING_KEYS) return vkey;
+    if (vkey >= GAMEPAD_VKEY_BASE && vkey < GAMEPAD_VKEY_BASE + BINDING_BUTTONS) {
+        return BINDING_KEYS + (vkey - GAMEPAD_VKEY_BASE);
     }
-    return false;
+    if (vkey >= AXIS_VKEY_BASE && vkey < AXIS_VKEY_BASE + BINDING_AXES) {
+        return BINDING_KEYS + BINDING_BUTTONS + (vkey - AXIS_VKEY_BASE);
+    }
+    if (vkey >= TOUCH_L_KAT && vkey <= TOUCH_R_DON) {
+        return BINDING_KEYS + BINDING_BUTTONS + BINDING_AXES + (vkey - TOUCH_L_KAT);
+    }
+    return -1;
 }
 
-bool is_l_don_pressed(PlayerNum player_num) {
-    if (player_num == PlayerNum::P1) {
-        if (is_input_key_pressed(global_data.config->keys_1p.left_don, global_data.config->gamepad_1p.left_don)) return true;
-        return check_key_pressed(TOUCH_L_DON);
-    } else if (player_num == PlayerNum::P2) {
-        return is_input_key_pressed(global_data.config->keys_2p.left_don, global_data.config->gamepad_2p.left_don);
-    } else if (player_num != PlayerNum::ALL) {
-        return false;
+static void bind_drum(int vkey, uint8_t action, bool second_player) {
+    int slot = binding_slot(vkey);
+    if (slot < 0) return;
+    (second_player ? drum_bindings[slot].actions_2p : drum_bindings[slot].actions_1p) |= action;
+}
+
+void rebuild_input_bindings() {
+    drum_bindings.fill(DrumBinding{});
+    const Config* c = global_data.config;
+    auto bind_side = [](const std::vector<int>& keys, const std::vector<int>& buttons, uint8_t action, bool p2) {
+        for (int key : keys) bind_drum(key, action, p2);
+        for (int button : buttons) bind_drum(GAMEPAD_VKEY_BASE + button, action, p2);
+    };
+    bind_side(c->keys_1p.left_don,  c->gamepad_1p.left_don,  DRUM_L_DON, false);
+    bind_side(c->keys_1p.right_don, c->gamepad_1p.right_don, DRUM_R_DON, false);
+    bind_side(c->keys_1p.left_kat,  c->gamepad_1p.left_kat,  DRUM_L_KAT, false);
+    bind_side(c->keys_1p.right_kat, c->gamepad_1p.right_kat, DRUM_R_KAT, false);
+    bind_side(c->keys_2p.left_don,  c->gamepad_2p.left_don,  DRUM_L_DON, true);
+    bind_side(c->keys_2p.right_don, c->gamepad_2p.right_don, DRUM_R_DON, true);
+    bind_side(c->keys_2p.left_kat,  c->gamepad_2p.left_kat,  DRUM_L_KAT, true);
+    bind_side(c->keys_2p.right_kat, c->gamepad_2p.right_kat, DRUM_R_KAT, true);
+    // The touch drum always plays as 1P
+    bind_drum(TOUCH_L_DON, DRUM_L_DON, false);
+    bind_drum(TOUCH_R_DON, DRUM_R_DON, false);
+    bind_drum(TOUCH_L_KAT, DRUM_L_KAT, false);
+    bind_drum(TOUCH_R_KAT, DRUM_R_KAT, false);
+    for (int slot = 0; slot < BINDING_SLOTS; slot++) {
+        hitsound_bindings[slot].store((uint8_t)(drum_bindings[slot].actions_1p | (drum_bindings[slot].actions_2p << 4)),
+                                      std::memory_order_relaxed);
     }
-    std::vector<int> keys = global_data.config->keys_1p.left_don;
-    const auto& keys_2p = global_data.config->keys_2p.left_don;
-    keys.insert(keys.end(), keys_2p.begin(), keys_2p.end());
-    std::vector<int> gamepad_buttons = global_data.config->gamepad_1p.left_don;
-    const auto& gp2 = global_data.config->gamepad_2p.left_don;
-    gamepad_buttons.insert(gamepad_buttons.end(), gp2.begin(), gp2.end());
-    if (is_input_key_pressed(keys, gamepad_buttons)) return true;
-    return check_key_pressed(TOUCH_L_DON);
+    drum_bindings_built = true;
 }
 
-bool is_r_don_pressed(PlayerNum player_num) {
-    if (player_num == PlayerNum::P1) {
-        if (is_input_key_pressed(global_data.config->keys_1p.right_don, global_data.config->gamepad_1p.right_don)) return true;
-        return check_key_pressed(TOUCH_R_DON);
-    } else if (player_num == PlayerNum::P2) {
-        return is_input_key_pressed(global_data.config->keys_2p.right_don, global_data.config->gamepad_2p.right_don);
-    } else if (player_num != PlayerNum::ALL) {
-        return false;
+// While a simulation thread judges drums alongside the game thread, both
+// consume the pending buffers and serialise on this. Otherwise there is a
+// single consumer and no lock is taken.
+static std::atomic<bool> consumers_shared{false};
+static std::mutex        consumer_mutex;
+
+static std::unique_lock<std::mutex> lock_consumers() {
+    if (!consumers_shared.load(std::memory_order_acquire)) return {};
+    return std::unique_lock<std::mutex>(consumer_mutex);
+}
+
+void set_input_consumers_shared(bool shared) {
+    consumers_shared.store(shared, std::memory_order_release);
+}
+
+// Moves everything queued into the pending buffers
+static void drain_input_queue() {
+    if (!drum_bindings_built) rebuild_input_bindings();
+    InputEvent event;
+    while (input_queue.pop(event)) {
+        if (event.pressed) {
+            int slot = binding_slot(event.key);
+            if (slot >= 0) {
+                event.actions_1p = drum_bindings[slot].actions_1p;
+                event.actions_2p = drum_bindings[slot].actions_2p;
+            }
+            if (pending_press_count == PENDING_EVENTS) {
+                std::move(pending_presses.begin() + 1, pending_presses.end(), pending_presses.begin());
+                pending_press_count--;
+            }
+            pending_presses[pending_press_count++] = event;
+        } else {
+            if (pending_release_count == PENDING_EVENTS) {
+                std::move(pending_releases.begin() + 1, pending_releases.end(), pending_releases.begin());
+                pending_release_count--;
+            }
+            pending_releases[pending_release_count++] = event.key;
+        }
     }
-    std::vector<int> keys = global_data.config->keys_1p.right_don;
-    const auto& keys_2p = global_data.config->keys_2p.right_don;
-    keys.insert(keys.end(), keys_2p.begin(), keys_2p.end());
-    std::vector<int> gamepad_buttons = global_data.config->gamepad_1p.right_don;
-    const auto& gp2 = global_data.config->gamepad_2p.right_don;
-    gamepad_buttons.insert(gamepad_buttons.end(), gp2.begin(), gp2.end());
-    if (is_input_key_pressed(keys, gamepad_buttons)) return true;
-    return check_key_pressed(TOUCH_R_DON);
 }
 
-bool is_l_kat_pressed(PlayerNum player_num) {
-    if (player_num == PlayerNum::P1) {
-        if (is_input_key_pressed(global_data.config->keys_1p.left_kat, global_data.config->gamepad_1p.left_kat)) return true;
-        return check_key_pressed(TOUCH_L_KAT);
-    } else if (player_num == PlayerNum::P2) {
-        return is_input_key_pressed(global_data.config->keys_2p.left_kat, global_data.config->gamepad_2p.left_kat);
-    } else if (player_num != PlayerNum::ALL) {
-        return false;
+// Event-to-consume latency of every press the game takes, when
+// general.input_latency_stats is on. Game thread only.
+static LatencyHistogram input_latency;
+
+static void record_input_latency(double latency_ms) {
+    input_latency.record(latency_ms * 1000.0);
+}
+
+std::string input_latency_summary() {
+    if (input_latency.count == 0) return "Input latency: no presses recorded";
+    std::string buckets;
+    for (size_t i = 0; i < LATENCY_BUCKETS; i++) {
+        if (input_latency.buckets[i] == 0) continue;
+        buckets += fmt::format(" <{}us:{}", 2ull << i, input_latency.buckets[i]);
+    }
+    return fmt::format("Input latency: {} presses, mean {:.2f} ms, p50 <{:.2f} ms, p99 <{:.2f} ms, worst {:.2f} ms |{}",
+                       input_latency.count, input_latency.mean_us() / 1000.0,
+                       input_latency.percentile_us(0.50) / 1000.0, input_latency.percentile_us(0.99) / 1000.0,
+                       input_latency.worst_us / 1000.0, buckets);
+}
+
+void reset_input_latency() {
+    input_latency.reset();
+}
+
+// Removes the oldest pending press that matches, returning its time
+template <typename Match>
+static std::optional<double> take_pending_press(Match match) {
+    auto lock = lock_consumers();
+    drain_input_queue();
+    size_t oldest = pending_press_count;
+    for (size_t i = 0; i < pending_press_count; i++) {
+        if (!match(pending_presses[i])) continue;
+        if (oldest == pending_press_count || pending_presses[i].time_ms < pending_presses[oldest].time_ms) oldest = i;
     }
-    std::vector<int> keys = global_data.config->keys_1p.left_kat;
-    const auto& keys_2p = global_data.config->keys_2p.left_kat;
-    keys.insert(keys.end(), keys_2p.begin(), keys_2p.end());
-    std::vector<int> gamepad_buttons = global_data.config->gamepad_1p.left_kat;
-    const auto& gp2 = global_data.config->gamepad_2p.left_kat;
-    gamepad_buttons.insert(gamepad_buttons.end(), gp2.begin(), gp2.end());
-    if (is_input_key_pressed(keys, gamepad_buttons)) return true;
-    return check_key_pressed(TOUCH_L_KAT);
+    if (oldest == pending_press_count) return std::nullopt;
+    double time_ms = pending_presses[oldest].time_ms;
+    if (global_data.config->general.input_latency_stats) record_input_latency(get_current_ms() - time_ms);
+    std::move(pending_presses.begin() + oldest + 1, pending_presses.begin() + pending_press_count,
+              pending_presses.begin() + oldest);
+    pending_press_count--;
+    return time_ms;
 }
 
-bool is_r_kat_pressed(PlayerNum player_num) {
+static bool take_drum_press(PlayerNum player_num, uint8_t action, double* press_ms) {
+    std::optional<double> press;
     if (player_num == PlayerNum::P1) {
-        if (is_input_key_pressed(global_data.config->keys_1p.right_kat, global_data.config->gamepad_1p.right_kat)) return true;
-        return check_key_pressed(TOUCH_R_KAT);
+        press = take_pending_press([action](const InputEvent& e) { return (e.actions_1p & action) != 0; });
     } else if (player_num == PlayerNum::P2) {
-        return is_input_key_pressed(global_data.config->keys_2p.right_kat, global_data.config->gamepad_2p.right_kat);
-    } else if (player_num != PlayerNum::ALL) {
-        return false;
+        press = take_pending_press([action](const InputEvent& e) { return (e.actions_2p & action) != 0; });
+    } else if (player_num == PlayerNum::ALL) {
+        press = take_pending_press([action](const InputEvent& e) { return ((e.actions_1p | e.actions_2p) & action) != 0; });
+    }
+    if (!press) return false;
+    if (press_ms) *press_ms = *press;
+    return true;
+}
+
+// Input-thread hitsounds, one entry per PlayerNum::ALL/P1/P2. Written by
+// the game thread in arm_input_hitsounds, read by whichever thread polls.
+// A SoundId is packed as slot << 32 | generation.
+struct ArmedHitsounds {
+    std::atomic<uint64_t> don{0};
+    std::atomic<uint64_t> kat{0};
+    std::atomic<int64_t>  expires_ns{0};  // steady_clock
+};
+// Long enough to ride out a slow frame, short enough that a pause menu or
+// screen change never plays a stray hit
+static constexpr auto HITSOUND_ARM_LEASE = std::chrono::milliseconds(100);
+static std::array<ArmedHitsounds, 3> armed_hitsounds;
+
+static uint64_t pack_sound(SoundId id) {
+    return ((uint64_t)id.slot << 32) | id.generation;
+}
+
+static SoundId unpack_sound(uint64_t packed) {
+    return SoundId{(uint32_t)(packed >> 32), (uint32_t)packed};
+}
+
+static int64_t steady_now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static bool take_press(int key, double* press_ms) {
+    std::optional<double> press = take_key_press(key);
+    if (!press) return false;
+    if (press_ms) *press_ms = *press;
+    return true;
+}
+
+bool is_input_key_pressed(const std::vector<int>& keys, const std::vector<int>& gamepad_buttons, double* press_ms) {
+
+    for (int key : keys) {
+        if (take_press(key, press_ms)) return true;
+    }
+
+    // Check gamepad buttons (offset by 10000)
+    if (gamepad_buttons.empty()) return false;
+
+    for (int button : gamepad_buttons) {
+        if (take_press(10000 + button, press_ms)) return true;
+    }
+    return false;
+}
+
+bool is_l_don_pressed(PlayerNum player_num, double* press_ms) {
+    return take_drum_press(player_num, DRUM_L_DON, press_ms);
+}
+
+bool is_r_don_pressed(PlayerNum player_num, double* press_ms) {
+    return take_drum_press(player_num, DRUM_R_DON, press_ms);
+}
+
+bool is_l_kat_pressed(PlayerNum player_num, double* press_ms) {
+    return take_drum_press(player_num, DRUM_L_KAT, press_ms);
+}
+
+bool is_r_kat_pressed(PlayerNum player_num, double* press_ms) {
+    return take_drum_press(player_num, DRUM_R_KAT, press_ms);
+}
+
+bool input_hitsounds_enabled() {
+    return global_data.config->general.input_thread_hitsounds;
+}
+
+void arm_input_hitsounds(PlayerNum player_num, SoundId don, SoundId kat) {
+    if (player_num != PlayerNum::ALL && player_num != PlayerNum::P1 && player_num != PlayerNum::P2) return;
+    if (!drum_bindings_built) rebuild_input_bindings();
+
+    // The sounds only change with the screen; every other frame this is
+    // just the lease moving on
+    ArmedHitsounds& armed = armed_hitsounds[(int)player_num];
+    if (armed.don.load(std::memory_order_relaxed) != pack_sound(don)) armed.don.store(pack_sound(don), std::memory_order_relaxed);
+    if (armed.kat.load(std::memory_order_relaxed) != pack_sound(kat)) armed.kat.store(pack_sound(kat), std::memory_order_relaxed);
+    const int64_t lease_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(HITSOUND_ARM_LEASE).count();
+    armed.expires_ns.store(steady_now_ns() + lease_ns, std::memory_order_release);
+}
+
+// Called for every new press by whichever thread picked it up.
+// The play goes straight onto the mixer's voice queue. play_sound takes
+// the engine's lock shared, so it only waits while a sound or music stream
+// is being stored or unloaded, which never holds it across file I/O.
+static void play_input_hitsound(int key) {
+    const int slot = binding_slot(key);
+    if (slot < 0) return;
+    const uint8_t actions = hitsound_bindings[slot].load(std::memory_order_relaxed);
+    if (actions == 0) return;
+    const int64_t now = steady_now_ns();
+    for (int player = 0; player < (int)armed_hitsounds.size(); player++) {
+        const ArmedHitsounds& armed = armed_hitsounds[player];
+        if (now >= armed.expires_ns.load(std::memory_order_acquire)) continue;
+        // The same keys the is_*_pressed(player_num) checks consume
+        uint8_t drums = actions & 0x0F;
+        if (player == (int)PlayerNum::ALL) drums |= actions >> 4;
+        else if (player == (int)PlayerNum::P2) drums = actions >> 4;
+        if (drums & (DRUM_L_DON | DRUM_R_DON)) {
+            audio.play_sound(unpack_sound(armed.don.load(std::memory_order_relaxed)), VolumePreset::HITSOUND);
+        } else if (drums & (DRUM_L_KAT | DRUM_R_KAT)) {
+            audio.play_sound(unpack_sound(armed.kat.load(std::memory_order_relaxed)), VolumePreset::HITSOUND);
+        }
     }
-    std::vector<int> keys = global_data.config->keys_1p.right_kat;
-    const auto& keys_2p = global_data.config->keys_2p.right_kat;
-    keys.insert(keys.end(), keys_2p.begin(), keys_2p.end());
-    std::vector<int> gamepad_buttons = global_data.config->gamepad_1p.right_kat;
-    const auto& gp2 = global_data.config->gamepad_2p.right_kat;
-    gamepad_buttons.insert(gamepad_buttons.end(), gp2.begin(), gp2.end());
-    if (is_input_key_pressed(keys, gamepad_buttons)) return true;
-    return check_key_pressed(TOUCH_R_KAT);
 }
 
 #ifdef _WIN32
@@ -265,7 +565,7 @@ static int touch_quadrant_vkey(ray::Vector2 pos, int sw, int sh) {
     return left ? TOUCH_L_KAT : TOUCH_R_KAT;
 }
 
-static bool touch_watch_registered = false;
+static bool input_watch_registered = false;
 
 static int char_to_raylib_key(unsigned char c) {
     if (c >= 'a' && c <= 'z') return c - 32;
@@ -273,7 +573,63 @@ static int char_to_raylib_key(unsigned char c) {
     return 0;
 }
 
-static bool SDLCALL touch_event_watch(void* /*userdata*/, SDL_Event* event) {
+void queue_input_press(int vkey, double time_ms) {
+    if (global_data.input_locked) return;
+    // Newest controller press, kept apart from the event queue so the
+    // keybind screen can read it: the queued press is consumed by whatever
+    // navigates the menu before the option box ever sees it.
+    if (vkey >= GAMEPAD_VKEY_BASE && vkey < AXIS_VKEY_BASE) {
+        last_gamepad_vkey.store(vkey, std::memory_order_relaxed);
+    }
+    play_input_hitsound(vkey);
+    push_press(vkey, time_ms);
+}
+
+void queue_input_release(int vkey) {
+    push_release(vkey);
+}
+
+// Controllers the evdev backend reads itself; SDL's events for them would
+// be duplicates
+static bool claimed_by_evdev(SDL_JoystickID id) {
+    return evdev_owns_device(SDL_GetJoystickPathForID(id));
+}
+
+static void joystick_axis_moved(const SDL_JoyAxisEvent& e) {
+    constexpr float JOYSTICK_AXIS_THRESHOLD = 0.5f;
+    if (e.axis >= 8) return;
+    const int64_t state_key = (int64_t)e.which * 256 + e.axis;
+    const float value = e.value / 32767.0f;
+    const float prev  = sdl_prev_axis[state_key];
+    sdl_prev_axis[state_key] = value;
+
+    const int key_pos = AXIS_VKEY_BASE + e.axis * 2;
+    const int key_neg = AXIS_VKEY_BASE + e.axis * 2 + 1;
+    const double time_ms = sdl_event_ms(e.timestamp);
+    const bool cur_pos  = value >  JOYSTICK_AXIS_THRESHOLD;
+    const bool cur_neg  = value < -JOYSTICK_AXIS_THRESHOLD;
+    const bool prev_pos = prev  >  JOYSTICK_AXIS_THRESHOLD;
+    const bool prev_neg = prev  < -JOYSTICK_AXIS_THRESHOLD;
+    if (cur_pos  && !prev_pos) { play_input_hitsound(key_pos); push_press(key_pos, time_ms); }
+    if (!cur_pos && prev_pos)  push_release(key_pos);
+    if (cur_neg  && !prev_neg) { play_input_hitsound(key_neg); push_press(key_neg, time_ms); }
+    if (!cur_neg && prev_neg)  push_release(key_neg);
+}
+
+// Every key, controller and touch event goes through here as SDL queues
+// it, with SDL's own timestamp, so no thread has to poll for them. Windows
+// keyboards are the exception: GetAsyncKeyState on the polling thread sees
+// a key before the main thread next pumps events. So are the keys an evdev
+// keyboard reader takes on Linux, for the same reason.
+static bool SDLCALL input_event_watch(void* /*userdata*/, SDL_Event* event) {
+    if (event->type == SDL_EVENT_JOYSTICK_ADDED || event->type == SDL_EVENT_JOYSTICK_REMOVED) {
+        refresh_sdl_joysticks();
+        return 1;
+    }
+    if (event->type == SDL_EVENT_WINDOW_FOCUS_GAINED || event->type == SDL_EVENT_WINDOW_FOCUS_LOST) {
+        evdev_set_window_focused(event->type == SDL_EVENT_WINDOW_FOCUS_GAINED);
+        return 1;
+    }
     if (global_data.input_locked) return 1;
 
 #if defined(__linux__) && !defined(PLATFORM_ANDROID)
@@ -287,28 +643,91 @@ static bool SDLCALL touch_event_watch(void* /*userdata*/, SDL_Event* event) {
             SDL_Keymod mod = SDL_KMOD_NONE;
             SDL_Scancode sc = SDL_GetScancodeFromKey(keycode, &mod);
             if (sc != SDL_SCANCODE_UNKNOWN && key_state[sc]) continue;
-            std::lock_guard<std::mutex> lock(input_mutex);
-            pressed_keys.insert(key);
-            released_keys.insert(key);
+            play_input_hitsound(key);
+            push_press(key, sdl_event_ms(event->text.timestamp));
+            push_release(key);
         }
         return 1;
     }
 #endif
 
-    if (event->type == SDL_EVENT_KEY_DOWN &&
-        event->key.scancode == SDL_SCANCODE_AC_BACK) {
-        std::lock_guard<std::mutex> lock(input_mutex);
-        pressed_keys.insert(ray::KEY_ESCAPE);
-        return 0;
-    }
-    if (event->type == SDL_EVENT_KEY_UP &&
-        event->key.scancode == SDL_SCANCODE_AC_BACK) {
-        std::lock_guard<std::mutex> lock(input_mutex);
-        released_keys.insert(ray::KEY_ESCAPE);
-        return 0;
+    switch (event->type) {
+    case SDL_EVENT_KEY_DOWN:
+        if (event->key.scancode == SDL_SCANCODE_AC_BACK) {
+            push_press(ray::KEY_ESCAPE, sdl_event_ms(event->key.timestamp));
+            return 0;
+        }
+#ifndef _WIN32
+        if (!event->key.repeat) {
+            int key = sdl_scancode_to_key(event->key.scancode);
+            if (key && !evdev_reads_key(key)) {
+                play_input_hitsound(key);
+                push_press(key, sdl_event_ms(event->key.timestamp));
+            }
+        }
+#endif
+        break;
+    case SDL_EVENT_KEY_UP:
+        if (event->key.scancode == SDL_SCANCODE_AC_BACK) {
+            push_release(ray::KEY_ESCAPE);
+            return 0;
+        }
+#ifndef _WIN32
+        if (int key = sdl_scancode_to_key(event->key.scancode); key && !evdev_reads_key(key)) push_release(key);
+#endif
+        break;
+
+    case SDL_EVENT_GAMEPAD_BUTTON_DOWN:
+        if (claimed_by_evdev(event->gbutton.which)) break;
+        if (int button = sdl_gamepad_button_to_raylib(event->gbutton.button)) {
+            queue_input_press(GAMEPAD_VKEY_BASE + button, sdl_event_ms(event->gbutton.timestamp));
+        }
+        break;
+    case SDL_EVENT_GAMEPAD_BUTTON_UP:
+        if (claimed_by_evdev(event->gbutton.which)) break;
+        if (int button = sdl_gamepad_button_to_raylib(event->gbutton.button)) {
+            push_release(GAMEPAD_VKEY_BASE + button);
+        }
+        break;
+    case SDL_EVENT_GAMEPAD_AXIS_MOTION: {
+        // raylib reports the analogue triggers as buttons once pulled past 0.1
+        const SDL_GamepadAxisEvent& e = event->gaxis;
+        if (e.axis != SDL_GAMEPAD_AXIS_LEFT_TRIGGER && e.axis != SDL_GAMEPAD_AXIS_RIGHT_TRIGGER) break;
+        if (claimed_by_evdev(e.which)) break;
+        const int vkey = GAMEPAD_VKEY_BASE + (e.axis == SDL_GAMEPAD_AXIS_LEFT_TRIGGER
+                                              ? ray::GAMEPAD_BUTTON_LEFT_TRIGGER_2
+                                              : ray::GAMEPAD_BUTTON_RIGHT_TRIGGER_2);
+        // Negative keys keep gamepad triggers apart from fallback joystick axes
+        const int64_t state_key = -((int64_t)e.which * 256 + e.axis) - 1;
+        const float value = e.value / 32767.0f;
+        const bool  was   = sdl_prev_axis[state_key] > 0.1f;
+        sdl_prev_axis[state_key] = value;
+        if (value > 0.1f && !was)      queue_input_press(vkey, sdl_event_ms(e.timestamp));
+        else if (value <= 0.1f && was) push_release(vkey);
+        break;
     }
 
-    if (event->type == SDL_EVENT_FINGER_DOWN) {
+    // Joystick events also arrive for gamepads; only the fallback
+    // joysticks opened here are read as raw buttons, and only until the
+    // evdev backend picks them up
+    case SDL_EVENT_JOYSTICK_BUTTON_DOWN:
+        if (sdl_joysticks.count(event->jbutton.which) && event->jbutton.button < 32 &&
+            !claimed_by_evdev(event->jbutton.which)) {
+            // 1-indexed to match raylib's gamepad button convention
+            queue_input_press(GAMEPAD_VKEY_BASE + event->jbutton.button + 1, sdl_event_ms(event->jbutton.timestamp));
+        }
+        break;
+    case SDL_EVENT_JOYSTICK_BUTTON_UP:
+        if (sdl_joysticks.count(event->jbutton.which) && event->jbutton.button < 32 &&
+            !claimed_by_evdev(event->jbutton.which)) {
+            push_release(GAMEPAD_VKEY_BASE + event->jbutton.button + 1);
+        }
+        break;
+    case SDL_EVENT_JOYSTICK_AXIS_MOTION:
+        if (sdl_joysticks.count(event->jaxis.which) && !claimed_by_evdev(event->jaxis.which)) joystick_axis_moved(event->jaxis);
+        break;
+
+    case SDL_EVENT_FINGER_DOWN: {
         if (!global_data.config->general.touch_input) return 1;
         SDL_FingerID id = event->tfinger.fingerID;
         if (!touch_id_to_vkey.count(id)) {
@@ -318,119 +737,58 @@ static bool SDLCALL touch_event_watch(void* /*userdata*/, SDL_Event* event) {
             int vkey = touch_quadrant_vkey(pos, sw, sh);
             touch_id_to_vkey[id] = vkey;
             touch_drum_pressed.store(true, std::memory_order_relaxed);
-            std::lock_guard<std::mutex> lock(input_mutex);
-            pressed_keys.insert(vkey);
+            play_input_hitsound(vkey);
+            push_press(vkey, sdl_event_ms(event->tfinger.timestamp));
         }
-    } else if (event->type == SDL_EVENT_FINGER_UP ||
-               event->type == SDL_EVENT_FINGER_CANCELED) {
+        break;
+    }
+    case SDL_EVENT_FINGER_UP:
+    case SDL_EVENT_FINGER_CANCELED: {
         SDL_FingerID id = event->tfinger.fingerID;
         auto it = touch_id_to_vkey.find(id);
         if (it != touch_id_to_vkey.end()) {
-            std::lock_guard<std::mutex> lock(input_mutex);
-            released_keys.insert(it->second);
+            push_release(it->second);
             touch_id_to_vkey.erase(it);
         }
+        break;
+    }
+    default:
+        break;
     }
     return 1;
 }
 
 void poll_touch_once() {
-    if (!touch_watch_registered) {
-        SDL_AddEventWatch(touch_event_watch, nullptr);
-        touch_watch_registered = true;
+    if (!input_watch_registered) {
+        // Joysticks plugged in before the watch existed sent their
+        // ADDED events already
+        refresh_sdl_joysticks();
+        SDL_AddEventWatch(input_event_watch, nullptr);
+        input_watch_registered = true;
     }
 }
 
-// Scan all keyboard keys once and push press/release events.
-// Used by the polling thread on desktop and called directly per-frame on web.
+// Windows only: scans the keyboard with GetAsyncKeyState and pushes press
+// and release events. Everything else arrives through input_event_watch.
 void poll_keyboard_once() {
-    if (global_data.input_locked) return;
-    static std::vector<int> local_pressed;
-    static std::vector<int> local_released;
-    local_pressed.clear();
-    local_released.clear();
-
 #ifdef _WIN32
+    if (global_data.input_locked) return;
+    double poll_ms = 0.0;
     for (int key = 32; key < 349; key++) {
         bool current_state  = is_key_down_native(key);
         bool previous_state = previous_key_states[key];
-        if (current_state  && !previous_state) local_pressed.push_back(key);
-        if (!current_state && previous_state)  local_released.push_back(key);
-        previous_key_states[key] = current_state;
-    }
-#else
-    for (int key = 32; key < 349; key++) {
-        bool current_state  = ray::IsKeyDown(key);
-        bool previous_state = previous_key_states[key];
-        if (current_state  && !previous_state) local_pressed.push_back(key);
-        if (!current_state && previous_state)  local_released.push_back(key);
         previous_key_states[key] = current_state;
-    }
-#endif
-
-    for (int gamepad = 0; gamepad < 4; gamepad++) {
-        if (!ray::IsGamepadAvailable(gamepad)) continue;
-        for (int btn = 1; btn <= 17; btn++) {
-            int key = 10000 + btn;
-            bool current_state  = ray::IsGamepadButtonDown(gamepad, btn);
-            bool previous_state = previous_gamepad_states[btn];
-            if (current_state  && !previous_state) local_pressed.push_back(key);
-            if (!current_state && previous_state)  local_released.push_back(key);
-            previous_gamepad_states[btn] = current_state;
-        }
-
-    }
-
-    refresh_sdl_joysticks();
-    constexpr float JOYSTICK_AXIS_THRESHOLD = 0.5f;
-
-    for (auto& [joy_id, joy] : sdl_joysticks) {
-        int num_buttons = SDL_GetNumJoystickButtons(joy);
-        for (int btn = 0; btn < num_buttons && btn < 32; btn++) {
-            int64_t state_key = (int64_t)joy_id * 256 + btn;
-            // Use 1-indexed encoding to match raylib's gamepad button convention
-            int vkey = 10000 + btn + 1;
-            bool cur  = SDL_GetJoystickButton(joy, btn);
-            bool prev = sdl_prev_button[state_key];
-            if (cur  && !prev) local_pressed.push_back(vkey);
-            if (!cur && prev)  local_released.push_back(vkey);
-            sdl_prev_button[state_key] = cur;
-        }
-
-        int num_axes = SDL_GetNumJoystickAxes(joy);
-        for (int axis = 0; axis < num_axes && axis < 8; axis++) {
-            int64_t state_key = (int64_t)joy_id * 256 + axis;
-            float value = SDL_GetJoystickAxis(joy, axis) / 32767.0f;
-            float prev  = sdl_prev_axis[state_key];
-            int key_pos = 20000 + axis * 2;
-            int key_neg = 20000 + axis * 2 + 1;
-            bool cur_pos  = value >  JOYSTICK_AXIS_THRESHOLD;
-            bool cur_neg  = value < -JOYSTICK_AXIS_THRESHOLD;
-            bool prev_pos = prev  >  JOYSTICK_AXIS_THRESHOLD;
-            bool prev_neg = prev  < -JOYSTICK_AXIS_THRESHOLD;
-            if (cur_pos  && !prev_pos) local_pressed.push_back(key_pos);
-            if (!cur_pos && prev_pos)  local_released.push_back(key_pos);
-            if (cur_neg  && !prev_neg) local_pressed.push_back(key_neg);
-            if (!cur_neg && prev_neg)  local_released.push_back(key_neg);
-            sdl_prev_axis[state_key] = value;
-        }
-    }
-
-    // Remember the newest controller press separately from pressed_keys so
-    // the keybind screen can read it: the pressed_keys entry is consumed by
-    // whatever navigates the menu before the option box ever sees it.
-    for (int vkey : local_pressed) {
-        if (vkey >= GAMEPAD_VKEY_BASE && vkey < AXIS_VKEY_BASE) {
-            last_gamepad_vkey.store(vkey, std::memory_order_relaxed);
-            break;
+        if (current_state == previous_state) continue;
+        if (current_state) {
+            if (poll_ms == 0.0) poll_ms = get_current_ms();
+            // Sound first: the game thread only judges this on its next frame
+            play_input_hitsound(key);
+            push_press(key, poll_ms);
+        } else {
+            push_release(key);
         }
     }
-
-    if (!local_pressed.empty() || !local_released.empty()) {
-        std::lock_guard<std::mutex> lock(input_mutex);
-        pressed_keys.insert(local_pressed.begin(), local_pressed.end());
-        released_keys.insert(local_released.begin(), local_released.end());
-    }
+#endif
 }
 
 int take_gamepad_button_pressed() {
@@ -440,36 +798,45 @@ int take_gamepad_button_pressed() {
 }
 
 void input_polling_thread() {
+#ifdef _WIN32
+    PROFILE_THREAD("input poll");
     while (input_thread_running) {
-        poll_keyboard_once();
+        {
+            PROFILE_SCOPE("poll_keyboard_once");
+            poll_keyboard_once();
+        }
         std::this_thread::sleep_for(std::chrono::microseconds(500));
     }
+#endif
 }
 
 bool check_key_pressed(int key) {
-    std::lock_guard<std::mutex> lock(input_mutex);
-    auto it = pressed_keys.find(key);
-    if (it != pressed_keys.end()) {
-        pressed_keys.erase(it);
-        return true;
-    }
-    return false;
+    return take_key_press(key).has_value();
+}
+
+std::optional<double> take_key_press(int key) {
+    return take_pending_press([key](const InputEvent& e) { return e.key == key; });
 }
 
 bool check_key_released(int key) {
-    std::lock_guard<std::mutex> lock(input_mutex);
-    auto it = released_keys.find(key);
-    if (it != released_keys.end()) {
-        released_keys.erase(it);
+    auto lock = lock_consumers();
+    drain_input_queue();
+    for (size_t i = 0; i < pending_release_count; i++) {
+        if (pending_releases[i] != key) continue;
+        std::move(pending_releases.begin() + i + 1, pending_releases.begin() + pending_release_count,
+                  pending_releases.begin() + i);
+        pending_release_count--;
         return true;
     }
     return false;
 }
 
 void clear_input_buffers() {
-    std::lock_guard<std::mutex> lock(input_mutex);
-    pressed_keys.clear();
-    released_keys.clear();
+    auto lock = lock_consumers();
+    InputEvent discarded;
+    while (input_queue.pop(discarded)) {}
+    pending_press_count   = 0;
+    pending_release_count = 0;
 }
 
 void shutdown_sdl_joysticks() {
@@ -1,24 +1,74 @@
 #pragma once
 
 #include "global_data.h"
-#include <unordered_set>
+#include "audio.h"
+#include <cstdint>
+#include <optional>
+#include <string>
 
 extern std::atomic<bool> input_thread_running;
 extern std::thread input_thread;
 
-extern std::mutex input_mutex;
-extern std::unordered_multiset<int> pressed_keys;
-extern std::unordered_multiset<int> released_keys;
 extern std::atomic<bool> touch_drum_pressed;
 
+// Drum actions a key can be bound to. Bits, since one key may be bound to
+// several (or to both players).
+enum DrumAction : uint8_t {
+    DRUM_L_DON = 1 << 0,
+    DRUM_R_DON = 1 << 1,
+    DRUM_L_KAT = 1 << 2,
+    DRUM_R_KAT = 1 << 3,
+};
+
+// One press or release. The SDL event watch (and, on Windows, the keyboard
+// polling thread) push these onto a lock-free queue; the game thread
+// drains it into a fixed buffer on its next check and fills in the drum
+// actions from the binding table, so checks take no locks and never
+// allocate.
+struct InputEvent {
+    int     key = 0;
+    double  time_ms = 0.0;     // when it happened, on the get_current_ms clock
+    bool    pressed = true;
+    uint8_t actions_1p = 0;    // DrumAction bits bound to key for each player
+    uint8_t actions_2p = 0;
+};
+
+// Gamepad/joystick buttons and axes are folded into the key space at these
+// offsets (config stores the bare button number).
+inline constexpr int GAMEPAD_VKEY_BASE = 10000;
+inline constexpr int AXIS_VKEY_BASE    = 20000;
+
+// For input backends on their own threads (input_evdev.cpp): queue a press,
+// playing its hitsound if armed, or a release
+void queue_input_press(int vkey, double time_ms);
+void queue_input_release(int vkey);
+
+// Rebuilds the key -> drum action table from the config. Call after the
+// key bindings change.
+void rebuild_input_bindings();
+
+// Windows only; elsewhere these return at once. Windows keeps polling
+// GetAsyncKeyState every 500 us on purpose: it has no evdev-style reader
+// here, and raw input would need a window of its own on this thread, so a
+// press can be up to half a millisecond late. Other platforms read every
+// device from SDL events as the main thread pumps them, once a frame: the
+// press keeps SDL's timestamp, so judgement is unaffected, but a keyboard
+// hitsound (general.input_thread_hitsounds) waits for that frame. On Linux
+// general.evdev_keyboard reads keyboards on the evdev thread instead; macOS
+// has no such reader and keeps that frame of hitsound delay.
 void input_polling_thread();
 void poll_keyboard_once();
 void poll_touch_once();
 
 // Check if a key was pressed since the last check
-// This consumes the key press event
+// This consumes the key press event. Game thread only, like every check,
+// unless set_input_consumers_shared is on.
 bool check_key_pressed(int key);
 
+// Like check_key_pressed, but returns when the (oldest buffered) press
+// happened, on the get_current_ms clock
+std::optional<double> take_key_press(int key);
+
 // Check if a key was released since the last check
 // This consumes the key release event
 bool check_key_released(int key);
@@ -29,17 +79,38 @@ bool check_key_released(int key);
 // only sees devices it has a gamepad mapping for.
 int take_gamepad_button_pressed();
 
+// With general.input_latency_stats on, every press the game consumes is
+// timed from its event to the check that took it. Game thread only.
+std::string input_latency_summary();
+void reset_input_latency();
+
+// On while GameScreen's simulation thread takes drum presses alongside the
+// game thread; checks then lock against each other. Flip it only while no
+// other thread is checking.
+void set_input_consumers_shared(bool shared);
+
 // Clear all buffered input events
 // Useful when changing screens or locking input
 void clear_input_buffers();
+
+// Opt-in (general.input_thread_hitsounds): the input event watch (or the
+// Windows polling thread) plays drum hitsounds as soon as it sees the
+// press, before Player::handle_input would. Judgement still drains the
+// input queue on the game thread. A player keeps its hitsounds armed by
+// calling this every frame it takes input; when it stops (screen change,
+// pause) they lapse.
+bool input_hitsounds_enabled();
+void arm_input_hitsounds(PlayerNum player_num, SoundId don, SoundId kat);
 void shutdown_sdl_joysticks();
 void android_set_keyboard_visible(bool visible);
 
-bool is_input_key_pressed(const std::vector<int>& keys, const std::vector<int>& gamepad_buttons);
-bool is_l_don_pressed(PlayerNum player_num = PlayerNum::ALL);
-bool is_r_don_pressed(PlayerNum player_num = PlayerNum::ALL);
-bool is_l_kat_pressed(PlayerNum player_num = PlayerNum::ALL);
-bool is_r_kat_pressed(PlayerNum player_num = PlayerNum::ALL);
+// press_ms, when given, receives the time of the press that was consumed
+bool is_input_key_pressed(const std::vector<int>& keys, const std::vector<int>& gamepad_buttons,
+                          double* press_ms = nullptr);
+bool is_l_don_pressed(PlayerNum player_num = PlayerNum::ALL, double* press_ms = nullptr);
+bool is_r_don_pressed(PlayerNum player_num = PlayerNum::ALL, double* press_ms = nullptr);
+bool is_l_kat_pressed(PlayerNum player_num = PlayerNum::ALL, double* press_ms = nullptr);
+bool is_r_kat_pressed(PlayerNum player_num = PlayerNum::ALL, double* press_ms = nullptr);
 
 inline bool operator==(const ray::Color& a, const ray::Color& b)
 {
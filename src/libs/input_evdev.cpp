@@ -0,0 +1,422 @@
+#include "input_evdev.h"
+
+#if defined(__linux__) && !defined(PLATFORM_ANDROID) && !defined(__EMSCRIPTEN__)
+
+#include "input.h"
+#include "animation.h"
+#include "profiler.h"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <bitset>
+#include <cerrno>
+#include <cstdio>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#include <fcntl.h>
+#include <linux/input.h>
+#include <sys/epoll.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+static constexpr const char* EVDEV_DIR = "/dev/input";
+static constexpr int   EVDEV_MAX_DEVICES  = 256;   // event0..event255
+static constexpr int   EVDEV_MAX_BUTTONS  = 32;    // as many as the SDL fallback reads
+static constexpr int   EVDEV_MAX_AXES     = 8;
+static constexpr float EVDEV_AXIS_THRESHOLD = 0.5f;
+
+// epoll user data for the inotify fd; devices use their event number
+static constexpr uint64_t INOTIFY_TAG = ~0ull;
+
+static std::atomic<bool> evdev_running{false};
+static std::thread evdev_thread;
+static std::array<std::atomic<bool>, EVDEV_MAX_DEVICES> evdev_claimed{};
+// Set by start_evdev_input before the thread starts
+static bool read_joysticks = false;
+static bool read_keyboards = false;
+static std::atomic<int>  keyboards_open{0};
+// Keyboards are read whatever window has focus; presses only count while ours does
+static std::atomic<bool> window_focused{true};
+
+struct EvdevAxis {
+    int   code;
+    int   min;
+    int   max;
+    float value = 0.0f;
+};
+
+struct EvdevDevice {
+    int fd = -1;
+    int number = 0;
+    std::string name;
+    std::array<int8_t, KEY_CNT> button_index;   // -1 for keys we don't read
+    std::array<int8_t, ABS_CNT> axis_index;
+    std::vector<EvdevAxis> axes;
+    std::bitset<KEY_CNT> down;
+    bool keyboard = false;  // keys map to raylib key codes rather than buttons
+    bool dropped = false;   // kernel buffer overran; skip to the next SYN_REPORT and resync
+};
+
+static bool test_bit(const unsigned long* bits, int bit) {
+    constexpr int BITS = sizeof(unsigned long) * 8;
+    return (bits[bit / BITS] >> (bit % BITS)) & 1;
+}
+
+static int event_number(const char* name) {
+    int number = -1;
+    if (std::sscanf(name, "event%d", &number) != 1) return -1;
+    return (number >= 0 && number < EVDEV_MAX_DEVICES) ? number : -1;
+}
+
+// Kernel timestamps are CLOCK_MONOTONIC (set per device in open_device);
+// move them onto get_current_ms by their age
+static double evdev_event_ms(const input_event& ev) {
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    const double now_ms   = now.tv_sec * 1000.0 + now.tv_nsec / 1e6;
+    const double event_ms = ev.input_event_sec * 1000.0 + ev.input_event_usec / 1000.0;
+    return get_current_ms() - std::max(now_ms - event_ms, 0.0);
+}
+
+static float axis_value(const EvdevAxis& axis, int raw) {
+    if (axis.max <= axis.min) return 0.0f;
+    return 2.0f * (float)(raw - axis.min) / (float)(axis.max - axis.min) - 1.0f;
+}
+
+static void axis_moved(EvdevAxis& axis, int index, float value, double time_ms) {
+    const float prev = axis.value;
+    axis.value = value;
+    const int key_pos = AXIS_VKEY_BASE + index * 2;
+    const int key_neg = AXIS_VKEY_BASE + index * 2 + 1;
+    const bool cur_pos  = value >  EVDEV_AXIS_THRESHOLD;
+    const bool cur_neg  = value < -EVDEV_AXIS_THRESHOLD;
+    const bool prev_pos = prev  >  EVDEV_AXIS_THRESHOLD;
+    const bool prev_neg = prev  < -EVDEV_AXIS_THRESHOLD;
+    if (cur_pos  && !prev_pos) queue_input_press(key_pos, time_ms);
+    if (!cur_pos && prev_pos)  queue_input_release(key_pos);
+    if (cur_neg  && !prev_neg) queue_input_press(key_neg, time_ms);
+    if (!cur_neg && prev_neg)  queue_input_release(key_neg);
+}
+
+// The printable keys, which drums are bound to, in evdev key code order
+// from each row's first key. Their raylib codes are their (upper case)
+// ASCII characters; the rest of the keyboard is left to SDL.
+struct EvdevKeyRow {
+    int         first_code;
+    const char* keys;
+};
+static constexpr EvdevKeyRow EVDEV_KEY_ROWS[] = {
+    {KEY_1,         "1234567890-="},
+    {KEY_Q,         "QWERTYUIOP[]"},
+    {KEY_A,         "ASDFGHJKL;'`"},
+    {KEY_BACKSLASH, "\\ZXCVBNM,./"},
+    {KEY_SPACE,     " "},
+};
+
+// raylib's key code for an evdev key code, or 0 if SDL reads that key
+static int evdev_key_to_raylib(int code) {
+    for (const EvdevKeyRow& row : EVDEV_KEY_ROWS) {
+        const int offset = code - row.first_code;
+        if (offset >= 0 && offset < (int)std::strlen(row.keys)) return (unsigned char)row.keys[offset];
+    }
+    return 0;
+}
+
+static void button_changed(EvdevDevice& dev, int code, bool pressed, double time_ms) {
+    if (dev.down[code] == pressed) return;
+    dev.down[code] = pressed;
+    // Keys by raylib code; buttons 1-indexed, like the SDL fallback
+    const int vkey = dev.keyboard ? evdev_key_to_raylib(code)
+                                  : GAMEPAD_VKEY_BASE + dev.button_index[code] + 1;
+    if (!pressed) queue_input_release(vkey);
+    else if (!dev.keyboard || window_focused.load(std::memory_order_relaxed)) queue_input_press(vkey, time_ms);
+}
+
+// After SYN_DROPPED the events in between are gone; read the device's
+// current state and report whatever changed as of now
+static void resync_device(EvdevDevice& dev) {
+    unsigned long keys[KEY_CNT / (sizeof(unsigned long) * 8) + 1] = {};
+    if (ioctl(dev.fd, EVIOCGKEY(sizeof(keys)), keys) < 0) return;
+    const double now_ms = get_current_ms();
+    for (int code = 0; code < KEY_CNT; code++) {
+        if (dev.button_index[code] >= 0) button_changed(dev, code, test_bit(keys, code), now_ms);
+    }
+    for (size_t i = 0; i < dev.axes.size() && (int)i < EVDEV_MAX_AXES; i++) {
+        input_absinfo info{};
+        if (ioctl(dev.fd, EVIOCGABS(dev.axes[i].code), &info) < 0) continue;
+        axis_moved(dev.axes[i], (int)i, axis_value(dev.axes[i], info.value), now_ms);
+    }
+}
+
+// Opens /dev/input/<name> if it is a joystick, or with keyboards on a
+// keyboard, that we should read. Gamepads and mice are left to SDL.
+static std::unique_ptr<EvdevDevice> open_device(const char* name) {
+    const int number = event_number(name);
+    if (number < 0) return nullptr;
+    const std::string path = std::string(EVDEV_DIR) + "/" + name;
+    const int fd = open(path.c_str(), O_RDONLY | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0) {
+        if (errno == EACCES) spdlog::debug("evdev: no permission to read {}", path);
+        return nullptr;
+    }
+
+    unsigned long keybit[KEY_CNT / (sizeof(unsigned long) * 8) + 1] = {};
+    unsigned long absbit[ABS_CNT / (sizeof(unsigned long) * 8) + 1] = {};
+    if (ioctl(fd, EVIOCGBIT(EV_KEY, sizeof(keybit)), keybit) < 0) {
+        close(fd);
+        return nullptr;
+    }
+    ioctl(fd, EVIOCGBIT(EV_ABS, sizeof(absbit)), absbit);
+
+    bool joystick_buttons = false;
+    bool gamepad_buttons  = false;
+    for (int code = BTN_JOYSTICK; code < BTN_GAMEPAD; code++) joystick_buttons |= test_bit(keybit, code);
+    for (int code = BTN_TRIGGER_HAPPY; code < KEY_CNT; code++) joystick_buttons |= test_bit(keybit, code);
+    for (int code = BTN_GAMEPAD; code < BTN_DIGI; code++)      gamepad_buttons  |= test_bit(keybit, code);
+    // Letter keys and space tell a keyboard from the power button, media
+    // keys and the like
+    const bool keyboard = !joystick_buttons && test_bit(keybit, KEY_A) && test_bit(keybit, KEY_Z) &&
+                          test_bit(keybit, KEY_SPACE);
+    const bool joystick = joystick_buttons && !gamepad_buttons;
+    if (!(joystick && read_joysticks) && !(keyboard && read_keyboards)) {
+        close(fd);
+        return nullptr;
+    }
+
+    auto dev = std::make_unique<EvdevDevice>();
+    dev->fd       = fd;
+    dev->number   = number;
+    dev->keyboard = keyboard;
+    dev->button_index.fill(-1);
+    dev->axis_index.fill(-1);
+
+    if (keyboard) {
+        for (int code = 0; code < KEY_CNT; code++) {
+            if (test_bit(keybit, code) && evdev_key_to_raylib(code)) dev->button_index[code] = 0;
+        }
+    } else {
+        // SDL's order: joystick buttons and up first, then the low key codes
+        int buttons = 0;
+        auto add_button = [&](int code) {
+            if (buttons < EVDEV_MAX_BUTTONS && test_bit(keybit, code)) dev->button_index[code] = (int8_t)buttons++;
+        };
+        for (int code = BTN_JOYSTICK; code < KEY_MAX; code++) add_button(code);
+        for (int code = 0; code < BTN_JOYSTICK; code++) add_button(code);
+    }
+
+    // Hats are reported as hats by SDL, not axes, so they take no number
+    for (int code = 0; code < ABS_MAX && !keyboard; code++) {
+        if (code == ABS_HAT0X) {
+            code = ABS_HAT3Y;
+            continue;
+        }
+        if (!test_bit(absbit, code)) continue;
+        input_absinfo info{};
+        if (ioctl(fd, EVIOCGABS(code), &info) < 0) continue;
+        // Still counted, so later axes keep SDL's numbering
+        const int index = (int)dev->axes.size();
+        dev->axes.push_back({code, info.minimum, info.maximum});
+        dev->axes.back().value = axis_value(dev->axes.back(), info.value);
+        if (index < EVDEV_MAX_AXES) dev->axis_index[code] = (int8_t)index;
+    }
+
+    int clock = CLOCK_MONOTONIC;
+    if (ioctl(fd, EVIOCSCLOCKID, &clock) < 0) {
+        spdlog::warn("evdev: {} can't report monotonic timestamps, skipping", path);
+        close(fd);
+        return nullptr;
+    }
+
+    char device_name[256] = {};
+    ioctl(fd, EVIOCGNAME(sizeof(device_name) - 1), device_name);
+    dev->name = device_name;
+
+    // Buttons already held when it was opened only count once released
+    unsigned long keys[KEY_CNT / (sizeof(unsigned long) * 8) + 1] = {};
+    if (ioctl(fd, EVIOCGKEY(sizeof(keys)), keys) >= 0) {
+        for (int code = 0; code < KEY_CNT; code++) {
+            if (dev->button_index[code] >= 0 && test_bit(keys, code)) dev->down[code] = true;
+        }
+    }
+    return dev;
+}
+
+// Returns false once the device is gone
+static bool read_device(EvdevDevice& dev) {
+    input_event events[64];
+    while (true) {
+        const ssize_t n = read(dev.fd, events, sizeof(events));
+        if (n < 0) return errno == EAGAIN || errno == EINTR;
+        if (n == 0) return false;
+        const size_t count = (size_t)n / sizeof(input_event);
+        for (size_t i = 0; i < count; i++) {
+            const input_event& ev = events[i];
+            if (ev.type == EV_SYN) {
+                if (ev.code == SYN_DROPPED) {
+                    dev.dropped = true;
+                } else if (ev.code == SYN_REPORT && dev.dropped) {
+                    dev.dropped = false;
+                    resync_device(dev);
+                }
+                continue;
+            }
+            if (dev.dropped) continue;
+            if (ev.type == EV_KEY && ev.code < KEY_CNT && dev.button_index[ev.code] >= 0) {
+                // value 2 is autorepeat
+                if (ev.value == 0 || ev.value == 1) button_changed(dev, ev.code, ev.value == 1, evdev_event_ms(ev));
+            } else if (ev.type == EV_ABS && ev.code < ABS_CNT && dev.axis_index[ev.code] >= 0) {
+                const int index = dev.axis_index[ev.code];
+                EvdevAxis& axis = dev.axes[index];
+                axis_moved(axis, index, axis_value(axis, ev.value), evdev_event_ms(ev));
+            }
+        }
+    }
+}
+
+static void release_all(EvdevDevice& dev) {
+    for (int code = 0; code < KEY_CNT; code++) {
+        if (dev.down[code]) button_changed(dev, code, false, 0.0);
+    }
+    for (size_t i = 0; i < dev.axes.size() && (int)i < EVDEV_MAX_AXES; i++) {
+        axis_moved(dev.axes[i], (int)i, 0.0f, 0.0);
+    }
+}
+
+static void evdev_thread_main() {
+    PROFILE_THREAD("evdev input");
+    const int epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (epoll_fd < 0) {
+        spdlog::error("evdev: epoll_create1 failed: {}", std::strerror(errno));
+        return;
+    }
+    const int inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (inotify_fd >= 0 && inotify_add_watch(inotify_fd, EVDEV_DIR, IN_CREATE | IN_ATTRIB | IN_DELETE) >= 0) {
+        epoll_event ev{};
+        ev.events   = EPOLLIN;
+        ev.data.u64 = INOTIFY_TAG;
+        epoll_ctl(epoll_fd, EPOLL_CTL_ADD, inotify_fd, &ev);
+    } else {
+        spdlog::warn("evdev: can't watch {} for new devices: {}", EVDEV_DIR, std::strerror(errno));
+    }
+
+    std::unordered_map<int, std::unique_ptr<EvdevDevice>> devices;
+
+    auto add_device = [&](const char* name) {
+        const int number = event_number(name);
+        if (number < 0 || devices.count(number)) return;
+        auto dev = open_device(name);
+        if (!dev) return;
+        epoll_event ev{};
+        ev.events   = EPOLLIN;
+        ev.data.u64 = (uint64_t)number;
+        if (epoll_ctl(epoll_fd, EPOLL_CTL_ADD, dev->fd, &ev) < 0) {
+            close(dev->fd);
+            return;
+        }
+        spdlog::info("evdev: reading {} '{}' ({}/{})", dev->keyboard ? "keyboard" : "joystick",
+                     dev->name, EVDEV_DIR, name);
+        if (dev->keyboard) keyboards_open.fetch_add(1, std::memory_order_relaxed);
+        else               evdev_claimed[number].store(true, std::memory_order_relaxed);
+        devices[number] = std::move(dev);
+    };
+    auto remove_device = [&](int number) {
+        auto it = devices.find(number);
+        if (it == devices.end()) return;
+        EvdevDevice& dev = *it->second;
+        spdlog::info("evdev: '{}' removed", dev.name);
+        release_all(dev);
+        epoll_ctl(epoll_fd, EPOLL_CTL_DEL, dev.fd, nullptr);
+        close(dev.fd);
+        if (dev.keyboard) keyboards_open.fetch_sub(1, std::memory_order_relaxed);
+        else              evdev_claimed[number].store(false, std::memory_order_relaxed);
+        devices.erase(it);
+    };
+
+    std::error_code ec;
+    for (const auto& entry : std::filesystem::directory_iterator(EVDEV_DIR, ec)) {
+        add_device(entry.path().filename().c_str());
+    }
+
+    epoll_event ready[16];
+    while (evdev_running.load(std::memory_order_relaxed)) {
+        // The timeout only bounds how long stop_evdev_input waits
+        const int n = epoll_wait(epoll_fd, ready, 16, 100);
+        for (int i = 0; i < n; i++) {
+            if (ready[i].data.u64 == INOTIFY_TAG) {
+                alignas(inotify_event) char buffer[4096];
+                ssize_t len;
+                while ((len = read(inotify_fd, buffer, sizeof(buffer))) > 0) {
+                    for (char* p = buffer; p < buffer + len;) {
+                        const inotify_event* ev = reinterpret_cast<const inotify_event*>(p);
+                        p += sizeof(inotify_event) + ev->len;
+                        if (ev->len == 0) continue;
+                        // IN_ATTRIB: udev grants access a moment after the node appears
+                        if (ev->mask & IN_DELETE) remove_device(event_number(ev->name));
+                        else                      add_device(ev->name);
+                    }
+                }
+                continue;
+            }
+            const int number = (int)ready[i].data.u64;
+            auto it = devices.find(number);
+            if (it == devices.end()) continue;
+            PROFILE_SCOPE("evdev read");
+            if ((ready[i].events & (EPOLLERR | EPOLLHUP)) || !read_device(*it->second)) {
+                remove_device(number);
+            }
+        }
+    }
+
+    while (!devices.empty()) remove_device(devices.begin()->first);
+    if (inotify_fd >= 0) close(inotify_fd);
+    close(epoll_fd);
+}
+
+void start_evdev_input(bool joysticks, bool keyboards) {
+    if (!joysticks && !keyboards) return;
+    if (evdev_running.exchange(true)) return;
+    read_joysticks = joysticks;
+    read_keyboards = keyboards;
+    evdev_thread = std::thread(evdev_thread_main);
+}
+
+void stop_evdev_input() {
+    if (!evdev_running.exchange(false)) return;
+    if (evdev_thread.joinable()) evdev_thread.join();
+}
+
+bool evdev_owns_device(const char* path) {
+    if (!path) return false;
+    const char* name = std::strrchr(path, '/');
+    const int number = event_number(name ? name + 1 : path);
+    return number >= 0 && evdev_claimed[number].load(std::memory_order_relaxed);
+}
+
+bool evdev_reads_key(int key) {
+    if (key <= 0 || key > 127 || keyboards_open.load(std::memory_order_relaxed) == 0) return false;
+    for (const EvdevKeyRow& row : EVDEV_KEY_ROWS) {
+        if (std::strchr(row.keys, key)) return true;
+    }
+    return false;
+}
+
+void evdev_set_window_focused(bool focused) {
+    window_focused.store(focused, std::memory_order_relaxed);
+}
+
+#else
+
+void start_evdev_input(bool, bool) {}
+void stop_evdev_input() {}
+bool evdev_owns_device(const char*) { return false; }
+bool evdev_reads_key(int) { return false; }
+void evdev_set_window_focused(bool) {}
+
+#endif
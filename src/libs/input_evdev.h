@@ -0,0 +1,32 @@
+#pragma once
+
+// Linux evdev input backend for USB drum controllers and other plain HID
+// joysticks. A thread reads EV_KEY/EV_ABS straight from /dev/input/event*
+// with the kernel's timestamps and feeds the input queue, so a tap shorter
+// than a frame can't fall between two state snapshots. Devices come and go
+// through inotify on /dev/input.
+//
+// Buttons and axes are numbered the way SDL's Linux joystick driver numbers
+// them, so bindings made through the SDL fallback keep working. Gamepads
+// (anything with BTN_GAMEPAD buttons) are left to SDL, as are devices the
+// process can't open. Elsewhere these do nothing.
+//
+// With keyboards on (general.evdev_keyboard), keyboards are read the same
+// way. SDL only hands key events over when the main thread pumps them, once
+// a frame, so this is what lets an input-thread hitsound play as the key
+// goes down. Only the printable keys are taken, and only while the window
+// has focus; the rest of the keyboard stays with SDL.
+void start_evdev_input(bool joysticks, bool keyboards);
+void stop_evdev_input();
+
+// Whether path (an SDL joystick path such as /dev/input/event5) is being
+// read by this backend, in which case SDL's events for it are ignored
+bool evdev_owns_device(const char* path);
+
+// Whether presses of raylib key code key come from an evdev keyboard, in
+// which case SDL's events for it are ignored
+bool evdev_reads_key(int key);
+
+// Keyboards are read whichever window has focus; the event watch passes
+// SDL's focus changes on so only presses made to the game count
+void evdev_set_window_focused(bool focused);
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+// Bounded multi-producer/single-consumer queue (Vyukov's sequence-per-cell
+// design). push() and pop() never block or allocate, so the audio callback
+// can drain it and any thread can feed it. push() fails when full.
+template <typename T, size_t Capacity>
+class MpscQueue {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "Capacity must be a power of two");
+
+public:
+    MpscQueue() {
+        for (size_t i = 0; i < Capacity; i++) {
+            cells[i].sequence.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MpscQueue(const MpscQueue&) = delete;
+    MpscQueue& operator=(const MpscQueue&) = delete;
+
+    bool push(const T& value) {
+        size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+        for (;;) {
+            Cell& cell = cells[pos & MASK];
+            size_t seq = cell.sequence.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {
+                if (enqueue_pos.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    cell.value = value;
+                    cell.sequence.store(pos + 1, std::memory_order_release);
+                    return true;
+                }
+            } else if (diff < 0) {
+                return false;  // full
+            } else {
+                pos = enqueue_pos.load(std::memory_order_relaxed);
+            }
+        }
+    }
+
+    // Consumer only
+    bool pop(T& out) {
+        Cell& cell = cells[dequeue_pos & MASK];
+        size_t seq = cell.sequence.load(std::memory_order_acquire);
+        if ((intptr_t)seq - (intptr_t)(dequeue_pos + 1) < 0) return false;  // empty
+        out = cell.value;
+        cell.sequence.store(dequeue_pos + Capacity, std::memory_order_release);
+        dequeue_pos++;
+        return true;
+    }
+
+private:
+    static constexpr size_t MASK = Capacity - 1;
+
+    struct Cell {
+        std::atomic<size_t> sequence;
+        T                   value;
+    };
+
+    std::array<Cell, Capacity> cells;
+    alignas(64) std::atomic<size_t> enqueue_pos{0};
+    alignas(64) size_t              dequeue_pos = 0;
+};
@@ -1387,7 +1387,7 @@ void modifier_inverse(NoteList& notes) {
     }
 }
 
-void modifier_random(NoteList& notes, int value) {
+void modifier_random(NoteList& notes, int value, uint32_t seed) {
     // value: 1 == kimagure, 2 == detarame
 
     if (value == 0 || notes.notes.empty()) return;
@@ -1395,8 +1395,7 @@ void modifier_random(NoteList& notes, int value) {
     int percentage = (notes.notes.size() / 5) * value;
     percentage = std::min(percentage, static_cast<int>(notes.notes.size()));
 
-    std::random_device rd;
-    std::mt19937 gen(rd());
+    std::mt19937 gen(seed != 0 ? seed : std::random_device{}());
 
     std::vector<int> indices(notes.notes.size());
     std::iota(indices.begin(), indices.end(), 0);
@@ -1465,7 +1464,7 @@ void apply_modifiers(NoteList& notes, const Modifiers& modifiers) {
     }
 
     if (modifiers.random > 0) {
-        modifier_random(notes, modifiers.random);
+        modifier_random(notes, modifiers.random, modifiers.random_seed);
     }
 
     modifier_speed(notes, modifiers.speed);
@@ -2,6 +2,7 @@
 
 #include <spdlog/spdlog.h>
 #include <cstddef>
+#include <cstdint>
 #include <deque>
 #include <filesystem>
 #include <functional>
@@ -30,6 +31,7 @@ struct Modifiers {
     bool inverse = false;
     int random = 0;
     int subdiff = 0;
+    uint32_t random_seed = 0;  // seeds the random shuffle; 0 draws a fresh one
 };
 
 enum class NoteType : int {
@@ -363,5 +365,5 @@ void modifier_moji(NoteList& notes);
 void modifier_speed(NoteList& notes, float value);
 void modifier_display(NoteList& notes);
 void modifier_inverse(NoteList& notes);
-void modifier_random(NoteList& notes, int value);
+void modifier_random(NoteList& notes, int value, uint32_t seed);
 void apply_modifiers(NoteList& notes, const Modifiers& modifiers);
@@ -0,0 +1,367 @@
+#include "pcm_cache.h"
+#include "profiler.h"
+#include "sha256.h"
+#include <spdlog/spdlog.h>
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+constexpr char     PCM_CACHE_MAGIC[8] = {'Y', 'D', 'P', 'C', 'M', 0, 0, 1};
+constexpr const char* PCM_CACHE_EXT = ".pcm";
+constexpr const char* PCM_LINK_EXT  = ".key";
+
+// Followed directly by frames * channels floats. 32 bytes keeps the sample
+// data aligned for the mix kernels.
+struct PcmCacheHeader {
+    char     magic[8];
+    uint32_t sample_rate;
+    uint32_t channels;
+    uint64_t frames;
+    uint64_t reserved;
+};
+static_assert(sizeof(PcmCacheHeader) == 32, "PcmCacheHeader must stay 32 bytes");
+
+// Maps a whole file read-only. The returned pointer unmaps on release.
+std::shared_ptr<const uint8_t> map_file(const fs::path& path, uint64_t& size) {
+#ifdef _WIN32
+    HANDLE file = CreateFileW(path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE,
+                              nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) return nullptr;
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+        CloseHandle(file);
+        return nullptr;
+    }
+    HANDLE mapping = CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    CloseHandle(file);
+    if (!mapping) return nullptr;
+    void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+    CloseHandle(mapping);  // the view keeps the mapping alive
+    if (!view) return nullptr;
+    size = (uint64_t)file_size.QuadPart;
+    return std::shared_ptr<const uint8_t>(static_cast<const uint8_t*>(view),
+                                          [](const uint8_t* p) { UnmapViewOfFile(p); });
+#else
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return nullptr;
+    struct stat st;
+    if (fstat(fd, &st) != 0 || st.st_size == 0) {
+        ::close(fd);
+        return nullptr;
+    }
+    void* addr = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);  // the mapping keeps the file alive
+    if (addr == MAP_FAILED) return nullptr;
+    size = (uint64_t)st.st_size;
+    size_t length = (size_t)st.st_size;
+    return std::shared_ptr<const uint8_t>(static_cast<const uint8_t*>(addr),
+                                          [length](const uint8_t* p) { munmap(const_cast<uint8_t*>(p), length); });
+#endif
+}
+
+}  // namespace
+
+PcmCache::~PcmCache() {
+    shutdown();
+}
+
+void PcmCache::configure(const fs::path& dir, uint64_t budget_bytes, unsigned int sample_rate, Decoder decoder) {
+#ifdef __EMSCRIPTEN__
+    // No persistent filesystem to cache into
+    budget_bytes = 0;
+#endif
+    shutdown();
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = false;
+    }
+    this->directory    = dir;
+    this->budget_bytes = budget_bytes;
+    this->sample_rate  = sample_rate;
+    this->decoder      = std::move(decoder);
+    enabled = false;
+    if (budget_bytes == 0) return;
+
+    std::error_code ec;
+    fs::create_directories(dir, ec);
+    if (ec) {
+        spdlog::warn("PCM cache disabled, cannot create {}: {}", dir.string(), ec.message());
+        return;
+    }
+    enabled = true;
+    spdlog::info("PCM cache enabled at {} ({} MB budget)", dir.string(), budget_bytes / (1024 * 1024));
+    evict();
+}
+
+fs::path PcmCache::entry_path(const std::string& key) const {
+    return directory / (key + PCM_CACHE_EXT);
+}
+
+std::optional<PcmCache::FileStat> PcmCache::stat_file(const fs::path& path) {
+    std::error_code ec;
+    FileStat stat;
+    stat.size = fs::file_size(path, ec);
+    if (ec) return std::nullopt;
+    stat.mtime = fs::last_write_time(path, ec);
+    if (ec) return std::nullopt;
+    stat.absolute = fs::absolute(path, ec).lexically_normal();
+    if (ec) return std::nullopt;
+    return stat;
+}
+
+fs::path PcmCache::link_path(const FileStat& stat) const {
+    // A replaced or edited file gets a new size or mtime, and so a new link
+    const std::u8string name = stat.absolute.generic_u8string();
+    const int64_t stamp = (int64_t)stat.mtime.time_since_epoch().count();
+    crypto::Sha256 hasher;
+    hasher.update(reinterpret_cast<const uint8_t*>(name.data()), name.size());
+    hasher.update(reinterpret_cast<const uint8_t*>(&stat.size), sizeof(stat.size));
+    hasher.update(reinterpret_cast<const uint8_t*>(&stamp), sizeof(stamp));
+    return directory / (crypto::to_hex(hasher.finalize()) + PCM_LINK_EXT);
+}
+
+std::string PcmCache::read_link(const fs::path& link) const {
+    std::ifstream in(link, std::ios::binary);
+    std::string hash;
+    if (!in || !std::getline(in, hash)) return "";
+    // One cut short by a crash is just a miss
+    if (hash.size() != 64) return "";
+    return hash;
+}
+
+std::string PcmCache::key_for(const fs::path& path) {
+    if (!enabled) return "";
+    std::optional<FileStat> stat = stat_file(path);
+    if (!stat) return "";
+
+    const std::string memo_key = stat->absolute.string();
+    std::string hash;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        auto it = key_memo.find(memo_key);
+        if (it != key_memo.end() && it->second.size == stat->size && it->second.mtime == stat->mtime) {
+            hash = it->second.hash;
+        }
+    }
+    if (hash.empty()) {
+        hash = read_link(link_path(*stat));
+        if (hash.empty()) return "";
+        std::lock_guard<std::mutex> lock(mutex);
+        key_memo[memo_key] = KeyMemo{stat->size, stat->mtime, hash};
+    }
+    // The rate is part of the key: the same file resampled for another
+    // device is a different entry.
+    return hash + "_" + std::to_string(sample_rate);
+}
+
+std::string PcmCache::hash_contents(const FileStat& stat) {
+    std::ifstream file(stat.absolute, std::ios::binary);
+    if (!file) return "";
+    crypto::Sha256 hasher;
+    std::vector<char> chunk(1 << 16);
+    while (file) {
+        file.read(chunk.data(), (std::streamsize)chunk.size());
+        hasher.update(reinterpret_cast<const uint8_t*>(chunk.data()), (size_t)file.gcount());
+    }
+    if (file.bad()) return "";
+    std::string hash = crypto::to_hex(hasher.finalize());
+
+    std::ofstream link(link_path(stat), std::ios::binary | std::ios::trunc);
+    link << hash << '\n';
+    if (!link) spdlog::warn("Failed to write PCM cache link for {}", stat.absolute.string());
+
+    std::lock_guard<std::mutex> lock(mutex);
+    key_memo[stat.absolute.string()] = KeyMemo{stat.size, stat.mtime, hash};
+    return hash + "_" + std::to_string(sample_rate);
+}
+
+std::optional<CachedPcm> PcmCache::lookup(const std::string& key) {
+    if (!enabled || key.empty()) return std::nullopt;
+    fs::path path = entry_path(key);
+
+    uint64_t size = 0;
+    std::shared_ptr<const uint8_t> mapping = map_file(path, size);
+    if (!mapping) return std::nullopt;
+
+    PcmCacheHeader header;
+    if (size < sizeof(header)) return std::nullopt;
+    std::memcpy(&header, mapping.get(), sizeof(header));
+    uint64_t expected = sizeof(header) + header.frames * header.channels * sizeof(float);
+    if (std::memcmp(header.magic, PCM_CACHE_MAGIC, sizeof(header.magic)) != 0 ||
+        header.sample_rate != sample_rate || header.channels == 0 || size != expected) {
+        spdlog::warn("Discarding corrupt PCM cache entry {}", path.filename().string());
+        mapping.reset();
+        std::error_code ec;
+        fs::remove(path, ec);
+        return std::nullopt;
+    }
+
+    // A hit makes the entry the most recently used
+    std::error_code ec;
+    fs::last_write_time(path, fs::file_time_type::clock::now(), ec);
+
+    CachedPcm pcm;
+    pcm.data     = std::shared_ptr<const float[]>(mapping, reinterpret_cast<const float*>(mapping.get() + sizeof(header)));
+    pcm.frames   = header.frames;
+    pcm.channels = header.channels;
+    return pcm;
+}
+
+void PcmCache::fill_async(const fs::path& path) {
+    if (!enabled || !decoder) return;
+    std::lock_guard<std::mutex> lock(mutex);
+    if (stopping || !queued_paths.insert(path.string()).second) return;
+    jobs.push_back(FillJob{path});
+    if (!worker.joinable()) {
+        worker = std::thread(&PcmCache::worker_loop, this);
+    }
+    jobs_cv.notify_one();
+}
+
+void PcmCache::shutdown() {
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+        jobs.clear();
+    }
+    jobs_cv.notify_all();
+    if (worker.joinable()) worker.join();
+}
+
+void PcmCache::worker_loop() {
+    PROFILE_THREAD("pcm cache");
+    std::unique_lock<std::mutex> lock(mutex);
+    while (true) {
+        jobs_cv.wait(lock, [this] { return stopping || !jobs.empty(); });
+        if (stopping) return;
+        FillJob job = std::move(jobs.front());
+        jobs.pop_front();
+        lock.unlock();
+
+        {
+            PROFILE_SCOPE("PcmCache::fill");
+            // key_for has no answer for a file until this has hashed it
+            std::string key;
+            if (std::optional<FileStat> stat = stat_file(job.path)) {
+                key = key_for(job.path);
+                if (key.empty()) key = hash_contents(*stat);
+            }
+            std::vector<float> pcm;
+            unsigned int channels = 0;
+            if (!key.empty() && !fs::exists(entry_path(key)) && decoder(job.path, pcm, channels) && channels > 0) {
+                if (write_entry(key, pcm, channels)) {
+                    spdlog::debug("Cached PCM for {} ({} MB)", job.path.filename().string(),
+                                  pcm.size() * sizeof(float) / (1024 * 1024));
+                    evict();
+                }
+            }
+        }
+
+        lock.lock();
+        queued_paths.erase(job.path.string());
+    }
+}
+
+bool PcmCache::write_entry(const std::string& key, const std::vector<float>& pcm, unsigned int channels) {
+    PcmCacheHeader header{};
+    std::memcpy(header.magic, PCM_CACHE_MAGIC, sizeof(header.magic));
+    header.sample_rate = sample_rate;
+    header.channels    = channels;
+    header.frames      = pcm.size() / channels;
+
+    // Write beside the entry and rename into place, so a reader never maps
+    // a partial file
+    fs::path final_path = entry_path(key);
+    fs::path temp_path  = final_path;
+    temp_path += ".tmp";
+    {
+        std::ofstream out(temp_path, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char*>(pcm.data()), (std::streamsize)(header.frames * channels * sizeof(float)));
+        if (!out) {
+            spdlog::warn("Failed to write PCM cache entry {}", temp_path.string());
+            out.close();
+            std::error_code ec;
+            fs::remove(temp_path, ec);
+            return false;
+        }
+    }
+    std::error_code ec;
+    fs::rename(temp_path, final_path, ec);
+    if (ec) {
+        spdlog::warn("Failed to store PCM cache entry {}: {}", final_path.string(), ec.message());
+        fs::remove(temp_path, ec);
+        return false;
+    }
+    // Stamp it with the same clock lookup() touches entries with; the
+    // kernel's write time can trail it by a few milliseconds
+    fs::last_write_time(final_path, fs::file_time_type::clock::now(), ec);
+    return true;
+}
+
+void PcmCache::evict() {
+    struct Entry {
+        fs::path           path;
+        uintmax_t          size;
+        fs::file_time_type used;
+    };
+    std::vector<Entry> entries;
+    std::vector<fs::path> links;
+    uint64_t total = 0;
+
+    std::error_code ec;
+    for (const auto& item : fs::directory_iterator(directory, ec)) {
+        if (!item.is_regular_file(ec)) continue;
+        if (item.path().extension() == ".tmp") {
+            // Left behind by a run that was killed mid-write
+            fs::file_time_type age = item.last_write_time(ec);
+            if (!ec && fs::file_time_type::clock::now() - age > std::chrono::hours(1)) fs::remove(item.path(), ec);
+            continue;
+        }
+        if (item.path().extension() == PCM_LINK_EXT) {
+            links.push_back(item.path());
+            continue;
+        }
+        if (item.path().extension() != PCM_CACHE_EXT) continue;
+        Entry entry{item.path(), item.file_size(ec), item.last_write_time(ec)};
+        if (ec) continue;
+        total += entry.size;
+        entries.push_back(std::move(entry));
+    }
+    if (total > budget_bytes) {
+        std::sort(entries.begin(), entries.end(), [](const Entry& a, const Entry& b) { return a.used < b.used; });
+        for (Entry& entry : entries) {
+            if (total <= budget_bytes) break;
+            // Fails on Windows while the entry is mapped; it goes next time
+            if (fs::remove(entry.path, ec)) {
+                total -= entry.size;
+                spdlog::debug("Evicted PCM cache entry {}", entry.path.filename().string());
+                entry.path.clear();
+            }
+        }
+    }
+
+    // A link whose entries are all gone would only save the next fill a
+    // hash, so it goes with them
+    std::unordered_set<std::string> hashes;  // of the entries left, at any rate
+    for (const Entry& entry : entries) {
+        if (!entry.path.empty()) hashes.insert(entry.path.stem().string().substr(0, 64));
+    }
+    for (const fs::path& link : links) {
+        if (!hashes.count(read_link(link))) fs::remove(link, ec);
+    }
+}
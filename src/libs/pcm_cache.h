@@ -0,0 +1,101 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+// A cached file's device-rate PCM, mapped read-only. The data pointer keeps
+// the mapping alive, so it can be handed straight to a MusicDecoder.
+struct CachedPcm {
+    std::shared_ptr<const float[]> data;  // interleaved float32
+    uint64_t     frames = 0;
+    unsigned int channels = 0;
+};
+
+// On-disk cache of songs already decoded and resampled to the device rate.
+// Entries are named by the SHA-256 of the source file plus the rate, and
+// each is a 32-byte header followed by raw interleaved floats, so a hit is
+// a single mmap with no decoding at all. Only the worker hashes: it leaves
+// a small link from the file's path, size and mtime to the content key, so
+// finding an entry again needs just a stat. Least recently used entries
+// (by file mtime, which a hit refreshes) are evicted to stay within budget.
+class PcmCache {
+public:
+    // Decodes a whole file to device-rate interleaved float PCM
+    using Decoder = std::function<bool(const fs::path& path, std::vector<float>& pcm, unsigned int& channels)>;
+
+    PcmCache() = default;
+    ~PcmCache();
+
+    PcmCache(const PcmCache&) = delete;
+    PcmCache& operator=(const PcmCache&) = delete;
+
+    // A budget of 0 leaves the cache disabled
+    void configure(const fs::path& dir, uint64_t budget_bytes, unsigned int sample_rate, Decoder decoder);
+    bool is_enabled() const { return enabled; }
+
+    // Content key for a file the worker has hashed, or "" if it hasn't
+    // been yet. The file itself is never read, so this is cheap enough for
+    // the loading thread.
+    std::string key_for(const fs::path& path);
+
+    std::optional<CachedPcm> lookup(const std::string& key);
+
+    // Hashes and decodes path on the cache's worker thread and stores it
+    // under its content key
+    void fill_async(const fs::path& path);
+
+    // Stops the worker; a half-written entry is discarded
+    void shutdown();
+
+private:
+    struct FileStat {
+        fs::path           absolute;
+        uintmax_t          size;
+        fs::file_time_type mtime;
+    };
+    struct KeyMemo {
+        uintmax_t          size;
+        fs::file_time_type mtime;
+        std::string        hash;  // of the contents, without the rate
+    };
+    struct FillJob {
+        fs::path path;
+    };
+
+    bool         enabled = false;
+    fs::path     directory;
+    uint64_t     budget_bytes = 0;
+    unsigned int sample_rate = 0;
+    Decoder      decoder;
+
+    std::mutex                               mutex;
+    std::unordered_map<std::string, KeyMemo> key_memo;  // by absolute path
+    std::deque<FillJob>                      jobs;
+    std::unordered_set<std::string>          queued_paths;
+    std::condition_variable                  jobs_cv;
+    std::thread                              worker;
+    bool                                     stopping = false;
+
+    static std::optional<FileStat> stat_file(const fs::path& path);
+
+    fs::path    entry_path(const std::string& key) const;
+    fs::path    link_path(const FileStat& stat) const;
+    std::string read_link(const fs::path& link) const;
+    std::string hash_contents(const FileStat& stat);
+    void        worker_loop();
+    bool        write_entry(const std::string& key, const std::vector<float>& pcm, unsigned int channels);
+    void        evict();
+};
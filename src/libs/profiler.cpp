@@ -0,0 +1,219 @@
+#include "profiler.h"
+#include <ctime>
+
+#ifdef PROFILER_ENABLED
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <fstream>
+#include <mutex>
+#include <vector>
+#include <spdlog/spdlog.h>
+
+// Events kept per thread; at 24 bytes each this is ~400 KB a thread and
+// a few seconds of a busy main thread
+static constexpr size_t EVENTS_PER_THREAD = 1 << 14;
+// Threads come and go with songs and loaders; past this many, buffers of
+// finished threads are handed to new ones
+static constexpr size_t MAX_THREAD_BUFFERS = 64;
+
+namespace {
+
+// Atomic fields so a dump can read a slot the owner is overwriting; the
+// claimed/published counters below tell it which slots to throw away
+struct ProfileEvent {
+    std::atomic<const char*> name{nullptr};
+    std::atomic<int64_t>     start_ns{0};
+    std::atomic<int64_t>     duration_ns{0};
+};
+
+struct ThreadBuffer {
+    std::array<ProfileEvent, EVENTS_PER_THREAD> events;
+    std::atomic<uint64_t>    claimed{0};    // slots the owner has started writing
+    std::atomic<uint64_t>    published{0};  // slots fully written
+    std::atomic<const char*> name{nullptr};
+    std::atomic<bool>        retired{false};
+    uint32_t                 tid = 0;
+};
+
+struct Registry {
+    std::mutex mutex;
+    std::vector<ThreadBuffer*> buffers;
+};
+
+// Never destroyed: detached threads may still record during static
+// destruction
+Registry& registry() {
+    static Registry* instance = new Registry();
+    return *instance;
+}
+
+const std::chrono::steady_clock::time_point profiler_epoch = std::chrono::steady_clock::now();
+
+int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - profiler_epoch).count();
+}
+
+ThreadBuffer* acquire_buffer() {
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    if (reg.buffers.size() < MAX_THREAD_BUFFERS) {
+        ThreadBuffer* buffer = new ThreadBuffer();
+        buffer->tid = (uint32_t)reg.buffers.size() + 1;
+        reg.buffers.push_back(buffer);
+        return buffer;
+    }
+    for (ThreadBuffer* buffer : reg.buffers) {
+        if (!buffer->retired.load(std::memory_order_acquire)) continue;
+        buffer->claimed.store(0, std::memory_order_relaxed);
+        buffer->published.store(0, std::memory_order_relaxed);
+        buffer->name.store(nullptr, std::memory_order_relaxed);
+        buffer->retired.store(false, std::memory_order_relaxed);
+        return buffer;
+    }
+    return nullptr;
+}
+
+struct ThreadHandle {
+    ThreadBuffer* buffer = nullptr;
+    bool          acquired = false;
+
+    ThreadBuffer* get() {
+        if (!acquired) {
+            buffer = acquire_buffer();
+            acquired = true;
+        }
+        return buffer;
+    }
+
+    ~ThreadHandle() {
+        if (buffer) buffer->retired.store(true, std::memory_order_release);
+    }
+};
+
+thread_local ThreadHandle this_thread_buffer;
+
+void record(const char* name, int64_t start_ns, int64_t end_ns) {
+    ThreadBuffer* buffer = this_thread_buffer.get();
+    if (!buffer) return;
+    const uint64_t index = buffer->claimed.load(std::memory_order_relaxed);
+    buffer->claimed.store(index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+
+    ProfileEvent& event = buffer->events[index % EVENTS_PER_THREAD];
+    event.name.store(name, std::memory_order_relaxed);
+    event.start_ns.store(start_ns, std::memory_order_relaxed);
+    event.duration_ns.store(end_ns - start_ns, std::memory_order_relaxed);
+    buffer->published.store(index + 1, std::memory_order_release);
+}
+
+void write_json_string(std::ofstream& out, const char* text) {
+    out << '"';
+    for (const char* c = text; *c; c++) {
+        if (*c == '"' || *c == '\\') out << '\\';
+        if ((unsigned char)*c < 0x20) continue;
+        out << *c;
+    }
+    out << '"';
+}
+
+} // namespace
+
+ProfileScope::ProfileScope(const char* name) : name(name), start_ns(now_ns()) {}
+
+ProfileScope::~ProfileScope() {
+    record(name, start_ns, now_ns());
+}
+
+void profiler_set_thread_name(const char* name) {
+    ThreadBuffer* buffer = this_thread_buffer.get();
+    if (buffer) buffer->name.store(name, std::memory_order_relaxed);
+}
+
+bool profiler_available() {
+    return true;
+}
+
+bool profiler_dump(const std::string& path) {
+    std::ofstream out(path, std::ios::trunc);
+    if (!out) {
+        spdlog::error("Failed to open profile trace {}", path);
+        return false;
+    }
+
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    bool first = true;
+    size_t total = 0;
+    struct Copied { const char* name; int64_t start_ns; int64_t duration_ns; };
+    std::vector<Copied> copied;
+
+    for (ThreadBuffer* buffer : reg.buffers) {
+        const char* thread_name = buffer->name.load(std::memory_order_relaxed);
+        if (thread_name) {
+            out << (first ? "" : ",\n") << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":1,\"tid\":" << buffer->tid
+                << ",\"args\":{\"name\":";
+            write_json_string(out, thread_name);
+            out << "}}";
+            first = false;
+        }
+
+        const uint64_t published = buffer->published.load(std::memory_order_acquire);
+        const uint64_t begin = published > EVENTS_PER_THREAD ? published - EVENTS_PER_THREAD : 0;
+        copied.clear();
+        for (uint64_t i = begin; i < published; i++) {
+            const ProfileEvent& event = buffer->events[i % EVENTS_PER_THREAD];
+            copied.push_back({event.name.load(std::memory_order_relaxed),
+                              event.start_ns.load(std::memory_order_relaxed),
+                              event.duration_ns.load(std::memory_order_relaxed)});
+        }
+        // Anything the owner started overwriting during the copy is torn
+        std::atomic_thread_fence(std::memory_order_acquire);
+        const uint64_t claimed = buffer->claimed.load(std::memory_order_relaxed);
+        const uint64_t valid_from = claimed > EVENTS_PER_THREAD ? claimed - EVENTS_PER_THREAD : 0;
+
+        for (uint64_t i = std::max(begin, valid_from); i < published; i++) {
+            const Copied& event = copied[i - begin];
+            if (!event.name) continue;
+            out << (first ? "" : ",\n") << "{\"ph\":\"X\",\"name\":";
+            write_json_string(out, event.name);
+            out << fmt::format(",\"pid\":1,\"tid\":{},\"ts\":{:.3f},\"dur\":{:.3f}}}",
+                               buffer->tid, event.start_ns / 1000.0, event.duration_ns / 1000.0);
+            first = false;
+            total++;
+        }
+    }
+    out << "\n]}\n";
+    out.close();
+    if (!out) {
+        spdlog::error("Failed to write profile trace {}", path);
+        return false;
+    }
+    spdlog::info("Wrote {} profile events to {}", total, path);
+    return true;
+}
+
+#else
+
+#include <spdlog/spdlog.h>
+
+bool profiler_available() {
+    return false;
+}
+
+bool profiler_dump(const std::string& path) {
+    spdlog::warn("Profiler not compiled in (build with -DPROFILER=ON), not writing {}", path);
+    return false;
+}
+
+#endif
+
+std::string profiler_default_path() {
+    std::time_t now = std::time(nullptr);
+    char stamp[32];
+    std::strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", std::localtime(&now));
+    return std::string("profile-") + stamp + ".json";
+}
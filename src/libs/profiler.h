@@ -0,0 +1,52 @@
+#pragma once
+
+#include <string>
+
+// Scoped profiler. PROFILE_SCOPE("name") records how long the enclosing
+// scope took on the calling thread; PROFILE_THREAD("name") labels the
+// thread in the trace. Names must be string literals, only the pointer
+// is kept. Each thread writes its own ring buffer without locking, so the
+// newest events survive and older ones are overwritten.
+//
+// Compiled in for Debug builds or with -DPROFILER=ON; otherwise the
+// macros expand to nothing and the functions below are no-ops.
+
+#ifdef PROFILER_ENABLED
+
+#include <cstdint>
+
+class ProfileScope {
+public:
+    explicit ProfileScope(const char* name);
+    ~ProfileScope();
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    const char* name;
+    int64_t     start_ns;
+};
+
+void profiler_set_thread_name(const char* name);
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profile_scope_, __LINE__)(name)
+#define PROFILE_THREAD(name) profiler_set_thread_name(name)
+
+#else
+
+#define PROFILE_SCOPE(name) ((void)0)
+#define PROFILE_THREAD(name) ((void)0)
+
+#endif
+
+bool profiler_available();
+
+// Writes every thread's buffered events as Chrome trace JSON (loads in
+// chrome://tracing and ui.perfetto.dev). Returns false on I/O failure or
+// when the profiler isn't compiled in.
+bool profiler_dump(const std::string& path);
+
+// profile-<date>-<time>.json in the working directory, next to latest.log
+std::string profiler_default_path();
@@ -0,0 +1,179 @@
+#include "replay.h"
+#include <cstdint>
+#include <cstring>
+#include <ctime>
+#include <fstream>
+#include <spdlog/spdlog.h>
+
+namespace {
+
+constexpr char REPLAY_MAGIC[8] = {'Y', 'D', 'R', 'P', 'L', 'Y', 0, 1};
+
+// Followed by the chart hash, song path and score method (lengths below),
+// then event_count packed events: hit_ms as a double, the judge delay as
+// a float, and the drum as a byte. Host byte order, like the PCM cache.
+struct ReplayHeader {
+    char     magic[8];
+    int32_t  difficulty;
+    int32_t  audio_offset;
+    int32_t  visual_offset;
+    uint32_t random_seed;
+    uint8_t  speed;
+    uint8_t  display;
+    uint8_t  inverse;
+    uint8_t  random;
+    uint8_t  subdiff;
+    uint8_t  auto_play;
+    uint16_t hash_length;
+    uint16_t path_length;
+    uint16_t method_length;
+    int32_t  score;
+    int32_t  good;
+    int32_t  ok;
+    int32_t  bad;
+    int32_t  max_combo;
+    int32_t  drumroll;
+    uint32_t event_count;
+};
+static_assert(sizeof(ReplayHeader) == 64, "ReplayHeader must stay 64 bytes");
+
+constexpr size_t EVENT_SIZE = sizeof(double) + sizeof(float) + 1;
+
+} // namespace
+
+bool save_replay(const fs::path& path, const Replay& replay) {
+    const std::string song_path = replay.song_path.generic_string();
+    if (replay.chart_hash.size() > UINT16_MAX || song_path.size() > UINT16_MAX ||
+        replay.score_method.size() > UINT16_MAX) {
+        spdlog::error("Replay strings too long, not writing {}", path.string());
+        return false;
+    }
+
+    ReplayHeader header{};
+    std::memcpy(header.magic, REPLAY_MAGIC, sizeof(header.magic));
+    header.difficulty    = replay.difficulty;
+    header.audio_offset  = replay.audio_offset;
+    header.visual_offset = replay.visual_offset;
+    header.random_seed   = replay.modifiers.random_seed;
+    header.speed         = (uint8_t)replay.modifiers.speed;
+    header.display       = replay.modifiers.display;
+    header.inverse       = replay.modifiers.inverse;
+    header.random        = (uint8_t)replay.modifiers.random;
+    header.subdiff       = (uint8_t)replay.modifiers.subdiff;
+    header.auto_play     = replay.modifiers.auto_play;
+    header.hash_length   = (uint16_t)replay.chart_hash.size();
+    header.path_length   = (uint16_t)song_path.size();
+    header.method_length = (uint16_t)replay.score_method.size();
+    header.score         = replay.result.score;
+    header.good          = replay.result.good;
+    header.ok            = replay.result.ok;
+    header.bad           = replay.result.bad;
+    header.max_combo     = replay.result.max_combo;
+    header.drumroll      = replay.result.total_drumroll;
+    header.event_count   = (uint32_t)replay.events.size();
+
+    std::vector<char> events(replay.events.size() * EVENT_SIZE);
+    char* out_event = events.data();
+    for (const ReplayEvent& event : replay.events) {
+        const float judge_delay = (float)(event.judge_ms - event.hit_ms);
+        std::memcpy(out_event, &event.hit_ms, sizeof(double));
+        std::memcpy(out_event + sizeof(double), &judge_delay, sizeof(float));
+        out_event[sizeof(double) + sizeof(float)] = (char)event.type;
+        out_event += EVENT_SIZE;
+    }
+
+    std::error_code ec;
+    if (path.has_parent_path()) fs::create_directories(path.parent_path(), ec);
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+    out.write(replay.chart_hash.data(), (std::streamsize)replay.chart_hash.size());
+    out.write(song_path.data(), (std::streamsize)song_path.size());
+    out.write(replay.score_method.data(), (std::streamsize)replay.score_method.size());
+    out.write(events.data(), (std::streamsize)events.size());
+    out.close();
+    if (!out) {
+        spdlog::error("Failed to write replay {}", path.string());
+        return false;
+    }
+    spdlog::info("Saved replay of {} presses to {}", replay.events.size(), path.string());
+    return true;
+}
+
+std::optional<Replay> load_replay(const fs::path& path) {
+    std::ifstream in(path, std::ios::binary);
+    if (!in) {
+        spdlog::error("Failed to open replay {}", path.string());
+        return std::nullopt;
+    }
+    ReplayHeader header;
+    in.read(reinterpret_cast<char*>(&header), sizeof(header));
+    if (!in || std::memcmp(header.magic, REPLAY_MAGIC, sizeof(header.magic)) != 0) {
+        spdlog::error("{} is not a replay", path.string());
+        return std::nullopt;
+    }
+
+    Replay replay;
+    std::string song_path;
+    replay.chart_hash.resize(header.hash_length);
+    song_path.resize(header.path_length);
+    replay.score_method.resize(header.method_length);
+    in.read(replay.chart_hash.data(), header.hash_length);
+    in.read(song_path.data(), header.path_length);
+    in.read(replay.score_method.data(), header.method_length);
+    std::vector<char> events((size_t)header.event_count * EVENT_SIZE);
+    in.read(events.data(), (std::streamsize)events.size());
+    if (!in) {
+        spdlog::error("Replay {} is truncated", path.string());
+        return std::nullopt;
+    }
+
+    replay.song_path     = fs::path(song_path);
+    replay.difficulty    = header.difficulty;
+    replay.audio_offset  = header.audio_offset;
+    replay.visual_offset = header.visual_offset;
+    replay.modifiers.random_seed = header.random_seed;
+    replay.modifiers.speed       = header.speed;
+    replay.modifiers.display     = header.display != 0;
+    replay.modifiers.inverse     = header.inverse != 0;
+    replay.modifiers.random      = header.random;
+    replay.modifiers.subdiff     = header.subdiff;
+    replay.modifiers.auto_play   = header.auto_play != 0;
+    replay.result.score          = header.score;
+    replay.result.good           = header.good;
+    replay.result.ok             = header.ok;
+    replay.result.bad            = header.bad;
+    replay.result.max_combo      = header.max_combo;
+    replay.result.total_drumroll = header.drumroll;
+
+    replay.events.reserve(header.event_count);
+    const char* in_event = events.data();
+    for (uint32_t i = 0; i < header.event_count; i++, in_event += EVENT_SIZE) {
+        ReplayEvent event;
+        float judge_delay;
+        std::memcpy(&event.hit_ms, in_event, sizeof(double));
+        std::memcpy(&judge_delay, in_event + sizeof(double), sizeof(float));
+        const uint8_t type = (uint8_t)in_event[sizeof(double) + sizeof(float)];
+        if (type > (uint8_t)InputLogType::KAT_R) {
+            spdlog::error("Replay {} has an unknown drum {} at press {}", path.string(), type, i);
+            return std::nullopt;
+        }
+        event.judge_ms = event.hit_ms + judge_delay;
+        event.type     = (InputLogType)type;
+        replay.events.push_back(event);
+    }
+    return replay;
+}
+
+fs::path replay_default_path(const std::string& chart_hash) {
+    std::time_t now = std::time(nullptr);
+    char stamp[32];
+    std::strftime(stamp, sizeof(stamp), "%Y%m%d-%H%M%S", std::localtime(&now));
+    return fs::path("Replays") / (std::string(stamp) + "-" + chart_hash.substr(0, 8) + ".ydr");
+}
+
+bool replay_result_matches(const Replay& replay, const ResultData& result) {
+    return replay.result.score == result.score && replay.result.good == result.good &&
+           replay.result.ok == result.ok && replay.result.bad == result.bad &&
+           replay.result.max_combo == result.max_combo &&
+           replay.result.total_drumroll == result.total_drumroll;
+}
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "global_data.h"
+#include "network.h"
+#include <filesystem>
+#include <optional>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+
+struct ReplayEvent {
+    double       hit_ms;    // chart time of the press, as in input_log
+    double       judge_ms;  // chart time of the update that judged it
+    InputLogType type;
+};
+
+// One play's drum input plus everything else judgement depends on, so
+// feeding the events back through Player reproduces the score exactly.
+struct Replay {
+    std::string chart_hash;    // SongParser::get_diff_hash(difficulty)
+    fs::path    song_path;
+    int         difficulty = 0;
+    Modifiers   modifiers;     // random_seed included
+    std::string score_method;
+    int         audio_offset = 0;
+    int         visual_offset = 0;
+    ResultData  result;        // what the play scored, to check playback against
+    std::vector<ReplayEvent> events;
+};
+
+// A fixed header, the strings, then 13 bytes per press. Returns false on
+// I/O failure.
+bool save_replay(const fs::path& path, const Replay& replay);
+std::optional<Replay> load_replay(const fs::path& path);
+
+// Replays/<date>-<time>-<first 8 of the chart hash>.ydr
+fs::path replay_default_path(const std::string& chart_hash);
+
+// True if the recorded tallies match these
+bool replay_result_matches(const Replay& replay, const ResultData& result);
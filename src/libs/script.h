@@ -1,5 +1,6 @@
 #pragma once
 
+#include "profiler.h"
 #include "texture.h"
 #include <sol/sol.hpp>
 #include <spdlog/spdlog.h>
@@ -11,9 +12,11 @@ protected:
     template<typename... Args>
     bool load(const std::string& class_name, const std::string& script_name, Args&&... args);
 
+    // context is a literal like "Timer:update"; it also names the profile scope
     template<typename... Args>
-    void call(sol::protected_function& fn, const std::string& context, Args&&... args) {
+    void call(sol::protected_function& fn, const char* context, Args&&... args) {
         if (!fn.valid()) return;
+        PROFILE_SCOPE(context);
         auto result = fn(lua_object, std::forward<Args>(args)...);
         if (!result.valid()) {
             sol::error err = result;
@@ -22,8 +25,9 @@ protected:
     }
 
     template<typename Ret, typename... Args>
-    sol::optional<Ret> call_r(sol::protected_function& fn, const std::string& context, Args&&... args) {
+    sol::optional<Ret> call_r(sol::protected_function& fn, const char* context, Args&&... args) {
         if (!fn.valid()) return sol::nullopt;
+        PROFILE_SCOPE(context);
         auto result = fn(lua_object, std::forward<Args>(args)...);
         if (!result.valid()) {
             sol::error err = result;
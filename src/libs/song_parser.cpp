@@ -22,8 +22,7 @@ std::string SongParser::get_difficulty_name() {
     return std::visit([](auto& p) { return p.get_difficulty_name(); }, impl);
 }
 
-std::tuple<NoteList, std::deque<NoteList>, std::deque<NoteList>, std::deque<NoteList>>
-SongParser::notes_to_position(int diff) {
+ChartNotes SongParser::notes_to_position(int diff) {
     return std::visit([diff](auto& p) {
         return p.notes_to_position(diff);
     }, impl);
@@ -5,6 +5,10 @@
 #include "parsers/osu.h"
 #include "parsers/tja.h"
 
+// A chart compiled by notes_to_position: main notes, then the master,
+// expert and normal branch sections
+using ChartNotes = std::tuple<NoteList, std::deque<NoteList>, std::deque<NoteList>, std::deque<NoteList>>;
+
 // Exposes the same public interface as TJAParser so existing code
 // can be updated by substituting SongParser for TJAParser.
 class SongParser {
@@ -18,8 +22,7 @@ public:
     void get_metadata() {}
     std::string get_difficulty_name();
 
-    std::tuple<NoteList, std::deque<NoteList>, std::deque<NoteList>, std::deque<NoteList>>
-    notes_to_position(int diff);
+    ChartNotes notes_to_position(int diff);
 
     std::string get_song_hash();
     std::string get_diff_hash(int difficulty);
@@ -1,5 +1,6 @@
 #include "texture.h"
 #include "filesystem.h"
+#include "profiler.h"
 #include <spdlog/spdlog.h>
 
 void TextureWrapper::init(const fs::path& skin_path) {
@@ -301,6 +302,7 @@ void TextureWrapper::load_animations(const std::string& screen_name) {
 }
 
 void TextureWrapper::load_folder(const std::string& screen_name, const std::string& subset) {
+    PROFILE_SCOPE("TextureWrapper::load_folder");
     // Subset leaf name is the key used in tex_id_map (e.g. "notes_nijiiro" from "game/notes_nijiiro")
     const std::string subset_key = fs::path(subset).filename().string();
     const std::string dedup_key = screen_name + "/" + subset_key;
@@ -395,6 +397,55 @@ void TextureWrapper::load_folder(const std::string& screen_name, const std::stri
     }
 }
 
+int TextureWrapper::read_texture_width(const std::string& screen_name, const std::string& subset,
+                                       const std::string& tex_name) const {
+    auto read_from = [&](const fs::path& folder) -> int {
+        fs::path tex_json = folder / "texture.json";
+        if (!fs::exists(tex_json)) return 0;
+        try {
+            auto tex_config = read_json_file(tex_json);
+            if (!tex_config.IsObject() || !tex_config.HasMember(tex_name.c_str())) return 0;
+            const Value& tex_mapping = tex_config[tex_name.c_str()];
+            // Same rule as read_tex_obj_data: the first crop sets the width
+            const Value* first = &tex_mapping;
+            if (tex_mapping.IsArray()) first = tex_mapping.Size() > 0 ? &tex_mapping[0] : nullptr;
+            if (first != nullptr && first->IsObject() && first->HasMember("crop") &&
+                (*first)["crop"].IsArray() && (*first)["crop"].Size() > 0) {
+                return static_cast<int>((*first)["crop"][0][2].GetFloat());
+            }
+
+            // Otherwise the image itself, or the first frame of a framed one
+            fs::path image = folder / (tex_name + ".png");
+            fs::path tex_dir = folder / tex_name;
+            if (fs::is_directory(tex_dir)) {
+                image.clear();
+                int first_frame = 0;
+                for (const auto& entry : fs::directory_iterator(tex_dir)) {
+                    if (!entry.is_regular_file()) continue;
+                    int frame = std::stoi(entry.path().stem().string());
+                    if (image.empty() || frame < first_frame) {
+                        image = entry.path();
+                        first_frame = frame;
+                    }
+                }
+            }
+            if (image.empty() || !fs::exists(image)) return 0;
+            ray::Image img = ray::LoadImage(image.string().c_str());
+            int width = img.width;
+            ray::UnloadImage(img);
+            return width;
+        } catch (const std::exception& e) {
+            spdlog::warn("Failed to read {} from {}: {}", tex_name, tex_json.string(), e.what());
+            return 0;
+        }
+    };
+
+    // Child entries override the parent's, as in load_folder
+    int width = read_from(graphics_path / screen_name / subset);
+    if (width == 0 && has_parent_skin()) width = read_from(parent_graphics_path / screen_name / subset);
+    return width;
+}
+
 void TextureWrapper::unload_folder(const std::string& screen_name, const std::string& subset) {
     const std::string subset_key = fs::path(subset).filename().string();
     const std::string dedup_key = screen_name + "/" + subset_key;
@@ -413,6 +464,7 @@ void TextureWrapper::unload_folder(const std::string& screen_name, const std::st
 }
 
 void TextureWrapper::load_screen_textures(const std::string& screen_name) {
+    PROFILE_SCOPE("TextureWrapper::load_screen_textures");
     fs::path screen_path = graphics_path / screen_name;
     fs::path parent_screen_path = parent_graphics_path / screen_name;
 
@@ -178,6 +178,12 @@ public:
 
     void load_folder(const std::string& screen_name, const std::string& subset);
 
+    // Width load_folder would give tex_name, read from its texture.json crop
+    // or its image without loading anything onto the GPU; 0 if the skin
+    // doesn't have it. For headless runs, which have no window to load into
+    int read_texture_width(const std::string& screen_name, const std::string& subset,
+                           const std::string& tex_name) const;
+
     void unload_folder(const std::string& screen_name, const std::string& subset);
 
     void load_screen_textures(const std::string& screen_name);
@@ -1,5 +1,6 @@
 #include "video.h"
 #include "audio.h"
+#include "profiler.h"
 #include "texture.h"
 #include <spdlog/spdlog.h>
 
@@ -61,16 +62,19 @@ void VideoPlayer::audio_manager() {
 
 void VideoPlayer::decode_loop() {
 #ifndef __EMSCRIPTEN__
+    PROFILE_THREAD("video decode");
     try {
         container->seek(0);
         frame_generator = container->decode_video(0);
 
         int produced = 0;
         while (!decode_stop.load(std::memory_order_relaxed)) {
-            if (!frame_generator->next(current_decoded_frame)) break; // EOF
-            current_decoded_frame->reformat("rgb24");
-
             DecodedFrame frame;
+            {
+                PROFILE_SCOPE("VideoPlayer::decode_frame");
+                if (!frame_generator->next(current_decoded_frame)) break; // EOF
+                current_decoded_frame->reformat("rgb24");
+            }
             {
                 std::lock_guard<std::mutex> lock(queue_mutex);
                 if (!spare_buffers.empty()) {
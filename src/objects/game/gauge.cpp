@@ -7,9 +7,9 @@ Gauge::Gauge()
       previous_length(0), is_clear(false), is_rainbow(false),
       tamashii_fire_change(nullptr), gauge_update_anim(nullptr) {}
 
-Gauge::Gauge(GaugeMode mode, PlayerNum player_num, int total_notes, int difficulty, int level)
+Gauge::Gauge(GaugeMode mode, PlayerNum player_num, int total_notes, int difficulty, int level, bool animated)
     : gauge_length(0), mode(mode), player_num(player_num), total_notes(total_notes),
-      previous_length(0), is_clear(false), is_rainbow(false),
+      animated(animated), previous_length(0), is_clear(false), is_rainbow(false),
       tamashii_fire_change(nullptr), gauge_update_anim(nullptr) {
 
     if (mode == GaugeMode::NORMAL) {
@@ -70,8 +70,10 @@ Gauge::Gauge(GaugeMode mode, PlayerNum player_num, int total_notes, int difficul
             }
         };
 
-        tamashii_fire_change = (TextureChangeAnimation*)tex.get_animation(25);
-        gauge_update_anim    = (FadeAnimation*)tex.get_animation(10);
+        if (animated) {
+            tamashii_fire_change = (TextureChangeAnimation*)tex.get_animation(25);
+            gauge_update_anim    = (FadeAnimation*)tex.get_animation(10);
+        }
     } else {
         // DAN: animations loaded lazily in update() since this object may be
         // constructed before the texture system is ready (class-member initializer)
@@ -181,7 +183,7 @@ void Gauge::update(double current_ms) {
         return;
     }
 
-    if (mode == GaugeMode::DAN && !anims_loaded) {
+    if (mode == GaugeMode::DAN && !anims_loaded && animated) {
         tamashii_fire_change = (TextureChangeAnimation*)tex.get_animation(25);
         gauge_update_anim    = (FadeAnimation*)tex.get_animation(10);
         anims_loaded = true;
@@ -191,6 +193,7 @@ void Gauge::update(double current_ms) {
     is_clear   = (mode == GaugeMode::NORMAL)
                  ? gauge_length > clear_start[std::min(difficulty, (int)Difficulty::HARD)] - 1
                  : is_rainbow;
+    if (!animated) return;
 
     if (gauge_length == gauge_max && !rainbow_fade_in.has_value()) {
         rainbow_fade_in = (FadeAnimation*)tex.get_animation(63);
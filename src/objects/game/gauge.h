@@ -14,8 +14,10 @@ public:
     float gauge_length;
     float gauge_max;
 
-    // Live gameplay gauge.
-    Gauge(GaugeMode mode, PlayerNum player_num, int total_notes, int difficulty = 0, int level = 1);
+    // Live gameplay gauge. animated=false tracks length and clear state
+    // only, for headless runs without skin animations.
+    Gauge(GaugeMode mode, PlayerNum player_num, int total_notes, int difficulty = 0, int level = 1,
+          bool animated = true);
 
     // Result-screen gauge: shows a fixed final length.
     static Gauge make_result(GaugeMode mode, PlayerNum player_num, float gauge_length, bool is_2p = false);
@@ -59,6 +61,7 @@ private:
     float rainbow_frac = 0.0f;
 
     bool anims_loaded = false;
+    bool animated = true;
 
     // Result presentation
     bool is_result = false;
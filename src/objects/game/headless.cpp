@@ -0,0 +1,225 @@
+#include "headless.h"
+#include "player.h"
+#include "../../libs/calibration.h"
+#include "../../libs/global_data.h"
+#include <algorithm>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <spdlog/spdlog.h>
+
+namespace fs = std::filesystem;
+
+// GameScreen holds the first note of a TJA back by this much
+static constexpr int TJA_START_DELAY_MS = 1000;
+// Run past the last note so late misses and the gauge settle
+static constexpr double END_MARGIN_MS = 2000.0;
+
+std::optional<std::vector<ReplayEvent>> read_headless_inputs(const fs::path& path) {
+    std::ifstream file(path);
+    if (!file) {
+        spdlog::error("Failed to open input script {}", path.string());
+        return std::nullopt;
+    }
+    std::vector<ReplayEvent> presses;
+    std::string line;
+    int line_number = 0;
+    while (std::getline(file, line)) {
+        line_number++;
+        if (line.empty() || line[0] == '#' || line[0] == '\r') continue;
+        std::istringstream fields(line);
+        double ms;
+        std::string name;
+        if (!(fields >> ms >> name)) {
+            spdlog::error("{}:{}: expected \"<ms> <don_l|don_r|kat_l|kat_r>\"", path.string(), line_number);
+            return std::nullopt;
+        }
+        InputLogType type;
+        if (name == "don_l") type = InputLogType::DON_L;
+        else if (name == "don_r") type = InputLogType::DON_R;
+        else if (name == "kat_l") type = InputLogType::KAT_L;
+        else if (name == "kat_r") type = InputLogType::KAT_R;
+        else {
+            spdlog::error("{}:{}: unknown drum {}", path.string(), line_number, name);
+            return std::nullopt;
+        }
+        presses.push_back({ms, ms, type});
+    }
+    return presses;
+}
+
+struct HeadlessRun {
+    double chart_ms = 0.0;
+    double wall_ms = 0.0;
+    uint64_t updates = 0;
+    ResultData result;
+};
+
+static std::optional<HeadlessRun> play_chart(const fs::path& song, const HeadlessOptions& options,
+                                             const std::vector<ReplayEvent>* presses,
+                                             const Modifiers& base_modifiers = {}) {
+    std::optional<SongParser> parser;
+    try {
+        parser = SongParser(song, song.extension() == ".osu" ? 0 : TJA_START_DELAY_MS);
+    } catch (const std::exception& e) {
+        spdlog::error("Failed to parse {}: {}", song.string(), e.what());
+        return std::nullopt;
+    }
+
+    auto& courses = parser->metadata.course_data;
+    int difficulty = static_cast<int>(Difficulty::EASY);
+    if (options.difficulty.has_value()) {
+        if (courses.find(*options.difficulty) == courses.end()) {
+            spdlog::error("{} has no difficulty {}", song.string(), *options.difficulty);
+            return std::nullopt;
+        }
+        difficulty = *options.difficulty;
+    } else if (!courses.empty()) {
+        difficulty = courses.rbegin()->first;
+    }
+
+    Modifiers modifiers = base_modifiers;
+    modifiers.auto_play = modifiers.auto_play || options.auto_play;
+    std::optional<Background> background;
+    HeadlessRun run;
+    auto start = std::chrono::steady_clock::now();
+
+    std::optional<Player> player;
+    try {
+        player.emplace(parser, PlayerNum::P1, difficulty, false, modifiers, true);
+    } catch (const std::exception& e) {
+        spdlog::error("Failed to load {} difficulty {}: {}", song.string(), difficulty, e.what());
+        return std::nullopt;
+    }
+    if (presses) player->set_scripted_input(*presses);
+
+    double start_ms = 0.0;
+    if (std::optional<Note> first = player->get_first_note()) start_ms = std::min(start_ms, first->load_ms);
+    const double end_ms = player->end_time + END_MARGIN_MS;
+    const double tick_ms = std::max(options.tick_ms, 0.001);
+    run.chart_ms = end_ms - start_ms;
+    // Times from the tick count rather than a running sum, so they don't
+    // drift with the tick size
+    for (uint64_t tick = 0;; tick++) {
+        const double ms = start_ms + tick * tick_ms;
+        if (ms > end_ms) break;
+        player->advance(ms, ms, background);
+        run.updates++;
+    }
+    run.wall_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+    ResultData result = run.result = player->get_result_score();
+    std::string title = parser->metadata.title.count("en") ? parser->metadata.title.at("en") : "";
+    if (title.empty()) title = song.stem().string();
+    std::string line = fmt::format("{} [{}] score {} good {} ok {} bad {} combo {} roll {}",
+                                   title, difficulty, result.score, result.good, result.ok, result.bad,
+                                   result.max_combo, result.total_drumroll);
+    if (player->gauge.has_value()) {
+        line += fmt::format(" gauge {:.1f}% {}", player->gauge->get_progress() * 100.0,
+                            player->gauge->get_is_clear() ? "clear" : "fail");
+    }
+    if (!player->hit_errors.empty()) {
+        OffsetEstimate est = estimate_offset(player->hit_errors);
+        line += fmt::format(" error {:+.1f}ms", est.median_ms);
+    }
+    std::cout << line << "\n";
+    return run;
+}
+
+// Player reads the score method from the config; a replay swaps its own
+// in for as long as it plays, so the charts after it keep the configured one
+struct ScoreMethodOverride {
+    std::string saved;
+    explicit ScoreMethodOverride(const std::string& method) : saved(global_data.config->general.score_method) {
+        if (!method.empty()) global_data.config->general.score_method = method;
+    }
+    ~ScoreMethodOverride() { global_data.config->general.score_method = saved; }
+    ScoreMethodOverride(const ScoreMethodOverride&) = delete;
+    ScoreMethodOverride& operator=(const ScoreMethodOverride&) = delete;
+};
+
+// Plays a replay with its own chart and modifiers; fails if it no longer
+// scores what it recorded
+static std::optional<HeadlessRun> play_replay(const fs::path& path, const HeadlessOptions& options) {
+    std::optional<Replay> replay = load_replay(path);
+    if (!replay) return std::nullopt;
+    ScoreMethodOverride score_method(replay->score_method);
+
+    HeadlessOptions replay_options = options;
+    replay_options.difficulty = replay->difficulty;
+    replay_options.auto_play  = false;
+    std::optional<HeadlessRun> run = play_chart(replay->song_path, replay_options, &replay->events, replay->modifiers);
+    if (!run) return std::nullopt;
+    if (!replay_result_matches(*replay, run->result)) {
+        spdlog::error("{}: recorded score {} good {} ok {} bad {} combo {} roll {}, replayed differently",
+                      path.string(), replay->result.score, replay->result.good, replay->result.ok,
+                      replay->result.bad, replay->result.max_combo, replay->result.total_drumroll);
+        return std::nullopt;
+    }
+    return run;
+}
+
+int run_headless(const fs::path& path, const HeadlessOptions& options) {
+    std::optional<std::vector<ReplayEvent>> presses;
+    if (!options.inputs.empty()) {
+        presses = read_headless_inputs(options.inputs);
+        if (!presses) return 1;
+    }
+
+    // Only the skin's config and texture metadata are read, for the screen
+    // size, judge position and note width that note load times are
+    // measured against
+    fs::path skin_path = fs::path("Skins") / global_data.config->paths.skin / "Graphics";
+    try {
+        tex.init(skin_path);
+    } catch (const std::exception& e) {
+        spdlog::warn("Failed to read skin config from {}: {}", skin_path.string(), e.what());
+    }
+    JudgePos::X = tex.skin_config[SC::JUDGE_POS].x;
+    JudgePos::Y = tex.skin_config[SC::JUDGE_POS].y;
+    if (Player::skin_note_width() <= 0) {
+        spdlog::warn("{} has no notes/9 texture; note load times won't match a played game",
+                     skin_path.string());
+    }
+
+    std::vector<fs::path> songs;
+    std::error_code ec;
+    if (fs::is_directory(path, ec)) {
+        for (auto it = fs::recursive_directory_iterator(path, fs::directory_options::skip_permission_denied, ec);
+             it != fs::recursive_directory_iterator(); it.increment(ec)) {
+            if (ec) break;
+            const fs::path ext = it->path().extension();
+            if (it->is_regular_file(ec) && (ext == ".tja" || ext == ".osu" || ext == ".ydr")) songs.push_back(it->path());
+        }
+        // Same order on every run, so result files diff cleanly
+        std::sort(songs.begin(), songs.end());
+    } else if (fs::exists(path, ec)) {
+        songs.push_back(path);
+    } else {
+        spdlog::error("Song file not found: {}", path.string());
+        return 1;
+    }
+
+    int failed = 0;
+    HeadlessRun total;
+    for (const fs::path& song : songs) {
+        std::optional<HeadlessRun> run = song.extension() == ".ydr"
+            ? play_replay(song, options)
+            : play_chart(song, options, presses ? &*presses : nullptr);
+        if (!run) {
+            failed++;
+            continue;
+        }
+        total.chart_ms += run->chart_ms;
+        total.wall_ms  += run->wall_ms;
+        total.updates  += run->updates;
+    }
+
+    const double wall_s = total.wall_ms / 1000.0;
+    std::cerr << fmt::format("{} charts ({} failed), {} updates in {:.1f}ms: {:.0f} updates/s, {:.0f}x realtime\n",
+                             songs.size(), failed, total.updates, total.wall_ms,
+                             wall_s > 0 ? total.updates / wall_s : 0.0,
+                             total.wall_ms > 0 ? total.chart_ms / total.wall_ms : 0.0);
+    return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include "../../libs/replay.h"
+#include <filesystem>
+#include <optional>
+#include <vector>
+
+struct HeadlessOptions {
+    std::optional<int> difficulty;  // highest course when unset
+    double tick_ms = 1.0;           // chart time between updates
+    bool auto_play = false;
+    std::filesystem::path inputs;   // presses to play; none means every note is missed
+};
+
+// "<ms> don_l|don_r|kat_l|kat_r" per line in chart time, as input_log
+// records them; blank lines and lines starting with # are skipped. Each
+// press is judged on the first update at or past it.
+std::optional<std::vector<ReplayEvent>> read_headless_inputs(const std::filesystem::path& path);
+
+// Plays a chart, or every .tja/.osu under a directory, through Player
+// with no window, audio or textures. Prints one result line per chart to
+// stdout (identical across runs and machines for the same inputs) and the
+// timing to stderr. A .ydr replay, or a directory of them, is played with
+// its own chart, modifiers and presses and checked against the score it
+// recorded. Returns non-zero if anything couldn't be played or a replay
+// scored differently.
+int run_headless(const std::filesystem::path& path, const HeadlessOptions& options);
@@ -1,13 +1,25 @@
 #include "player.h"
 #include "../../libs/audio.h"
 #include "../../libs/input.h"
+#include "../../libs/profiler.h"
 #include "../../libs/scores.h"
+#include <algorithm>
+#include <cassert>
 #include <cmath>
+#include <limits>
+#include <random>
+
+// GameScreen swaps in the nijiiro set when that's enabled
+int Player::skin_note_width() {
+    const char* subset = global_data.config->general.nijiiro_notes ? "notes_nijiiro" : "notes";
+    return tex.read_texture_width("game", subset, "9");
+}
 
 Player::Player(std::optional<SongParser>& parser_ref, PlayerNum player_num_param, int difficulty_param,
-       bool is_2p_param, const Modifiers& modifiers_param)
+       bool is_2p_param, const Modifiers& modifiers_param, bool headless_param)
     : is_2p(is_2p_param)
     , is_dan(false)
+    , headless(headless_param)
     , player_num(player_num_param)
     , difficulty(difficulty_param)
     , visual_offset(global_data.config->general.visual_offset)
@@ -27,12 +39,26 @@ Player::Player(std::optional<SongParser>& parser_ref, PlayerNum player_num_param
     , is_gogo_time(false)
     , autoplay_hit_side(Side::LEFT)
     , last_subdivision(-1)
-    , combo_display(combo, 0)
-    , score_counter(0, is_2p)
 {
+    // Pinned so seek_to reshuffles the same way and a replay can redo it
+    if (modifiers.random > 0 && modifiers.random_seed == 0) modifiers.random_seed = std::random_device{}();
+    // Headless runs load no textures, so they read notes/9 from the skin's
+    // files; the two must agree or branch sections count different notes
+    if (headless) {
+        note_half_w = skin_note_width() / 2;
+    } else {
+        note_half_w = tex.textures[NOTES::_9]->width / 2;
+        assert(skin_note_width() / 2 == note_half_w && "headless note load times would differ");
+    }
     reset_chart();
-    don_hitsound = "hitsound_don_" + std::to_string((int)player_num) + "p";
-    kat_hitsound = "hitsound_kat_" + std::to_string((int)player_num) + "p";
+    if (headless) return;
+
+    combo_display.emplace(combo, 0);
+    score_counter.emplace(0, is_2p);
+    don_hitsound = audio.get_sound_id("hitsound_don_" + std::to_string((int)player_num) + "p");
+    kat_hitsound = audio.get_sound_id("hitsound_kat_" + std::to_string((int)player_num) + "p");
+    balloon_pop_sound  = audio.get_sound_id("balloon_pop");
+    kusudama_pop_sound = audio.get_sound_id("kusudama_pop");
 
     std::string pnum = std::to_string((int)player_num);
     lane_cover_tex_id = tex.get_enum("lane/" + pnum + "p_lane_cover");
@@ -91,7 +117,8 @@ void Player::spawn_ending_anim() {
     }
 }
 
-void Player::reload_for_dan(std::optional<SongParser>& new_parser, int new_difficulty) {
+void Player::reload_for_dan(std::optional<SongParser>& new_parser, int new_difficulty,
+                            std::optional<ChartNotes> compiled) {
     parser = new_parser;
     difficulty = new_difficulty;
 
@@ -108,7 +135,7 @@ void Player::reload_for_dan(std::optional<SongParser>& new_parser, int new_diffi
     draw_judge_list.clear();
 
     gauge.reset();
-    reset_chart();
+    reset_chart(std::move(compiled));
     gauge.reset();  // reset_chart recreates gauge; discard it for dan mode
 }
 
@@ -132,6 +159,9 @@ void Player::handle_timeline(double ms_from_start) {
     }
 }
 
+// How far ahead of the chart autoplay hits are queued on the audio stream
+static constexpr double AUTOPLAY_LOOKAHEAD_MS = 50.0;
+
 void Player::autoplay_manager(double ms_from_start, double current_ms, std::optional<Background>& background) {
     if (!modifiers.auto_play) return;
 
@@ -147,8 +177,10 @@ void Player::autoplay_manager(double ms_from_start, double current_ms, std::opti
             last_subdivision = subdivision_in_ms;
             hit_type = DrumType::DON;
             autoplay_hit_side = autoplay_hit_side == Side::LEFT ? Side::RIGHT : Side::LEFT;
-            spawn_hit_effects(hit_type, autoplay_hit_side);
-            audio.play_sound(don_hitsound, VolumePreset::HITSOUND);
+            if (presenting()) {
+                apply([this, side = autoplay_hit_side] { spawn_hit_effects(DrumType::DON, side); });
+                audio.play_sound(don_hitsound, VolumePreset::HITSOUND);
+            }
             check_note(ms_from_start, hit_type, current_ms, background);
         }
     } else {
@@ -156,29 +188,58 @@ void Player::autoplay_manager(double ms_from_start, double current_ms, std::opti
         // up both sides and leave the alternating hand where it was for the
         // next single note. Drumrolls keep alternating even when big.
         auto autoplay_hit = [&](DrumType type, bool big) {
+            if (!presenting()) return;
             if (big) {
-                spawn_hit_effects(type, Side::LEFT);
-                spawn_hit_effects(type, Side::RIGHT);
+                apply([this, type] {
+                    spawn_hit_effects(type, Side::LEFT);
+                    spawn_hit_effects(type, Side::RIGHT);
+                });
             } else {
                 autoplay_hit_side = autoplay_hit_side == Side::LEFT ? Side::RIGHT : Side::LEFT;
-                spawn_hit_effects(type, autoplay_hit_side);
+                apply([this, type, side = autoplay_hit_side] { spawn_hit_effects(type, side); });
             }
         };
 
+        // Queue hitsounds slightly ahead on the audio stream so each one
+        // starts on its exact sample rather than on the first frame past
+        // hit_ms. Judgement below still happens on the frame loop.
+        // ms_from_start follows the audible clock, so the schedule is
+        // anchored there and must look past the output latency.
+        const double horizon_ms = !presenting() ? ms_from_start
+                                                : ms_from_start + AUTOPLAY_LOOKAHEAD_MS + audio.get_output_latency() * 1000.0;
+        // The audio clock as of current_ms, the instant ms_from_start was
+        // read for, rather than however far into the frame this runs
+        const double stream_now = !presenting() ? 0.0 : audio.get_audio_clock() - (get_current_ms() - current_ms) / 1000.0;
+        double scheduled_until  = autoplay_scheduled_ms;
+        auto schedule = [&](const std::deque<Note>& notes, SoundId sound) {
+            if (!presenting()) return;
+            for (const Note& note : notes) {
+                if (note.hit_ms > horizon_ms) break;
+                if (note.hit_ms <= autoplay_scheduled_ms) continue;
+                double delay = (note.hit_ms - ms_from_start) / 1000.0 / playback_rate;
+                audio.play_sound_at(sound, stream_now + delay, VolumePreset::HITSOUND);
+                scheduled_until = std::max(scheduled_until, note.hit_ms);
+            }
+        };
+        schedule(don_notes, don_hitsound);
+        schedule(kat_notes, kat_hitsound);
+
         while (!don_notes.empty() && ms_from_start >= don_notes.front().hit_ms) {
             hit_type = DrumType::DON;
             autoplay_hit(hit_type, don_notes.front().type == NoteType::DON_L);
-            audio.play_sound(don_hitsound, VolumePreset::HITSOUND);
+            if (presenting() && don_notes.front().hit_ms > scheduled_until) audio.play_sound(don_hitsound, VolumePreset::HITSOUND);
+            // When the note was due, not the frame that got round to it
+            last_note_hit = current_ms - (ms_from_start - don_notes.front().hit_ms) / playback_rate;
             check_note(ms_from_start, hit_type, current_ms, background);
-            last_note_hit = current_ms;
         }
 
         while (!kat_notes.empty() && ms_from_start >= kat_notes.front().hit_ms) {
             hit_type = DrumType::KAT;
             autoplay_hit(hit_type, kat_notes.front().type == NoteType::KAT_L);
-            audio.play_sound(kat_hitsound, VolumePreset::HITSOUND);
+            if (presenting() && kat_notes.front().hit_ms > scheduled_until) audio.play_sound(kat_hitsound, VolumePreset::HITSOUND);
             check_note(ms_from_start, hit_type, current_ms, background);
         }
+        autoplay_scheduled_ms = scheduled_until;
     }
 }
 
@@ -225,20 +286,24 @@ void Player::evaluate_branch(double current_ms) {
             branch_r_count = std::max(curr_drumroll_count, branch_r_count);
         }
         float count = branch_condition == "p" ? branch_p_count : branch_r_count;
-        if (branch_indicator.has_value()) {
-            spdlog::info("Branch set to {} based on conditions {}, {}, {}", branch_diff_to_string(branch_indicator->difficulty), count, e_req, m_req);
-        }
+        apply([this, count, e_req, m_req] {
+            if (branch_indicator.has_value()) {
+                spdlog::info("Branch set to {} based on conditions {}, {}, {}", branch_diff_to_string(branch_indicator->difficulty), count, e_req, m_req);
+            }
+        });
         if (count >= e_req && count < m_req && e_req >= 0) {
             if (!branch_e.empty()) {
                 merge_branch_section(branch_e.front(), current_ms);
                 branch_e.pop_front();
-                if (branch_indicator.has_value() and branch_indicator->difficulty != BranchDifficulty::EXPERT) {
-                    if (branch_indicator->difficulty == BranchDifficulty::MASTER) {
-                        branch_indicator->level_down(BranchDifficulty::EXPERT);
-                    } else {
-                        branch_indicator->level_up(BranchDifficulty::EXPERT);
+                apply([this] {
+                    if (branch_indicator.has_value() and branch_indicator->difficulty != BranchDifficulty::EXPERT) {
+                        if (branch_indicator->difficulty == BranchDifficulty::MASTER) {
+                            branch_indicator->level_down(BranchDifficulty::EXPERT);
+                        } else {
+                            branch_indicator->level_up(BranchDifficulty::EXPERT);
+                        }
                     }
-                }
+                });
             }
             if (!branch_m.empty()) {
                 branch_m.pop_front();
@@ -250,9 +315,11 @@ void Player::evaluate_branch(double current_ms) {
             if (!branch_m.empty()) {
                 merge_branch_section(branch_m.front(), current_ms);
                 branch_m.pop_front();
-                if (branch_indicator.has_value() and branch_indicator->difficulty != BranchDifficulty::MASTER) {
-                    branch_indicator->level_up(BranchDifficulty::MASTER);
-                }
+                apply([this] {
+                    if (branch_indicator.has_value() and branch_indicator->difficulty != BranchDifficulty::MASTER) {
+                        branch_indicator->level_up(BranchDifficulty::MASTER);
+                    }
+                });
             }
             if (!branch_n.empty()) {
                 branch_n.pop_front();
@@ -264,9 +331,11 @@ void Player::evaluate_branch(double current_ms) {
             if (!branch_n.empty()) {
                 merge_branch_section(branch_n.front(), current_ms);
                 branch_n.erase(branch_n.begin());
-                if (branch_indicator.has_value() and branch_indicator->difficulty != BranchDifficulty::NORMAL) {
-                    branch_indicator->level_down(BranchDifficulty::NORMAL);
-                }
+                apply([this] {
+                    if (branch_indicator.has_value() and branch_indicator->difficulty != BranchDifficulty::NORMAL) {
+                        branch_indicator->level_down(BranchDifficulty::NORMAL);
+                    }
+                });
             }
             if (!branch_m.empty()) {
                 branch_m.pop_front();
@@ -281,15 +350,118 @@ void Player::evaluate_branch(double current_ms) {
     }
 }
 
-void Player::update(double ms_from_start, double current_ms, std::optional<Background>& background) {
-    note_manager(ms_from_start, background);
-    combo_display.update(current_ms, combo);
-    if (combo_announce.has_value()) {
-        combo_announce->update(current_ms);
+void Player::apply(std::function<void()> effect) {
+    if (simulating) deferred_effects.push_back(std::move(effect));
+    else effect();
+}
+
+void Player::simulate(double ms_from_start, double current_ms, std::optional<Background>& background) {
+    PROFILE_SCOPE("Player::simulate");
+    simulating = true;
+    judge_notes(ms_from_start, current_ms, background);
+    if (is_branch) {
+        evaluate_branch(ms_from_start);
+    }
+    simulating = false;
+}
+
+void Player::update(double ms_from_start, double current_ms, std::optional<Background>& background, bool judge) {
+    PROFILE_SCOPE("Player::update");
+    draw_note_manager(ms_from_start);
+    // After the note buffer has caught up, so a queued hit finds its note
+    for (auto& effect : deferred_effects) effect();
+    deferred_effects.clear();
+    if (presenting()) update_hit_effects(current_ms);
+    if (!headless) update_counters(current_ms);
+    handle_timeline(ms_from_start);
+    if (delay_start.has_value() && delay_end.has_value()) {
+        if (ms_from_start >= delay_end.value()) {
+            double delay = delay_end.value() - delay_start.value();
+            for (auto& note : draw_note_buffer) note.load_ms += delay;
+            for (auto& note : draw_note_list) note.load_ms += delay;
+            for (auto& note : barlines) note.load_ms += delay;
+            delay_start.reset();
+            delay_end.reset();
+        }
+    }
+
+    if (presenting()) update_score_effects(current_ms);
+    if (judge) judge_notes(ms_from_start, current_ms, background);
+    if (dan_gauge) {
+        dan_gauge->update(current_ms);
+    } else if (gauge.has_value()) {
+        gauge->update(current_ms);
+        if (background.has_value()) {
+            background->handle_gauge(player_num, gauge->get_progress(), gauge->get_is_clear(), gauge->get_is_rainbow());
+        }
+    }
+    if (!headless) update_overlays(current_ms);
+
+    if (judge && is_branch) {
+        evaluate_branch(ms_from_start);
+    }
+    if (chara && presenting()) chara->update(current_ms);
+
+    drawn.combo = combo;
+    drawn.is_balloon = is_balloon;
+    drawn.active_index = other_notes.empty() ? -1 : other_notes.front().index;
+}
+
+void Player::judge_notes(double ms_from_start, double current_ms, std::optional<Background>& background) {
+    // Presses first: each one misses only the notes whose window closed
+    // before it was pressed, however late in the frame it is seen
+    handle_input(ms_from_start, current_ms, background);
+    pass_notes(ms_from_start, background);
+    autoplay_manager(ms_from_start, current_ms, background);
+}
+
+void Player::pass_notes(double ms, std::optional<Background>& background) {
+    size_t pending;
+    do {
+        pending = don_notes.size() + kat_notes.size() + other_notes.size();
+        play_note_manager(ms, background);
+    } while (don_notes.size() + kat_notes.size() + other_notes.size() != pending);
+}
+
+void Player::advance(double ms_from_start, double current_ms, std::optional<Background>& background) {
+    while (scripted_input.has_value() && !modifiers.auto_play && scripted_index < scripted_input->size()) {
+        const double judge_ms = (*scripted_input)[scripted_index].judge_ms;
+        if (judge_ms >= ms_from_start) break;
+        update(judge_ms, current_ms, background, true);
+    }
+    update(ms_from_start, current_ms, background, true);
+}
+
+// About where a frame would have landed timeline and branch changes
+static constexpr double FAST_FORWARD_STEP_MS = 1.0;
+
+void Player::fast_forward(double from_ms, double to_ms, double current_ms) {
+    std::optional<Background> no_background;
+    fast_forwarding = true;
+    for (uint64_t step = 0;; step++) {
+        const double ms = from_ms + step * FAST_FORWARD_STEP_MS;
+        if (ms >= to_ms) break;
+        advance(ms, current_ms, no_background);
     }
+    advance(to_ms, current_ms, no_background);
+    fast_forwarding = false;
+    draw_judge_list.clear();
+    draw_arc_list.clear();
+    base_score_list.clear();
+    if (score_counter) score_counter->update_count(score);
+}
+
+void Player::update_counters(double current_ms) {
     drumroll_counter_manager(current_ms);
     balloon_counter_manager(current_ms);
     kusudama_counter_manager(current_ms);
+}
+
+void Player::update_hit_effects(double current_ms) {
+    combo_display->update(current_ms, combo);
+    if (combo_announce.has_value()) {
+        combo_announce->update(current_ms);
+    }
     for (auto it = draw_judge_list.begin(); it != draw_judge_list.end(); ) {
         it->update(current_ms);
         if (it->is_finished()) {
@@ -321,18 +493,9 @@ void Player::update(double ms_from_start, double current_ms, std::optional<Backg
             ++it;
         }
     }
-    handle_timeline(ms_from_start);
-    if (delay_start.has_value() && delay_end.has_value()) {
-        if (ms_from_start >= delay_end.value()) {
-            double delay = delay_end.value() - delay_start.value();
-            for (auto& note : draw_note_buffer) note.load_ms += delay;
-            for (auto& note : draw_note_list) note.load_ms += delay;
-            for (auto& note : barlines) note.load_ms += delay;
-            delay_start.reset();
-            delay_end.reset();
-        }
-    }
+}
 
+void Player::update_score_effects(double current_ms) {
     for (auto it = draw_arc_list.begin(); it != draw_arc_list.end(); ) {
         it->update(current_ms);
         if (it->is_finished()) {
@@ -358,26 +521,19 @@ void Player::update(double ms_from_start, double current_ms, std::optional<Backg
         if (it->is_finished()) {
             it = base_score_list.erase(it);
             if (tex.options[SCO::DELAY_SCORE_ADDITION])
-                score_counter.update_count(score);
+                score_counter->update_count(score);
         } else {
             ++it;
         }
     }
     if (!tex.options[SCO::DELAY_SCORE_ADDITION]) {
-        score_counter.update_count(score);
+        score_counter->update_count(score);
     }
-    score_counter.update(current_ms);
-    autoplay_manager(ms_from_start, current_ms, background);
-    handle_input(ms_from_start, current_ms, background);
+    score_counter->update(current_ms);
+}
+
+void Player::update_overlays(double current_ms) {
     nameplate.update(current_ms);
-    if (dan_gauge) {
-        dan_gauge->update(current_ms);
-    } else if (gauge.has_value()) {
-        gauge->update(current_ms);
-        if (background.has_value()) {
-            background->handle_gauge(player_num, gauge->get_progress(), gauge->get_is_clear(), gauge->get_is_rainbow());
-        }
-    }
     if (judge_counter.has_value()) {
         judge_counter->update(good_count, ok_count, bad_count, total_drumroll);
     }
@@ -387,14 +543,10 @@ void Player::update(double ms_from_start, double current_ms, std::optional<Backg
     if (ending_anim.has_value()) {
         std::visit([&current_ms](auto& anim) { anim.update(current_ms); }, ending_anim.value());
     }
-
-    if (is_branch) {
-        evaluate_branch(ms_from_start);
-    }
-    chara->update(current_ms);
 }
 
 void Player::draw(double ms_from_start, float x, float y, ray::Shader& mask_shader) {
+    PROFILE_SCOPE("Player::draw");
     tex.draw_texture(LANE::LANE_BACKGROUND, {.y=y});
     if (player_num == PlayerNum::AI) tex.draw_texture(LANE::AI_LANE_BACKGROUND, {.y=y});
     if (branch_indicator.has_value()) {
@@ -474,7 +626,6 @@ void Player::draw_practice(double ms_from_start, float x, float y, ray::Shader&
 }
 
 void Player::get_load_time(Note& note) {
-    int note_half_w = tex.textures[NOTES::_9]->width / 2;
     float travel_distance = tex.screen_width - JudgePos::X;
     float base_pixels_per_ms = (note.bpm / 240000 * abs(note.scroll_x) * travel_distance);
     if (base_pixels_per_ms == 0) {
@@ -504,8 +655,10 @@ void Player::get_load_time(Note& note) {
     note.unload_ms = note.hit_ms + unload_offset;
 }
 
-void Player::reset_chart() {
-    auto [notes, branch_m_temp, branch_e_temp, branch_n_temp] = parser->notes_to_position(difficulty);
+void Player::reset_chart(std::optional<ChartNotes> compiled) {
+    autoplay_scheduled_ms = -std::numeric_limits<double>::infinity();
+    auto [notes, branch_m_temp, branch_e_temp, branch_n_temp] =
+        compiled.has_value() ? std::move(*compiled) : parser->notes_to_position(difficulty);
     apply_modifiers(notes, modifiers);
 
     Note* last_note = nullptr;
@@ -614,7 +767,7 @@ void Player::reset_chart() {
             gauge_total_notes++;
         }
     }
-    gauge = Gauge(GaugeMode::NORMAL, player_num, gauge_total_notes, difficulty, stars);
+    gauge = Gauge(GaugeMode::NORMAL, player_num, gauge_total_notes, difficulty, stars, !headless);
 
     //setup score
     base_score = 0;
@@ -692,12 +845,12 @@ void Player::handle_gogotime(double ms_from_start, const TimelineObject& timelin
 
     is_gogo_time = timeline_object.gogo_time.value();
 
-    if (is_gogo_time) {
+    if (!headless && is_gogo_time) {
         gogo_time = GogoTime();
         fireworks = Fireworks();
         chara->set_anim(AnimIndex::DON_SABI);
         chara->set_anim(AnimIndex::DON_SABI_START);
-    } else {
+    } else if (!headless) {
         gogo_time.reset();
         chara->set_anim(AnimIndex::DON_NORMAL);
     }
@@ -740,7 +893,7 @@ void Player::handle_bpmchange(double ms_from_start, const TimelineObject& timeli
     if (!timeline_object.bpm.has_value()) return;
 
     bpm = timeline_object.bpm.value();
-    chara->set_bpm(bpm);
+    if (chara) chara->set_bpm(bpm);
 
     if (buffer_index != (int)timeline_buffer.size() - 1)
         timeline_buffer[buffer_index] = std::move(timeline_buffer.back());
@@ -813,7 +966,7 @@ void Player::handle_lyric(double ms_from_start, const TimelineObject& timeline_o
         current_lyric.reset();
     }
 
-    current_lyric.emplace(timeline_object.lyric.value(), 40, ray::WHITE, ray::BLUE, false, 4.0);
+    if (!headless) current_lyric.emplace(timeline_object.lyric.value(), 40, ray::WHITE, ray::BLUE, false, 4.0);
     if (buffer_index != (int)timeline_buffer.size() - 1)
         timeline_buffer[buffer_index] = std::move(timeline_buffer.back());
     timeline_buffer.pop_back();
@@ -822,10 +975,12 @@ void Player::handle_lyric(double ms_from_start, const TimelineObject& timeline_o
 void Player::play_note_manager(double current_ms, std::optional<Background>& background) {
     if (!don_notes.empty() && don_notes.front().hit_ms + Timing::BAD < current_ms) {
         combo = 0;
-        if (background.has_value()) background->handle_bad(PlayerNum(1 + is_2p));
         bad_count++;
-        if (dan_gauge) dan_gauge->add_bad();
-        else if (gauge.has_value()) gauge->add_bad();
+        apply([this, &background] {
+            if (background.has_value()) background->handle_bad(PlayerNum(1 + is_2p));
+            if (dan_gauge) dan_gauge->add_bad();
+            else if (gauge.has_value()) gauge->add_bad();
+        });
 
         don_notes.pop_front();
         branch_note_count++;
@@ -833,10 +988,12 @@ void Player::play_note_manager(double current_ms, std::optional<Background>& bac
 
     if (!kat_notes.empty() && kat_notes.front().hit_ms + Timing::BAD < current_ms) {
         combo = 0;
-        if (background.has_value()) background->handle_bad(PlayerNum(1 + is_2p));
         bad_count++;
-        if (dan_gauge) dan_gauge->add_bad();
-        else if (gauge.has_value()) gauge->add_bad();
+        apply([this, &background] {
+            if (background.has_value()) background->handle_bad(PlayerNum(1 + is_2p));
+            if (dan_gauge) dan_gauge->add_bad();
+            else if (gauge.has_value()) gauge->add_bad();
+        });
 
         kat_notes.pop_front();
         branch_note_count++;
@@ -871,6 +1028,11 @@ void Player::play_note_manager(double current_ms, std::optional<Background>& bac
 }
 
 void Player::draw_note_manager(double current_ms) {
+    if (headless) {
+        // Branch sections still time themselves off draw_note_list
+        while (!draw_note_list.empty() && current_ms >= draw_note_list.front().load_ms) draw_note_list.pop_front();
+        return;
+    }
     if (!draw_note_list.empty() && current_ms >= draw_note_list.front().load_ms) {
         Note current_note = draw_note_list.front();
         draw_note_list.pop_front();
@@ -935,11 +1097,6 @@ void Player::draw_note_manager(double current_ms) {
         draw_note_buffer.end());
 }
 
-void Player::note_manager(double current_ms, std::optional<Background>& background) {
-    play_note_manager(current_ms, background);
-    draw_note_manager(current_ms);
-}
-
 void Player::note_correct(const Note& note, double current_ms) {
     if (!don_notes.empty() && don_notes[0] == note) {
         don_notes.pop_front();
@@ -959,70 +1116,88 @@ void Player::note_correct(const Note& note, double current_ms) {
     if (note.type < NoteType::BALLOON_HEAD) {
         combo++;
         if (combo % 10 == 0) {
-            chara->set_anim(AnimIndex::DON_COMBO);
+            present([this] { if (chara) chara->set_anim(AnimIndex::DON_COMBO); });
         }
         if (combo % 100 == 0) {
-            combo_announce = ComboAnnounce(combo, current_ms, player_num);
+            present([this, combo = combo, current_ms] { combo_announce = ComboAnnounce(combo, current_ms, player_num); });
         }
         if (combo > max_combo) {
             max_combo = combo;
         }
         if (combo % 100 == 0 && score_method == ScoreMethod::GEN3) {
             score += 10000;
-            base_score_list.push_back(ScoreCounterAnimation(player_num, 10000, is_2p));
+            present([this] { base_score_list.push_back(ScoreCounterAnimation(player_num, 10000, is_2p)); });
         }
     }
 
     if (note.type != NoteType::KUSUDAMA) {
-        bool is_big = note.type == NoteType::DON_L || note.type == NoteType::KAT_L || note.type == NoteType::BALLOON_HEAD;
-        draw_arc_list.push_back(NoteArc(note.type, current_ms, PlayerNum(is_2p + 1), is_big, note.type == NoteType::BALLOON_HEAD, judge_x, judge_y));
-    }
-    auto it = std::lower_bound(draw_note_buffer.begin(), draw_note_buffer.end(),
-                               note.index, [](const Note& n, int idx) { return n.index < idx; });
-    if (it != draw_note_buffer.end() && *it == note) {
-        draw_note_buffer.erase(it);
-    }
+        present([this, type = note.type, current_ms] {
+            bool is_big = type == NoteType::DON_L || type == NoteType::KAT_L || type == NoteType::BALLOON_HEAD;
+            draw_arc_list.push_back(NoteArc(type, current_ms, PlayerNum(is_2p + 1), is_big, type == NoteType::BALLOON_HEAD, judge_x, judge_y));
+        });
+    }
+    apply([this, note] {
+        auto it = std::lower_bound(draw_note_buffer.begin(), draw_note_buffer.end(),
+                                   note.index, [](const Note& n, int idx) { return n.index < idx; });
+        if (it != draw_note_buffer.end() && *it == note) {
+            draw_note_buffer.erase(it);
+        }
+    });
 }
 
 void Player::check_drumroll(double current_ms, DrumType drum_type, std::optional<Background>& background) {
-    draw_arc_list.push_back(NoteArc(NoteType(drum_type), current_ms, PlayerNum(is_2p + 1), (int)drum_type == 3 || (int)drum_type == 4, false));
+    present([this, drum_type, current_ms] {
+        draw_arc_list.push_back(NoteArc(NoteType(drum_type), current_ms, PlayerNum(is_2p + 1), (int)drum_type == 3 || (int)drum_type == 4, false));
+    });
     curr_drumroll_count++;
     total_drumroll++;
     branch_r_count++;
-    if (background.has_value()) background->handle_drumroll(PlayerNum(is_2p + 1));
+    apply([this, &background] { if (background.has_value()) background->handle_drumroll(PlayerNum(is_2p + 1)); });
     score += 100;
-    if (base_score_list.size() < 5) {
-        base_score_list.push_back(ScoreCounterAnimation(player_num, 100, is_2p));
-    }
-    if (draw_note_buffer.empty()) return;
-    if (!other_notes.empty()) {
-        int active_drumroll_index = other_notes[0].index;
+    present([this] {
+        if (base_score_list.size() < 5) base_score_list.push_back(ScoreCounterAnimation(player_num, 100, is_2p));
+    });
+    if (other_notes.empty()) return;
+    apply([this, active_drumroll_index = other_notes[0].index, hits = curr_drumroll_count] {
         auto drumroll_it = std::lower_bound(draw_note_buffer.begin(), draw_note_buffer.end(),
                                             active_drumroll_index,
                                             [](const Note& n, int idx) { return n.index < idx; });
         if (drumroll_it != draw_note_buffer.end() && drumroll_it->index == active_drumroll_index &&
             (drumroll_it->type == NoteType::ROLL_HEAD || drumroll_it->type == NoteType::ROLL_HEAD_L) &&
             drumroll_it->color.has_value()) {
-            drumroll_it->color.value() = std::max(0, 255 - (curr_drumroll_count * 10));
+            drumroll_it->color.value() = std::max(0, 255 - (hits * 10));
         }
-    }
+    });
 }
 
 void Player::check_balloon(double current_ms, DrumType drum_type, const Note& balloon, std::optional<Background>& background) {
     if (drum_type != DrumType::DON) return;
-    if (!balloon_counter.has_value()) {
-        balloon_counter = BalloonCounter(balloon.count.value(), is_2p);
-        chara->set_anim(AnimIndex::DON_BALLOON_LOOP);
-    }
-    if (background.has_value()) background->handle_balloon(PlayerNum(is_2p + 1));
+    if (!headless) {
+        apply([this, count = balloon.count.value()] {
+            if (balloon_counter.has_value()) return;
+            balloon_counter = BalloonCounter(count, is_2p);
+            chara->set_anim(AnimIndex::DON_BALLOON_LOOP);
+        });
+    }
+    apply([this, &background] { if (background.has_value()) background->handle_balloon(PlayerNum(is_2p + 1)); });
     curr_balloon_count++;
     total_drumroll++;
     score += 100;
-    base_score_list.push_back(ScoreCounterAnimation(player_num, 100, is_2p));
+    present([this] { base_score_list.push_back(ScoreCounterAnimation(player_num, 100, is_2p)); });
     if (curr_balloon_count == balloon.count.value()) {
         is_balloon = false;
-        balloon_counter->update(current_ms, curr_balloon_count);
-        audio.play_sound("balloon_pop", VolumePreset::HITSOUND);
+        if (!headless) {
+            apply([this, current_ms, hits = curr_balloon_count] {
+                if (balloon_counter.has_value()) balloon_counter->update(current_ms, hits);
+            });
+        }
+        if (presenting()) audio.play_sound(balloon_pop_sound, VolumePreset::HITSOUND);
+        // Scored on the pop itself so headless runs match; the counter
+        // animation only decides the chara's reaction
+        if (score_method == ScoreMethod::GEN3) {
+            score += 5000;
+            present([this] { base_score_list.push_back(ScoreCounterAnimation(player_num, 5000, is_2p)); });
+        }
         note_correct(balloon, current_ms);
         curr_balloon_count = 0;
     }
@@ -1030,18 +1205,24 @@ void Player::check_balloon(double current_ms, DrumType drum_type, const Note& ba
 
 void Player::check_kusudama(double current_ms, DrumType drum_type, const Note& balloon, std::optional<Background>& background) {
     if (drum_type != DrumType::DON) return;
-    if (!kusudama_counter.has_value()) {
-        kusudama_counter = KusudamaCounter(balloon.count.value());
+    if (!headless) {
+        apply([this, count = balloon.count.value()] {
+            if (!kusudama_counter.has_value()) kusudama_counter = KusudamaCounter(count);
+        });
     }
-    if (background.has_value()) background->handle_balloon(PlayerNum(is_2p + 1));
+    apply([this, &background] { if (background.has_value()) background->handle_balloon(PlayerNum(is_2p + 1)); });
     curr_balloon_count++;
     total_drumroll++;
     score += 100;
-    base_score_list.push_back(ScoreCounterAnimation(player_num, 100, is_2p));
+    present([this] { base_score_list.push_back(ScoreCounterAnimation(player_num, 100, is_2p)); });
     if (curr_balloon_count == balloon.count.value()) {
         is_balloon = false;
-        audio.play_sound("kusudama_pop", VolumePreset::HITSOUND);
-        kusudama_counter->update(current_ms, curr_balloon_count);
+        if (presenting()) audio.play_sound(kusudama_pop_sound, VolumePreset::HITSOUND);
+        if (!headless) {
+            apply([this, current_ms, hits = curr_balloon_count] {
+                if (kusudama_counter.has_value()) kusudama_counter->update(current_ms, hits);
+            });
+        }
         note_correct(balloon, current_ms);
         curr_balloon_count = 0;
     }
@@ -1100,40 +1281,53 @@ void Player::check_note(double ms_from_start, DrumType drum_type, double current
         if (ms_from_start > (curr_note.hit_ms + bad_window_ms)) return;
 
         bool big = curr_note.type == NoteType::DON_L || curr_note.type == NoteType::KAT_L;
+        // How late the hit was in real time, for offset calibration;
+        // chart time runs at playback_rate
+        const double hit_error_ms = (ms_from_start - curr_note.hit_ms) / playback_rate;
         if ((curr_note.hit_ms - good_window_ms <= ms_from_start) && (ms_from_start <= curr_note.hit_ms + good_window_ms)) {
-            if (draw_judge_list.size() < 7) {
-                draw_judge_list.push_back(Judgment(Judgments::GOOD, big));
-            }
-            lane_hit_effect = LaneHitEffect(drum_type, Judgments::GOOD);
             good_count++;
             score += base_score;
-            if (base_score_list.size() < 5) {
-                base_score_list.push_back(ScoreCounterAnimation(player_num, base_score, is_2p));
-            }
+            present([this, big, drum_type, added = base_score] {
+                if (draw_judge_list.size() < 7) {
+                    draw_judge_list.push_back(Judgment(Judgments::GOOD, big));
+                }
+                lane_hit_effect = LaneHitEffect(drum_type, Judgments::GOOD);
+                if (base_score_list.size() < 5) {
+                    base_score_list.push_back(ScoreCounterAnimation(player_num, added, is_2p));
+                }
+            });
             note_correct(curr_note, current_ms);
-            if (dan_gauge) dan_gauge->add_good();
-            else if (gauge.has_value()) gauge->add_good();
+            hit_errors.push_back(hit_error_ms);
             branch_p_count++;
             branch_note_count++;
-            if (background.has_value()) background->handle_good(PlayerNum(1 + is_2p));
+            apply([this, &background] {
+                if (dan_gauge) dan_gauge->add_good();
+                else if (gauge.has_value()) gauge->add_good();
+                if (background.has_value()) background->handle_good(PlayerNum(1 + is_2p));
+            });
 
         } else if ((curr_note.hit_ms - ok_window_ms) <= ms_from_start && ms_from_start <= (curr_note.hit_ms + ok_window_ms)) {
-            draw_judge_list.push_back(Judgment(Judgments::OK, big));
-            lane_hit_effect = LaneHitEffect(drum_type, Judgments::OK);
             ok_count++;
             score += 10 * std::floor(base_score / 2 / 10);
-            if (base_score_list.size() < 5) {
-                base_score_list.push_back(ScoreCounterAnimation(player_num, 10 * std::floor(base_score / 2 / 10), is_2p));
-            }
+            present([this, big, drum_type, added = 10 * std::floor(base_score / 2 / 10)] {
+                draw_judge_list.push_back(Judgment(Judgments::OK, big));
+                lane_hit_effect = LaneHitEffect(drum_type, Judgments::OK);
+                if (base_score_list.size() < 5) {
+                    base_score_list.push_back(ScoreCounterAnimation(player_num, added, is_2p));
+                }
+            });
             note_correct(curr_note, current_ms);
-            if (dan_gauge) dan_gauge->add_ok();
-            else if (gauge.has_value()) gauge->add_ok();
+            hit_errors.push_back(hit_error_ms);
             branch_p_count += 0.5;
             branch_note_count++;
-            if (background.has_value()) background->handle_ok(PlayerNum(1 + is_2p));
+            apply([this, &background] {
+                if (dan_gauge) dan_gauge->add_ok();
+                else if (gauge.has_value()) gauge->add_ok();
+                if (background.has_value()) background->handle_ok(PlayerNum(1 + is_2p));
+            });
 
         } else if ((curr_note.hit_ms - bad_window_ms) <= ms_from_start && ms_from_start <= (curr_note.hit_ms + bad_window_ms)) {
-            draw_judge_list.push_back(Judgment(Judgments::BAD, big));
+            present([this, big] { draw_judge_list.push_back(Judgment(Judgments::BAD, big)); });
             bad_count++;
             combo = 0;
             branch_note_count++;
@@ -1145,12 +1339,14 @@ void Player::check_note(double ms_from_start, DrumType drum_type, double current
                 note = kat_notes.front();
                 kat_notes.pop_front();
             }
-            auto it = std::lower_bound(draw_note_buffer.begin(), draw_note_buffer.end(),
-                                       note.index, [](const Note& n, int idx) { return n.index < idx; });
-            if (it != draw_note_buffer.end() && *it == note) draw_note_buffer.erase(it);
-            if (dan_gauge) dan_gauge->add_bad();
-            else if (gauge.has_value()) gauge->add_bad();
-            if (background.has_value()) background->handle_bad(PlayerNum(1 + is_2p));
+            apply([this, &background, note] {
+                auto it = std::lower_bound(draw_note_buffer.begin(), draw_note_buffer.end(),
+                                           note.index, [](const Note& n, int idx) { return n.index < idx; });
+                if (it != draw_note_buffer.end() && *it == note) draw_note_buffer.erase(it);
+                if (dan_gauge) dan_gauge->add_bad();
+                else if (gauge.has_value()) gauge->add_bad();
+                if (background.has_value()) background->handle_bad(PlayerNum(1 + is_2p));
+            });
         }
     }
 }
@@ -1180,10 +1376,6 @@ void Player::balloon_counter_manager(double current_ms) {
     if (balloon_counter.has_value()) {
         balloon_counter->update(current_ms, curr_balloon_count);
         if (balloon_counter->is_finished()) {
-            if (score_method == ScoreMethod::GEN3) {
-                score += 5000;
-                base_score_list.push_back(ScoreCounterAnimation(player_num, 5000, is_2p));
-            }
             balloon_counter.reset();
             chara->set_anim(AnimIndex::DON_NORMAL);
             chara->set_anim(AnimIndex::DON_BALLOON_SUCCESS);
@@ -1210,38 +1402,86 @@ void Player::spawn_hit_effects(DrumType drum_type, Side side) {
     }
 }
 
+void Player::set_scripted_input(std::vector<ReplayEvent> presses) {
+    std::stable_sort(presses.begin(), presses.end(), [](const ReplayEvent& a, const ReplayEvent& b) {
+        return a.judge_ms != b.judge_ms ? a.judge_ms < b.judge_ms : a.hit_ms < b.hit_ms;
+    });
+    scripted_input = std::move(presses);
+    scripted_index = 0;
+}
+
+void Player::handle_scripted_input(double ms_from_start, double current_ms, std::optional<Background>& background) {
+    while (scripted_index < scripted_input->size() && (*scripted_input)[scripted_index].judge_ms <= ms_from_start) {
+        const ReplayEvent press = (*scripted_input)[scripted_index++];
+        const DrumType drum_type = (press.type == InputLogType::DON_L || press.type == InputLogType::DON_R) ? DrumType::DON : DrumType::KAT;
+        const Side side = (press.type == InputLogType::DON_L || press.type == InputLogType::KAT_L) ? Side::LEFT : Side::RIGHT;
+        if (presenting()) {
+            apply([this, drum_type, side] { spawn_hit_effects(drum_type, side); });
+            audio.play_sound(drum_type == DrumType::DON ? don_hitsound : kat_hitsound, VolumePreset::HITSOUND);
+        }
+        input_log.insert({press.hit_ms, press.type});
+        press_log.push_back({press.hit_ms, ms_from_start, press.type});
+        pass_notes(press.hit_ms, background);
+        check_note(press.hit_ms, drum_type, current_ms, background);
+    }
+}
+
 void Player::handle_input(double ms_from_start, double current_ms, std::optional<Background>& background) {
     if (modifiers.auto_play) return;
+    if (scripted_input.has_value()) {
+        handle_scripted_input(ms_from_start, current_ms, background);
+        return;
+    }
+    if (headless) return;
+
+    // The input thread plays the hitsound itself when it sees the press
+    const bool thread_hitsounds = input_hitsounds_enabled();
+    if (thread_hitsounds) arm_input_hitsounds(player_num, don_hitsound, kat_hitsound);
 
     struct InputCheck {
-        bool (*check_func)(PlayerNum);
+        bool (*check_func)(PlayerNum, double*);
         DrumType drum_type;
         Side side;
-        const std::string* sound;
+        SoundId sound;
     };
 
     const InputCheck input_checks[] = {
-        InputCheck{is_l_don_pressed, DrumType::DON, Side::LEFT, &don_hitsound},
-        InputCheck{is_r_don_pressed, DrumType::DON, Side::RIGHT, &don_hitsound},
-        InputCheck{is_l_kat_pressed, DrumType::KAT, Side::LEFT, &kat_hitsound},
-        InputCheck{is_r_kat_pressed, DrumType::KAT, Side::RIGHT, &kat_hitsound}
+        InputCheck{is_l_don_pressed, DrumType::DON, Side::LEFT, don_hitsound},
+        InputCheck{is_r_don_pressed, DrumType::DON, Side::RIGHT, don_hitsound},
+        InputCheck{is_l_kat_pressed, DrumType::KAT, Side::LEFT, kat_hitsound},
+        InputCheck{is_r_kat_pressed, DrumType::KAT, Side::RIGHT, kat_hitsound}
     };
 
+    pending_presses.clear();
     for (const auto& input : input_checks) {
-
-        while (input.check_func(player_num)) {
-            spawn_hit_effects(input.drum_type, input.side);
-            audio.play_sound(*input.sound, VolumePreset::HITSOUND);
-            InputLogType log_type;
-            if (input.drum_type == DrumType::DON) {
-                log_type = input.side == Side::LEFT ? InputLogType::DON_L : InputLogType::DON_R;
-            } else {
-                log_type = input.side == Side::LEFT ? InputLogType::KAT_L : InputLogType::KAT_R;
-            }
-            input_log.insert({ms_from_start, log_type});
-            check_note(ms_from_start, input.drum_type, current_ms, background);
+        double press_ms = current_ms;
+        while (input.check_func(player_num, &press_ms)) {
+            // Judge at the moment of the press rather than at this frame;
+            // chart time runs at playback_rate against the wall clock
+            const double hit_ms = ms_from_start + (press_ms - current_ms) * playback_rate;
+            pending_presses.push_back({hit_ms, (uint8_t)(&input - input_checks)});
         }
     }
+    // Oldest first across all four drums, so each meets the notes as
+    // they stood when it was pressed
+    std::stable_sort(pending_presses.begin(), pending_presses.end(),
+                     [](const PendingPress& a, const PendingPress& b) { return a.hit_ms < b.hit_ms; });
+
+    for (const PendingPress& press : pending_presses) {
+        const InputCheck& input = input_checks[press.check];
+        apply([this, drum_type = input.drum_type, side = input.side] { spawn_hit_effects(drum_type, side); });
+        if (!thread_hitsounds) audio.play_sound(input.sound, VolumePreset::HITSOUND);
+        InputLogType log_type;
+        if (input.drum_type == DrumType::DON) {
+            log_type = input.side == Side::LEFT ? InputLogType::DON_L : InputLogType::DON_R;
+        } else {
+            log_type = input.side == Side::LEFT ? InputLogType::KAT_L : InputLogType::KAT_R;
+        }
+        input_log.insert({press.hit_ms, log_type});
+        press_log.push_back({press.hit_ms, ms_from_start, log_type});
+        pass_notes(press.hit_ms, background);
+        check_note(press.hit_ms, input.drum_type, current_ms, background);
+    }
 }
 
 void Player::draw_bar(double current_ms, float y, const Note& bar) {
@@ -1347,15 +1587,15 @@ void Player::draw_notes(double current_ms, float y) {
 
     double eighth_in_ms = (bpm == 0) ? 0 : (60000.0 * 4.0 / bpm) / 8.0;
     int current_eighth = 0;
-    if (combo >= 50 && eighth_in_ms != 0) {
+    if (drawn.combo >= 50 && eighth_in_ms != 0) {
         current_eighth = static_cast<int>(current_ms / eighth_in_ms);
     }
 
     auto skip_note = [&](const Note& note) {
-        if (balloon_counter.has_value() && note.type == NoteType::BALLOON_HEAD && !other_notes.empty() && note.index == other_notes[0].index) {
+        if (balloon_counter.has_value() && note.type == NoteType::BALLOON_HEAD && note.index == drawn.active_index) {
             return true;
         }
-        if (kusudama_counter.has_value() && note.type == NoteType::KUSUDAMA && !other_notes.empty() && note.index == other_notes[0].index) {
+        if (kusudama_counter.has_value() && note.type == NoteType::KUSUDAMA && note.index == drawn.active_index) {
             return true;
         }
         return note.type == NoteType::TAIL;
@@ -1487,7 +1727,7 @@ void Player::draw_overlays(float y, const ray::Shader& mask_shader) {
     }
     draw_modifiers(y);
 
-    combo_display.draw(y);
+    combo_display->draw(y);
     if (combo_announce.has_value()) {
         combo_announce->draw(y + (tex.skin_config[SC::COMBO_ANNOUNCE_P2_Y_OFFSET].y * is_2p));
     }
@@ -1510,7 +1750,7 @@ void Player::draw_overlays(float y, const ray::Shader& mask_shader) {
             nameplate.draw(tex.skin_config[SC::GAME_NAMEPLATE_1P].x, y + tex.skin_config[SC::GAME_NAMEPLATE_1P].y);
         }
     }
-    if (is_balloon) {
+    if (drawn.is_balloon) {
         chara->draw(tex.skin_config[SC::GAME_CHARA_BALLOON].x, y + tex.skin_config[SC::GAME_CHARA_BALLOON].y);
     } else {
         if (is_2p) {
@@ -1529,7 +1769,7 @@ void Player::draw_overlays(float y, const ray::Shader& mask_shader) {
     if (kusudama_counter.has_value()) {
         kusudama_counter->draw();
     }
-    score_counter.draw(y);
+    score_counter->draw(y);
     for (ScoreCounterAnimation& anim : base_score_list) {
         anim.draw(y);
     }
@@ -1538,7 +1778,15 @@ void Player::draw_overlays(float y, const ray::Shader& mask_shader) {
     }
 }
 
+void Player::cancel_scheduled_hitsounds() {
+    autoplay_scheduled_ms = -std::numeric_limits<double>::infinity();
+    if (!presenting()) return;
+    audio.cancel_scheduled_sound(don_hitsound);
+    audio.cancel_scheduled_sound(kat_hitsound);
+}
+
 void Player::seek_to(double resume_time) {
+    cancel_scheduled_hitsounds();
     don_notes.clear();
     kat_notes.clear();
     other_notes.clear();
@@ -4,6 +4,7 @@
 #include "../../libs/song_parser.h"
 #include "../../libs/text.h"
 #include "../../libs/network.h"
+#include "../../libs/replay.h"
 #include "../global/nameplate.h"
 #include "../global/chara_3d.h"
 #include "background.h"
@@ -27,6 +28,7 @@
 #include "judge_counter.h"
 #include "score_counter.h"
 #include "score_counter_animation.h"
+#include <functional>
 
 namespace JudgePos {
     inline float X = 0.0f;
@@ -47,11 +49,25 @@ public:
     double end_time;
     float bpm;
     PlayerNum player_num;
-    double last_note_hit;
+    // Wall-clock ms (current_ms's clock) the last autoplayed don was due at
+    double last_note_hit = 0.0;
     std::map<double, InputLogType> input_log;
-
+    // Every press in the order judged. input_log keeps one of two presses
+    // on the same timestamp (a big note struck with both hands); replays
+    // need both.
+    std::vector<ReplayEvent> press_log;
+    // Real-time error (ms, + late) of every GOOD/OK hit
+    std::vector<double> hit_errors;
+
+    // headless: judge and score only. No textures, sounds, Lua or
+    // animations are touched, so it runs without a window or audio device;
+    // draw() must not be called.
     Player(std::optional<SongParser>& parser_ref, PlayerNum player_num_param, int difficulty_param,
-           bool is_2p_param, const Modifiers& modifiers_param);
+           bool is_2p_param, const Modifiers& modifiers_param, bool headless_param = false);
+
+    // notes/9's width read from the skin's files, as GameScreen would load
+    // it; 0 if the skin has none
+    static int skin_note_width();
 
     std::optional<JudgeCounter> judge_counter;
     std::optional<Gauge> gauge;
@@ -59,6 +75,10 @@ public:
 
     std::optional<Note> get_first_note();
 
+    // Real seconds per chart second divided out when scheduling autoplay hits
+    // on the audio stream (practice mode slows the song down).
+    void set_playback_rate(double rate) { playback_rate = rate; }
+
     ResultData get_result_score();
 
     int get_good() const { return good_count; }
@@ -82,15 +102,45 @@ public:
     int get_total_drumroll() const { return total_drumroll; }
     int get_scissor_x() const { return virtual_to_screen_x(static_cast<float>(tex.textures[lane_cover_tex_id]->x2[0])); }
     void set_is_dan(bool v) { is_dan = v; }
+    bool is_headless() const { return headless; }
+    const Modifiers& get_modifiers() const { return modifiers; }
+
+    // Judge these presses instead of reading the input queue. Each is
+    // judged at its hit_ms on the first update at or past its judge_ms.
+    void set_scripted_input(std::vector<ReplayEvent> presses);
+
+    // update(), plus an update at each scripted press's judge_ms on the
+    // way, so presses meet the same note state they were recorded against
+    // however the frames fall
+    void advance(double ms_from_start, double current_ms, std::optional<Background>& background);
 
-    void reload_for_dan(std::optional<SongParser>& new_parser, int new_difficulty);
+    // Judges from from_ms up to to_ms in 1ms steps with no effects or
+    // sounds, for seeking a replay; the score comes out as if played
+    void fast_forward(double from_ms, double to_ms, double current_ms);
+
+    // compiled: the new parser's notes_to_position(new_difficulty), if the
+    // caller already has it (Dan mode compiles the next song ahead)
+    void reload_for_dan(std::optional<SongParser>& new_parser, int new_difficulty,
+                        std::optional<ChartNotes> compiled = std::nullopt);
 
     void spawn_ending_anim();
 
     void seek_to(double resume_time);
 
-    void update(double ms_from_start, double current_ms, std::optional<Background>& background);
+    // Drops the autoplay hitsounds queued ahead on the audio stream, for a
+    // pause or seek; they are queued again from wherever play goes on
+    void cancel_scheduled_hitsounds();
+
+    // judge=false leaves note judgement, misses and autoplay to simulate()
+    // and applies the effects it queued instead
+    void update(double ms_from_start, double current_ms, std::optional<Background>& background, bool judge = true);
+    // The judgement half of update, for GameScreen's simulation thread.
+    // It leaves everything draw() reads alone and queues the changes for
+    // the next update(), so background must outlive that update.
+    void simulate(double ms_from_start, double current_ms, std::optional<Background>& background);
 
+    // Reads only what update() last left, never the judgement state
+    // simulate() may be changing meanwhile
     void draw(double ms_from_start, float x, float y, ray::Shader& mask_shader);
 
     void draw_practice(double ms_from_start, float x, float y, ray::Shader& mask_shader, bool draw_notes_on);
@@ -105,6 +155,7 @@ protected:
 private:
     bool is_2p;
     bool is_dan;
+    bool headless;
     int difficulty;
     int visual_offset;
     std::string score_method;
@@ -123,6 +174,8 @@ private:
     int total_drumroll;
 
     int arc_points;
+    // Half the notes/9 width, which note load times travel past
+    int note_half_w = 0;
     float judge_x;
     float judge_y;
 
@@ -166,8 +219,45 @@ private:
     int branch_note_count;
     std::string branch_condition;
 
-    std::string don_hitsound;
-    std::string kat_hitsound;
+    SoundId don_hitsound;
+    SoundId kat_hitsound;
+    SoundId balloon_pop_sound;
+    SoundId kusudama_pop_sound;
+
+    double playback_rate = 1.0;
+    double autoplay_scheduled_ms;  // latest hit_ms already queued on the audio stream
+
+    std::optional<std::vector<ReplayEvent>> scripted_input;
+    size_t scripted_index = 0;
+    bool fast_forwarding = false;
+
+    // Presses drained from the input queue this update, sorted before
+    // judging; kept to reuse the allocation
+    struct PendingPress {
+        double  hit_ms;
+        uint8_t check;  // index into handle_input's drum checks
+    };
+    std::vector<PendingPress> pending_presses;
+
+    // Effects, sounds and animations are wanted
+    bool presenting() const { return !headless && !fast_forwarding; }
+
+    // Judgement's changes to what draw() reads (effects, gauge, background,
+    // the note buffer) go through apply(): straight away, or while
+    // simulate() runs, queued for the next update() on the game thread
+    bool simulating = false;
+    std::vector<std::function<void()>> deferred_effects;
+    void apply(std::function<void()> effect);
+    // apply(), for what only a presented play shows
+    void present(std::function<void()> effect) { if (presenting()) apply(std::move(effect)); }
+
+    // The judgement state draw() reads, copied at the end of update()
+    struct DrawnState {
+        int  combo = 0;
+        bool is_balloon = false;
+        int  active_index = -1;  // other_notes.front(), the roll or balloon under way
+    };
+    DrawnState drawn;
 
     TexID lane_cover_tex_id;
     TexID lane_icon_tex_id;
@@ -176,11 +266,11 @@ private:
     std::vector<Judgment> draw_judge_list;
     std::vector<GaugeHitEffect> gauge_hit_effect;
     std::vector<NoteArc> draw_arc_list;
-    Combo combo_display;
+    std::optional<Combo> combo_display;
     std::optional<DrumrollCounter> drumroll_counter;
     std::optional<BalloonCounter> balloon_counter;
     std::optional<KusudamaCounter> kusudama_counter;
-    ScoreCounter score_counter;
+    std::optional<ScoreCounter> score_counter;
     std::vector<ScoreCounterAnimation> base_score_list;
     std::optional<GogoTime> gogo_time;
     std::optional<Fireworks> fireworks;
@@ -192,7 +282,7 @@ private:
 
     void get_load_time(Note& note);
 
-    void reset_chart();
+    void reset_chart(std::optional<ChartNotes> compiled = std::nullopt);
 
     void handle_timeline(double ms_from_start);
 
@@ -220,7 +310,12 @@ private:
 
     void draw_note_manager(double current_ms);
 
-    void note_manager(double current_ms, std::optional<Background>& background);
+    // Misses every note whose window closed before ms, and opens and
+    // closes drumrolls and balloons up to it
+    void pass_notes(double ms, std::optional<Background>& background);
+
+    // Buffered presses, then misses up to ms_from_start, then autoplay
+    void judge_notes(double ms_from_start, double current_ms, std::optional<Background>& background);
 
     void note_correct(const Note& note, double current_ms);
 
@@ -238,10 +333,16 @@ private:
 
     void kusudama_counter_manager(double current_ms);
 
+    void update_hit_effects(double current_ms);
+    void update_counters(double current_ms);
+    void update_score_effects(double current_ms);
+    void update_overlays(double current_ms);
+
     virtual void spawn_hit_effects(DrumType drum_type, Side side);
 
 protected:
     virtual void handle_input(double ms_from_start, double current_ms, std::optional<Background>& background);
+    void handle_scripted_input(double ms_from_start, double current_ms, std::optional<Background>& background);
 
 private:
 
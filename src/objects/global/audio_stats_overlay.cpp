@@ -0,0 +1,39 @@
+#include "audio_stats_overlay.h"
+#include "../../libs/audio.h"
+#include "../../libs/texture.h"
+#include "../../libs/text.h"
+
+void AudioStatsOverlay::update(double current_ms, const std::string& extra) {
+    // Refreshing every frame just makes the numbers unreadable
+    if (current_ms - last_refresh < REFRESH_MS) return;
+    last_refresh = current_ms;
+
+    stats = audio.get_audio_stats();
+    lines.clear();
+    std::string summary = stats.summary();
+    if (!extra.empty()) summary += "\n" + extra;
+    size_t start = 0;
+    while (start < summary.size()) {
+        size_t end = summary.find('\n', start);
+        if (end == std::string::npos) end = summary.size();
+        lines.push_back(summary.substr(start, end - start));
+        start = end + 1;
+    }
+}
+
+void AudioStatsOverlay::draw() {
+    float size = 16.0f * global_tex.screen_scale;
+    float x = 20.0f * global_tex.screen_scale;
+    float y = 50.0f * global_tex.screen_scale;
+
+    ray::Color color;
+    if (stats.xruns > 0 || stats.worst_percent >= 100.0) color = ray::RED;
+    else if (stats.worst_percent >= 50.0) color = ray::YELLOW;
+    else color = ray::LIME;
+
+    for (const std::string& line : lines) {
+        ray::Font font = font_manager.get_font(line, size);
+        DrawTextEx(font, line.c_str(), ray::Vector2{ x, y }, size, 1.0f, color);
+        y += size * 1.25f;
+    }
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include "../../libs/audio_stats.h"
+#include <string>
+#include <vector>
+
+// Debug readout of the mixer's callback timing, under the FPS counter,
+// followed by any other timing summaries the caller passes in
+class AudioStatsOverlay {
+private:
+    static constexpr double REFRESH_MS = 250.0;
+    double last_refresh = -REFRESH_MS;
+    AudioStatsSnapshot stats;
+    std::vector<std::string> lines;
+
+public:
+    void update(double current_ms, const std::string& extra = "");
+
+    void draw();
+};
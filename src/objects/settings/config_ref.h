@@ -36,6 +36,7 @@ inline ConfigRef get_config_ref(const std::string& path) {
     Config* c = global_data.config;
     // general
     if (path == "general/fps_counter")              return &c->general.fps_counter;
+    if (path == "general/audio_stats")              return &c->general.audio_stats;
     if (path == "general/audio_offset")             return &c->general.audio_offset;
     if (path == "general/visual_offset")            return &c->general.visual_offset;
     if (path == "general/language")                 return &c->general.language;
@@ -48,6 +49,13 @@ inline ConfigRef get_config_ref(const std::string& path) {
     if (path == "general/score_method")             return &c->general.score_method;
     if (path == "general/display_bpm")              return &c->general.display_bpm;
     if (path == "general/touch_input")              return &c->general.touch_input;
+    if (path == "general/input_thread_hitsounds")   return &c->general.input_thread_hitsounds;
+    if (path == "general/input_latency_stats")      return &c->general.input_latency_stats;
+    if (path == "general/evdev_input")              return &c->general.evdev_input;
+    if (path == "general/evdev_keyboard")           return &c->general.evdev_keyboard;
+    if (path == "general/sim_tick_hz")              return &c->general.sim_tick_hz;
+    if (path == "general/profile_on_exit")          return &c->general.profile_on_exit;
+    if (path == "general/save_replays")             return &c->general.save_replays;
     // network
     if (path == "network/online_play")              return &c->network.online_play;
     if (path == "network/access_code")              return &c->network.access_code;
@@ -73,6 +81,7 @@ inline ConfigRef get_config_ref(const std::string& path) {
     if (path == "keys/pause_key")        return &c->keys.pause_key;
     if (path == "keys/back_key")         return &c->keys.back_key;
     if (path == "keys/restart_key")      return &c->keys.restart_key;
+    if (path == "keys/profile_key")      return &c->keys.profile_key;
     // keys_1p/2p / gamepad (vector<int>)
     if (path == "keys_1p/left_kat")      return &c->keys_1p.left_kat;
     if (path == "keys_1p/left_don")      return &c->keys_1p.left_don;
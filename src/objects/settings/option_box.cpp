@@ -1,5 +1,6 @@
 #include "option_box.h"
 #include "../../libs/animation.h"
+#include "../../libs/calibration.h"
 #include "../../libs/input.h"
 
 std::string getKeyString(int key_code);
@@ -299,6 +300,7 @@ void KeybindOptionBox::confirm() {
     } else {
         config_ref.set_vec(value);
     }
+    rebuild_input_bindings();
 }
 
 void KeybindOptionBox::update(double current_time) {
@@ -359,6 +361,7 @@ void KeyBindControllerOptionBox::confirm() {
     } else {
         config_ref.set_vec(value);
     }
+    rebuild_input_bindings();
 }
 
 void KeyBindControllerOptionBox::update(double current_time) {
@@ -457,11 +460,19 @@ AudioOffsetOptionBox::AudioOffsetOptionBox(const std::string& name,
     : BaseOptionBox(name, description, path)
     , value(config_ref.get_int())
     , calibrate_screen(calibrate_screen)
-    , offset_highlighted(true)
+    , focus(OFFSET)
     , value_text(nullptr)
     , calibrate_text(std::make_unique<OutlinedText>("Calibrate", OPTION_FONT_SIZE, ray::WHITE, ray::BLACK, false, 4, -4))
     , flicker_fade(make_flicker())
 {
+    if (path == "general/audio_offset") {
+        auto estimate = recent_offset_estimate();
+        if (estimate && estimate->reliable() && estimate->suggested_offset() != value) {
+            suggestion = estimate->suggested_offset();
+            std::string label = std::string("Use ") + (*suggestion >= 0 ? "+" : "") + std::to_string(*suggestion) + " ms";
+            suggestion_text = std::make_unique<OutlinedText>(label, OPTION_FONT_SIZE, ray::WHITE, ray::BLACK, false, 4, -4);
+        }
+    }
     rebuild_text();
 }
 
@@ -473,26 +484,36 @@ void AudioOffsetOptionBox::rebuild_text() {
 
 void AudioOffsetOptionBox::confirm() {
     if (is_highlighted) return;  // entering — act on exit only
-    if (offset_highlighted) {
+    if (focus == OFFSET) {
         config_ref.set_int(value);
-    } else {
+    } else if (focus == CALIBRATE) {
         wants_screen_change = true;
         pending_screen      = calibrate_screen;
+    } else if (suggestion) {
+        value = *suggestion;
+        config_ref.set_int(value);
+        spdlog::info("Audio offset set to {} ms from recent plays", value);
+        suggestion.reset();
+        suggestion_text.reset();
+        focus = OFFSET;
+        rebuild_text();
     }
 }
 
 void AudioOffsetOptionBox::move_left() {
-    if (offset_highlighted) {
+    if (focus == OFFSET) {
         value -= 1;
         rebuild_text();
     } else {
-        offset_highlighted = true;
+        focus = (Button)(focus - 1);
     }
 }
 
 void AudioOffsetOptionBox::move_right() {
-    if (offset_highlighted) {
-        offset_highlighted = false;
+    if (focus == OFFSET) {
+        focus = CALIBRATE;
+    } else if (focus == CALIBRATE && suggestion) {
+        focus = SUGGESTION;
     }
 }
 
@@ -500,32 +521,21 @@ void AudioOffsetOptionBox::update(double current_time) {
     flicker_fade->update(current_time);
 }
 
-void AudioOffsetOptionBox::draw() {
-    draw_base();
-
-    // Offset value button (index 0)
-    if (offset_highlighted && is_highlighted) {
-        tex.draw_texture(OPTION::BUTTON_ON,  {.fade=flicker_fade->attribute, .index=0});
+void AudioOffsetOptionBox::draw_button(Button button, OutlinedText& text) {
+    if (focus == button && is_highlighted) {
+        tex.draw_texture(OPTION::BUTTON_ON,  {.fade=flicker_fade->attribute, .index=button});
     } else {
-        tex.draw_texture(OPTION::BUTTON_OFF, {.index=0});
-    }
-    {
-        auto& btn = tex.textures[OPTION::BUTTON_ON];
-        float tx = btn->x[0] + (btn->width  / 2.0f) - (value_text->width  / 2.0f);
-        float ty = btn->y[0] + (btn->height / 2.0f) - (value_text->height / 2.0f);
-        value_text->draw({.x=tx, .y=ty});
+        tex.draw_texture(OPTION::BUTTON_OFF, {.index=button});
     }
+    auto& btn = tex.textures[OPTION::BUTTON_ON];
+    float tx = btn->x[button] + (btn->width  / 2.0f) - (text.width  / 2.0f);
+    float ty = btn->y[button] + (btn->height / 2.0f) - (text.height / 2.0f);
+    text.draw({.x=tx, .y=ty});
+}
 
-    // Calibrate button (index 1)
-    if (!offset_highlighted && is_highlighted) {
-        tex.draw_texture(OPTION::BUTTON_ON,  {.fade=flicker_fade->attribute, .index=1});
-    } else {
-        tex.draw_texture(OPTION::BUTTON_OFF, {.index=1});
-    }
-    {
-        auto& btn = tex.textures[OPTION::BUTTON_ON];
-        float tx = btn->x[1] + (btn->width  / 2.0f) - (calibrate_text->width  / 2.0f);
-        float ty = btn->y[1] + (btn->height / 2.0f) - (calibrate_text->height / 2.0f);
-        calibrate_text->draw({.x=tx, .y=ty});
-    }
+void AudioOffsetOptionBox::draw() {
+    draw_base();
+    draw_button(OFFSET, *value_text);
+    draw_button(CALIBRATE, *calibrate_text);
+    if (suggestion_text) draw_button(SUGGESTION, *suggestion_text);
 }
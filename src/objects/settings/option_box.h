@@ -151,12 +151,18 @@ public:
     Screens pending_screen      = Screens::INPUT_CALI;
 
 private:
+    enum Button { OFFSET, CALIBRATE, SUGGESTION };
+
     int             value;
     Screens          calibrate_screen;
-    bool             offset_highlighted;  // true = on offset button, false = on calibrate button
+    Button           focus;
+    // Offset recent plays reliably point to, offered on a third button
+    std::optional<int>              suggestion;
     std::unique_ptr<OutlinedText>   value_text;
     std::unique_ptr<OutlinedText>   calibrate_text;
+    std::unique_ptr<OutlinedText>   suggestion_text;
     std::unique_ptr<FadeAnimation>  flicker_fade;
 
     void rebuild_text();
+    void draw_button(Button button, OutlinedText& text);
 };
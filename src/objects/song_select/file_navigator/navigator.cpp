@@ -4,6 +4,7 @@
 #include "color_utils.h"
 #include "../song_select_script.h"
 #include "../../../libs/filesystem.h"
+#include "../../../libs/profiler.h"
 #include <random>
 #include <cmath>
 
@@ -21,9 +22,11 @@ parse_songs_parallel(const std::vector<fs::path>& paths, std::atomic<bool>& abor
     std::vector<std::thread> pool;
     for (unsigned t = 0; t < workers && t < paths.size(); t++) {
         pool.emplace_back([&] {
+            PROFILE_THREAD("song parser");
             for (size_t i; (i = next.fetch_add(1)) < paths.size();) {
                 if (abort_flag.load()) break;
                 try {
+                    PROFILE_SCOPE("SongParser");
                     parsed[i] = std::make_unique<SongParser>(paths[i]);
                 } catch (const std::exception& e) {
                     spdlog::warn("Failed to parse {}: {}", paths[i].string(), e.what());
@@ -104,6 +107,8 @@ void Navigator::preload(std::vector<fs::path> songs_paths) {
 
 #ifndef __EMSCRIPTEN__
     song_files_thread = std::thread([this, songs_paths]() {
+        PROFILE_THREAD("song files");
+        PROFILE_SCOPE("Navigator::scan_song_files");
         for (const fs::path& root_path : songs_paths) {
             try {
                 std::error_code ec;
@@ -452,7 +457,9 @@ void Navigator::parse_song_list(const fs::path& path, BoxDef box_def, bool inlin
 }
 
 void Navigator::load_current_directory_async(const fs::path path) {
+    PROFILE_THREAD("navigator loader");
     wait_for_song_files();
+    PROFILE_SCOPE("Navigator::load_current_directory");
     BoxDef box_def = parse_box_def(path);
 
     setup_back_box(path, true);
@@ -769,7 +776,9 @@ void Navigator::load_collection_search(const fs::path& path, const BoxDef& box_d
 }
 
 void Navigator::load_songs_inline_async(const fs::path path, BoxDef box_def) {
+    PROFILE_THREAD("navigator loader");
     wait_for_song_files();
+    PROFILE_SCOPE("Navigator::load_songs_inline");
     int songs_added = 0;
     std::unordered_map<std::string, std::unique_ptr<SongParser>> preparsed;
 
@@ -1362,6 +1371,7 @@ void Navigator::exit_diff_select() {
 }
 
 void Navigator::update(double current_ms) {
+    PROFILE_SCOPE("Navigator::update");
     if (genre_bg.has_value()) {
         if (inline_state && inline_state->fading_out)
             genre_bg->update(current_ms, pending_inline_folder);
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "../../libs/audio.h"
 #include "../../libs/global_data.h"
 #include "../../libs/scores.h"
 #include "../../libs/text.h"
@@ -11,7 +12,7 @@ private:
     int selected_sound;
     int direction;
     std::vector<std::string> sounds;
-    std::string curr_sound;
+    SoundId curr_sound;
 
     FadeAnimation* blue_arrow_fade;
     MoveAnimation* blue_arrow_move;
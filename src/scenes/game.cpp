@@ -2,8 +2,18 @@
 #include "../libs/scores.h"
 #include "../libs/input.h"
 #include "../libs/network.h"
+#include "../libs/calibration.h"
+#include "../libs/profiler.h"
+#include <algorithm>
 #include <cmath>
 
+// Overlapping voices per hitsound; enough for 30+ hits/sec drumrolls
+static constexpr unsigned int HITSOUND_VOICES = 4;
+// Replay drum controls
+static constexpr double REPLAY_SEEK_MS    = 5000.0;
+static constexpr double REPLAY_SPEED_STEP = 0.25;
+static constexpr double REPLAY_SPEED_MIN  = 0.25;
+static constexpr double REPLAY_SPEED_MAX  = 2.0;
 
 void GameScreen::on_screen_start() {
     Screen::on_screen_start();
@@ -11,7 +21,6 @@ void GameScreen::on_screen_start() {
     ms_from_start = 0;
     start_ms = 0;
     start_delay = 1000.0f;
-    last_resync_ms = 0;
     JudgePos::X = tex.skin_config[SC::JUDGE_POS].x;
     JudgePos::Y = tex.skin_config[SC::JUDGE_POS].y;
     song_started = false;
@@ -49,9 +58,26 @@ void GameScreen::on_screen_start() {
         SetShaderValueTexture(mask_shader, GetShaderLocation(mask_shader, "texture1"), rainbow->texture);
     }
     SessionData& session_data = global_data.session_data[(int)global_data.player_num];
+    playback_speed = 1.0;
+    replay_frames.reset();
+    last_replay_frame_ms = 0.0;
+    if (!session_data.replay_path.empty()) {
+        replay = load_replay(session_data.replay_path);
+        session_data.replay_path.clear();
+    }
+    load_hitsounds();  // before init_tja: players resolve their hitsound handles on construction
     init_tja(session_data.selected_song);
     spdlog::info("TJA initialized for song: {}", session_data.selected_song.string());
-    load_hitsounds();
+    if (replay.has_value()) {
+        if (parser->get_diff_hash(session_data.selected_difficulty) != replay->chart_hash) {
+            spdlog::warn("Chart has changed since the replay was recorded; it won't score the same");
+        }
+        if (replay->score_method != global_data.config->general.score_method) {
+            spdlog::warn("Replay was scored with {}, playing back with {}", replay->score_method,
+                         global_data.config->general.score_method);
+        }
+        spdlog::info("Playing back a replay of {} presses", replay->events.size());
+    }
     song_info = SongInfo(session_data.song_title, session_data.song_subtitle, parser->metadata.subtitle_full_display, session_data.genre_index, global_data.songs_played + 1);
     result_transition = ResultTransition(global_data.player_num);
     bpm = parser->metadata.bpm;
@@ -79,9 +105,84 @@ void GameScreen::on_screen_start() {
             start_ms += extra_delay;
         }
     }
+
+    // A replay judges its recorded presses on the update that replays them
+    if (simulation_capable && !replay.has_value() && global_data.config->general.sim_tick_hz > 0) {
+        start_simulation(global_data.config->general.sim_tick_hz);
+    }
+}
+
+void GameScreen::start_simulation(int tick_hz) {
+    tick_hz = std::clamp(tick_hz, 60, 8000);
+    set_input_consumers_shared(true);
+    sim_running.store(true, std::memory_order_release);
+    sim_thread = std::thread(&GameScreen::simulation_loop, this, tick_hz);
+    spdlog::info("Simulation running at {} Hz", tick_hz);
+}
+
+void GameScreen::stop_simulation() {
+    if (!sim_running.exchange(false, std::memory_order_acq_rel)) return;
+    if (sim_thread.joinable()) sim_thread.join();
+    set_input_consumers_shared(false);
+}
+
+std::unique_lock<std::mutex> GameScreen::lock_simulation() {
+    if (!sim_running.load(std::memory_order_acquire)) return {};
+    return std::unique_lock<std::mutex>(sim_mutex);
+}
+
+void GameScreen::simulation_loop(int tick_hz) {
+    using clock = std::chrono::steady_clock;
+    const auto tick = std::chrono::nanoseconds(1000000000LL / tick_hz);
+    auto next_tick = clock::now();
+    PROFILE_THREAD("simulation");
+    while (sim_running.load(std::memory_order_acquire)) {
+        {
+            // Never wait on the game thread: a tick it blocks is skipped,
+            // and the presses it would have judged keep their timestamps.
+            // This is also what lets on_screen_end join from inside update.
+            std::unique_lock<std::mutex> lock(sim_mutex, std::try_to_lock);
+            if (lock.owns_lock() && !paused) {
+                // start_ms tracks the audio clock (resync_song), so this
+                // is the chart time update() would compute right now
+                const double current_ms = get_current_ms();
+                for (auto& player : players) {
+                    player->simulate(current_ms - start_ms, current_ms, background);
+                }
+            }
+        }
+        next_tick += tick;
+        const auto now = clock::now();
+        // After a long stall carry on from now rather than burst through
+        // the missed ticks; the input they'd have judged is all queued
+        if (next_tick < now) next_tick = now;
+        std::this_thread::sleep_until(next_tick);
+    }
+}
+
+// Feeds the calibration pool with the offset each hit of this play would
+// have needed: the one it was judged with, moved by how late it landed
+void GameScreen::record_hit_offsets() {
+    const double audio_offset = global_data.config->general.audio_offset;
+    if (replay.has_value()) return;
+    for (const auto& player : players) {
+        if (player->is_auto_play() || player->hit_errors.empty()) continue;
+        std::vector<double> offsets;
+        offsets.reserve(player->hit_errors.size());
+        for (double error : player->hit_errors) offsets.push_back(audio_offset + error);
+        record_play_offsets(offsets);
+    }
+    if (auto estimate = recent_offset_estimate(); estimate && estimate->samples > 0) {
+        spdlog::info("Audio offset from recent plays: median {:.1f} ms [{:.1f}, {:.1f}], trimmed mean {:.1f} ms "
+                     "[{:.1f}, {:.1f}], {} hits{}",
+                     estimate->median_ms, estimate->median_low_ms, estimate->median_high_ms,
+                     estimate->trimmed_mean_ms, estimate->trimmed_low_ms, estimate->trimmed_high_ms,
+                     estimate->samples, estimate->reliable() ? "" : " (not yet reliable)");
+    }
 }
 
 Screens GameScreen::on_screen_end(Screens next_screen) {
+    stop_simulation();
     song_started = false;
     ray::UnloadShader(mask_shader);
 
@@ -94,11 +195,17 @@ Screens GameScreen::on_screen_end(Screens next_screen) {
         spdlog::info("Background unloaded");
     }
     transition.reset();
-    if (pending_song_load.valid()) pending_song_load.wait();
-    pending_song_load = {};
     song_music.reset();
     parser.reset();
+    record_hit_offsets();
     players.clear();
+    replay.reset();
+    playback_speed = 1.0;
+
+    if (global_data.config->general.input_latency_stats) {
+        spdlog::info("{}", input_latency_summary());
+        reset_input_latency();
+    }
 
     return Screen::on_screen_end(next_screen);
 }
@@ -111,10 +218,16 @@ void GameScreen::load_hitsounds() {
     fs::path sounds_dir = audio.sounds_path;
     int neiro_p1 = scores_manager.get_player_data(get_player_id(PlayerNum::P1)).value_or(PlayerData{}).neiro_index;
     int neiro_p2 = scores_manager.get_player_data(get_player_id(PlayerNum::P2)).value_or(PlayerData{}).neiro_index;
-    audio.load_sound(sounds_dir / "hit_sounds" / std::to_string(neiro_p1) / "don.ogg", "hitsound_don_1p");
-    audio.load_sound(sounds_dir / "hit_sounds" / std::to_string(neiro_p1) / "ka.ogg",  "hitsound_kat_1p");
-    audio.load_sound(sounds_dir / "hit_sounds" / std::to_string(neiro_p2) / "don.ogg", "hitsound_don_2p");
-    audio.load_sound(sounds_dir / "hit_sounds" / std::to_string(neiro_p2) / "ka.ogg",  "hitsound_kat_2p");
+    SoundId hitsounds[] = {
+        audio.load_sound(sounds_dir / "hit_sounds" / std::to_string(neiro_p1) / "don.ogg", "hitsound_don_1p"),
+        audio.load_sound(sounds_dir / "hit_sounds" / std::to_string(neiro_p1) / "ka.ogg",  "hitsound_kat_1p"),
+        audio.load_sound(sounds_dir / "hit_sounds" / std::to_string(neiro_p2) / "don.ogg", "hitsound_don_2p"),
+        audio.load_sound(sounds_dir / "hit_sounds" / std::to_string(neiro_p2) / "ka.ogg",  "hitsound_kat_2p"),
+    };
+    // Let fast hits overlap instead of cutting off the previous hit's tail
+    for (SoundId id : hitsounds) {
+        audio.set_sound_polyphony(id, HITSOUND_VOICES, VoiceStealPolicy::QUIETEST);
+    }
     spdlog::info("Loaded ogg hit sounds for 1P and 2P");
 }
 
@@ -132,38 +245,20 @@ void GameScreen::init_tja(fs::path song) {
     global_data.session_data[(int)global_data.player_num].song_subtitle = subtitles.count(lang) ? subtitles.at(lang) : "";
     global_data.session_data[(int)global_data.player_num].song_subtitle_full_display = parser->metadata.subtitle_full_display;
 
-    if (fs::exists(parser->metadata.wave) && !song_music.has_value() && !pending_song_load.valid()) {
-        fs::path wave = parser->metadata.wave;
-        pending_song_load = std::async(std::launch::async, [wave] {
-            return audio.load_sound(wave, "song");
-        });
+    if (fs::exists(parser->metadata.wave) && !song_music.has_value()) {
+        std::string name = audio.load_music_stream(parser->metadata.wave, "song");
+        if (!name.empty()) song_music = name;
     }
 
-    players.push_back(std::make_unique<Player>(parser, global_data.player_num, global_data.session_data[(int)global_data.player_num].selected_difficulty, false, get_player_modifiers(global_data.player_num)));
-}
-
-void GameScreen::poll_pending_song() {
-    if (!pending_song_load.valid() ||
-        pending_song_load.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
-        return;
-
-    std::string name = pending_song_load.get();
-    if (name.empty()) return;
-    song_music = name;
-
-    if (song_started && !paused) {
-        audio.play_sound(*song_music, VolumePreset::MUSIC);
-        double audio_ms = ms_from_start
-                        - (parser->metadata.offset * 1000 + start_delay
-                           - (double)global_data.config->general.audio_offset);
-        audio.seek_sound(*song_music, (float)std::max(0.0, audio_ms / 1000.0));
-    }
+    Modifiers modifiers = replay.has_value() ? replay->modifiers : get_player_modifiers(global_data.player_num);
+    players.push_back(std::make_unique<Player>(parser, global_data.player_num, global_data.session_data[(int)global_data.player_num].selected_difficulty, false, modifiers));
+    if (replay.has_value()) players.back()->set_scripted_input(replay->events);
 }
 
 void GameScreen::start_song(double ms_from_start) {
     if (ms_from_start >= parser->metadata.offset*1000 + start_delay - (double)global_data.config->general.audio_offset && !song_started) {
         if (song_music.has_value()) {
-            audio.play_sound(song_music.value(), VolumePreset::MUSIC);
+            audio.play_music_stream(song_music.value(), VolumePreset::MUSIC);
             spdlog::info("Song started at {}", ms_from_start);
         }
         if (movie.has_value()) {
@@ -176,17 +271,15 @@ void GameScreen::start_song(double ms_from_start) {
 
 void GameScreen::pause_song() {
     paused = !paused;
-    double audio_time;
     if (paused) {
         if (song_music.has_value()) {
-            audio_time = audio.get_sound_time_played(song_music.value());
-            audio.stop_sound(song_music.value());
+            audio.pause_music_stream(song_music.value());
         }
+        for (auto& player : players) player->cancel_scheduled_hitsounds();
         pause_time = get_current_ms() - start_ms;
     } else {
         if (song_music.has_value()) {
-            audio.play_sound(song_music.value(), VolumePreset::MUSIC);
-            audio.seek_sound(song_music.value(), audio_time);
+            audio.resume_music_stream(song_music.value());
         }
         start_ms = get_current_ms() - pause_time;
     }
@@ -194,16 +287,19 @@ void GameScreen::pause_song() {
 
 void GameScreen::restart_song() {
     if (song_music.has_value()) {
-        audio.stop_sound(song_music.value());
+        audio.stop_music_stream(song_music.value());
     }
     players.clear();
     init_tja(global_data.session_data[(int)global_data.player_num].selected_song);
     audio.play_sound("restart", VolumePreset::SOUND);
+    if (playback_speed != 1.0 && song_music.has_value()) audio.set_music_pitch(song_music.value(), 1.0f);
+    playback_speed = 1.0;
+    replay_frames.reset();
+    last_replay_frame_ms = 0.0;
     song_started = false;
     score_saved = false;
     paused = false;
     pause_time = 0;
-    last_resync_ms = 0;
     start_ms = get_current_ms() - parser->metadata.offset*1000 - (double)global_data.config->general.audio_offset;
     ms_from_start = get_current_ms() - start_ms;
 }
@@ -214,7 +310,7 @@ std::optional<Screens> GameScreen::global_keys() {
 
     if (check_key_pressed(global_data.config->keys.back_key)) {
         if (song_music.has_value())
-            audio.stop_sound(song_music.value());
+            audio.stop_music_stream(song_music.value());
         return on_screen_end(Screens::SONG_SELECT);
     }
 
@@ -280,28 +376,128 @@ void GameScreen::save_score(int player_id, PlayerNum player_num) {
 void GameScreen::resync_song(double current_ms) {
     if (!song_started) return;
     if (!song_music.has_value()) return;
-    if (!audio.is_sound_playing(song_music.value())) return;
-
-    double audio_ms = audio.get_sound_time_played(song_music.value()) * 1000.0f;
-    double audio_ms_adjusted = audio_ms + (parser->metadata.offset * 1000 + start_delay - (double)global_data.config->general.audio_offset);
-
-    double drift = audio_ms_adjusted - ms_from_start;
-    if (std::abs(drift) > 100.0) {
-        spdlog::debug("Hard resyncing chart from {} to {}", ms_from_start, audio_ms_adjusted);
-        ms_from_start = audio_ms_adjusted;
-    } else if (std::abs(drift) > 5.0) {
-        double frame_delta = (last_resync_ms > 0.0) ? (current_ms - last_resync_ms) : 16.667;
-        double correction_rate = std::min(frame_delta / 16.667, 4.0);
-        ms_from_start += drift * 0.5 * correction_rate;
-    }
-    last_resync_ms = current_ms;
-    start_ms = current_ms - ms_from_start;
+
+    // While the song is audible the chart runs on the audio clock itself;
+    // start_ms is kept in step so the frame clock takes over seamlessly
+    // when it stops (pause, end of song).
+    std::optional<double> audio_time = audio.get_music_clock(song_music.value());
+    if (!audio_time.has_value()) return;
+
+    ms_from_start = *audio_time * 1000.0 + (parser->metadata.offset * 1000 + start_delay - (double)global_data.config->general.audio_offset);
+    start_ms = current_ms - ms_from_start / playback_speed;
+}
+
+void GameScreen::seek_replay(double target_ms, double current_ms) {
+    target_ms = std::min(target_ms, players[0]->end_time);
+    double from_ms = ms_from_start;
+    for (auto& player : players) player->cancel_scheduled_hitsounds();
+    if (target_ms < ms_from_start) {
+        // Judgement only runs forward, so going back replays from the top
+        const int difficulty = global_data.session_data[(int)global_data.player_num].selected_difficulty;
+        players.clear();
+        players.push_back(std::make_unique<Player>(parser, global_data.player_num, difficulty, false, replay->modifiers));
+        players.back()->set_scripted_input(replay->events);
+        players.back()->set_playback_rate(playback_speed);
+        from_ms = 0.0;
+        if (std::optional<Note> first = players.back()->get_first_note()) from_ms = std::min(from_ms, first->load_ms);
+        target_ms = std::max(target_ms, from_ms);
+    }
+    for (auto& player : players) player->fast_forward(from_ms, target_ms, current_ms);
+    ms_from_start = target_ms;
+    start_ms = current_ms - ms_from_start / playback_speed;
+    last_replay_frame_ms = 0.0;
+
+    // The background movie keeps its own clock and isn't moved
+    if (!song_music.has_value()) return;
+    const double music_ms = ms_from_start - (parser->metadata.offset * 1000 + start_delay - (double)global_data.config->general.audio_offset);
+    if (music_ms < 0.0) {
+        audio.stop_music_stream(song_music.value());
+        song_started = false;
+        return;
+    }
+    // Seek before starting, so not even a buffer of the intro plays;
+    // resume (unlike play) keeps the position
+    audio.seek_music_stream(song_music.value(), (float)(music_ms / 1000.0));
+    if (!song_started) {
+        audio.resume_music_stream(song_music.value(), VolumePreset::MUSIC);
+        if (movie.has_value()) {
+            movie->start(get_current_ms());
+            movie->set_volume(0.0);
+        }
+        song_started = true;
+    }
+    spdlog::info("Replay seeked to {:.0f} ms", ms_from_start);
+}
+
+void GameScreen::set_playback_speed(double speed, double current_ms) {
+    playback_speed = std::clamp(speed, REPLAY_SPEED_MIN, REPLAY_SPEED_MAX);
+    start_ms = current_ms - ms_from_start / playback_speed;
+    if (song_music.has_value()) {
+        audio.set_music_preserve_pitch(song_music.value(), true);
+        audio.set_music_pitch(song_music.value(), (float)playback_speed);
+    }
+    for (auto& player : players) player->set_playback_rate(playback_speed);
+    spdlog::info("Replay speed {:.2f}x", playback_speed);
+}
+
+void GameScreen::update_replay_controls(double current_ms) {
+    if (!transition->is_finished() || paused || score_saved) return;
+    if (is_l_kat_pressed(global_data.player_num)) {
+        seek_replay(ms_from_start - REPLAY_SEEK_MS, current_ms);
+    } else if (is_r_kat_pressed(global_data.player_num)) {
+        seek_replay(ms_from_start + REPLAY_SEEK_MS, current_ms);
+    } else if (is_l_don_pressed(global_data.player_num)) {
+        set_playback_speed(playback_speed - REPLAY_SPEED_STEP, current_ms);
+    } else if (is_r_don_pressed(global_data.player_num)) {
+        set_playback_speed(playback_speed + REPLAY_SPEED_STEP, current_ms);
+    }
+}
+
+void GameScreen::finish_replay() {
+    ResultData result = players[0]->get_result_score();
+    if (replay_result_matches(*replay, result)) {
+        spdlog::info("Replay reproduced its score of {}", result.score);
+    } else {
+        spdlog::warn("Replay scored {} good {} ok {} bad {} combo {} roll {}, recorded {} good {} ok {} bad {} combo {} roll {}",
+                     result.score, result.good, result.ok, result.bad, result.max_combo, result.total_drumroll,
+                     replay->result.score, replay->result.good, replay->result.ok, replay->result.bad,
+                     replay->result.max_combo, replay->result.total_drumroll);
+    }
+
+    if (replay_frames.count == 0) return;
+    spdlog::info("Replay frames: {} frames, mean {:.2f} ms, p50 <{:.2f} ms, p99 <{:.2f} ms, worst {:.2f} ms",
+                 replay_frames.count, replay_frames.mean_us() / 1000.0, replay_frames.percentile_us(0.50) / 1000.0,
+                 replay_frames.percentile_us(0.99) / 1000.0, replay_frames.worst_us / 1000.0);
+}
+
+void GameScreen::record_replay() {
+    if (!global_data.config->general.save_replays) return;
+    const Player& player = *players[0];
+    if (player.is_auto_play()) return;
+
+    const SessionData& session_data = global_data.session_data[(int)player.player_num];
+    Replay recording;
+    recording.chart_hash    = parser->get_diff_hash(session_data.selected_difficulty);
+    recording.song_path     = session_data.selected_song;
+    recording.difficulty    = session_data.selected_difficulty;
+    recording.modifiers     = player.get_modifiers();
+    recording.score_method  = global_data.config->general.score_method;
+    recording.audio_offset  = global_data.config->general.audio_offset;
+    recording.visual_offset = global_data.config->general.visual_offset;
+    recording.result        = session_data.result_data;
+    recording.events        = player.press_log;
+    save_replay(replay_default_path(recording.chart_hash), recording);
 }
 
 void GameScreen::end_song() {
     if (ms_from_start >= players[0]->end_time + 1000 && !score_saved) {
         global_data.session_data[(int)players[0]->player_num].result_data = players[0]->get_result_score();
-        save_score(global_data.config->general.player_1_id, players[0]->player_num);
+        if (replay.has_value()) {
+            finish_replay();
+        } else {
+            save_score(global_data.config->general.player_1_id, players[0]->player_num);
+            record_replay();
+        }
         for (auto& player : players) {
             player->spawn_ending_anim();
         }
@@ -318,26 +514,45 @@ void GameScreen::end_song() {
 }
 
 std::optional<Screens> GameScreen::update() {
+    // First: on the first frame this runs on_screen_start, which starts
+    // the simulation thread. Locking before it would leave the rest of
+    // that frame unlocked against a thread already simulating.
     Screen::update();
 
     double current_ms = get_frame_ms();
     allnet_indicator.update(current_ms);
+    // The simulation thread queues what it does to the background on the
+    // players, so the movie and background update without the lock
+    update_background(current_ms);
+    song_info.update(current_ms);
+    result_transition.update(current_ms);
+
+    auto sim_lock = lock_simulation();
     if (!paused)
-        ms_from_start = current_ms - start_ms;
+        ms_from_start = (current_ms - start_ms) * playback_speed;
 
     transition->update(current_ms);
-    poll_pending_song();
     if (transition->is_finished()) {
         start_song(ms_from_start);
         global_data.input_locked = 0;
     }
     resync_song(current_ms);
-    update_background(current_ms);
 
-    for (auto& player : players)
-        player->update(ms_from_start, current_ms, background);
-    song_info.update(current_ms);
-    result_transition.update(current_ms);
+    if (replay.has_value()) {
+        update_replay_controls(current_ms);
+        if (song_started && !paused && !score_saved) {
+            if (last_replay_frame_ms > 0.0) replay_frames.record((current_ms - last_replay_frame_ms) * 1000.0);
+            last_replay_frame_ms = current_ms;
+        } else {
+            last_replay_frame_ms = 0.0;
+        }
+        for (auto& player : players)
+            player->advance(ms_from_start, current_ms, background);
+    } else {
+        const bool judge = !sim_running.load(std::memory_order_relaxed);
+        for (auto& player : players)
+            player->update(ms_from_start, current_ms, background, judge);
+    }
 
     if (result_transition.is_finished && !audio.is_sound_playing("result_transition")) {
         return on_screen_end(Screens::RESULT);
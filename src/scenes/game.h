@@ -1,5 +1,6 @@
 #pragma once
 
+#include "../libs/audio_stats.h"
 #include "../libs/screen.h"
 #include "../libs/video.h"
 #include "../objects/game/player.h"
@@ -7,21 +8,24 @@
 #include "../objects/game/song_info.h"
 #include "../objects/game/result_transition.h"
 #include "../objects/global/allnet_indicator.h"
-#include <future>
+#include <atomic>
+#include <mutex>
+#include <thread>
 
 class GameScreen : public Screen {
 protected:
-    GameScreen(const std::string& name) : Screen(name) {}
+    // Variants drive their players themselves and always judge per frame
+    GameScreen(const std::string& name) : Screen(name), simulation_capable(false) {}
 
 public:
-    GameScreen() : Screen("game") {
+    GameScreen() : Screen("game"), simulation_capable(true) {
     }
+    ~GameScreen() override { stop_simulation(); }
 
     ray::Shader mask_shader;
     double start_ms;
     double ms_from_start;
     double start_delay;
-    double last_resync_ms;
     bool song_started;
     bool paused;
     bool score_saved;
@@ -29,11 +33,10 @@ public:
     float bpm;
 
     std::optional<VideoPlayer> movie;
+    // Music stream name of the song. It is decoded on the stream's own
+    // thread while playing, so loading only opens the file and primes the
+    // first few hundred milliseconds.
     std::optional<std::string> song_music;
-    // Song audio decodes (and possibly resamples) on a worker thread; the
-    // synchronous load blocked the main thread for seconds on long songs.
-    // update() polls this and fills song_music when the load finishes.
-    std::future<std::string> pending_song_load;
     std::optional<SongParser> parser;
     std::string scene_preset;
     std::vector<std::unique_ptr<Player>> players;
@@ -43,6 +46,11 @@ public:
     AllNetIcon allnet_indicator;
     std::optional<Background> background;
 
+    // Set while playing back a replay (--replay). The player is fed the
+    // recorded presses; the drums seek (kat) and change speed (don).
+    std::optional<Replay> replay;
+    double playback_speed = 1.0;
+
     void on_screen_start() override;
 
     virtual Modifiers get_player_modifiers(PlayerNum pn);
@@ -55,13 +63,11 @@ public:
 
     void start_song(double ms_from_start);
 
-    void poll_pending_song();
-
     void restart_song();
 
     void pause_song();
 
-    void resync_song(double ms_from_start);
+    void resync_song(double current_ms);
 
     void end_song();
 
@@ -71,6 +77,22 @@ public:
 
     void save_score(int player_id, PlayerNum player_num);
 
+    void record_hit_offsets();
+
+    // Writes players[0]'s play to Replays/ when general.save_replays is on
+    void record_replay();
+
+    // Jumps the replay to target_ms, rebuilding the players from the
+    // start when going back
+    void seek_replay(double target_ms, double current_ms);
+
+    void set_playback_speed(double speed, double current_ms);
+
+    void update_replay_controls(double current_ms);
+
+    // Logs whether the replay reproduced its score and how long its frames took
+    void finish_replay();
+
     std::optional<Screens> update() override;
 
     void draw_players();
@@ -78,4 +100,26 @@ public:
     void draw_overlay();
 
     void draw() override;
+
+private:
+    // Optional fixed-rate simulation (general.sim_tick_hz > 0): note
+    // judgement, misses, gauge and score run on sim_thread from the
+    // timestamped input queue, so a render hitch doesn't hold hits back.
+    // update() holds sim_mutex while it runs the players, which applies
+    // what the ticks since the last frame queued for display and copies
+    // what draw() reads; draw() then runs without it.
+    const bool        simulation_capable;
+    std::mutex        sim_mutex;
+    std::thread       sim_thread;
+    std::atomic<bool> sim_running{false};
+
+    void start_simulation(int tick_hz);
+    void stop_simulation();
+    void simulation_loop(int tick_hz);
+    std::unique_lock<std::mutex> lock_simulation();
+
+    // Time between consecutive frames of a replay, for finish_replay;
+    // the frame after a seek is left out
+    LatencyHistogram replay_frames;
+    double last_replay_frame_ms = 0.0;
 };
@@ -32,7 +32,8 @@ void Game2PScreen::init_tja(fs::path song) {
     global_data.session_data[(int)PlayerNum::P2].song_subtitle_full_display = parser->metadata.subtitle_full_display;
 
     if (fs::exists(parser->metadata.wave) && !song_music.has_value()) {
-        song_music = audio.load_sound(parser->metadata.wave, "song");
+        std::string name = audio.load_music_stream(parser->metadata.wave, "song");
+        if (!name.empty()) song_music = name;
     }
 
     players.push_back(std::make_unique<Player>(
@@ -55,7 +56,6 @@ std::optional<Screens> Game2PScreen::update() {
     if (!paused) {
         ms_from_start = current_time - start_ms;
     }
-    poll_pending_song();
     if (transition->is_finished()) {
         start_song(ms_from_start);
         global_data.input_locked = 0;
@@ -63,7 +63,7 @@ std::optional<Screens> Game2PScreen::update() {
         start_ms = current_time - parser->metadata.offset * 1000;
     }
 
-    resync_song(ms_from_start);
+    resync_song(current_time);
 
     update_background(current_time);
 
@@ -97,7 +97,7 @@ std::optional<Screens> Game2PScreen::update() {
     }
 
     if (ray::IsKeyPressed(global_data.config->keys.restart_key)) {
-        if (song_music.has_value()) audio.stop_sound(song_music.value());
+        if (song_music.has_value()) audio.stop_music_stream(song_music.value());
         players.clear();
         parser_2p.reset();
         init_tja(global_data.session_data[(int)PlayerNum::P1].selected_song);
@@ -106,14 +106,13 @@ std::optional<Screens> Game2PScreen::update() {
         score_saved = false;
         paused = false;
         pause_time = 0;
-        last_resync_ms = 0;
         // See GameScreen::restart_song - reset the chart clock or the song
         // starts immediately, skipping the lead-in (#83).
         start_ms = get_current_ms() - parser->metadata.offset*1000 - (double)global_data.config->general.audio_offset;
         ms_from_start = get_current_ms() - start_ms;
     }
     if (check_key_pressed(global_data.config->keys.back_key)) {
-        if (song_music.has_value()) audio.stop_sound(song_music.value());
+        if (song_music.has_value()) audio.stop_music_stream(song_music.value());
         return on_screen_end(Screens::SONG_SELECT_2P);
     }
     if (ray::IsKeyPressed(global_data.config->keys.pause_key)) {
@@ -2,6 +2,12 @@
 #include <algorithm>
 #include "../libs/input.h"
 
+// Each Dan song gets its own stream name, so the next one can be opened
+// while the current one is still playing
+static std::string dan_music_name(int index) {
+    return "song_dan_" + std::to_string(index);
+}
+
 void DanGameScreen::on_screen_start() {
     Screen::on_screen_start();
     mask_shader   = load_shader("shader/dummy.vs", "shader/mask.fs");
@@ -28,8 +34,8 @@ void DanGameScreen::on_screen_start() {
         SetShaderValueTexture(mask_shader, GetShaderLocation(mask_shader, "texture1"), rainbow->texture);
     }
 
+    load_hitsounds();  // before init_dan: players resolve their hitsound handles on construction
     init_dan();
-    load_hitsounds();
 
     transition.emplace("", "", true);
     transition->start();
@@ -68,8 +74,10 @@ void DanGameScreen::init_dan() {
     const auto& first = sd.selected_dan[0];
     sd.selected_difficulty = first.difficulty;
     parser.emplace(first.song_path, (int)start_delay);
-    if (fs::exists(parser->metadata.wave))
-        song_music = audio.load_sound(parser->metadata.wave, "song");
+    if (fs::exists(parser->metadata.wave)) {
+        std::string name = audio.load_music_stream(parser->metadata.wave, dan_music_name(0));
+        if (!name.empty()) song_music = name;
+    }
 
     players.clear();
     players.push_back(std::make_unique<Player>(
@@ -92,6 +100,40 @@ void DanGameScreen::init_dan() {
     song_info = SongInfo(current_song_title, subtitle, parser->metadata.subtitle_full_display, first.genre_index - 1, 1);
 
     start_ms = get_current_ms() - parser->metadata.offset * 1000;
+    prepare_next_song();
+}
+
+void DanGameScreen::prepare_next_song() {
+    SessionData& sd = global_data.session_data[(int)global_data.player_num];
+    const int index = song_index + 1;
+    if (index >= (int)sd.selected_dan.size()) return;
+
+    DanSongEntry entry = sd.selected_dan[index];
+    int delay = (int)start_delay;
+    next_song = std::async(std::launch::async, [entry, index, delay]() {
+        PreparedSong prepared;
+        prepared.index = index;
+        try {
+            prepared.parser.emplace(entry.song_path, delay);
+            prepared.notes = prepared.parser->notes_to_position(entry.difficulty);
+            if (fs::exists(prepared.parser->metadata.wave)) {
+                // Opening the stream starts its decoder and fills the ring
+                std::string name = audio.load_music_stream(prepared.parser->metadata.wave, dan_music_name(index));
+                if (!name.empty()) prepared.music = name;
+            }
+        } catch (const std::exception& e) {
+            spdlog::error("Failed to prepare Dan song {}: {}", entry.song_path.string(), e.what());
+            prepared.parser.reset();
+            prepared.notes.reset();
+        }
+        return prepared;
+    });
+}
+
+void DanGameScreen::discard_next_song() {
+    if (!next_song.valid()) return;
+    PreparedSong prepared = next_song.get();
+    if (prepared.music.has_value()) audio.unload_music_stream(prepared.music.value());
 }
 
 void DanGameScreen::change_song() {
@@ -100,17 +142,37 @@ void DanGameScreen::change_song() {
     sd.selected_difficulty = entry.difficulty;
 
     if (song_music.has_value()) {
-        audio.stop_sound(song_music.value());
+        audio.unload_music_stream(song_music.value());
         song_music.reset();
     }
 
-    parser.emplace(entry.song_path, (int)start_delay);
-    if (fs::exists(parser->metadata.wave))
-        song_music = audio.load_sound(parser->metadata.wave, "song");
+    // Normally long finished by now; only waits if the previous song was
+    // shorter than the time it takes to load this one
+    PreparedSong prepared;
+    if (next_song.valid()) {
+        if (next_song.wait_for(std::chrono::seconds(0)) != std::future_status::ready) {
+            spdlog::warn("Dan song {} was not ready in time, waiting for it", song_index + 1);
+        }
+        prepared = next_song.get();
+    }
+
+    std::optional<ChartNotes> compiled;
+    if (prepared.index == song_index && prepared.parser.has_value()) {
+        parser = std::move(prepared.parser);
+        compiled = std::move(prepared.notes);
+        song_music = prepared.music;
+    } else {
+        if (prepared.music.has_value()) audio.unload_music_stream(prepared.music.value());
+        parser.emplace(entry.song_path, (int)start_delay);
+        if (fs::exists(parser->metadata.wave)) {
+            std::string name = audio.load_music_stream(parser->metadata.wave, dan_music_name(song_index));
+            if (!name.empty()) song_music = name;
+        }
+    }
 
     song_started = false;
 
-    players[0]->reload_for_dan(parser, entry.difficulty);
+    players[0]->reload_for_dan(parser, entry.difficulty, std::move(compiled));
     players[0]->dan_gauge = &dan_gauge;
 
     const std::string& lang = global_data.config->general.language;
@@ -120,6 +182,7 @@ void DanGameScreen::change_song() {
 
     //dan_transition.start();
     start_ms = get_current_ms() - parser->metadata.offset * 1000;
+    prepare_next_song();
 }
 
 void DanGameScreen::fill_unplayed_songs() {
@@ -235,6 +298,8 @@ void DanGameScreen::check_exam_failures(bool course_finished) {
 Screens DanGameScreen::on_screen_end(Screens next_screen) {
     dan_info_cache.reset();
     hori_name.reset();
+    discard_next_song();
+    if (song_music.has_value()) audio.unload_music_stream(song_music.value());
     return GameScreen::on_screen_end(next_screen);
 }
 
@@ -252,7 +317,7 @@ std::optional<Screens> DanGameScreen::update() {
 
     update_background(current_ms);
 
-    resync_song(ms_from_start);
+    resync_song(current_ms);
 
     players[0]->update(ms_from_start, current_ms, background);
     song_info.update(current_ms);
@@ -327,11 +392,14 @@ std::optional<Screens> DanGameScreen::update() {
 
     // Global keys (back / restart)
     if (check_key_pressed(global_data.config->keys.back_key)) {
-        if (song_music.has_value()) audio.stop_sound(song_music.value());
+        if (song_music.has_value()) audio.stop_music_stream(song_music.value());
         return on_screen_end(Screens::DAN_SELECT);
     }
     if (check_key_pressed(global_data.config->keys.restart_key)) {
-        if (song_music.has_value()) { audio.stop_sound(song_music.value()); song_music.reset(); }
+        // As on_screen_end: the prefetched next song and this one's stream
+        // would otherwise stay loaded behind the restarted course
+        discard_next_song();
+        if (song_music.has_value()) { audio.unload_music_stream(song_music.value()); song_music.reset(); }
         song_index = 0;
         prev_good = prev_ok = prev_bad = prev_drumroll = 0;
         sd.dan_result_data = DanResultData();
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "game.h"
+#include <future>
 
 struct DanExamInfo {
     float   progress     = 0;
@@ -44,8 +45,21 @@ private:
     int prev_good = 0, prev_ok = 0, prev_bad = 0, prev_drumroll = 0;
     std::string current_song_title;
 
+    // The next song, parsed, compiled and with its music stream open and
+    // primed, built in the background while the current one plays so the
+    // switch is only a handoff
+    struct PreparedSong {
+        int                        index = -1;
+        std::optional<SongParser>  parser;
+        std::optional<ChartNotes>  notes;
+        std::optional<std::string> music;
+    };
+    std::future<PreparedSong> next_song;
+
     void init_dan();
     void change_song();
+    void prepare_next_song();
+    void discard_next_song();
 
     DanInfoCache calculate_dan_info();
     int get_exam_progress(const Exam& exam);
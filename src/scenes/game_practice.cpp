@@ -32,6 +32,8 @@ Screens PracticeGameScreen::on_screen_end(Screens next_screen) {
 
 void PracticeGameScreen::init_tja(fs::path song) {
     GameScreen::init_tja(song);
+    // Slowed-down playback should still sound in key
+    if (song_music.has_value()) audio.set_music_preserve_pitch(song_music.value(), true);
     if (!players.empty()) {
         players.back() = std::make_unique<PracticePlayer>(
             parser,
@@ -80,8 +82,9 @@ void PracticeGameScreen::pause_song_practice() {
 
     if (paused) {
         if (song_music.has_value()) {
-            audio.stop_sound(song_music.value());
+            audio.pause_music_stream(song_music.value());
         }
+        for (auto& player : players) player->cancel_scheduled_hitsounds();
         pause_time = (int)(get_current_ms() - start_ms);
 
         if (bars.empty()) return;
@@ -115,12 +118,15 @@ void PracticeGameScreen::pause_song_practice() {
 
         pause_time = (int)start_time;
 
+        // The seek returns at once; resync_song holds the chart at
+        // start_time until the music has refilled from there
         if (song_music.has_value()) {
-            audio.play_sound(song_music.value(), VolumePreset::MUSIC);
             double seek_sec = (start_time - start_delay) / 1000.0 - parser->metadata.offset;
-            audio.seek_sound(song_music.value(), std::max(0.0, seek_sec));
-            audio.set_sound_pitch(song_music.value(), song_speed / 10.0f);
+            audio.seek_music_stream(song_music.value(), (float)std::max(0.0, seek_sec));
+            audio.set_music_pitch(song_music.value(), song_speed / 10.0f);
+            audio.resume_music_stream(song_music.value(), VolumePreset::MUSIC);
         }
+        for (auto& player : players) player->set_playback_rate(song_speed / 10.0);
         song_started = true;
         start_ms = get_current_ms() - pause_time;
         ms_from_start = start_time;
@@ -129,7 +135,7 @@ void PracticeGameScreen::pause_song_practice() {
 
 void PracticeGameScreen::restart_practice() {
     if (song_music.has_value()) {
-        audio.stop_sound(song_music.value());
+        audio.stop_music_stream(song_music.value());
     }
     players.clear();
     init_tja(global_data.session_data[(int)global_data.player_num].selected_song);
@@ -138,7 +144,6 @@ void PracticeGameScreen::restart_practice() {
     song_started = false;
     paused       = false;
     menu.close();
-    last_resync_ms = 0;
     start_ms = get_current_ms() - parser->metadata.offset * 1000
              - (double)global_data.config->general.audio_offset;
     ms_from_start = get_current_ms() - start_ms;
@@ -147,10 +152,10 @@ void PracticeGameScreen::restart_practice() {
 std::optional<Screens> PracticeGameScreen::handle_menu_action(PracticeMenu::Action action) {
     switch (action) {
         case PracticeMenu::Action::END_GAME:
-            if (song_music.has_value()) audio.stop_sound(song_music.value());
+            if (song_music.has_value()) audio.stop_music_stream(song_music.value());
             return on_screen_end(Screens::ENTRY);
         case PracticeMenu::Action::ANOTHER_SONG:
-            if (song_music.has_value()) audio.stop_sound(song_music.value());
+            if (song_music.has_value()) audio.stop_music_stream(song_music.value());
             return on_screen_end(Screens::PRACTICE_SELECT);
         case PracticeMenu::Action::RESTART:
             restart_practice();
@@ -185,7 +190,7 @@ std::optional<Screens> PracticeGameScreen::global_keys_practice() {
 
     if (check_key_pressed(global_data.config->keys.back_key)) {
         if (song_music.has_value()) {
-            audio.stop_sound(song_music.value());
+            audio.stop_music_stream(song_music.value());
         }
         return on_screen_end(Screens::PRACTICE_SELECT);
     }
@@ -248,7 +253,7 @@ std::optional<Screens> PracticeGameScreen::global_keys_practice() {
             if (speed_down) { song_speed = std::max(1, song_speed - 1); speed_l_kat_anim->start(); }
             if (speed_up)   { song_speed++;                              speed_r_kat_anim->start(); }
             if (song_music.has_value())
-                audio.set_sound_pitch(song_music.value(), song_speed / 10.0f);
+                audio.set_music_pitch(song_music.value(), song_speed / 10.0f);
         }
 
         bool scrobble_left  = is_l_kat_pressed(global_data.player_num);
@@ -292,16 +297,16 @@ std::optional<Screens> PracticeGameScreen::update() {
     double current_ms = get_frame_ms();
     transition->update(current_ms);
     if (!paused) {
-        if (song_started && song_music.has_value() && audio.is_sound_playing(song_music.value())) {
-            double audio_ms = audio.get_sound_time_played(song_music.value()) * 1000.0;
-            ms_from_start = audio_ms + parser->metadata.offset * 1000.0
+        std::optional<double> audio_time;
+        if (song_started && song_music.has_value()) audio_time = audio.get_music_clock(song_music.value());
+        if (audio_time.has_value()) {
+            ms_from_start = *audio_time * 1000.0 + parser->metadata.offset * 1000.0
                           + start_delay - global_data.config->general.audio_offset;
             start_ms = current_ms - ms_from_start;
         } else {
             ms_from_start = current_ms - start_ms;
         }
     }
-    poll_pending_song();
     if (transition->is_finished()) {
         start_song(current_ms);
         global_data.input_locked = 0;
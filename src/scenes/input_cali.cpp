@@ -17,11 +17,16 @@ void InputCaliScreen::on_screen_start() {
 
     background.reset();
     background.emplace(global_data.player_num, 150, "TUTORIAL");
-    average_latency = 0.0;
+    offsets.clear();
+    estimate = OffsetEstimate{};
+    estimate_text.reset();
 }
 
 Screens InputCaliScreen::on_screen_end(Screens next_screen) {
-    global_data.config->general.audio_offset = average_latency * -1;
+    if (estimate.samples > 0) {
+        global_data.config->general.audio_offset = estimate.suggested_offset();
+        spdlog::info("Calibrated audio offset to {} ms from {} taps", estimate.suggested_offset(), estimate.samples);
+    }
     return GameScreen::on_screen_end(next_screen);
 }
 
@@ -38,20 +43,17 @@ std::optional<Screens> InputCaliScreen::update() {
         return Screens::SETTINGS;
     }
 
-    if (is_l_don_pressed() || is_r_don_pressed()) {
-        double current_ms = get_current_ms();
-        double latency = players[0]->last_note_hit - current_ms;
-        latencies.push_back(latency);
-        size_t n = latencies.size();
-        std::sort(latencies.begin(), latencies.end());
-
-        if (n % 2 == 0) {
-            average_latency = (latencies[n/2 - 1] + latencies[n/2]) / 2.0;
-        } else {
-            average_latency = latencies[n/2];
-        }
-        average_latency_text.reset();
-        average_latency_text.emplace(ray::TextFormat("Average Latency: %.2f ms", average_latency * -1), 40, ray::WHITE, ray::BLUE, false, 4.0);
+    double press_ms = 0.0;
+    const bool pressed = is_l_don_pressed(PlayerNum::ALL, &press_ms) || is_r_don_pressed(PlayerNum::ALL, &press_ms);
+    if (pressed && players[0]->last_note_hit > 0.0) {
+        double latency = press_ms - players[0]->last_note_hit;
+        offsets.push_back(global_data.config->general.audio_offset + latency);
+        estimate = estimate_offset(offsets);
+        estimate_text.reset();
+        estimate_text.emplace(ray::TextFormat("Offset: %+d ms  (%.1f to %.1f, %d taps)%s",
+                                              estimate.suggested_offset(), estimate.median_low_ms, estimate.median_high_ms,
+                                              (int)estimate.samples, estimate.reliable() ? "" : "  keep tapping"),
+                              40, ray::WHITE, ray::BLUE, false, 4.0);
     }
 
     return result;
@@ -61,8 +63,8 @@ void InputCaliScreen::draw() {
     ray::ClearBackground(ray::BLACK);
     if (background.has_value()) background->draw_back();
     players[0]->draw(ms_from_start, 0, 232 * tex.screen_scale, mask_shader);
-    if (average_latency_text.has_value()) {
-        average_latency_text->draw({.x=(int)(tex.screen_width/2) - average_latency_text->width/2, .y=static_cast<float>(tex.screen_height - 40 - (int)(average_latency_text->height*1.5))});
+    if (estimate_text.has_value()) {
+        estimate_text->draw({.x=(int)(tex.screen_width/2) - estimate_text->width/2, .y=static_cast<float>(tex.screen_height - 40 - (int)(estimate_text->height*1.5))});
     }
     if (background.has_value()) background->draw_fore();
     draw_overlay();
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "game.h"
+#include "../libs/calibration.h"
 
 class InputCaliScreen : public GameScreen {
 public:
@@ -12,7 +13,9 @@ public:
     std::optional<Screens> update() override;
     void draw() override;
 
-    std::vector<double> latencies;
-    double average_latency;
-    std::optional<OutlinedText> average_latency_text;
+    // Offset each tap asks for: the current one, moved by how far the tap
+    // landed from the autoplayed note
+    std::vector<double> offsets;
+    OffsetEstimate estimate;
+    std::optional<OutlinedText> estimate_text;
 };
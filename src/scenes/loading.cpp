@@ -3,6 +3,7 @@
 #include "../libs/scores.h"
 #include "../libs/filesystem.h"
 #include "../libs/song_parser.h"
+#include "../libs/profiler.h"
 #include "../objects/song_select/file_navigator/navigator.h"
 
 void LoadingScreen::on_screen_start() {
@@ -31,6 +32,7 @@ void LoadingScreen::load_song_hashes() {
 
     auto worker = [&](int start, int end) {
         for (int i = start; i < end; i++) {
+            PROFILE_SCOPE("LoadingScreen::hash_song");
             auto u8 = songs[i].u8string();
             const std::string path(u8.begin(), u8.end());
 
@@ -79,7 +81,10 @@ void LoadingScreen::load_song_hashes() {
     for (int i = 0; i < thread_count; i++) {
         int start = i * chunk;
         int end = (i == thread_count - 1) ? songs.size() : start + chunk;
-        threads.emplace_back(worker, start, end);
+        threads.emplace_back([&worker, start, end] {
+            PROFILE_THREAD("song hash loader");
+            worker(start, end);
+        });
     }
     for (auto& t : threads) t.join();
 #endif
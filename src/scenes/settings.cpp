@@ -42,7 +42,16 @@ Screens SettingsScreen::on_screen_end(Screens next_screen) {
 
     audio.close_audio_device();
     fs::path sounds_path = fs::path("Skins") / global_data.config->paths.skin / "Sounds";
-    audio.init_audio_device(sounds_path, global_data.config->audio, global_data.config->volume);
+    if (global_data.config->audio.buffer_size <= 0) {
+        // Buffer size set to auto: find the smallest that runs clean here
+        int buffer_size = audio.calibrate_buffer_size(sounds_path, global_data.config->audio, global_data.config->volume);
+        if (buffer_size > 0) {
+            global_data.config->audio.buffer_size = buffer_size;
+            save_config(*global_data.config);
+        }
+    } else {
+        audio.init_audio_device(sounds_path, global_data.config->audio, global_data.config->volume);
+    }
 
     box_manager.reset();
 